@@ -1,26 +1,23 @@
 #pragma once
 #include <Arduino.h>
-#include <FS.h>
-#include <SPIFFS.h>
 #include <HTTPClient.h>
-#include "driver/i2s.h"
+#include "freertos/semphr.h"
+#include "EspHal.h"
+#include "BufferPool.h"
+#include "LatencyStats.h"
+#include "CaptureFrontEnd.h"
+#include "TakeWriter.h"
+#include "AudioEncoder.h"
+#include "UploadQueue.h"
+#include "InboxSubscriber.h"
+#include "InboxPrefetcher.h"
 
-// 16-bit mono PCM WAV header
-struct WavHeader
+// Where captured audio goes while recording
+enum class CaptureMode
 {
-    char riff[4] = {'R', 'I', 'F', 'F'};
-    uint32_t chunkSize = 0;
-    char wave[4] = {'W', 'A', 'V', 'E'};
-    char fmt[4] = {'f', 'm', 't', ' '};
-    uint32_t subchunk1Size = 16;
-    uint16_t audioFormat = 1;
-    uint16_t numChannels = 1;
-    uint32_t sampleRate = 16000;
-    uint32_t byteRate = 32000; // sampleRate * numChannels * (bitsPerSample/8)
-    uint16_t blockAlign = 2;   // numChannels * (bitsPerSample/8)
-    uint16_t bitsPerSample = 16;
-    char data[4] = {'d', 'a', 't', 'a'};
-    uint32_t subchunk2Size = 0;
+    File,  // write a WAV to SPIFFS and queue it for upload
+    Stream // chunked POST to the inbox while recording, teed to SPIFFS;
+           // the copy is queued unless the server answers 2xx
 };
 
 class ApiClientModule
@@ -32,26 +29,69 @@ public:
 
     void begin();
     void start();
-    void stop();
+    void stop();        // blocks until drained (File mode: until the WAV is queued)
+    void requestStop(); // returns at once; the take callback follows
+    // Runs on the writer task when a take is finished: written and queued
+    // (File) or acknowledged by the server (Stream). Keep it short.
+    typedef void (*TakeCallback)(bool ok, void *ctx);
+    void setTakeCallback(TakeCallback cb, void *ctx);
     void setInboxPath(const char *path);
+    void setCaptureMode(CaptureMode mode); // call before start()
+    void setEncoder(AudioEncoder *encoder); // nullptr = raw PCM WAV
+    // Drop leading/trailing silence and shorten long pauses (default on)
+    void setSilenceTrim(bool on);
+    // DC/high-pass/AGC front end settings; call before begin()
+    void setFrontEnd(const CaptureDsp::Config &cfg);
+    // HAL seams, call before begin(); nullptr = the board default
+    void setAudioSource(AudioSource *source); // I2S mic on the ctor pins
+    void setFileStore(FileStore *store);      // SPIFFS
+    void setTransport(HttpTransport *net);    // WiFiClient
+    void subscribeInbox(); // SSE push; checkInbox() polls only while it is down
     bool checkInbox();
+    InboxSubscriber &inbox() { return m_inbox; }
+    // Download announced messages to flash ahead of playback; paused
+    // while recording. Needs setInboxPath(); messages are <inbox>/<id>.
+    void prefetchInbox(const MessageCache::Config &cfg = MessageCache::Config());
+    InboxPrefetcher &prefetcher() { return m_prefetch; }
+    // True once the take is on the server (Stream mode) or safely in the
+    // upload queue. Waits for an in-flight take to finish first.
     bool upload();
+    size_t pendingUploads() const { return m_queue.count(); }
+
+    // Capture ring health for the last take
+    uint32_t overruns() const { return m_ring.overruns(); }
+    size_t ringHighWater() const { return m_ring.highWater(); }
+
+    // Latency/throughput of the last takes as one JSON line, e.g. for the
+    // serial monitor: release->file closed, closed->upload ack, capture rate
+    void printBench(Print &out) const;
+    void resetBench();
+
+    // POST the metrics registry to API_HOST + path every periodMs
+    void publishMetrics(const char *path, uint32_t periodMs = 60000);
 
 private:
-    // File/WAV helpers
-    void writeWavHeader(File &f, uint32_t numSamples);
-    void flushChunk();
+    // Writer side: m_writer drains the ring to SPIFFS and the network
+    static void writerTaskThunk(void *arg);
+    void writerTask();
+    TakeWriter::Result streamTake();
+    static bool commitThunk(const char *path, uint32_t *seq, void *ctx);
+    static void closedThunk(void *ctx);
 
-    // Task + processing
+    // Reader side: m_front converts, trims and fills the ring
     static void readerTaskThunk(void *arg);
     void readerTask(); // runs on its own core
-    void processChunk(int32_t *i2sBuf, size_t samples);
+    static void chunkThunk(size_t samples, size_t dropped, uint32_t gateUs, void *ctx);
+    static uint32_t nowUs();
+    void finishCapture();
 
     // Configuration
-    const int m_i2s_num;
-    const int m_sck_pin, m_ws_pin, m_sd_pin;
+    I2sMicSource m_mic;
+    AudioSource *m_source = &m_mic;
+    FileStore *m_store = &SpiffsStore::shared();
+    HttpTransport *m_net = &WifiTransport::shared();
     const uint32_t m_sampleRate;
-    const size_t m_chunkSamples;
+    size_t m_chunkSamples; // capped to one pool block in begin()
     const uint32_t m_maxSeconds;
     const char *m_outPath;
 
@@ -62,12 +102,44 @@ private:
     volatile bool m_isRecording = false;
     uint32_t m_startMillis = 0;
 
-    File m_file;
-    int16_t *m_buf = nullptr;
-    size_t m_bufIdx = 0;
-    uint32_t m_totalSamples = 0;
+    PoolBlock m_readBlock;  // reader's I2S buffer
+    PoolBlock m_chunkBlock; // m_front's chunk of converted samples
 
     volatile bool m_stopRequested = false; // ask reader to finish & drain
     TaskHandle_t m_readerTask = nullptr;   // already present
     TaskHandle_t m_waiterTask = nullptr;   // who’s waiting for the drain to finish?
+
+    CaptureRing m_ring;
+    CaptureFrontEnd m_front{m_ring, &ApiClientModule::chunkThunk, this, &ApiClientModule::nowUs};
+    CaptureMode m_mode = CaptureMode::File;
+    SemaphoreHandle_t m_takeDone = nullptr;
+    TaskHandle_t m_writerTask = nullptr;
+    TaskClock m_writerClock; // the writer's: m_front's chunks wake its waits
+    TakeWriter m_writer{m_ring, m_writerClock, m_outPath};
+    volatile bool m_takeActive = false; // writer owns the current take
+    bool m_takeOk = false;
+    TakeCallback m_takeCb = nullptr;
+    void *m_takeCtx = nullptr;
+
+    // Encoder stage, run on the writer task
+    PcmEncoder m_pcmEncoder;
+    AudioEncoder *m_encoder = &m_pcmEncoder;
+
+    UploadQueue m_queue;
+    bool m_takeQueued = false;
+
+    InboxSubscriber m_inbox;
+    InboxPrefetcher m_prefetch;
+
+    // Per-take timestamps (micros) feeding the bench stats
+    void noteClosed();
+    void noteAck(uint32_t bytes);
+    static void onSentThunk(uint32_t seq, uint32_t bytes, void *ctx);
+    uint32_t m_tStart = 0, m_tRelease = 0, m_tClosed = 0;
+    volatile uint32_t m_ackSeq = UINT32_MAX; // queued take awaiting upload
+    LatencyStats<32> m_drainUs;
+    LatencyStats<32> m_releaseToClosedUs;
+    LatencyStats<32> m_closedToAckUs;
+    LatencyStats<32> m_captureSps;
+    LatencyStats<32> m_uploadBps;
 };
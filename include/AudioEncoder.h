@@ -0,0 +1,73 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Encoder stage between the capture ring and storage/upload.
+// The writer task feeds it 16-bit mono PCM in arbitrary block sizes; the
+// encoder owns the container header so the file format and the upload
+// Content-Type always follow the chosen codec.
+class AudioEncoder
+{
+public:
+    static const uint32_t kUnknownLength = 0xFFFFFFFF; // streaming header
+    static const size_t kMaxHeaderBytes = 64;
+
+    virtual ~AudioEncoder() = default;
+
+    virtual const char *contentType() const = 0;
+    virtual size_t headerSize() const = 0;
+    // Fills headerSize() bytes. Pass kUnknownLength while still streaming.
+    virtual void makeHeader(uint8_t *hdr, uint32_t sampleRate,
+                            uint32_t numSamples, uint32_t dataBytes) const = 0;
+
+    // Upper bound on bytes produced by encode(n) or finish()
+    virtual size_t maxEncodedBytes(size_t samples) const = 0;
+    virtual void reset() = 0;
+    virtual size_t encode(const int16_t *in, size_t n, uint8_t *out) = 0;
+    virtual size_t finish(uint8_t *out) = 0; // flush a partial block
+};
+
+// Raw 16-bit PCM in a canonical 44-byte WAV (audioFormat = 1)
+class PcmEncoder : public AudioEncoder
+{
+public:
+    const char *contentType() const override { return "audio/wav"; }
+    size_t headerSize() const override { return 44; }
+    void makeHeader(uint8_t *hdr, uint32_t sampleRate,
+                    uint32_t numSamples, uint32_t dataBytes) const override;
+    size_t maxEncodedBytes(size_t samples) const override { return samples * sizeof(int16_t); }
+    void reset() override {}
+    size_t encode(const int16_t *in, size_t n, uint8_t *out) override;
+    size_t finish(uint8_t *) override { return 0; }
+};
+
+// IMA-ADPCM, 4 bits/sample (~4:1), in a WAV with format tag 0x0011.
+// 256-byte blocks of 505 samples; the fact chunk carries the true length
+// so the padded last block plays back at the right size.
+class ImaAdpcmEncoder : public AudioEncoder
+{
+public:
+    static const uint16_t kBlockAlign = 256;
+    static const uint16_t kSamplesPerBlock = (kBlockAlign - 4) * 2 + 1; // 505
+
+    const char *contentType() const override { return "audio/vnd.wave; codec=11"; }
+    size_t headerSize() const override { return 60; }
+    void makeHeader(uint8_t *hdr, uint32_t sampleRate,
+                    uint32_t numSamples, uint32_t dataBytes) const override;
+    size_t maxEncodedBytes(size_t samples) const override
+    {
+        return (samples / kSamplesPerBlock + 1) * kBlockAlign;
+    }
+    void reset() override;
+    size_t encode(const int16_t *in, size_t n, uint8_t *out) override;
+    size_t finish(uint8_t *out) override;
+
+private:
+    void encodeBlock(const int16_t *in, uint8_t *out);
+    uint8_t encodeSample(int16_t sample);
+
+    int16_t m_pending[kSamplesPerBlock];
+    size_t m_pendingCount = 0;
+    int32_t m_predictor = 0;
+    int m_stepIndex = 0; // carried across blocks so each starts well-tuned
+};
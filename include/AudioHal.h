@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Audio I/O seen by the capture and playback code. The board uses I2S
+// (EspHal.h); the native build plugs in file-backed fakes that keep
+// real-time pacing (src/native/HostHal.h).
+
+// Mono capture in the mic's 32-bit container, sample in the top bits
+class AudioSource
+{
+public:
+    static const uint32_t kForever = 0xFFFFFFFF;
+
+    virtual ~AudioSource() = default;
+    virtual bool begin(uint32_t sampleRate) = 0;
+    virtual void start() = 0; // drop stale frames and start clocking
+    virtual void stop() = 0;
+    // Up to n samples, waiting at most timeoutMs for data; returns the count
+    virtual size_t read(int32_t *dst, size_t n, uint32_t timeoutMs) = 0;
+};
+
+// Interleaved 16-bit stereo playback
+class AudioSink
+{
+public:
+    virtual ~AudioSink() = default;
+    virtual bool begin(uint32_t sampleRate) = 0;
+    virtual void setSampleRate(uint32_t sampleRate) = 0;
+    virtual void start() = 0; // starts from silence
+    virtual void stop() = 0;
+    // Blocks until all frames are queued; returns frames written
+    virtual size_t write(const int16_t *frames, size_t n) = 0;
+};
@@ -1,14 +1,25 @@
 #pragma once
 #include <atomic>
 #include <Arduino.h>
-#include <FS.h>
-#include <SPIFFS.h>
-#include "driver/i2s.h"
+#include "EspHal.h"
+#include "WavWriter.h"
+#include "BufferPool.h"
+#include "CaptureDsp.h"
 
 class AudioRecorderModule {
 public:
+  static const uint32_t kSampleRate = 16000;
+  typedef WavWriter<1, 16, kSampleRate> Wav;
+
   AudioRecorderModule(int i2s_num, int sck_pin, int ws_pin, int sd_pin);
 
+  // HAL seams, call before begin(); nullptr = I2S mic / SPIFFS
+  void setAudioSource(AudioSource* source);
+  void setFileStore(FileStore* store);
+  // Streaming: max-size header up front and no seek-back on stop, so the
+  // file can be read while recording. Takes effect on the next recording.
+  void setWavMode(Wav::Mode mode) { m_wav.setMode(mode); }
+
   void begin();
   bool startRecording(const char* path); // returns true on success
   void stopRecording();
@@ -17,14 +28,16 @@ public:
   void plot();
 
 private:
-  // WAV helpers
-  void writeWavHeader(fs::File &f, uint32_t sampleRate, uint16_t bits, uint16_t channels);
-  void finalizeWav(fs::File &f, uint32_t dataBytes);
-
-  const int m_i2s_num;
-  const int m_sck_pin, m_ws_pin, m_sd_pin;
+  I2sMicSource m_mic;
+  AudioSource* m_source = &m_mic;
+  FileStore* m_store = &SpiffsStore::shared();
   std::atomic<bool> m_is_recording{false};
 
-  File m_file;
-  uint32_t m_dataBytes = 0; // how many bytes of PCM have been written
+  std::unique_ptr<StoredFile> m_file;
+  Wav m_wav;
+  CaptureDsp m_dsp; // per recorder: filter state must not be shared
+
+  // From the audio pool in begin(): raw I2S words and converted PCM
+  PoolBlock m_raw;
+  PoolBlock m_pcm;
 };
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+
+// Exponential backoff with full jitter: uniform in
+// [0, min(capMs, baseMs * 2^attempt)], drawn from rnd (any uniform
+// 32-bit value). Header-only and free of Arduino types so the portable
+// modules share it; NetUtil's backoffMs() feeds it esp_random().
+inline uint32_t backoffMs(uint8_t attempt, uint32_t baseMs, uint32_t capMs, uint32_t rnd)
+{
+    uint32_t ceiling = baseMs << (attempt < 16 ? attempt : 16);
+    if (ceiling > capMs || ceiling < baseMs)
+        ceiling = capMs;
+    return rnd % (ceiling + 1);
+}
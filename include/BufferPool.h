@@ -0,0 +1,92 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+
+class BufferPool;
+
+// Reference-counted handle to one pool block. Copies share the block,
+// the last one to go returns it; a handle can also be detached to a
+// small index and adopted on the other side of a queue, which is how
+// blocks travel between tasks without copying their contents.
+class PoolBlock
+{
+public:
+    PoolBlock() = default;
+    PoolBlock(const PoolBlock &o);
+    PoolBlock(PoolBlock &&o) noexcept : m_pool(o.m_pool), m_idx(o.m_idx) { o.m_pool = nullptr; }
+    PoolBlock &operator=(PoolBlock o) noexcept;
+    ~PoolBlock() { reset(); }
+
+    explicit operator bool() const { return m_pool != nullptr; }
+    void reset();
+
+    uint8_t *data() const;
+    template <typename T>
+    T *as() const { return reinterpret_cast<T *>(data()); }
+    size_t capacity() const; // bytes
+    // Bytes of valid payload, travels with the block
+    size_t length() const;
+    void setLength(size_t bytes);
+
+    // Hand the reference over as an index (no refcount change); adopt()
+    // on the receiving side turns it back into a handle
+    uint8_t detach();
+
+private:
+    friend class BufferPool;
+    PoolBlock(BufferPool *pool, uint8_t idx) : m_pool(pool), m_idx(idx) {}
+
+    BufferPool *m_pool = nullptr;
+    uint8_t m_idx = 0;
+};
+
+// Fixed-size audio blocks carved out of one allocation made in begin().
+// Acquire and release are lock-free (a free bitmap and per-block
+// refcounts), so the I2S reader, the writer and the playback tasks can
+// all use it; nothing allocates after begin(). On boards with PSRAM the
+// blocks can live there, leaving internal RAM for Wi-Fi and DMA.
+class BufferPool
+{
+public:
+    static const size_t kMaxBlocks = 32;
+    static const size_t kBlockBytes = 2048; // 512 x int32 or 1024 x int16
+
+    enum class Placement : uint8_t
+    {
+        Internal,
+        PreferPsram, // falls back to internal RAM if there is none
+    };
+
+    // The pool all audio modules share
+    static BufferPool &audio();
+
+    // Idempotent; modules call it with defaults from their own begin(),
+    // so call it first from setup() to choose the size and placement
+    bool begin(size_t blocks = 16, Placement where = Placement::Internal);
+
+    // Empty handle if every block is taken; never blocks
+    PoolBlock acquire();
+    PoolBlock adopt(uint8_t idx) { return PoolBlock(this, idx); }
+
+    size_t blocks() const { return m_blocks; }
+    size_t inUse() const { return m_inUse.load(std::memory_order_relaxed); }
+    size_t peak() const { return m_peak.load(std::memory_order_relaxed); }
+    uint32_t exhausted() const { return m_exhausted.load(std::memory_order_relaxed); }
+    bool inPsram() const { return m_psram; }
+
+private:
+    friend class PoolBlock;
+    void addRef(uint8_t idx) { m_refs[idx].fetch_add(1, std::memory_order_relaxed); }
+    void release(uint8_t idx);
+    uint8_t *blockData(uint8_t idx) const { return m_mem + idx * kBlockBytes; }
+
+    uint8_t *m_mem = nullptr;
+    size_t m_blocks = 0;
+    bool m_psram = false;
+    std::atomic<uint32_t> m_free{0}; // bit per free block
+    std::atomic<uint16_t> m_refs[kMaxBlocks];
+    uint16_t m_length[kMaxBlocks];
+    std::atomic<uint32_t> m_inUse{0};
+    std::atomic<uint32_t> m_peak{0};
+    std::atomic<uint32_t> m_exhausted{0};
+};
@@ -1,26 +1,54 @@
 #pragma once
 #include <Arduino.h>
+#include <atomic>
+#include "Scheduler.h"
+#include "SpscRing.h"
+#include "Gestures.h"
 
+// Push button on a GPIO edge interrupt. The ISR only timestamps the edge,
+// queues it and wakes the scheduler; debounce and gestures run on the
+// loop task, driven by the edge times and a scheduler timer. Between
+// presses nothing runs at all.
 class Button
 {
 public:
-    explicit Button(uint8_t pin);
+    Button(uint8_t pin, Scheduler &sched);
 
-    void begin();  // call in setup()
-    void update(); // call every loop()
+    // call in setup(); edgeEvent is the scheduler event id the ISR posts
+    void begin(uint16_t edgeEvent);
+    void setConfig(const GestureDetector::Config &cfg) { _gestures.setConfig(cfg); }
+    // Gestures are reported on the loop task
+    void setCallback(GestureDetector::Callback cb, void *ctx);
 
-    bool isPressed() const; // debounced current state (active-low with INPUT_PULLUP)
+    // After sleep: feed the level in, since the edge that woke the chip
+    // came while the interrupt was off
+    void resync();
+
+    bool isPressed() const; // debounced current state
     bool wasPressed();      // true exactly once after a press edge
     bool wasReleased();     // true exactly once after a release edge
 
 private:
+    struct Edge
+    {
+        uint32_t ms; // scheduler time, for the detector
+        uint32_t us; // for press latency
+        uint8_t pressed;
+    };
+
+    static void IRAM_ATTR isr(void *arg);
+    static void onEdges(uint16_t event, uint32_t arg, void *ctx);
+    static void onGesture(Gesture g, uint32_t at, void *ctx);
+
     uint8_t _pin;
-    int _stable;                 // last debounced electrical level (HIGH/LOW)
-    int _lastReading;            // last instantaneous read
-    unsigned long _lastChangeMs; // when _lastReading last changed
+    Scheduler &_sched;
+    uint16_t _edgeEvent = 0;
+    SpscRing<Edge, 32> _edges; // ISR -> loop task
+    GestureDetector _gestures;
+    GestureDetector::Callback _cb = nullptr;
+    void *_cbCtx = nullptr;
+    std::atomic<bool> _posted{false}; // an edge event is queued
 
     bool _latchedPressed; // edge latches
     bool _latchedReleased;
-
-    static const unsigned long DEBOUNCE_MS = 50;
 };
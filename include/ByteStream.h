@@ -0,0 +1,14 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte pipe the modules read and write through: a stored file, an HTTP
+// body or a socket. Kept free of Arduino types so it builds on the host.
+class ByteStream
+{
+public:
+    virtual ~ByteStream() = default;
+    // Up to len bytes; 0 means end of data or timeout
+    virtual size_t read(uint8_t *dst, size_t len) = 0;
+    virtual size_t write(const uint8_t *src, size_t len) = 0;
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Mic front end: I2S 32-bit containers (INMP441: 24-bit, MSB aligned) in,
+// 16-bit PCM out. Replaces the fixed ">> shift" with, per sample:
+//   DC blocker -> 80 Hz high-pass (biquad) -> AGC gain -> saturate
+// all integer (Q30 filter, Q16 gain). Works on blocks of kBlockSamples:
+// each block is filtered and its peak measured before any of it is
+// scaled, so the limiter sees a transient coming (one block of
+// look-ahead without delaying the output).
+class CaptureDsp
+{
+public:
+    static const size_t kBlockSamples = 256; // 16 ms at 16 kHz
+
+    // Gains are Q16 with 1.0 mapping 24-bit full scale to 16-bit full
+    // scale (>> 16); the old fixed ">> 11" is 1 << 21
+    struct Config
+    {
+        uint16_t hpfHz = 80;             // 0 = DC blocker only
+        bool agc = true;                 // false = fixed initialGain
+        uint32_t initialGain = 1u << 21; // where a take starts (">> 11")
+        uint32_t minGain = 1u << 16;     // 0 dB
+        uint32_t maxGain = 1u << 24;     // +48 dB (">> 8")
+        int16_t targetPeak = 16384;      // AGC aims block peaks here (-6 dBFS)
+        int16_t limitPeak = 29000;       // hard ceiling after gain (-1 dBFS)
+        uint32_t gateLevel = 1024;       // 24-bit peak (-78 dBFS) below which gain is held
+    };
+
+    CaptureDsp() = default;
+    explicit CaptureDsp(const Config &cfg) : m_cfg(cfg) {}
+
+    // Computes the filter for this rate and resets state; call before a take
+    void begin(uint32_t sampleRate);
+    void reset();
+    void process(const int32_t *in, int16_t *out, size_t n);
+
+    uint32_t gain() const { return m_gain; }
+    uint32_t limitedBlocks() const { return m_limited; }
+
+private:
+    void block(const int32_t *in, int16_t *out, size_t n);
+
+    Config m_cfg;
+
+    // DC blocker: running mean in Q6 of the 24-bit signal
+    int32_t m_dc = 0;
+
+    // High-pass biquad, direct form I with error feedback. b1 = -2*b0 and
+    // b2 = b0 for a high-pass, so only three coefficients are stored.
+    int32_t m_b0 = 1 << 30, m_a1 = 0, m_a2 = 0;
+    int32_t m_x1 = 0, m_x2 = 0, m_y1 = 0, m_y2 = 0;
+    int64_t m_err = 0;
+
+    // AGC
+    uint32_t m_env = 0;  // block-peak envelope, 24-bit scale
+    uint32_t m_gain = 0; // Q16, as applied at the end of the last block
+    uint32_t m_limited = 0;
+
+    int32_t m_scratch[kBlockSamples];
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "SpscRing.h"
+#include "Vad.h"
+#include "CaptureDsp.h"
+
+// Reader task produces into the ring, writer task consumes.
+// 16k samples = ~1s at 16 kHz, enough to ride out SPIFFS GC stalls.
+typedef SpscRing<int16_t, 16384> CaptureRing;
+
+// Reader half of a take: 32-bit mic words through the DSP front end into
+// fixed chunks, each chunk through the silence gate (when trimming) and
+// into the ring. Never blocks; a full ring counts the rest as overruns.
+// Portable, so the host tests run the same path as the reader task.
+class CaptureFrontEnd
+{
+public:
+    // After each chunk, on the reader task: wake the writer. dropped is
+    // what didn't fit in the ring; gateUs the gate's share (0 without a
+    // clock).
+    typedef void (*ChunkCallback)(size_t samples, size_t dropped, uint32_t gateUs, void *ctx);
+    typedef uint32_t (*MicrosFn)();
+
+    CaptureFrontEnd(CaptureRing &ring, ChunkCallback cb = nullptr, void *ctx = nullptr,
+                    MicrosFn nowUs = nullptr);
+
+    // chunk is the caller's buffer (a pool block on the board)
+    void begin(uint32_t sampleRate, int16_t *chunk, size_t chunkSamples);
+    void setDsp(const CaptureDsp::Config &cfg);
+    void setSilenceTrim(bool on) { m_trimSilence = on; }
+    bool silenceTrim() const { return m_trimSilence; }
+
+    void reset(); // new take; the ring is the caller's to reset
+    void process(const int32_t *raw, size_t n);
+    void finish(); // end of take: partial chunk, then the gate's tail
+
+    uint32_t samples() const { return m_samples; } // converted this take
+    const CaptureDsp &dsp() const { return m_dsp; }
+    const SilenceGate &gate() const { return m_gate; }
+
+private:
+    void flushChunk();
+    void push(const int16_t *samples, size_t n);
+    static void gateEmitThunk(const int16_t *samples, size_t n, void *ctx);
+
+    CaptureRing &m_ring;
+    const ChunkCallback m_cb;
+    void *const m_ctx;
+    const MicrosFn m_nowUs;
+
+    uint32_t m_sampleRate = 16000;
+    int16_t *m_chunk = nullptr;
+    size_t m_chunkSamples = 0;
+    size_t m_chunkLen = 0;
+    uint32_t m_samples = 0;
+    size_t m_dropped = 0; // this chunk
+
+    CaptureDsp m_dsp;
+    SilenceGate m_gate{&CaptureFrontEnd::gateEmitThunk, this};
+    bool m_trimSilence = true;
+};
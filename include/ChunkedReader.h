@@ -0,0 +1,38 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "ByteStream.h"
+
+// Undoes HTTP/1.1 chunked transfer coding on the way through: reads the
+// framed body from another stream (positioned after the response head)
+// and hands out only the data. Chunk extensions and trailers are
+// skipped. read() returns 0 once the last chunk is in, or when the
+// framing is bad or the source dries up inside it (failed()). Free of
+// Arduino types so it runs on the host.
+class ChunkedReader : public ByteStream
+{
+public:
+    explicit ChunkedReader(ByteStream &src) : m_src(src) {}
+
+    size_t read(uint8_t *dst, size_t len) override;
+    size_t write(const uint8_t *, size_t) override { return 0; }
+
+    bool ended() const { return m_state == State::Ended; }
+    bool failed() const { return m_state == State::Failed; }
+
+private:
+    enum class State
+    {
+        Size,    // "<hex>[;ext]\r\n" next
+        Data,    // m_left bytes of the chunk to go, then CRLF
+        Ended,   // last chunk and trailers read
+        Failed
+    };
+
+    bool readLine(char *line, size_t cap);
+    bool nextChunk();
+
+    ByteStream &m_src;
+    State m_state = State::Size;
+    uint32_t m_left = 0;
+};
@@ -0,0 +1,144 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <Preferences.h>
+#include "driver/i2s.h"
+#include "AudioHal.h"
+#include "FileStore.h"
+#include "HttpTransport.h"
+#include "WifiDriver.h"
+#include "Scheduler.h"
+
+// Board implementations of the HAL interfaces
+
+// INMP441 on an I2S RX port, mono right slot, 32-bit frames
+class I2sMicSource : public AudioSource
+{
+public:
+    I2sMicSource(int i2s_num, int sck_pin, int ws_pin, int sd_pin);
+
+    void setDmaBuffers(int count, int len); // call before begin()
+    bool begin(uint32_t sampleRate) override;
+    void start() override;
+    void stop() override;
+    size_t read(int32_t *dst, size_t n, uint32_t timeoutMs) override;
+
+private:
+    const int m_i2s_num;
+    const int m_sck_pin, m_ws_pin, m_sd_pin;
+    uint32_t m_sampleRate = 16000;
+    int m_dmaBufCount = 12;
+    int m_dmaBufLen = 1024;
+    QueueHandle_t m_events = nullptr; // driver events, for RX overflow counts
+};
+
+// MAX98357A on an I2S TX port, 16-bit stereo frames
+class I2sSpeakerSink : public AudioSink
+{
+public:
+    I2sSpeakerSink(int i2s_num, int bck_pin, int ws_pin, int data_pin);
+
+    void setDmaBuffers(int count, int len); // call before begin()
+    bool begin(uint32_t sampleRate) override;
+    void setSampleRate(uint32_t sampleRate) override;
+    void start() override;
+    void stop() override;
+    size_t write(const int16_t *frames, size_t n) override;
+
+private:
+    const int m_i2s_num;
+    const int m_bck_pin, m_ws_pin, m_data_pin;
+    int m_dmaBufCount = 8;
+    int m_dmaBufLen = 256;
+};
+
+class SpiffsStore : public FileStore
+{
+public:
+    static SpiffsStore &shared();
+
+    std::unique_ptr<StoredFile> open(const char *path, OpenMode mode) override;
+    bool exists(const char *path) override { return SPIFFS.exists(path); }
+    bool remove(const char *path) override { return SPIFFS.remove(path); }
+    bool rename(const char *from, const char *to) override { return SPIFFS.rename(from, to); }
+    void list(const char *dir, ListCallback cb, void *ctx) override;
+};
+
+// Raw WiFiClient sockets, one per connect()
+class WifiTransport : public HttpTransport
+{
+public:
+    static WifiTransport &shared();
+
+    std::unique_ptr<NetConnection> connect(const char *host, uint16_t port) override;
+};
+
+// Arduino WiFi in station mode. The SDK's flash copy of the config and
+// its auto-reconnect are off: WifiConnector decides how to (re)connect.
+// Events arrive on the Arduino event task.
+class EspWifiDriver : public WifiDriver
+{
+public:
+    static EspWifiDriver &shared();
+
+    void setEventCallback(EventCallback cb, void *ctx) override;
+    void connect(const char *ssid, const char *password, const uint8_t *bssid, uint8_t channel,
+                 const WifiIpConfig *ip) override;
+    void disconnect() override;
+    void renewLease() override;
+    void link(uint8_t bssid[6], uint8_t &channel, WifiIpConfig &ip) override;
+
+private:
+    static void onArduinoEvent(arduino_event_id_t event, arduino_event_info_t info);
+
+    EventCallback m_cb = nullptr;
+    void *m_ctx = nullptr;
+    bool m_registered = false;
+    volatile bool m_renewing = false; // the next GOT_IP / LOST_IP answers renewLease()
+};
+
+// WifiCache in NVS. Lease ages use the RTC clock, which runs through deep
+// sleep but restarts on power-up; a lease from before that is too old
+// to trust.
+class NvsWifiCache : public WifiCacheStore
+{
+public:
+    static NvsWifiCache &shared();
+
+    bool load(WifiCache &out, uint32_t &leaseAgeS) override;
+    void save(const WifiCache &cache, bool newLease) override;
+    void clear() override;
+
+private:
+    Preferences m_prefs;
+};
+
+// Arduino Stream (e.g. HTTPClient::getStream()) as a read-only ByteStream;
+// reads wait up to the stream's own timeout
+class StreamReader : public ByteStream
+{
+public:
+    explicit StreamReader(Stream &s) : m_s(s) {}
+
+    size_t read(uint8_t *dst, size_t len) override { return m_s.readBytes(dst, len); }
+    size_t write(const uint8_t *, size_t) override { return 0; }
+
+private:
+    Stream &m_s;
+};
+
+// millis() plus a task notification: waitMs() blocks the loop task, so
+// FreeRTOS idle (and automatic light sleep, where the SDK config enables
+// it) has the CPU until the next timer or post()
+class TaskClock : public SchedulerClock
+{
+public:
+    uint32_t nowMs() override { return millis(); }
+    void waitMs(uint32_t ms) override;
+    void wake() override;
+
+private:
+    volatile TaskHandle_t m_waiter = nullptr;
+};
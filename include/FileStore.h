@@ -0,0 +1,37 @@
+#pragma once
+#include <memory>
+#include "ByteStream.h"
+
+// Filesystem seen by the recorders and the player: SPIFFS on the board
+// (EspHal.h), a host directory in the native build. Files close when the
+// handle is destroyed.
+class StoredFile : public ByteStream
+{
+public:
+    virtual bool seek(uint32_t pos) = 0;
+    virtual uint32_t size() = 0;
+    virtual void flush() = 0;
+};
+
+enum class OpenMode
+{
+    Read,
+    Write, // create or truncate
+    Append
+};
+
+class FileStore
+{
+public:
+    // Full path of one file in the directory being listed
+    typedef void (*ListCallback)(const char *path, void *ctx);
+
+    virtual ~FileStore() = default;
+    // nullptr if the file can't be opened
+    virtual std::unique_ptr<StoredFile> open(const char *path, OpenMode mode) = 0;
+    virtual bool exists(const char *path) = 0;
+    virtual bool remove(const char *path) = 0;
+    virtual bool rename(const char *from, const char *to) = 0;
+    // Every file directly in dir, in no particular order
+    virtual void list(const char *dir, ListCallback cb, void *ctx) = 0;
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include "Scheduler.h"
+
+enum class Gesture : uint8_t
+{
+    Press,     // debounced down edge, timed at the first raw edge
+    Release,   // debounced up edge
+    Click,     // short press with no second one within doubleTapMs
+    DoubleTap, // two short presses
+    HoldStart, // still down after holdMs: hold-to-talk begins
+    HoldEnd,   // released after a HoldStart
+    LongPress, // still down after longPressMs (HoldStart came first)
+};
+
+const char *gestureName(Gesture g);
+
+// Turns raw, bouncy edges into presses and gestures. Debounce is
+// leading-edge: the first edge counts at once, then edges are ignored
+// for debounceMs and the level is re-checked when that window closes, so
+// press latency is the interrupt latency, not the debounce time. Deadlines
+// run on a scheduler timer; nothing here polls.
+class GestureDetector
+{
+public:
+    struct Config
+    {
+        uint16_t debounceMs = 20;
+        uint16_t doubleTapMs = 250;  // release -> next press
+        uint16_t holdMs = 350;       // Click below this, HoldStart above
+        uint16_t longPressMs = 2000;
+    };
+
+    // at = when the gesture happened (edge or deadline), in scheduler ms
+    typedef void (*Callback)(Gesture g, uint32_t at, void *ctx);
+
+    GestureDetector(Scheduler &sched, Callback cb, void *ctx);
+    void setConfig(const Config &cfg) { m_cfg = cfg; }
+
+    // A raw edge to the given level, stamped when it happened. Edges must
+    // come in time order but may arrive late (queued by an ISR).
+    void edge(bool pressed, uint32_t at);
+
+    bool isPressed() const { return m_stable; }
+    uint32_t bounces() const { return m_bounces; } // edges the debounce ate
+
+private:
+    static void timerThunk(SchedTimer &t, void *ctx);
+    void advance(uint32_t now);
+    bool nextDeadline(uint32_t &at) const;
+    void fire(uint32_t at);
+    void setStable(bool pressed, uint32_t at);
+    void arm();
+    void emit(Gesture g, uint32_t at) { m_cb(g, at, m_ctx); }
+
+    Scheduler &m_sched;
+    SchedTimer m_timer;
+    Callback m_cb;
+    void *m_ctx;
+    Config m_cfg;
+
+    bool m_raw = false;    // level of the last raw edge
+    bool m_stable = false; // debounced level
+    bool m_locked = false; // inside a debounce window
+    uint32_t m_unlockAt = 0;
+    uint32_t m_downAt = 0;
+    bool m_holding = false;
+    bool m_longSent = false;
+    bool m_tapPending = false; // a short press waiting to become Click or DoubleTap
+    uint32_t m_tapDeadline = 0;
+    uint32_t m_bounces = 0;
+};
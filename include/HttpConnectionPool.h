@@ -0,0 +1,87 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include "freertos/semphr.h"
+
+// Per-request timing, all in ms. dns/connect are 0 on a reused socket.
+struct HttpTiming
+{
+    uint32_t dnsMs = 0;
+    uint32_t connectMs = 0;
+    // Request line to response headers parsed. HTTPClient writes the body
+    // in the same call, so for a PUT/POST this includes sending it; it is
+    // time to first byte only for requests without a body.
+    uint32_t exchangeMs = 0;
+    uint32_t transferMs = 0; // body read
+    bool reused = false;
+};
+
+// Keeps up to kMaxSockets persistent (keep-alive) sockets, per host:port,
+// and leases them to one request at a time; configure() can lower the
+// limit. Sockets open on first use. Shared by inbox polling, metrics and
+// downloads so a poll cycle stops paying TCP (and later TLS) setup every
+// time.
+class HttpConnectionPool
+{
+public:
+    static const size_t kMaxSockets = 4;
+
+    static HttpConnectionPool &shared();
+
+    void configure(size_t maxSockets, uint32_t idleTimeoutMs);
+
+    // Returns a connected client for host:port, or nullptr. slot must be
+    // handed back to release().
+    WiFiClient *acquire(const String &host, uint16_t port, int &slot, HttpTiming &t);
+    void release(int slot, bool keepAlive);
+    void closeAll(); // e.g. before Wi-Fi goes to sleep
+
+private:
+    struct Slot
+    {
+        String host;
+        uint16_t port = 0;
+        WiFiClient client;
+        IPAddress ip;
+        uint32_t lastUsedMs = 0;
+        bool inUse = false;
+    };
+
+    HttpConnectionPool();
+    void reapIdle(uint32_t now); // with m_lock held
+
+    SemaphoreHandle_t m_lock;
+    Slot m_slots[kMaxSockets];
+    size_t m_maxSockets = kMaxSockets;
+    uint32_t m_idleTimeoutMs = 30000;
+};
+
+// One HTTP request over a pooled connection. Falls back to a private
+// socket if the pool is exhausted. Ends the request and returns the
+// socket to the pool on destruction.
+class PooledRequest
+{
+public:
+    explicit PooledRequest(const String &url, uint32_t timeoutMs = 10000);
+    ~PooledRequest();
+
+    HTTPClient &http() { return m_http; }
+    bool ok() const { return m_began; }
+
+    int send(const char *method, const String &payload = String());
+    int send(const char *method, Stream *body, size_t len);
+    String body();
+
+    const HttpTiming &timing() const { return m_timing; }
+
+private:
+    int finishSend(uint32_t t0, int httpCode);
+
+    HTTPClient m_http;
+    WiFiClient m_own; // used when the pool is exhausted
+    WiFiClient *m_client = nullptr;
+    int m_slot = -1;
+    bool m_began = false;
+    HttpTiming m_timing;
+};
@@ -0,0 +1,22 @@
+#pragma once
+#include <memory>
+#include "ByteStream.h"
+
+// TCP connection the hand-rolled HTTP/1.1 paths (chunked upload, SSE)
+// talk through: WiFiClient on the board, an in-process loopback server
+// in the native build.
+class NetConnection : public ByteStream
+{
+public:
+    virtual bool connected() = 0;
+    virtual int available() = 0; // bytes readable without blocking
+    virtual void close() = 0;
+};
+
+class HttpTransport
+{
+public:
+    virtual ~HttpTransport() = default;
+    // nullptr if the host can't be reached
+    virtual std::unique_ptr<NetConnection> connect(const char *host, uint16_t port) = 0;
+};
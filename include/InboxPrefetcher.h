@@ -0,0 +1,61 @@
+#pragma once
+#include <Arduino.h>
+#include <memory>
+#include "freertos/semphr.h"
+#include "FileStore.h"
+#include "MessageCache.h"
+
+// Downloads inbox messages into a MessageCache as soon as they are
+// announced, so pressing play opens a file instead of a request.
+//
+// One message at a time, oldest first, on a low-priority task. pause()
+// (while recording) stops between 1 KB chunks so the capture path has
+// the flash to itself; resume() carries on with a Range request, or
+// from the start if the server ignores it. Bodies need a Content-Length
+// (the cache sizes the slot up front). Failed fetches retry every 10 s while
+// Wi-Fi is up; messages the server no longer has (404/410) or that can
+// never fit the budget are dropped from the queue.
+class InboxPrefetcher
+{
+public:
+    static const size_t kMaxPending = 8;
+
+    // messageUrl + id is the message's WAV, e.g. "http://host/inbox/"
+    void begin(FileStore &store, const String &messageUrl,
+               const MessageCache::Config &cfg = MessageCache::Config());
+
+    void enqueue(const char *id); // any task; no-op if cached or queued
+    void pause();
+    void resume();
+
+    // Cached message ready to play (marks it used); false: not cached
+    bool cachedPath(const char *id, String &path);
+    // Last id enqueued (announced or polled); false: none yet
+    bool newest(String &id);
+    String messageUrl(const char *id) const { return m_url + id; }
+    size_t pending() const { return m_pending; }
+
+private:
+    enum class Fetch
+    {
+        Done,
+        Failed, // try again later
+        Gone    // never going to work: drop it
+    };
+
+    static void taskThunk(void *arg);
+    void task();
+    Fetch fetch(const char *id);
+    void waitWhilePaused();
+
+    static const uint32_t kRetryMs = 10000;
+
+    std::unique_ptr<MessageCache> m_cache;
+    String m_url;
+    SemaphoreHandle_t m_lock = nullptr; // cache and queue
+    TaskHandle_t m_task = nullptr;
+    char m_queue[kMaxPending][MessageCache::kMaxIdLen + 1];
+    char m_newest[MessageCache::kMaxIdLen + 1] = "";
+    volatile size_t m_pending = 0;
+    volatile bool m_paused = false;
+};
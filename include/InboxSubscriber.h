@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+#include <memory>
+#include "HttpTransport.h"
+#include "SseParser.h"
+
+class InboxPrefetcher;
+
+// Server-sent events subscription to the inbox (GET <inbox>/events).
+//
+// One connection stays open and the server pushes:
+//   event: message   data: {"id": "..."}   a new message arrived
+//   event: empty     data: {}              inbox drained
+// The server should send the current state right after connecting so a
+// fresh subscriber doesn't need a separate poll. Comment lines (": ping")
+// keep the connection alive; silence longer than the idle timeout is
+// treated as a dead link. Reconnects back off exponentially with jitter
+// and resume with Last-Event-ID. SseParser does the framing.
+class InboxSubscriber
+{
+public:
+    typedef void (*Callback)(const char *event, const char *data, void *ctx);
+
+    void begin(const String &eventsUrl, HttpTransport &net);
+    void setCallback(Callback cb, void *ctx);
+    // "message" events with an id are handed to it for download
+    void setPrefetcher(InboxPrefetcher *prefetch) { m_prefetch = prefetch; }
+
+    bool isConnected() const { return m_connected; }
+    bool hasMessages() const { return m_hasMessages; }
+    bool wasNotified(); // true exactly once after a new message event
+
+private:
+    static void taskThunk(void *arg);
+    void task();
+    std::unique_ptr<NetConnection> openStream();
+    bool readHeaders(NetConnection &conn);
+    static void onEventThunk(const char *event, const char *data, void *ctx);
+    void onEvent(const char *event, const char *data);
+
+    static const uint32_t kIdleTimeoutMs = 90000;
+    static const uint32_t kBaseRetryMs = 1000;
+    static const uint32_t kMaxRetryMs = 60000;
+
+    String m_url;
+    HttpTransport *m_net = nullptr;
+    Callback m_cb = nullptr;
+    void *m_cbCtx = nullptr;
+    InboxPrefetcher *m_prefetch = nullptr;
+    TaskHandle_t m_task = nullptr;
+
+    volatile bool m_connected = false;
+    volatile bool m_hasMessages = false;
+    volatile bool m_latched = false;
+
+    SseParser m_parser;
+};
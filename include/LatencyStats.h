@@ -0,0 +1,54 @@
+#pragma once
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Keeps the last N samples of one measurement (latency in us, a rate, ...)
+// and reports nearest-rank percentiles. Fixed storage, no allocation, so
+// it builds the same on the board and in the native benchmark. add() and
+// the readers are not synchronised: fine for diagnostics, where a report
+// racing a take just sees it one sample early or late.
+template <size_t N>
+class LatencyStats
+{
+public:
+    void add(uint32_t v)
+    {
+        m_v[m_next] = v;
+        m_next = (m_next + 1) % N;
+        if (m_count < N)
+            m_count++;
+        m_total++;
+    }
+
+    size_t count() const { return m_count; }
+    uint32_t total() const { return m_total; } // including samples aged out
+    void reset() { m_count = m_next = m_total = 0; }
+
+    // p in 0..100; 0 when empty
+    uint32_t percentile(uint8_t p) const
+    {
+        if (m_count == 0)
+            return 0;
+        uint32_t s[N];
+        std::copy(m_v, m_v + m_count, s);
+        std::sort(s, s + m_count);
+        size_t rank = (p * m_count + 99) / 100; // 1-based nearest rank
+        return s[rank ? rank - 1 : 0];
+    }
+
+    // {"n":..,"p50":..,"p90":..,"p99":..,"max":..}; returns snprintf's length
+    int formatJson(char *buf, size_t len) const
+    {
+        return snprintf(buf, len, "{\"n\":%u,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu}",
+                        (unsigned)m_count, (unsigned long)percentile(50), (unsigned long)percentile(90),
+                        (unsigned long)percentile(99), (unsigned long)percentile(100));
+    }
+
+private:
+    uint32_t m_v[N];
+    size_t m_count = 0;
+    size_t m_next = 0;
+    uint32_t m_total = 0;
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include "FileStore.h"
+
+// Bounded on-flash cache of downloaded inbox messages, keyed by message
+// ID, so playback starts from flash instead of the network.
+//
+// Entry i lives in <dir>/<i>.msg; <dir>/index holds each entry's ID,
+// size, CRC-32 and LRU stamp and is rewritten tmp + rename like the
+// upload queue's. A download goes to <dir>/dl.tmp, is read back and
+// checked against the CRC of what was received, and only then renamed
+// into its slot and indexed. After a power cut begin() drops entries
+// whose file is missing or the wrong size and files no entry owns.
+//
+// Room is made least recently used first, for both the byte budget and
+// the entry count. Not thread-safe: InboxPrefetcher serialises access.
+class MessageCache
+{
+public:
+    static const size_t kMaxEntries = 16;
+    static const size_t kMaxIdLen = 47;
+
+    struct Config
+    {
+        uint32_t maxBytes = 256 * 1024;
+        uint8_t maxEntries = kMaxEntries;
+        // Full CRC pass on every open(); writes are already read back
+        bool verifyOnOpen = false;
+    };
+
+    struct Stats
+    {
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint32_t stored = 0;
+        uint32_t evicted = 0;
+        uint32_t corrupt = 0; // failed a size or CRC check, dropped
+    };
+
+    explicit MessageCache(FileStore &store, const char *dir = "/m");
+
+    void setConfig(const Config &cfg);
+    bool begin(); // load and reconcile the index, enforce the budget
+
+    bool contains(const char *id) const { return find(id) >= 0; }
+    // Cached message for reading, or nullptr; marks it used
+    std::unique_ptr<StoredFile> open(const char *id);
+    // Same, as a path for players that open files themselves
+    bool path(const char *id, char *out, size_t len);
+    // Full CRC pass; a bad entry is dropped
+    bool verify(const char *id);
+    void remove(const char *id);
+
+    // One download at a time. size 0 if unknown; when known, room is
+    // made up front. False if the ID is cached, bad, or can never fit.
+    bool beginWrite(const char *id, uint32_t size);
+    bool write(const uint8_t *data, size_t len);
+    bool commitWrite(); // read back, check, index
+    void abortWrite();
+    bool writing() const { return m_file != nullptr; }
+    uint32_t written() const { return m_writeLen; }
+
+    size_t count() const;
+    uint32_t bytes() const { return m_bytes; }
+    const Stats &stats() const { return m_stats; }
+
+private:
+    struct Entry
+    {
+        char id[kMaxIdLen + 1];
+        uint32_t size;
+        uint32_t crc;
+        uint32_t used; // LRU stamp
+        uint8_t valid;
+        uint8_t pad[3];
+    };
+
+    struct Index
+    {
+        uint32_t magic;
+        uint32_t clock; // last LRU stamp handed out
+        Entry e[kMaxEntries];
+        uint32_t check; // CRC of the above: torn writes
+    };
+
+    int find(const char *id) const;
+    void slotPath(size_t i, char *out, size_t len) const;
+    std::unique_ptr<StoredFile> openEntry(int i);
+    bool crcOf(const char *path, uint32_t size, uint32_t &crc);
+    bool makeRoom(uint32_t size, bool newEntry);
+    void drop(int i);
+    void touch(int i);
+    bool loadIndex();
+    void saveIndex();
+
+    FileStore &m_store;
+    char m_dir[16];
+    char m_indexPath[32];
+    char m_indexTmpPath[32];
+    char m_tmpPath[32];
+    Config m_cfg;
+    Index m_ix;
+    uint32_t m_bytes = 0;
+    Stats m_stats;
+
+    std::unique_ptr<StoredFile> m_file; // download in progress
+    char m_writeId[kMaxIdLen + 1] = "";
+    uint32_t m_writeSize = 0;
+    uint32_t m_writeLen = 0;
+    uint32_t m_writeCrc = 0;
+};
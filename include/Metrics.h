@@ -0,0 +1,112 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <initializer_list>
+
+// Runtime metrics: counters, gauges and fixed-bucket histograms that
+// register themselves by name with metrics::Registry::shared(). Updates
+// are single relaxed atomics (a short search for histograms): no locks,
+// no allocation, safe from the I2S reader task.
+//
+// Define them at file scope next to the code that updates them:
+//   static metrics::Counter s_takes("takes");
+//   static metrics::Histogram s_writeUs("spiffs_write_us", {100, 1000, 10000});
+namespace metrics
+{
+    class Counter
+    {
+    public:
+        explicit Counter(const char *name);
+        void add(uint32_t n = 1) { m_v.fetch_add(n, std::memory_order_relaxed); }
+        uint32_t value() const { return m_v.load(std::memory_order_relaxed); }
+        const char *name() const { return m_name; }
+
+    private:
+        const char *m_name;
+        std::atomic<uint32_t> m_v{0};
+    };
+
+    class Gauge
+    {
+    public:
+        explicit Gauge(const char *name);
+        void set(int32_t v) { m_v.store(v, std::memory_order_relaxed); }
+        int32_t value() const { return m_v.load(std::memory_order_relaxed); }
+        const char *name() const { return m_name; }
+
+    private:
+        const char *m_name;
+        std::atomic<int32_t> m_v{0};
+    };
+
+    // Buckets are "<= bound" plus one overflow bucket
+    class Histogram
+    {
+    public:
+        static const size_t kMaxBounds = 12;
+
+        Histogram(const char *name, std::initializer_list<uint32_t> bounds);
+        void record(uint32_t v)
+        {
+            size_t i = 0;
+            while (i < m_nBounds && v > m_bounds[i])
+                i++;
+            m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+            uint32_t max = m_max.load(std::memory_order_relaxed);
+            while (v > max && !m_max.compare_exchange_weak(max, v, std::memory_order_relaxed))
+            {
+            }
+        }
+        const char *name() const { return m_name; }
+
+    private:
+        friend class Registry;
+
+        const char *m_name;
+        uint32_t m_bounds[kMaxBounds];
+        size_t m_nBounds = 0;
+        std::atomic<uint32_t> m_buckets[kMaxBounds + 1];
+        std::atomic<uint32_t> m_max{0};
+    };
+
+    class Registry
+    {
+    public:
+        static const size_t kMaxMetrics = 32;
+        static const size_t kMaxTasks = 8;
+
+        static Registry &shared();
+
+        void add(Counter *c);
+        void add(Gauge *g);
+        void add(Histogram *h);
+        // Reports the task's minimum free stack; handle may be nullptr
+        void watchTask(const char *name, TaskHandle_t handle);
+
+        // {"up":s,"heap":{..},"stack":{..},"c":{..},"g":{..},"h":{..}}
+        // Returns the length, or 0 if buf is too small.
+        size_t toJson(char *buf, size_t len);
+        void print(Print &out); // toJson() + newline, e.g. to Serial
+
+        // POST toJson() to url every periodMs while Wi-Fi is up
+        void startPublishing(const String &url, uint32_t periodMs = 60000);
+
+    private:
+        Registry() = default;
+        static void publishTaskThunk(void *arg);
+        void publishTask();
+
+        Counter *m_counters[kMaxMetrics];
+        Gauge *m_gauges[kMaxMetrics];
+        Histogram *m_histograms[kMaxMetrics];
+        size_t m_nCounters = 0, m_nGauges = 0, m_nHistograms = 0;
+
+        const char *m_taskNames[kMaxTasks];
+        TaskHandle_t m_tasks[kMaxTasks];
+        size_t m_nTasks = 0;
+
+        String m_url;
+        uint32_t m_periodMs = 60000;
+        TaskHandle_t m_publishTask = nullptr;
+    };
+}
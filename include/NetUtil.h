@@ -0,0 +1,11 @@
+#pragma once
+#include <Arduino.h>
+#include "Backoff.h"
+
+// Splits "http://host[:port]/path" into its parts. Plain http only; TLS
+// would need WiFiClientSecure.
+bool splitUrl(const String &url, String &host, uint16_t &port, String &path);
+
+// Exponential backoff with full jitter: uniform in
+// [0, min(capMs, baseMs * 2^attempt)]
+uint32_t backoffMs(uint8_t attempt, uint32_t baseMs, uint32_t capMs);
@@ -0,0 +1,10 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Block conversion of I2S 32-bit containers (INMP441: 24-bit data, MSB
+// aligned) to 16-bit PCM: out[i] = saturate16(in[i] >> shift).
+// Saturation is branch-free and the loop is unrolled so it stays cheap on
+// the Xtensa cores and auto-vectorizes (SSE/AVX) on a host build.
+// in and out must not overlap.
+void pcm32_to_pcm16(const int32_t *in, int16_t *out, size_t n, int shift);
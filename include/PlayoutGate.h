@@ -0,0 +1,35 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Output side of the playback jitter buffer. Nothing plays until the
+// pre-roll is queued (or the clip ended shorter than that); after that a
+// queued block plays, and a dry queue before the end of the clip is an
+// underrun: silence until data comes back, counted once per gap.
+// Free of RTOS calls, so the host bench drives the same decisions.
+class PlayoutGate
+{
+public:
+    enum class Step : uint8_t
+    {
+        Play,     // pop a block and write it
+        Underrun, // queue ran dry: count it, write silence
+        Silence,  // still dry, already counted
+        End       // fetcher done and queue drained
+    };
+
+    // New clip; at least one block is always held back
+    void start(size_t preRollBlocks);
+    // Pre-roll buffered, or nothing more is coming
+    bool ready(size_t queued, bool fetchDone) const;
+    // Read fetchDone before queued: a block queued just before the
+    // fetcher finished must still play
+    Step next(size_t queued, bool fetchDone);
+
+    uint32_t underruns() const { return m_underruns; } // this clip
+
+private:
+    size_t m_preRoll = 1;
+    bool m_starved = false;
+    uint32_t m_underruns = 0;
+};
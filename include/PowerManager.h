@@ -0,0 +1,85 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include "PowerPolicy.h"
+#include "Scheduler.h"
+
+class Button;
+class WifiModule;
+
+// Applies PowerPolicy to the board. Modules report what they are busy
+// with from any task; the decision runs on the loop task, which is also
+// the one that goes to sleep:
+//  - idle: radio in max modem sleep, the CPU idles in the scheduler
+//  - light sleep: Wi-Fi off, I2S drivers stay installed (stopped), wake
+//    on the button (EXT0, active low) or the inbox timer
+//  - deep sleep: same wake sources, residency kept in RTC memory
+// With PowerPolicy::Push::KeepLink neither sleep happens while the inbox
+// push stream is connected.
+// Wake-to-recording latency goes to the resume_to_record_us histogram.
+class PowerManager
+{
+public:
+    enum class Wake : uint8_t
+    {
+        Boot,
+        Button,
+        Inbox // timer: time to poll the inbox
+    };
+    typedef void (*WakeCallback)(Wake cause, void *ctx);
+
+    static PowerManager &shared();
+
+    // Call at the end of setup(); event is a scheduler event id for the
+    // manager's own use, wakePin must be an RTC GPIO
+    void begin(Scheduler &sched, uint16_t event, uint8_t wakePin,
+               const PowerPolicy::Config &cfg = PowerPolicy::Config());
+    void setWifi(WifiModule *wifi) { m_wifi = wifi; }     // suspended around light sleep
+    void setButton(Button *button) { m_button = button; } // resynced on wake
+    // Runs on the loop task after a button wake and whenever the inbox
+    // check is due; mark Network busy while checking
+    void setWakeCallback(WakeCallback cb, void *ctx);
+
+    // Any task
+    void setBusy(uint8_t sources, bool busy);
+    void touch();
+    void setPending(bool pending);
+    // The inbox push stream connected or dropped (InboxSubscriber)
+    void setPushConnected(bool connected);
+
+    Wake bootCause() const { return m_bootCause; }
+    // Residency per state since the first boot, as one JSON line
+    void printReport(Print &out);
+
+private:
+    static void onEvent(uint16_t event, uint32_t arg, void *ctx);
+    static void onTimer(SchedTimer &t, void *ctx);
+    void kick();
+    void evaluate();
+    void armWakeSources(uint32_t sleepMs);
+    void lightSleep(uint32_t sleepMs);
+    void deepSleep(uint32_t sleepMs);
+    void setRadio(bool idle);
+
+    Scheduler *m_sched = nullptr;
+    uint16_t m_event = 0;
+    uint8_t m_pin = 0;
+    SchedTimer m_timer{&PowerManager::onTimer, this};
+    PowerPolicy m_policy;
+
+    std::atomic<uint8_t> m_busy{0};
+    std::atomic<bool> m_touched{false};
+    std::atomic<bool> m_pending{false};
+    std::atomic<bool> m_pushConnected{false};
+    std::atomic<bool> m_posted{false};
+    std::atomic<bool> m_resumeArmed{false}; // until the first recording after a wake
+    uint32_t m_wakeUs = 0;
+    uint32_t m_lastResumeUs = 0;
+
+    WifiModule *m_wifi = nullptr;
+    Button *m_button = nullptr;
+    WakeCallback m_wakeCb = nullptr;
+    void *m_wakeCtx = nullptr;
+    int m_radioPs = -1; // last wifi_ps_type_t applied
+    Wake m_bootCause = Wake::Boot;
+};
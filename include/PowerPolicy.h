@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+
+enum class PowerState : uint8_t
+{
+    Active,     // something is busy; radio at full power while on the network
+    ModemSleep, // CPU idles in the scheduler, radio wakes per DTIM only
+    LightSleep, // everything paused until the button or the next inbox check
+    DeepSleep,  // RTC only; the button or the inbox timer reboots
+    Count
+};
+
+const char *powerStateName(PowerState s);
+
+// When to sleep and how deep. Pure bookkeeping on millis() timestamps so
+// the same code runs on the board and in the host simulation; the
+// PowerManager applies the answers to the hardware.
+//
+// Foreground sources (recording, playback, user input) count as user
+// activity and restart the idle timers when they end. Background ones
+// (uploads, network) only hold the device awake while they run, so a
+// periodic inbox check goes straight back to sleep.
+//
+// Light and deep sleep turn Wi-Fi off, which also drops the inbox push
+// stream. Config::push picks the trade-off: Poll (the default) sleeps as
+// usual and finds messages at the next inbox check; KeepLink goes no
+// lower than modem sleep while the stream is connected (DTIM wakes keep
+// it alive, messages arrive at once, at modem sleep current). A stream
+// that is down holds nothing, so a dead server can't pin the radio on.
+class PowerPolicy
+{
+public:
+    enum Source : uint8_t
+    {
+        Recording = 1 << 0,
+        Playback = 1 << 1,
+        Input = 1 << 2,
+        Upload = 1 << 3,
+        Network = 1 << 4,
+    };
+    static const uint8_t kForeground = Recording | Playback | Input;
+
+    enum class Push : uint8_t
+    {
+        Poll,    // sleep, inbox timer; the stream is only used while awake
+        KeepLink // stream connected: modem sleep, never light or deep
+    };
+
+    struct Config
+    {
+        uint32_t lightAfterMs = 20000;  // idle -> light sleep
+        uint32_t deepAfterMs = 600000;  // idle -> deep sleep, nothing pending
+        uint32_t inboxPeriodMs = 60000; // sleeping devices wake this often
+        Push push = Push::Poll;
+    };
+
+    PowerPolicy() = default;
+    explicit PowerPolicy(const Config &cfg) : m_cfg(cfg) {}
+
+    void begin(uint32_t now);
+    void setConfig(const Config &cfg) { m_cfg = cfg; }
+    const Config &config() const { return m_cfg; }
+
+    // Whole busy mask; foreground sources going idle count as activity
+    void setBusy(uint8_t mask, uint32_t now);
+    uint8_t busy() const { return m_busy; }
+    void touch(uint32_t now) { m_lastActivity = now; }
+    // Work that needs the radio later (queued uploads) rules out deep sleep
+    void setPending(bool pending) { m_pending = pending; }
+    // The inbox push stream is up (see Push)
+    void setPushConnected(bool connected) { m_pushConnected = connected; }
+    // Idle stays in modem sleep: the push stream needs the link
+    bool keepsLink() const { return m_pushConnected && m_cfg.push == Push::KeepLink; }
+
+    // State to be in now; for the sleep states sleepMs is the time until
+    // the next inbox check (the wake timer)
+    PowerState decide(uint32_t now, uint32_t &sleepMs) const;
+    // Radio may drop to modem sleep: nothing is on the network
+    bool radioIdle() const { return !(m_busy & (Upload | Network)); }
+    // ms until decide() changes by itself (kNever while busy)
+    uint32_t nextChangeMs(uint32_t now) const;
+
+    bool inboxDue(uint32_t now) const { return !before(now, m_nextInbox); }
+    void inboxChecked(uint32_t now) { m_nextInbox = now + m_cfg.inboxPeriodMs; }
+
+    // Residency accounting: call on every state change
+    void enter(PowerState s, uint32_t now);
+    PowerState state() const { return m_state; }
+    uint64_t residencyMs(PowerState s, uint32_t now) const;
+    uint32_t entries(PowerState s) const { return m_entries[(int)s]; }
+    // Carries totals across deep sleep (RTC memory on the board)
+    void addResidency(PowerState s, uint64_t ms) { m_residency[(int)s] += ms; }
+
+    static const uint32_t kNever = UINT32_MAX;
+
+private:
+    static bool before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+    Config m_cfg;
+    uint8_t m_busy = 0;
+    bool m_pending = false;
+    bool m_pushConnected = false;
+    uint32_t m_lastActivity = 0;
+    uint32_t m_nextInbox = 0;
+
+    PowerState m_state = PowerState::Active;
+    uint32_t m_since = 0;
+    uint64_t m_residency[(int)PowerState::Count] = {};
+    uint32_t m_entries[(int)PowerState::Count] = {};
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Polyphase resampler + channel mixer: 16-bit mono or stereo at any rate
+// whose ratio to the output rate reduces to <= kMaxPhases / anything,
+// out as interleaved stereo at one fixed rate. The I2S clock then never
+// changes between clips.
+//
+// The ratio L/M (output/input, reduced) picks a Kaiser-windowed sinc
+// bank of L phases, built once per configure() into a fixed table.
+// Taps per phase grow with the decimation factor so the anti-alias
+// cutoff stays at the lower of the two rates. Nothing allocates.
+class Resampler
+{
+public:
+    static const size_t kBaseTaps = 16;     // per phase when upsampling
+    static const size_t kMaxTaps = 48;      // 48 kHz -> 16 kHz
+    static const size_t kMaxPhases = 320;   // 22.05 kHz -> 16 kHz
+    static const size_t kMaxCoefs = 7680;   // phases * taps, 15 KB
+
+    explicit Resampler(uint32_t outRate) : m_outRate(outRate) {}
+
+    // False if the ratio needs more phases or taps than the table holds
+    bool configure(uint32_t inRate, uint16_t channels);
+    void reset(); // forget history, keep the filter
+
+    // Reads up to inFrames interleaved frames, writes up to outFrames
+    // stereo frames. Returns frames written; consumed says how many
+    // input frames were used (the rest must be passed again).
+    size_t process(const int16_t *in, size_t inFrames, size_t &consumed,
+                   int16_t *outStereo, size_t outFrames);
+
+    uint32_t outRate() const { return m_outRate; }
+    uint32_t inRate() const { return m_inRate; }
+    bool passthrough() const { return m_up == 1 && m_down == 1; }
+    size_t taps() const { return m_taps; }
+    size_t phases() const { return m_up; }
+
+private:
+    void push(const int16_t *frame);
+    int16_t dot(const int16_t *coef, const int16_t *hist) const;
+
+    const uint32_t m_outRate;
+    uint32_t m_inRate = 0;
+    uint16_t m_channels = 1;
+    uint32_t m_up = 1, m_down = 1; // L, M
+    size_t m_taps = kBaseTaps;
+
+    uint32_t m_phase = 0; // position between input samples, in 1/L steps
+
+    // Delay line per channel, written twice so the window is contiguous
+    int16_t m_hist[2][2 * kMaxTaps];
+    size_t m_pos = 0;
+
+    // Phase-major, each phase reversed to line up with the delay line; Q14
+    int16_t m_coef[kMaxCoefs];
+};
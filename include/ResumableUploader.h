@@ -0,0 +1,114 @@
+#pragma once
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include "FileStore.h"
+#include "HttpTransport.h"
+#include "Scheduler.h"
+
+// Resumable, part-wise upload of a stored file.
+//
+// Protocol (relative to the inbox URL):
+//   POST  <url>/uploads        Upload-Length: N     -> {"uploadId": "...", "offset": 0}
+//   GET   <url>/uploads/<id>                        -> {"offset": k}
+//   PUT   <url>/uploads/<id>   Upload-Offset: k,
+//                              Upload-Checksum: crc32 <hex>, part body
+//                                                   -> {"offset": k + len}
+// The server only advances the offset for a part whose CRC32 matches, so
+// the acknowledged offset is always safe to resume from. Session state
+// is kept in a small file (tmp + rename) so an upload survives a reboot.
+//
+// Plain HTTP/1.1 over HttpTransport, one kept-alive connection per
+// upload() that is reopened after any error. Retries wait on the clock,
+// so a wake() (UploadQueue::kick() on the board) cuts a backoff short.
+class ResumableUploader
+{
+public:
+    struct RetryPolicy
+    {
+        uint8_t maxAttempts = 8;      // per part
+        uint32_t baseDelayMs = 500;   // first retry waits up to this
+        uint32_t maxDelayMs = 30000;  // backoff cap
+        uint32_t timeoutMs = 10000;   // per response
+    };
+
+    enum class Result
+    {
+        Done,
+        Retry,  // out of attempts for now (server or link down); try later
+        Failed  // will never succeed: file unreadable or the server
+                // rejected its content (400, 413, 415, 422)
+    };
+
+    struct Stats
+    {
+        uint32_t parts = 0;    // acknowledged
+        uint32_t retries = 0;  // backoff waits
+        uint32_t connects = 0;
+        uint32_t sessions = 0; // created
+    };
+
+    ResumableUploader(FileStore &store, HttpTransport &net, SchedulerClock &clock,
+                      size_t partSize = 16 * 1024, const char *statePath = "/upload.ses");
+
+    void setRetryPolicy(const RetryPolicy &policy) { m_policy = policy; }
+    const Stats &stats() const { return m_stats; }
+
+    // Uploads (or resumes) path to baseUrl ("http://host[:port]/path").
+    // Done once the server has acknowledged the last byte; the caller
+    // owns deleting the file. A Failed upload's session is forgotten.
+    Result upload(const char *path, const char *baseUrl, const char *contentType);
+
+    // Drop any saved session, e.g. when the file it refers to is replaced
+    void forget();
+
+private:
+    static const size_t kMaxId = 47;
+    static const size_t kMaxPath = 31;
+
+    struct Session
+    {
+        uint32_t magic;
+        char path[kMaxPath + 1];
+        char id[kMaxId + 1];
+        uint32_t size;
+        uint32_t acked;
+        uint32_t check; // guards against a torn write
+    };
+
+    bool sendRemaining(StoredFile &f, const char *contentType);
+    bool createSession(const char *contentType);
+    int32_t queryOffset();
+    int32_t sendPart(StoredFile &f, uint32_t offset, size_t len);
+
+    int request(const char *method, const char *path, const char *headers, StoredFile *body,
+                uint32_t offset, size_t len);
+    bool readResponse(const char *method, int &status);
+    bool readLine(char *line, size_t cap);
+    void disconnect();
+
+    bool loadState(const char *path, uint32_t size);
+    void saveState();
+
+    FileStore &m_store;
+    HttpTransport &m_net;
+    SchedulerClock &m_clock;
+    const size_t m_partSize;
+    char m_statePath[24];
+    char m_stateTmpPath[28];
+    RetryPolicy m_policy;
+    Stats m_stats;
+
+    char m_host[64];
+    uint16_t m_port = 80;
+    char m_base[96]; // path part of the base URL
+    std::unique_ptr<NetConnection> m_conn;
+    char m_resp[256]; // body of the last response, NUL-terminated
+    uint32_t m_rnd = 1;
+
+    char m_path[kMaxPath + 1];
+    char m_uploadId[kMaxId + 1];
+    uint32_t m_size = 0;
+    uint32_t m_acked = 0;
+    bool m_rejected = false; // permanent failure in this upload()
+};
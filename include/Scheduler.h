@@ -0,0 +1,122 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Time source for the Scheduler. The board one blocks the loop task on a
+// task notification (so FreeRTOS idle, and light sleep where enabled,
+// get the CPU); the host one is a virtual clock driven by the test.
+class SchedulerClock
+{
+public:
+    static const uint32_t kForever = UINT32_MAX;
+
+    virtual ~SchedulerClock() = default;
+    virtual uint32_t nowMs() = 0;
+    // Block until wake() or until ms have passed (kForever: no timeout)
+    virtual void waitMs(uint32_t ms) = 0;
+    // Cut a waitMs() short; safe from any task or ISR
+    virtual void wake() = 0;
+};
+
+class Scheduler;
+
+// One-shot or periodic timer. The node is owned by the caller (usually a
+// member or a static), so arming it never allocates.
+class SchedTimer
+{
+public:
+    typedef void (*Callback)(SchedTimer &t, void *ctx);
+
+    SchedTimer(Callback cb, void *ctx) : m_cb(cb), m_ctx(ctx) {}
+    SchedTimer(const SchedTimer &) = delete;
+    SchedTimer &operator=(const SchedTimer &) = delete;
+
+    bool active() const { return m_pprev != nullptr; }
+    uint32_t due() const { return m_due; }
+
+private:
+    friend class Scheduler;
+    Callback m_cb;
+    void *m_ctx;
+    SchedTimer *m_next = nullptr;
+    SchedTimer **m_pprev = nullptr; // null while stopped
+    uint32_t m_due = 0;
+    uint32_t m_period = 0;
+};
+
+// Cooperative event loop for the main task: a hashed timer wheel plus a
+// bounded event queue. Everything runs on the task that calls step();
+// other tasks and ISRs only post() events. Times are millis() and wrap
+// safely.
+class Scheduler
+{
+public:
+    typedef void (*EventHandler)(uint16_t event, uint32_t arg, void *ctx);
+
+    static const size_t kWheelSlots = 64; // 1 ms each
+    static const size_t kQueueSize = 32;  // power of two
+    static const size_t kMaxHandlers = 16;
+
+    explicit Scheduler(SchedulerClock &clock);
+
+    // Timers may be (re)started or stopped from any callback; a timer
+    // started from a callback runs on a later pass, never the current one
+    void startTimer(SchedTimer &t, uint32_t delayMs, uint32_t periodMs = 0);
+    void stopTimer(SchedTimer &t);
+
+    // Every handler subscribed to an event runs, in subscription order
+    bool subscribe(uint16_t event, EventHandler fn, void *ctx);
+    // Lock-free; false (and counted) when the queue is full
+    bool post(uint16_t event, uint32_t arg = 0);
+
+    // Dispatch queued events and due timers; returns ms until there is
+    // more to do (0 = already, kForever = nothing scheduled)
+    uint32_t runDue();
+    // runDue(), then sleep on the clock until the next timer or post()
+    void step();
+
+    uint32_t now() { return m_clock.nowMs(); }
+    uint32_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    uint32_t idleMs() const { return m_idleMs; }
+    uint32_t wakeups() const { return m_wakeups; }
+
+private:
+    struct Cell
+    {
+        std::atomic<uint32_t> seq;
+        uint16_t event;
+        uint32_t arg;
+    };
+    struct Handler
+    {
+        uint16_t event;
+        EventHandler fn;
+        void *ctx;
+    };
+
+    void link(SchedTimer &t);
+    static void unlink(SchedTimer &t);
+    void runSlot(size_t slot, uint32_t now);
+    bool pop(uint16_t &event, uint32_t &arg);
+    bool queueEmpty() const;
+    uint32_t nextWait(uint32_t now) const;
+
+    SchedulerClock &m_clock;
+
+    SchedTimer *m_slots[kWheelSlots] = {};
+    uint32_t m_cursor; // next tick the wheel has not processed
+
+    // Bounded MPSC queue (Vyukov): producers claim a cell with a CAS,
+    // the loop task is the only consumer
+    Cell m_cells[kQueueSize];
+    std::atomic<uint32_t> m_enqueue{0};
+    uint32_t m_dequeue = 0;
+    std::atomic<uint32_t> m_dropped{0};
+
+    Handler m_handlers[kMaxHandlers];
+    size_t m_handlerCount = 0;
+
+    uint32_t m_idleMs = 0;
+    uint32_t m_wakeups = 0;
+};
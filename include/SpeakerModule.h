@@ -1,16 +1,98 @@
 #pragma once
 #include <Arduino.h>
-#include <FS.h>
-#include <SPIFFS.h>
-#include "driver/i2s.h"
+#include "EspHal.h"
+#include "SpscRing.h"
+#include "Resampler.h"
+#include "WavReader.h"
+#include "BufferPool.h"
+#include "PlayoutGate.h"
+#include "ChunkedReader.h"
 
+class PooledRequest;
+
+// Playback pipeline: a fetch task reads ahead from SPIFFS or the network
+// into a ring, an output task drains it into I2S. Both run on their own,
+// so play*() return immediately and the main loop keeps running.
+// Clips of any supported rate and channel count are resampled to one
+// stereo output rate, so I2S is set up once. Audio moves from fetch to
+// output as whole pool blocks: the output task writes the block the
+// resampler filled, no copy in between.
 class SpeakerModule {
 public:
   SpeakerModule(int i2s_num, int bck_pin, int ws_pin, int data_pin);
+
+  // DMA depth in frames = count * len; call before begin()
+  void setDmaBuffers(int count, int len);
+  // HAL seams, call before begin(); nullptr = I2S speaker / SPIFFS
+  void setAudioSink(AudioSink* sink);
+  void setFileStore(FileStore* store);
   void begin();
+
+  bool play(const char* path);      // non-blocking, from the file store
+  bool playStream(ByteStream &src); // non-blocking; src must outlive playback
+  // Non-blocking: the request runs on the fetch task, and a failure
+  // there ends the clip through the done callback (completed = false)
+  bool playUrl(const String &url);
   bool playFile(const char* path); // blocking playback; returns when finished
 
+  bool isPlaying() const { return m_playing; }
+  void stop();        // blocks until the pipeline is idle
+  void requestStop(); // returns at once; the done callback follows
+
+  // Runs on the output task once a clip has finished (completed = played
+  // to the end, false if stopped or the stream broke), or on the fetch
+  // task when playUrl() couldn't open one; keep it short, e.g. post an event
+  typedef void (*DoneCallback)(bool completed, void *ctx);
+  void setDoneCallback(DoneCallback cb, void *ctx);
+
+  // Audio starts once this much is buffered (network jitter headroom)
+  void setPreRollMs(uint32_t ms) { m_preRollMs = ms; }
+  uint32_t underruns() const { return m_underruns; }
+
 private:
-  const int m_i2s_num;
-  const int m_bck_pin, m_ws_pin, m_data_pin;
-};
\ No newline at end of file
+  bool openClip(ByteStream &src, uint32_t size);
+  bool startPlayback(ByteStream &src, uint32_t size);
+  void startTasks();
+  bool openUrl();
+  void closeSource();
+  void finish(bool completed);
+  static void fetchTaskThunk(void *arg);
+  void fetchTask();
+  static void outputTaskThunk(void *arg);
+  void outputTask();
+  void writeSilence(size_t frames);
+  PoolBlock waitBlock();
+  bool queueBlock(PoolBlock &blk);
+  void dropQueued();
+
+  I2sSpeakerSink m_i2s; // 8 x 256 frames of DMA = 128 ms @ 16 kHz
+  AudioSink* m_sink = &m_i2s;
+  FileStore* m_store = &SpiffsStore::shared();
+
+  // Read-ahead between fetch and output: detached pool blocks of 16 kHz
+  // stereo, 32 ms each (~0.25 s)
+  SpscRing<uint8_t, 8> m_queue;
+  Resampler m_resampler;
+  PlayoutGate m_gate; // pre-roll and underruns, output task only
+  TaskHandle_t m_fetchTask = nullptr;
+  TaskHandle_t m_outputTask = nullptr;
+
+  // Current clip
+  std::unique_ptr<StoredFile> m_file;
+  String m_url; // playUrl(), opened by the fetch task
+  PooledRequest *m_request = nullptr;
+  std::unique_ptr<StreamReader> m_body; // m_request's body
+  std::unique_ptr<ChunkedReader> m_chunked; // ... de-framed, if it came chunked
+  ByteStream *m_src = nullptr;
+  WavReader m_wav; // header parsed in play*(), samples decoded by the fetch task
+  uint16_t m_channels = 1; // of the clip; the ring is always stereo
+  volatile bool m_playing = false;
+  volatile bool m_fetchDone = true;
+  volatile bool m_stopRequested = false;
+  volatile bool m_failed = false; // the source broke off
+
+  uint32_t m_preRollMs = 200;
+  uint32_t m_underruns = 0;
+  DoneCallback m_doneCb = nullptr;
+  void *m_doneCtx = nullptr;
+};
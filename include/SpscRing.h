@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Lock-free single-producer / single-consumer ring.
+// One task may call push(), one other task may call pop(); nothing else
+// needs a lock. Capacity is a power of two so wrap-around is a mask, and
+// the free-running head/tail sit on their own cache lines so the two
+// cores don't fight over the same line on every call.
+template <typename T, size_t N>
+class SpscRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    // Producer side. Copies as much of src as fits and returns the count;
+    // anything that didn't fit is counted as an overrun.
+    size_t push(const T *src, size_t n)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        const size_t used = head - tail;
+        const size_t k = n < N - used ? n : N - used;
+
+        copyIn(head & kMask, src, k);
+        m_head.store(head + k, std::memory_order_release);
+
+        if (k < n)
+            m_overruns.fetch_add(n - k, std::memory_order_relaxed);
+        if (used + k > m_highWater.load(std::memory_order_relaxed))
+            m_highWater.store(used + k, std::memory_order_relaxed);
+        return k;
+    }
+
+    // Consumer side. Copies up to n items out and returns the count.
+    size_t pop(T *dst, size_t n)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t avail = head - tail;
+        const size_t k = n < avail ? n : avail;
+
+        copyOut(tail & kMask, dst, k);
+        m_tail.store(tail + k, std::memory_order_release);
+        return k;
+    }
+
+    // Approximate when called from a third task, exact from either end
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return N; }
+
+    uint32_t overruns() const { return m_overruns.load(std::memory_order_relaxed); }
+    size_t highWater() const { return m_highWater.load(std::memory_order_relaxed); }
+
+    // Only while neither side is running (e.g. between takes)
+    void reset()
+    {
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        m_overruns.store(0, std::memory_order_relaxed);
+        m_highWater.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t kMask = N - 1;
+    static constexpr size_t kCacheLine = 64;
+
+    void copyIn(size_t at, const T *src, size_t k)
+    {
+        const size_t first = k < N - at ? k : N - at;
+        memcpy(&m_data[at], src, first * sizeof(T));
+        memcpy(&m_data[0], src + first, (k - first) * sizeof(T));
+    }
+
+    void copyOut(size_t at, T *dst, size_t k) const
+    {
+        const size_t first = k < N - at ? k : N - at;
+        memcpy(dst, &m_data[at], first * sizeof(T));
+        memcpy(dst + first, &m_data[0], (k - first) * sizeof(T));
+    }
+
+    alignas(kCacheLine) std::atomic<size_t> m_head{0}; // written by producer only
+    alignas(kCacheLine) std::atomic<size_t> m_tail{0}; // written by consumer only
+    alignas(kCacheLine) std::atomic<uint32_t> m_overruns{0};
+    std::atomic<size_t> m_highWater{0};
+    T m_data[N];
+};
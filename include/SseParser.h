@@ -0,0 +1,62 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Reads the HTTP response of an event-stream subscription as bytes come
+// off the socket: status line and headers, then a plain or chunked body
+// split into SSE fields. Each complete event goes to the callback; a
+// blank line with no data before it (after a ": ping" comment, say) is
+// not an event. Free of Arduino types so it runs on the host.
+class SseParser
+{
+public:
+    typedef void (*EventCallback)(const char *event, const char *data, void *ctx);
+
+    void setCallback(EventCallback cb, void *ctx);
+    // New connection; the last event ID and retry survive it
+    void reset();
+    void feed(const uint8_t *data, size_t len);
+
+    int status() const { return m_status; } // -1 until the status line
+    bool headersDone() const { return m_state != State::Status && m_state != State::Headers; }
+    bool ended() const { return m_state == State::Ended; } // last chunk, or not a 200
+    const char *lastId() const { return m_lastId; }
+    uint32_t retryMs() const { return m_retryMs; } // 0 until the server sends "retry:"
+    uint32_t events() const { return m_events; }
+
+private:
+    enum class State
+    {
+        Status,
+        Headers,
+        Body,      // no framing: to the end of the connection
+        ChunkSize, // "<hex>\r\n"
+        ChunkData,
+        ChunkEnd,  // CRLF after the data
+        Ended
+    };
+
+    void headLine();
+    void bodyByte(char c);
+    void handleLine(char *line);
+    void dispatch();
+
+    EventCallback m_cb = nullptr;
+    void *m_cbCtx = nullptr;
+
+    State m_state = State::Status;
+    int m_status = -1;
+    bool m_chunked = false;
+    uint32_t m_chunkLeft = 0;
+    char m_head[128]; // status, header or chunk size line
+    size_t m_headLen = 0;
+
+    char m_line[256];
+    size_t m_lineLen = 0;
+    char m_event[32] = "";
+    char m_data[512];
+    size_t m_dataLen = 0;
+    char m_lastId[48] = "";
+    uint32_t m_retryMs = 0;
+    uint32_t m_events = 0;
+};
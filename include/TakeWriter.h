@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include "AudioEncoder.h"
+#include "CaptureFrontEnd.h"
+#include "FileStore.h"
+#include "HttpTransport.h"
+#include "Scheduler.h"
+
+// Writer half of a take: drains the capture ring through the encoder
+// into the staging WAV and, in Stream mode, into a chunked POST as well.
+//
+// Every encoded byte goes to the staging file, so it always holds the
+// whole take. The socket gets the same bytes while it keeps up; once the
+// ring backs up past half it is left behind and the rest goes out from
+// the file after release. The file is dropped only when the server
+// answers 2xx. A failed connect, a dead socket or any other answer sends
+// the whole file to the queue instead.
+//
+// Portable: the store, transport and clock are the HAL seams, and the
+// clock's waits are what the reader's wake() cuts short.
+class TakeWriter
+{
+public:
+    // Moves the finished staging file into the upload queue
+    typedef bool (*CommitFn)(const char *path, uint32_t *seq, void *ctx);
+    // The last byte of the take is on flash (File) or in the socket
+    typedef void (*ClosedFn)(void *ctx);
+
+    struct Result
+    {
+        bool ok = false;         // File: written cleanly; Stream: 2xx
+        bool queued = false;     // the staging file went to the queue
+        uint32_t seq = 0;        // ... as this entry
+        int status = -1;         // Stream: HTTP status, -1 if none came
+        uint32_t samples = 0;
+        uint32_t bytes = 0;      // encoded, header excluded
+        uint32_t backlog = 0;    // Stream: sent from flash after release
+        bool failedOver = false; // Stream: no connection, or it died
+    };
+
+    TakeWriter(CaptureRing &ring, SchedulerClock &clock, const char *stagingPath);
+
+    void begin(FileStore &store, HttpTransport &net);
+    void setCommit(CommitFn fn, void *ctx);
+    void setClosed(ClosedFn fn, void *ctx);
+
+    // Caller's task, before the reader starts: a fresh staging file with
+    // a placeholder header
+    bool open(AudioEncoder &encoder, uint32_t sampleRate);
+    // Reader task: nothing more is coming once the ring is empty
+    void captureDone();
+
+    // Writer task; both return once the take is sent or queued
+    Result writeFile();
+    // host == nullptr (no inbox configured) goes straight to the queue
+    Result stream(const char *host, uint16_t port, const char *path);
+
+private:
+    static const size_t kPopSamples = 512;
+    static const uint32_t kStatusTimeoutMs = 10000;
+
+    bool pump();
+    bool out(const uint8_t *data, size_t len);
+    bool sendHead(const char *host, const char *path);
+    void sendBacklog(Result &r);
+    void dropConnection();
+    bool closeFile();
+    void commit(Result &r);
+    int readStatus();
+
+    CaptureRing &m_ring;
+    SchedulerClock &m_clock;
+    const char *m_path;
+    FileStore *m_store = nullptr;
+    HttpTransport *m_net = nullptr;
+    CommitFn m_commit = nullptr;
+    void *m_commitCtx = nullptr;
+    ClosedFn m_closed = nullptr;
+    void *m_closedCtx = nullptr;
+
+    AudioEncoder *m_encoder = nullptr;
+    uint32_t m_sampleRate = 16000;
+    std::atomic<bool> m_captureDone{false};
+
+    std::unique_ptr<StoredFile> m_file;
+    bool m_fileOk = false;
+    std::unique_ptr<NetConnection> m_conn;
+    bool m_live = false;     // the socket gets bytes as they are encoded
+    bool m_failed = false;   // the connection was lost
+    uint8_t m_encBuf[1024];  // encoded output for one kPopSamples pop
+    uint32_t m_samples = 0;
+    uint32_t m_bytes = 0;    // encoded, header excluded
+    uint32_t m_sent = 0;     // of m_bytes, in the socket
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+
+// Binary hot-path tracing. Each event is a 12-byte record (cycle count,
+// event id, arg) appended to a ring owned by the current core; a record
+// costs a cycle-counter read, an uncontended fetch_add and three stores,
+// so it can stay on in production. trace::dump() prints the rings as
+// "#TRACE <base64>" lines; tools/trace2json.py turns a serial log into
+// Chrome trace / Perfetto JSON.
+//
+// Build with -DTRACE_ENABLED=0 to compile every call site out.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 256 // per core, power of two
+#endif
+
+// Add new events at the end and give them a name in Trace.cpp
+enum class TraceEvent : uint16_t
+{
+    ReaderRead = 1, // arg: samples
+    FlushChunk,     // arg: samples
+    RingFull,       // arg: samples dropped or spilled
+    Stop,           // arg: samples in the take
+    WriteTake,      // arg: encoded bytes
+    StreamTake,     // arg: encoded bytes
+    Upload,         // arg: 1 = on server or queued
+    Play,           // arg: sample rate
+    PlayWrite,      // arg: frames
+    Underrun,
+    Count
+};
+
+namespace trace
+{
+    struct Record
+    {
+        uint32_t cycles;
+        uint16_t id;  // TraceEvent | phase << 14
+        uint16_t seq; // low bits of the ring index, to spot torn records
+        uint32_t arg;
+    };
+
+    enum Phase : uint16_t
+    {
+        kInstant = 0,
+        kBegin = 1,
+        kEnd = 2,
+        kCounter = 3
+    };
+
+    struct CoreRing
+    {
+        std::atomic<uint32_t> next{0};
+        Record rec[TRACE_RECORDS];
+    };
+
+    static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "TRACE_RECORDS must be a power of two");
+
+    extern CoreRing g_rings[2];
+    extern volatile bool g_enabled;
+
+    inline void emit(TraceEvent ev, Phase ph, uint32_t arg)
+    {
+#if TRACE_ENABLED
+        if (!g_enabled)
+            return;
+        CoreRing &r = g_rings[xPortGetCoreID() & 1];
+        // Tasks on one core may preempt each other, so claim the slot first;
+        // a preempted record can read the counter after its successor, which
+        // trace2json.py allows for
+        uint32_t i = r.next.fetch_add(1, std::memory_order_relaxed);
+        Record &rec = r.rec[i & (TRACE_RECORDS - 1)];
+        rec.cycles = ESP.getCycleCount();
+        rec.id = (uint16_t)ev | (uint16_t)(ph << 14);
+        rec.seq = (uint16_t)i;
+        rec.arg = arg;
+#endif
+    }
+
+    inline void instant(TraceEvent ev, uint32_t arg = 0) { emit(ev, kInstant, arg); }
+    inline void begin(TraceEvent ev, uint32_t arg = 0) { emit(ev, kBegin, arg); }
+    inline void end(TraceEvent ev, uint32_t arg = 0) { emit(ev, kEnd, arg); }
+    inline void counter(TraceEvent ev, uint32_t value) { emit(ev, kCounter, value); }
+
+    void enable(bool on);
+    void clear();
+    // Writes both rings, oldest first per core. Pauses tracing meanwhile.
+    void dump(Print &out);
+}
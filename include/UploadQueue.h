@@ -0,0 +1,74 @@
+#pragma once
+#include <Arduino.h>
+#include <memory>
+#include "freertos/semphr.h"
+#include "EspHal.h"
+#include "ResumableUploader.h"
+
+// On-flash FIFO of finished recordings waiting for upload.
+//
+// Entries live in /q/<seq>.wav; /q/index and /q/index.1 hold the
+// head/tail sequence numbers, written in turn so one of them is always
+// whole. commit() renames a finished file into the queue and then
+// rewrites the index, so a power cut at any point leaves either the old
+// or the new queue: begin() re-adopts files past the tail and deletes
+// ones already popped. A background drainer uploads oldest-first
+// whenever Wi-Fi is up; recording only ever touches flash. The queue
+// never grows past maxBytes: when only the entry being uploaded is left
+// to evict, the new take is dropped.
+class UploadQueue
+{
+public:
+    enum class Eviction
+    {
+        DropOldest, // make room for the new take
+        RejectNew   // keep what is queued, drop the new take
+    };
+
+    // Called on the drainer task after an entry is acknowledged
+    typedef void (*SentCallback)(uint32_t seq, uint32_t bytes, void *ctx);
+
+    explicit UploadQueue(uint32_t maxBytes = 1024 * 1024,
+                         Eviction policy = Eviction::DropOldest);
+
+    // Recover state from store, start the drainer uploading over net
+    void begin(FileStore &store, HttpTransport &net);
+    void setUploadUrl(const String &url);
+    // Moves the file into the queue; seq (optional) gets its queue number
+    bool commit(const char *finishedPath, uint32_t *seq = nullptr);
+    void kick();                        // e.g. right after Wi-Fi connects;
+                                        // also ends an upload backoff
+    void setSentCallback(SentCallback cb, void *ctx);
+
+    size_t count() const;
+    uint32_t bytes() const { return m_bytes; }
+
+private:
+    static void drainerTaskThunk(void *arg);
+    void drainerTask();
+
+    String entryPath(uint32_t seq) const;
+    bool loadIndex();
+    void saveIndex();
+    void recover();
+    static void recoverEntry(const char *path, void *ctx);
+    void dropHead(); // with m_lock held
+
+    const uint32_t m_maxBytes;
+    const Eviction m_policy;
+
+    FileStore *m_store = nullptr;
+    SemaphoreHandle_t m_lock = nullptr;
+    TaskHandle_t m_drainerTask = nullptr;
+    TaskClock m_clock; // the drainer's: kick() wakes its waits
+    std::unique_ptr<ResumableUploader> m_uploader;
+    String m_url;
+
+    uint32_t m_head = 0; // oldest entry
+    uint32_t m_tail = 0; // next sequence number to assign
+    uint32_t m_bytes = 0;
+    uint8_t m_indexSlot = 1; // the slot saveIndex() wrote last
+    volatile uint32_t m_inFlight = UINT32_MAX; // entry the drainer is sending
+    SentCallback m_sentCb = nullptr;
+    void *m_sentCtx = nullptr;
+};
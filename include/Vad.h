@@ -0,0 +1,83 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Energy + zero-crossing voice activity detector, integer-only.
+// Works on fixed frames of 16-bit PCM (256 samples = 16 ms at 16 kHz)
+// and tracks the noise floor itself, so there is no level to tune per
+// mic. Cost is a multiply-add and a compare per sample.
+class Vad
+{
+public:
+    static const size_t kFrameSamples = 256;
+
+    struct Config
+    {
+        uint8_t onsetRatio = 4;     // speech: energy > noise * ratio (~6 dB)
+        uint8_t fricativeRatio = 2; // ... or > noise * this with a high ZCR
+        uint16_t zcrHigh = 64;      // crossings per frame for unvoiced speech
+        uint32_t minEnergy = 2000;  // absolute floor, ~ -50 dBFS
+        uint8_t hangoverFrames = 8; // stay "speech" this long after the last hit
+    };
+
+    Vad() = default;
+    explicit Vad(const Config &cfg) : m_cfg(cfg) {}
+
+    void reset();
+    // One frame of kFrameSamples samples
+    bool isSpeech(const int16_t *frame);
+
+    uint32_t noiseFloor() const { return m_noise; }
+    uint32_t lastEnergy() const { return m_energy; }
+
+private:
+    Config m_cfg;
+    uint32_t m_noise = 0; // mean (s*s >> 8) of non-speech frames
+    uint32_t m_energy = 0;
+    uint8_t m_hangover = 0;
+    uint8_t m_warmup = 0; // frames seen since reset, capped
+};
+
+// Trims silence from a take as it is captured: leading silence is dropped
+// except for a short pre-roll before the first word, and pauses longer
+// than maxPause are cut down to maxPause (which also bounds trailing
+// silence). Frames pass through emit() in order; nothing allocates.
+class SilenceGate
+{
+public:
+    typedef void (*Emit)(const int16_t *samples, size_t n, void *ctx);
+
+    static const size_t kMaxPreRollFrames = 20; // 320 ms at 16 kHz, 10 KB
+
+    // Lengths in frames of Vad::kFrameSamples
+    SilenceGate(Emit emit, void *ctx, uint8_t preRollFrames = 16, uint16_t maxPauseFrames = 38);
+
+    void reset();
+    void process(const int16_t *pcm, size_t n);
+    void finish(); // end of take: flush a partial frame if in speech
+
+    Vad &vad() { return m_vad; }
+    uint32_t keptSamples() const { return m_kept; }
+    uint32_t droppedSamples() const { return m_dropped; }
+
+private:
+    void frame(const int16_t *f);
+    void out(const int16_t *samples, size_t n);
+
+    Emit m_emit;
+    void *m_ctx;
+    const uint8_t m_preRollFrames;
+    const uint16_t m_maxPauseFrames;
+    Vad m_vad;
+
+    int16_t m_acc[Vad::kFrameSamples]; // partial frame between calls
+    size_t m_accLen = 0;
+
+    // Last frames while gated, replayed at the next onset
+    int16_t m_preRoll[kMaxPreRollFrames][Vad::kFrameSamples];
+    uint8_t m_preHead = 0, m_preCount = 0;
+
+    bool m_open = false;        // passing audio through
+    uint16_t m_silentFrames = 0; // consecutive non-speech frames while open
+    uint32_t m_kept = 0, m_dropped = 0;
+};
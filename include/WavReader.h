@@ -0,0 +1,67 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "ByteStream.h"
+
+// Streaming WAV parser and sample decoder. Walks the RIFF chunk list
+// forward only (skips LIST, fact, cue, ... by reading past them), so it
+// works on an HTTP body as well as a file. Accepts PCM 8/16/24/32-bit and
+// IEEE float 32/64, plain or WAVE_FORMAT_EXTENSIBLE, and decodes to
+// interleaved 16-bit.
+class WavReader
+{
+public:
+    enum class Error : uint8_t
+    {
+        None,
+        Truncated,   // stream ended inside the header
+        NotWave,     // no RIFF/WAVE signature
+        BadFormat,   // fmt chunk missing, short or inconsistent
+        Unsupported, // valid, but not a codec/bit depth we decode
+        NoData,      // chunk list ended without a data chunk
+        BadSize,     // a chunk claims more bytes than the file has
+    };
+
+    static const uint16_t kMaxChannels = 8;
+
+    struct Format
+    {
+        bool isFloat = false;
+        uint16_t channels = 0;
+        uint32_t sampleRate = 0;
+        uint16_t bitsPerSample = 0; // container size
+        uint16_t blockAlign = 0;
+        uint32_t dataBytes = 0; // after clamping to the file
+    };
+
+    // Reads up to the first byte of sample data. streamSize is the total
+    // length when known (file size, Content-Length), else 0; chunk sizes
+    // are checked against it and a data chunk running past the end is
+    // clamped to what is there.
+    Error parse(ByteStream &s, uint32_t streamSize = 0);
+
+    const Format &format() const { return m_fmt; }
+    uint32_t headerBytes() const { return m_headerBytes; }
+    uint32_t remainingBytes() const { return m_remaining; }
+
+    // Up to maxFrames interleaved frames; 0 at the end of the data (or on
+    // a read timeout). Partial frames are held over to the next call.
+    size_t readFrames(ByteStream &s, int16_t *out, size_t maxFrames);
+
+    static const char *errorName(Error e);
+
+private:
+    bool readExact(ByteStream &s, uint8_t *dst, size_t len);
+    bool skip(ByteStream &s, uint32_t len);
+    Error parseFmt(const uint8_t *p, uint32_t len);
+    void decode(const uint8_t *src, int16_t *out, size_t samples) const;
+
+    Format m_fmt;
+    uint32_t m_headerBytes = 0; // consumed by parse()
+    uint32_t m_remaining = 0;   // data bytes not yet read
+
+    // Raw bytes between the stream and decode(); 1536 is a multiple of
+    // most block sizes (1..8 channels of 1, 2, 3, 4 bytes)
+    uint8_t m_raw[1536];
+    size_t m_carry = 0; // partial frame at the front of m_raw
+};
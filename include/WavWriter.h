@@ -0,0 +1,125 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "FileStore.h"
+
+namespace wav
+{
+// Canonical 44-byte PCM header as plain bytes, so its layout never
+// depends on struct padding or packing attributes
+struct Header
+{
+    uint8_t bytes[44];
+};
+
+static const size_t kHeaderBytes = sizeof(Header);
+
+constexpr uint8_t le(uint32_t v, int shift) { return (uint8_t)((v >> shift) & 0xFF); }
+
+constexpr uint32_t riffSize(uint32_t dataBytes)
+{
+    return dataBytes > 0xFFFFFFFFu - 36 ? 0xFFFFFFFFu : 36 + dataBytes;
+}
+
+// Usable at compile time (WavWriter) and at run time (PcmEncoder)
+constexpr Header makeHeader(uint16_t channels, uint16_t bits, uint32_t rate, uint32_t dataBytes)
+{
+    return Header{{
+        'R', 'I', 'F', 'F',
+        le(riffSize(dataBytes), 0), le(riffSize(dataBytes), 8), le(riffSize(dataBytes), 16), le(riffSize(dataBytes), 24),
+        'W', 'A', 'V', 'E',
+        'f', 'm', 't', ' ',
+        16, 0, 0, 0,
+        1, 0, // PCM
+        le(channels, 0), le(channels, 8),
+        le(rate, 0), le(rate, 8), le(rate, 16), le(rate, 24),
+        le(rate * channels * (bits / 8), 0), le(rate * channels * (bits / 8), 8),
+        le(rate * channels * (bits / 8), 16), le(rate * channels * (bits / 8), 24),
+        le(channels * (bits / 8), 0), le(channels * (bits / 8), 8),
+        le(bits, 0), le(bits, 8),
+        'd', 'a', 't', 'a',
+        le(dataBytes, 0), le(dataBytes, 8), le(dataBytes, 16), le(dataBytes, 24),
+    }};
+}
+} // namespace wav
+
+// PCM WAV file writer with the format fixed at compile time, so both
+// headers it can write are constants in flash.
+//
+// Patch mode writes zero sizes up front and rewrites the header once, in
+// a single seek + 44-byte write, on finalize(). Streaming mode writes the
+// largest block-aligned size up front and never seeks back: the file is
+// valid while still being written (readers clamp to the real length) and
+// SPIFFS is spared the block rewrite.
+template <uint16_t Channels, uint16_t Bits, uint32_t Rate>
+class WavWriter
+{
+    static_assert(Channels >= 1 && Channels <= 8, "WavWriter: 1..8 channels");
+    static_assert(Bits == 8 || Bits == 16 || Bits == 24 || Bits == 32, "WavWriter: 8/16/24/32-bit PCM");
+    static_assert(Rate > 0, "WavWriter: sample rate");
+
+public:
+    enum class Mode : uint8_t
+    {
+        Patch,
+        Streaming,
+    };
+
+    static constexpr uint32_t kRate = Rate;
+    static constexpr uint16_t kBlockAlign = Channels * (Bits / 8);
+    static constexpr uint32_t kStreamingBytes = (0xFFFFFFFFu - 36) / kBlockAlign * kBlockAlign;
+    static constexpr wav::Header kPatchHeader = wav::makeHeader(Channels, Bits, Rate, 0);
+    static constexpr wav::Header kStreamingHeader = wav::makeHeader(Channels, Bits, Rate, kStreamingBytes);
+
+    static constexpr wav::Header header(uint32_t dataBytes)
+    {
+        return wav::makeHeader(Channels, Bits, Rate, dataBytes);
+    }
+
+    explicit WavWriter(Mode mode = Mode::Patch) : m_mode(mode) {}
+
+    // Between files only
+    void setMode(Mode mode) { m_mode = mode; }
+    Mode mode() const { return m_mode; }
+
+    bool begin(StoredFile &f)
+    {
+        m_dataBytes = 0;
+        const wav::Header &h = m_mode == Mode::Streaming ? kStreamingHeader : kPatchHeader;
+        return f.write(h.bytes, sizeof(h.bytes)) == sizeof(h.bytes);
+    }
+
+    // Interleaved little-endian samples; returns bytes written
+    size_t write(StoredFile &f, const void *samples, size_t bytes)
+    {
+        size_t n = f.write(static_cast<const uint8_t *>(samples), bytes);
+        m_dataBytes += n;
+        return n;
+    }
+
+    bool finalize(StoredFile &f)
+    {
+        if (m_mode == Mode::Streaming)
+            return true;
+        const wav::Header h = header(m_dataBytes - m_dataBytes % kBlockAlign);
+        return f.seek(0) && f.write(h.bytes, sizeof(h.bytes)) == sizeof(h.bytes);
+    }
+
+    uint32_t dataBytes() const { return m_dataBytes; }
+
+private:
+    Mode m_mode;
+    uint32_t m_dataBytes = 0;
+};
+
+// C++11 needs namespace-scope definitions for odr-used constexpr members
+template <uint16_t C, uint16_t B, uint32_t R>
+constexpr uint32_t WavWriter<C, B, R>::kRate;
+template <uint16_t C, uint16_t B, uint32_t R>
+constexpr uint16_t WavWriter<C, B, R>::kBlockAlign;
+template <uint16_t C, uint16_t B, uint32_t R>
+constexpr uint32_t WavWriter<C, B, R>::kStreamingBytes;
+template <uint16_t C, uint16_t B, uint32_t R>
+constexpr wav::Header WavWriter<C, B, R>::kPatchHeader;
+template <uint16_t C, uint16_t B, uint32_t R>
+constexpr wav::Header WavWriter<C, B, R>::kStreamingHeader;
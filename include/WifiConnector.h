@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+#include "WifiDriver.h"
+
+enum class WifiState
+{
+    Idle,
+    Connecting,
+    Connected,
+    Failed // timed out; start() again to retry
+};
+
+// Station connect logic on top of a WifiDriver, driven by its events:
+//  1. with a cached AP for this SSID, join that BSSID on its channel (no
+//     scan) and reuse the cached lease as a static config if it is
+//     recent enough (no DHCP)
+//  2. if the targeted join is refused or stays silent for fastTimeoutMs,
+//     fall back to a full scan with DHCP, retrying until the timeout
+//  3. once up, cache the AP and lease for next time; a reused lease is
+//     renewed with DHCP in the background and saved again once it is
+//     confirmed, and a refused one (NAK) means a reconnect with DHCP
+//  4. a lost link reconnects the same way
+// Not thread-safe: on the board WifiModule serialises the driver's
+// events with start()/tick() from its own tasks.
+class WifiConnector
+{
+public:
+    struct Config
+    {
+        uint32_t fastTimeoutMs = 1500; // targeted join before falling back
+        uint32_t retryMs = 1000;       // between full attempts
+        uint32_t leaseMaxAgeS = 3600;  // older leases go through DHCP again
+    };
+
+    // Phases of the last connect, ms
+    struct Timings
+    {
+        uint32_t associateMs = 0; // start -> joined the AP
+        uint32_t ipMs = 0;        // joined -> address
+        uint32_t totalMs = 0;
+        uint8_t attempts = 0;     // driver connects
+        bool fast = false;        // joined the cached AP without scanning
+        bool cachedLease = false; // skipped DHCP
+        bool fellBack = false;    // the targeted join failed first
+        bool leaseRefused = false; // a reused lease was NAKed: DHCP after all
+        uint16_t lastReason = 0;  // last disconnect reason seen
+    };
+
+    static const uint32_t kNever = UINT32_MAX;
+
+    explicit WifiConnector(WifiDriver &driver, WifiCacheStore *cache = nullptr);
+
+    void setConfig(const Config &cfg) { m_cfg = cfg; }
+    // Always use this instead of DHCP (ip 0 switches back)
+    void setStaticIp(const WifiIpConfig &ip) { m_static = ip; }
+
+    // Strings must outlive the connection (e.g. from secrets.h)
+    void start(const char *ssid, const char *password, uint32_t timeoutMs, uint32_t now);
+    void stop();
+    void onEvent(WifiDriver::Event e, uint16_t reason, uint32_t now);
+    // Acts on timeouts and the events seen since the last call; returns
+    // ms until it wants to run again (kNever: only on the next event)
+    uint32_t tick(uint32_t now);
+
+    WifiState state() const { return m_state; }
+    const Timings &timings() const { return m_timings; }
+    const char *ssid() const { return m_ssid; }
+    const char *password() const { return m_password; }
+    uint32_t timeoutMs() const { return m_timeout; }
+
+private:
+    enum class Phase : uint8_t
+    {
+        Fast,  // targeted join on the cached AP
+        Full,  // scanning join
+        Retry, // waiting to scan again
+        Up
+    };
+
+    void connectFast(uint32_t now, bool reuseLease);
+    void connectFull(uint32_t now);
+    void saveCache();
+    static uint32_t hashSsid(const char *ssid);
+
+    WifiDriver &m_driver;
+    WifiCacheStore *m_store;
+    Config m_cfg;
+    WifiIpConfig m_static;
+
+    const char *m_ssid = nullptr;
+    const char *m_password = nullptr;
+    uint32_t m_timeout = 0;
+    uint32_t m_start = 0;
+    uint32_t m_phaseStart = 0;
+    uint32_t m_assocAt = 0;
+    uint32_t m_retryAt = 0;
+
+    WifiState m_state = WifiState::Idle;
+    Phase m_phase = Phase::Full;
+    bool m_associated = false;
+    bool m_fallBack = false; // set by events, acted on in tick()
+    bool m_lost = false;
+    bool m_save = false;
+    bool m_renew = false;    // ask the driver to renew the reused lease
+    bool m_renewing = false; // ... and wait for its answer
+    bool m_renewed = false;  // the lease in use came from DHCP after all
+    bool m_refused = false;
+
+    bool m_haveCache = false;
+    WifiCache m_cache;
+    Timings m_timings;
+};
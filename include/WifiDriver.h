@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+
+// IPv4 settings for the station, addresses as IPAddress stores them
+// (first octet in the low byte). ip 0 means DHCP.
+struct WifiIpConfig
+{
+    uint32_t ip = 0;
+    uint32_t gateway = 0;
+    uint32_t netmask = 0;
+    uint32_t dns = 0;
+};
+
+// Station-mode Wi-Fi the connect logic drives: the Arduino WiFi class on
+// the board, a scripted fake in the native build. Progress comes back
+// as events, from the driver's own task on the board.
+class WifiDriver
+{
+public:
+    enum class Event : uint8_t
+    {
+        Associated,  // joined the AP, no address yet
+        GotIp,        // DHCP answered or the static config is applied
+        Disconnected, // lost or never got the link; reason is the 802.11 / esp_wifi code
+        LeaseRenewed, // renewLease(): DHCP confirmed it; link() has the lease now
+        LeaseRefused  // renewLease(): NAK, the address is not ours any more
+    };
+    typedef void (*EventCallback)(Event e, uint16_t reason, void *ctx);
+
+    // Disconnect reasons the connector tells apart
+    static const uint16_t kReasonAuthFail = 202;
+    static const uint16_t kReasonNoApFound = 201;
+
+    virtual ~WifiDriver() = default;
+    virtual void setEventCallback(EventCallback cb, void *ctx) = 0;
+    // bssid nullptr / channel 0 scans all channels; ip nullptr uses DHCP
+    virtual void connect(const char *ssid, const char *password, const uint8_t *bssid, uint8_t channel,
+                         const WifiIpConfig *ip) = 0;
+    virtual void disconnect() = 0;
+    // Up on a reused lease: have DHCP confirm it in the background
+    virtual void renewLease() = 0;
+    // AP and addresses in use, valid after GotIp
+    virtual void link(uint8_t bssid[6], uint8_t &channel, WifiIpConfig &ip) = 0;
+};
+
+// What a fast reconnect needs: the AP we were on and the last lease
+struct WifiCache
+{
+    uint32_t ssidHash = 0; // the network this belongs to
+    uint8_t bssid[6] = {};
+    uint8_t channel = 0;   // 0: nothing cached
+    WifiIpConfig lease;    // last DHCP answer, ip 0 if none
+};
+
+// Keeps the WifiCache across reboots: NVS on the board, memory on the host
+class WifiCacheStore
+{
+public:
+    virtual ~WifiCacheStore() = default;
+    // leaseAgeS: seconds since the lease was handed out, UINT32_MAX if unknown
+    virtual bool load(WifiCache &out, uint32_t &leaseAgeS) = 0;
+    // newLease: the lease came from DHCP just now (restarts its age)
+    virtual void save(const WifiCache &cache, bool newLease) = 0;
+    virtual void clear() = 0;
+};
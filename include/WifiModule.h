@@ -2,18 +2,49 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <HTTPClient.h>
+#include "HttpConnectionPool.h"
+#include "WifiConnector.h"
 
+// Station connection through WifiConnector: rejoins the last AP on its
+// channel with the last lease (cached in NVS) before falling back to a
+// scan and DHCP
 class WifiModule
 {
 public:
-    WifiModule() = default;
+    typedef void (*ChangeCallback)(void *ctx);
+
+    WifiModule();
 
     // Set Wi-Fi to station mode (safe to call multiple times)
     void beginStation();
 
-    // Connect with a timeout (ms). Returns true on success.
+    // Connect with a timeout (ms). Returns true on success. Blocks on the
+    // driver's events, not a status poll.
     bool connect(const char *ssid, const char *password, uint32_t timeoutMs = 15000);
 
+    // Non-blocking connect: startConnect() returns at once. poll() does
+    // the work (fallbacks, retries, the timeout): call it when the change
+    // callback fires and again pollInMs() later.
+    void startConnect(const char *ssid, const char *password, uint32_t timeoutMs = 15000);
+    WifiState poll();
+    uint32_t pollInMs() const { return m_pollIn; } // WifiConnector::kNever: only on a change
+    WifiState state() const { return m_reported; }
+    // From the Wi-Fi event task; e.g. post a scheduler event that polls
+    void setChangeCallback(ChangeCallback cb, void *ctx);
+
+    // Fixed address instead of DHCP and the cached lease; call before
+    // connecting. An ip of 0.0.0.0 goes back to DHCP.
+    void setStaticIp(IPAddress ip, IPAddress gateway, IPAddress netmask, IPAddress dns);
+    // Drop the cached AP and lease, e.g. after moving the device
+    void forgetNetwork();
+    // Join/address/total ms of the last connect, and which path it took
+    const WifiConnector::Timings &connectTimings() const { return m_connector.timings(); }
+
+    // Radio off for light sleep; resume() reconnects with the last
+    // credentials if it was connected or connecting before
+    void suspend();
+    void resume();
+
     // Quick status helpers
     bool isConnected() const;
     IPAddress localIP() const;
@@ -21,4 +52,22 @@ public:
     // Convenience HTTP GET. Returns HTTP status code (e.g. 200), or negative on failure.
     // On 200 OK, 'payloadOut' is filled with the response body.
     int httpGet(const String &url, String &payloadOut, uint32_t timeoutMs = 10000);
+
+    // DNS/connect/TTFB/transfer breakdown of the last httpGet()
+    const HttpTiming &lastTiming() const { return m_lastTiming; }
+
+private:
+    static void onDriverEvent(WifiDriver::Event e, uint16_t reason, void *ctx);
+    void init();
+    void report(WifiState s);
+
+    HttpTiming m_lastTiming;
+    WifiConnector m_connector;
+    SemaphoreHandle_t m_lock = nullptr;    // connector: event task vs callers
+    SemaphoreHandle_t m_changed = nullptr; // given per driver event
+    ChangeCallback m_changeCb = nullptr;
+    void *m_changeCtx = nullptr;
+    WifiState m_reported = WifiState::Idle;
+    uint32_t m_pollIn = WifiConnector::kNever;
+    bool m_suspended = false;
 };
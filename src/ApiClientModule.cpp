@@ -1,6 +1,22 @@
 #include "ApiClientModule.h"
 #include "secrets.h"
 #include <ArduinoJson.h>
+#include "NetUtil.h"
+#include "HttpConnectionPool.h"
+#include "Trace.h"
+#include "Metrics.h"
+#include "PowerManager.h"
+
+static metrics::Counter s_takes("takes");
+static metrics::Counter s_spilledTakes("spilled_takes");
+static metrics::Counter s_streamFailovers("stream_failovers");
+static metrics::Counter s_streamLost("stream_lost_takes");
+static metrics::Counter s_captureOverruns("capture_overruns");
+static metrics::Gauge s_ringPeak("capture_ring_peak");
+static metrics::Counter s_vadDropped("vad_dropped_samples");
+static metrics::Gauge s_agcGain("agc_gain_q16");
+static metrics::Counter s_limitedBlocks("agc_limited_blocks");
+static metrics::Histogram s_vadBlockUs("vad_block_us", {25, 50, 100, 200, 400, 800});
 
 ApiClientModule::ApiClientModule(int i2s_num,
                                  int sck_pin,
@@ -10,47 +26,43 @@ ApiClientModule::ApiClientModule(int i2s_num,
                                  size_t chunkSamples,
                                  uint32_t maxSeconds,
                                  const char *outPath)
-    : m_i2s_num(i2s_num),
-      m_sck_pin(sck_pin),
-      m_ws_pin(ws_pin),
-      m_sd_pin(sd_pin),
+    : m_mic(i2s_num, sck_pin, ws_pin, sd_pin),
       m_sampleRate(sampleRate),
       m_chunkSamples(chunkSamples),
       m_maxSeconds(maxSeconds),
       m_outPath(outPath)
 {
     m_samplePeriod = 1000000UL / m_sampleRate;
-    m_buf = new int16_t[m_chunkSamples];
 }
 
+static const size_t kReadSamples = BufferPool::kBlockBytes / sizeof(int32_t);
+
 void ApiClientModule::begin()
 {
-    i2s_config_t cfg = {
-        .mode = static_cast<i2s_mode_t>(I2S_MODE_MASTER | I2S_MODE_RX),
-        .sample_rate = m_sampleRate,
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
-        .channel_format = I2S_CHANNEL_FMT_ONLY_RIGHT, // flipped because of bug in the library
-        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
-        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 12,
-        .dma_buf_len = 1024,
-        .tx_desc_auto_clear = false,
-        .fixed_mclk = 0};
-
-    i2s_pin_config_t pins = {
-        .bck_io_num = m_sck_pin,
-        .ws_io_num = m_ws_pin,
-        .data_out_num = I2S_PIN_NO_CHANGE,
-        .data_in_num = m_sd_pin};
-
-    i2s_driver_install((i2s_port_t)m_i2s_num, &cfg, 0, nullptr);
-    i2s_set_pin((i2s_port_t)m_i2s_num, &pins);
-
-    // Ensure exact mono/32-bit/16kHz clock setup
-    i2s_set_clk((i2s_port_t)m_i2s_num, m_sampleRate,
-                I2S_BITS_PER_SAMPLE_32BIT, I2S_CHANNEL_MONO);
-
-    Serial.println("I2S initialized for digital mic (mono/right)");
+    // The only audio buffers the capture path needs; nothing allocates
+    // once recording starts
+    BufferPool::audio().begin();
+    m_readBlock = BufferPool::audio().acquire();
+    m_chunkBlock = BufferPool::audio().acquire();
+    if (!m_readBlock || !m_chunkBlock)
+    {
+        Serial.println("Audio buffer pool exhausted; capture disabled");
+        return;
+    }
+    m_chunkSamples = min(m_chunkSamples, m_chunkBlock.capacity() / sizeof(int16_t));
+    m_front.begin(m_sampleRate, m_chunkBlock.as<int16_t>(), m_chunkSamples);
+
+    if (m_source->begin(m_sampleRate))
+        Serial.println("Audio input initialized (mono)");
+    else
+        Serial.println("Audio input init failed");
+
+    // Pick up recordings left over from before a reboot
+    m_queue.setSentCallback(&ApiClientModule::onSentThunk, this);
+    m_queue.begin(*m_store, *m_net);
+    m_writer.begin(*m_store, *m_net);
+    m_writer.setCommit(&ApiClientModule::commitThunk, this);
+    m_writer.setClosed(&ApiClientModule::closedThunk, this);
 
     // Spawn a dedicated high-priority reader task
     // Core notes: Arduino loop runs on core 1. Wi-Fi often on core 0.
@@ -63,66 +75,134 @@ void ApiClientModule::begin()
         20,   // priority
         &m_readerTask,
         0); // core 0
+
+    // The writer does the slow part (SPIFFS / HTTP) next to loop() on
+    // core 1, well below the reader's priority
+    m_takeDone = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(
+        &ApiClientModule::writerTaskThunk,
+        "audio_writer",
+        8192,
+        this,
+        5,
+        &m_writerTask,
+        1);
+
+    metrics::Registry::shared().watchTask("i2s_reader", m_readerTask);
+    metrics::Registry::shared().watchTask("audio_writer", m_writerTask);
 }
 
 void ApiClientModule::setInboxPath(const char *path)
 {
     m_inboxPath = path;
+    m_queue.setUploadUrl(String(API_HOST) + String(m_inboxPath));
+}
+
+void ApiClientModule::setAudioSource(AudioSource *source)
+{
+    if (m_readerTask)
+        return;
+    m_source = source ? source : &m_mic;
 }
 
-void ApiClientModule::writeWavHeader(File &f, uint32_t numSamples)
+void ApiClientModule::setFileStore(FileStore *store)
 {
-    WavHeader h;
-    h.sampleRate = m_sampleRate;
-    h.byteRate = m_sampleRate * 2; // mono, 16-bit
-    h.blockAlign = 2;
-    h.bitsPerSample = 16;
-    h.subchunk2Size = numSamples * 2;
-    h.chunkSize = 36 + h.subchunk2Size;
+    if (m_readerTask)
+        return; // the upload queue has bound it
+    m_store = store ? store : &SpiffsStore::shared();
+}
 
-    f.seek(0);
-    f.write(reinterpret_cast<uint8_t *>(&h), sizeof(WavHeader));
+void ApiClientModule::setTransport(HttpTransport *net)
+{
+    if (m_readerTask)
+        return; // the upload queue has bound it
+    m_net = net ? net : &WifiTransport::shared();
 }
 
-void ApiClientModule::flushChunk()
+void ApiClientModule::setCaptureMode(CaptureMode mode)
 {
-    if (m_bufIdx == 0 || !m_file)
+    if (m_isRecording || m_takeActive)
         return;
-    m_file.write(reinterpret_cast<uint8_t *>(m_buf), m_bufIdx * sizeof(int16_t));
-    m_bufIdx = 0;
+    m_mode = mode;
+}
+
+void ApiClientModule::setEncoder(AudioEncoder *encoder)
+{
+    if (m_isRecording || m_takeActive)
+        return;
+    m_encoder = encoder ? encoder : &m_pcmEncoder;
+}
+
+void ApiClientModule::setSilenceTrim(bool on)
+{
+    if (m_isRecording || m_takeActive)
+        return;
+    m_front.setSilenceTrim(on);
+}
+
+void ApiClientModule::setFrontEnd(const CaptureDsp::Config &cfg)
+{
+    if (m_isRecording || m_takeActive)
+        return;
+    m_front.setDsp(cfg);
+}
+
+uint32_t ApiClientModule::nowUs()
+{
+    return micros();
+}
+
+// Reader task, after each chunk reached the ring. Never blocks: SPIFFS and
+// the network are the writer's problem.
+void ApiClientModule::chunkThunk(size_t samples, size_t dropped, uint32_t gateUs, void *ctx)
+{
+    ApiClientModule *self = static_cast<ApiClientModule *>(ctx);
+    self->m_writerClock.wake();
+    trace::instant(TraceEvent::FlushChunk, samples);
+    if (self->m_front.silenceTrim())
+        s_vadBlockUs.record(gateUs);
+    if (dropped)
+        trace::instant(TraceEvent::RingFull, dropped);
 }
 
 void ApiClientModule::start()
 {
-    if (m_isRecording)
+    if (m_isRecording || !m_chunkBlock)
+        return;
+    if (m_takeActive)
+    {
+        Serial.println("Previous take still being written; not starting");
         return;
+    }
 
-    if (SPIFFS.exists(m_outPath))
-        SPIFFS.remove(m_outPath);
-    m_file = SPIFFS.open(m_outPath, FILE_WRITE);
-    if (!m_file)
+    // Both modes stage the whole take on flash; Stream mode drops it once
+    // the server has it
+    if (!m_writer.open(*m_encoder, m_sampleRate))
     {
         Serial.println("Failed to open output WAV for writing");
         return;
     }
 
-    // Reserve space for WAV header
-    WavHeader blank;
-    m_file.write(reinterpret_cast<uint8_t *>(&blank), sizeof(WavHeader));
+    m_ring.reset();
+    m_front.reset();
+    xSemaphoreTake(m_takeDone, 0);
+    m_takeOk = false;
+    m_takeQueued = false;
+    m_takeActive = true;
 
-    m_totalSamples = 0;
-    m_bufIdx = 0;
     m_startMillis = millis();
+    m_tStart = micros();
 
-    // RESET I2S/DMA STATE FOR A FRESH TAKE
-    i2s_zero_dma_buffer((i2s_port_t)m_i2s_num);
-    // Re-assert exact clocking each time (avoids drift after Wi-Fi)
-    i2s_set_clk((i2s_port_t)m_i2s_num, m_sampleRate,
-                I2S_BITS_PER_SAMPLE_32BIT, I2S_CHANNEL_MONO);
-    i2s_start((i2s_port_t)m_i2s_num);
+    // Fresh DMA state and clocking for the take
+    m_source->start();
 
-    // Let the reader task start consuming
+    // Let the reader task start consuming; prefetch downloads keep off
+    // the flash until the take is done
+    m_prefetch.pause();
+    PowerManager::shared().setBusy(PowerPolicy::Recording, true);
     m_isRecording = true;
+    xTaskNotifyGive(m_readerTask);
+    xTaskNotifyGive(m_writerTask);
 
     Serial.println("Recording started");
 }
@@ -134,33 +214,66 @@ void ApiClientModule::stop()
 
     // Ask the reader to drain and remember who’s waiting
     m_waiterTask = xTaskGetCurrentTaskHandle();
+    requestStop();
+
+    // The reader blocks at most one DMA buffer, then drains for ~50 ms
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(500)) == 0)
+        Serial.println("Drain timeout; reader still busy");
+
+    // File mode callers expect a finished WAV when stop() returns. The
+    // writer only has the ring's backlog left, so this is short.
+    if (m_mode == CaptureMode::File &&
+        xSemaphoreTake(m_takeDone, pdMS_TO_TICKS(2000)) == pdTRUE)
+        xSemaphoreGive(m_takeDone);
+    m_waiterTask = nullptr;
+}
+
+void ApiClientModule::requestStop()
+{
+    if (!m_isRecording || m_stopRequested)
+        return;
+    m_tRelease = micros();
     m_stopRequested = true;
+}
 
-    // Wait (with a timeout) for the reader to say “drained”
-    const uint32_t notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(150));
-    if (notified == 0)
-    {
-        Serial.println("Drain timeout; proceeding cautiously");
-        // Worst case: try one last app-level flush
-        flushChunk();
-    }
+void ApiClientModule::setTakeCallback(TakeCallback cb, void *ctx)
+{
+    m_takeCtx = ctx;
+    m_takeCb = cb;
+}
+
+// Reader task, once the residual DMA is drained: close the capture side
+// and hand the tail over to the writer
+void ApiClientModule::finishCapture()
+{
+    m_front.finish();
 
-    // Now the reader is no longer touching I2S or the file. Safe to stop DMA.
-    i2s_stop((i2s_port_t)m_i2s_num);
-    i2s_zero_dma_buffer((i2s_port_t)m_i2s_num);
+    const uint32_t tDrained = micros();
+    m_drainUs.add(tDrained - m_tRelease);
+    if (m_tRelease != m_tStart)
+        m_captureSps.add((uint64_t)m_front.samples() * 1000000ULL / (m_tRelease - m_tStart));
 
-    // Finalize file
-    if (m_file)
-    {
-        m_file.flush();
-        writeWavHeader(m_file, m_totalSamples);
-        m_file.close();
-    }
+    // The reader is no longer touching I2S or the ring. Safe to stop DMA.
+    m_source->stop();
 
-    Serial.printf("Recording stopped. Samples: %u (~%.2fs)\n",
-                  m_totalSamples, m_totalSamples / float(m_sampleRate));
+    m_writer.captureDone();
 
-    m_waiterTask = nullptr;
+    Serial.printf("Recording stopped. Samples: %u (~%.2fs), overruns: %u, ring peak: %u\n",
+                  (unsigned)m_front.samples(), m_front.samples() / float(m_sampleRate),
+                  (unsigned)m_ring.overruns(), (unsigned)m_ring.highWater());
+
+    s_takes.add();
+    s_captureOverruns.add(m_ring.overruns());
+    s_ringPeak.set(m_ring.highWater());
+    s_agcGain.set(m_front.dsp().gain());
+    s_limitedBlocks.add(m_front.dsp().limitedBlocks());
+    if (m_front.silenceTrim())
+    {
+        const SilenceGate &gate = m_front.gate();
+        s_vadDropped.add(gate.droppedSamples());
+        Serial.printf("Silence trim: kept %u, dropped %u samples\n",
+                      (unsigned)gate.keptSamples(), (unsigned)gate.droppedSamples());
+    }
 }
 
 void ApiClientModule::readerTaskThunk(void *arg)
@@ -170,47 +283,41 @@ void ApiClientModule::readerTaskThunk(void *arg)
 
 void ApiClientModule::readerTask()
 {
-    int32_t *i2sBuf = (int32_t *)heap_caps_malloc(sizeof(int32_t) * 1024, MALLOC_CAP_8BIT);
-    if (!i2sBuf)
-    {
-        Serial.println("Failed to alloc i2sBuf");
-        vTaskDelete(nullptr);
-        return;
-    }
+    int32_t *i2sBuf = m_readBlock.as<int32_t>();
 
     for (;;)
     {
         if (!m_isRecording)
         {
-            vTaskDelay(pdMS_TO_TICKS(10));
+            // Parked until start(); no polling so the CPU can idle
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
             continue;
         }
 
         // Normal blocking read while recording
-        size_t bytesRead = 0;
-        esp_err_t err = i2s_read((i2s_port_t)m_i2s_num, (void *)i2sBuf,
-                                 sizeof(int32_t) * 1024, &bytesRead, portMAX_DELAY);
-        if (err == ESP_OK && bytesRead > 0)
+        trace::begin(TraceEvent::ReaderRead);
+        size_t got = m_source->read(i2sBuf, kReadSamples, AudioSource::kForever);
+        trace::end(TraceEvent::ReaderRead, got);
+        if (got > 0)
         {
-            processChunk(i2sBuf, bytesRead / sizeof(int32_t));
+            m_front.process(i2sBuf, got);
         }
 
         // If a stop was requested, switch to a bounded non-blocking drain
         if (m_stopRequested)
         {
+            trace::begin(TraceEvent::Stop);
             const uint32_t deadline = millis() + 50; // ~50ms to slurp residual DMA
             do
             {
-                bytesRead = 0;
-                err = i2s_read((i2s_port_t)m_i2s_num, (void *)i2sBuf,
-                               sizeof(int32_t) * 1024, &bytesRead, pdMS_TO_TICKS(2));
-                if (err != ESP_OK || bytesRead == 0)
+                got = m_source->read(i2sBuf, kReadSamples, 2);
+                if (got == 0)
                     break;
-                processChunk(i2sBuf, bytesRead / sizeof(int32_t));
+                m_front.process(i2sBuf, got);
             } while (millis() < deadline);
 
-            // Final app-buffer flush to file
-            flushChunk();
+            finishCapture();
+            trace::end(TraceEvent::Stop, m_front.samples());
             // Tell the waiter we’re fully drained
             if (m_waiterTask)
                 xTaskNotifyGive(m_waiterTask);
@@ -222,123 +329,219 @@ void ApiClientModule::readerTask()
     }
 }
 
-static inline int16_t to_int16_from_i2s32(int32_t s32)
+void ApiClientModule::writerTaskThunk(void *arg)
 {
-    // s32 is sign-extended 24-bit audio in the top bits of a 32-bit word.
-    // Shift down to leave ~15–16 useful bits with a little headroom.
-    int32_t x = s32 >> 11; // try 11–12; 11 keeps more volume, 12 more headroom
-    if (x > 32767)
-        x = 32767; // saturate, don't wrap
-    if (x < -32768)
-        x = -32768;
-    return (int16_t)x;
+    static_cast<ApiClientModule *>(arg)->writerTask();
 }
 
-void ApiClientModule::processChunk(int32_t *i2sBuf, size_t samples)
+void ApiClientModule::writerTask()
 {
-    for (size_t i = 0; i < samples; ++i)
+    for (;;)
     {
-        int32_t s = i2sBuf[i];
-        // int16_t pcm = (int16_t)(s >> 8);
-        int16_t pcm = to_int16_from_i2s32(s);
-        m_buf[m_bufIdx++] = pcm;
-        m_totalSamples++;
+        // Park until start() hands us a take; stray wakes from the last
+        // take's data notifications are ignored
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!m_takeActive)
+            continue;
 
-        if (m_bufIdx >= m_chunkSamples)
-        {
-            flushChunk();
-        }
+        const TraceEvent ev = m_mode == CaptureMode::Stream ? TraceEvent::StreamTake : TraceEvent::WriteTake;
+        trace::begin(ev);
+        const TakeWriter::Result r = m_mode == CaptureMode::Stream ? streamTake() : m_writer.writeFile();
+        trace::end(ev, r.bytes);
+        m_takeOk = r.ok;
+        m_takeQueued = r.queued;
+        m_takeActive = false;
+        xSemaphoreGive(m_takeDone);
+        m_prefetch.resume();
+        PowerManager::shared().setBusy(PowerPolicy::Recording, false);
+        if (m_takeCb)
+            m_takeCb(m_takeOk, m_takeCtx);
+    }
+}
+
+bool ApiClientModule::commitThunk(const char *path, uint32_t *seq, void *ctx)
+{
+    ApiClientModule *self = static_cast<ApiClientModule *>(ctx);
+    if (!self->m_queue.commit(path, seq))
+        return false;
+    self->m_ackSeq = *seq;
+    return true;
+}
+
+void ApiClientModule::closedThunk(void *ctx)
+{
+    static_cast<ApiClientModule *>(ctx)->noteClosed();
+}
+
+// One take: chunked POST to the inbox while recording, teed into the
+// staging file. Unless the server answers 2xx the whole file is queued
+// for the drainer, so a dropped connection costs latency, not audio.
+TakeWriter::Result ApiClientModule::streamTake()
+{
+    String host, path;
+    uint16_t port = 0;
+    const bool haveUrl = m_inboxPath && splitUrl(String(API_HOST) + String(m_inboxPath), host, port, path);
+    const TakeWriter::Result r = haveUrl ? m_writer.stream(host.c_str(), port, path.c_str())
+                                         : m_writer.stream(nullptr, 0, nullptr);
+
+    if (r.failedOver)
+        s_streamFailovers.add();
+    if (r.backlog)
+    {
+        s_spilledTakes.add();
+        Serial.printf("Sent %u backlogged bytes from SPIFFS\n", (unsigned)r.backlog);
     }
+    if (r.ok)
+        noteAck(m_encoder->headerSize() + r.bytes);
+    else if (!r.queued)
+        s_streamLost.add();
+    Serial.printf("Stream response: %d (%u bytes)%s\n", r.status, (unsigned)r.bytes,
+                  r.queued ? ", queued from SPIFFS" : "");
+    return r;
 }
 
 bool ApiClientModule::upload()
 {
+    trace::begin(TraceEvent::Upload);
     if (m_isRecording)
     {
         Serial.println("Upload called while recording; stopping first");
         stop();
     }
 
-    if (!m_inboxPath)
+    if (m_takeActive)
     {
-        Serial.println("Upload path not set! Call setInboxPath().");
-        return false;
+        // Stream mode: most of the take is already on the server, this
+        // just waits for the ack
+        xSemaphoreTake(m_takeDone, portMAX_DELAY);
+        xSemaphoreGive(m_takeDone);
     }
-
-    String url = String(API_HOST) + String(m_inboxPath);
-    Serial.print("POST ");
-    Serial.println(url);
-
-    File f = SPIFFS.open(m_outPath, FILE_READ);
-    if (!f)
+    if (m_mode == CaptureMode::Stream && m_takeOk)
     {
-        Serial.println("No WAV to upload");
-        return false;
+        trace::end(TraceEvent::Upload, 1);
+        return true;
     }
 
-    HTTPClient http;
-    http.begin(url);
-    http.addHeader("Content-Type", "audio/wav");
+    // File mode, or the stream fell back to SPIFFS: the take is in the
+    // queue and the drainer sends it oldest-first when Wi-Fi is up
+    m_queue.kick();
+    if (!m_takeQueued)
+        Serial.println("Take was not queued");
+    trace::end(TraceEvent::Upload, m_takeQueued);
+    return m_takeQueued;
+}
 
-    int httpCode = http.sendRequest("POST", &f, f.size());
-    if (httpCode > 0)
+void ApiClientModule::publishMetrics(const char *path, uint32_t periodMs)
+{
+    metrics::Registry::shared().startPublishing(String(API_HOST) + String(path), periodMs);
+}
+
+void ApiClientModule::subscribeInbox()
+{
+    if (!m_inboxPath)
     {
-        Serial.printf("Upload response: %d\n", httpCode);
-        String resp = http.getString();
-        Serial.println(resp);
+        Serial.println("Inbox path not set! Call setInboxPath().");
+        return;
     }
-    else
+    m_inbox.begin(String(API_HOST) + String(m_inboxPath) + "/events", *m_net);
+}
+
+void ApiClientModule::prefetchInbox(const MessageCache::Config &cfg)
+{
+    if (!m_inboxPath)
     {
-        Serial.printf("HTTP POST failed: %s\n", http.errorToString(httpCode).c_str());
-        http.end();
-        f.close();
-        return false;
+        Serial.println("Inbox path not set! Call setInboxPath().");
+        return;
     }
-
-    http.end();
-    f.close();
-    SPIFFS.remove(m_outPath);
-    return true;
+    m_prefetch.begin(*m_store, String(API_HOST) + String(m_inboxPath) + "/", cfg);
+    m_inbox.setPrefetcher(&m_prefetch);
 }
 
 bool ApiClientModule::checkInbox()
 {
+    // With a live subscription the server has already told us; no request
+    if (m_inbox.isConnected())
+        return m_inbox.hasMessages();
+
     String url = String(API_HOST) + String(m_inboxPath);
     Serial.print("GET ");
     Serial.println(url);
 
-    HTTPClient http;
-    http.begin(url);
-    http.addHeader("Content-Type", "audio/wav");
+    PooledRequest req(url);
 
-    int httpCode = http.sendRequest("GET");
+    int httpCode = req.send("GET");
     if (httpCode > 0)
     {
-        Serial.printf("Upload response: %d\n", httpCode);
-        String resp = http.getString();
-        // Serial.println(resp);
+        String resp = req.body();
+        const HttpTiming &t = req.timing();
+        Serial.printf("Inbox response: %d (dns %u, connect %u, exchange %u, body %u ms%s)\n",
+                      httpCode, (unsigned)t.dnsMs, (unsigned)t.connectMs,
+                      (unsigned)t.exchangeMs, (unsigned)t.transferMs, t.reused ? ", reused" : "");
 
         JsonDocument doc;
         deserializeJson(doc, resp);
-        const char *code = doc["code"];
+        const char *code = doc["code"] | "";
 
         Serial.println(code);
+        if (doc["id"].is<const char *>())
+            m_prefetch.enqueue(doc["id"]);
 
-        if (code == "EMPTY")
-        {
-            http.end();
-            return false;
-        }
-        else
-        {
-            http.end();
-            return true;
-        }
+        return strcmp(code, "EMPTY") != 0;
     }
     else
     {
-        Serial.printf("HTTP POST failed: %s\n", http.errorToString(httpCode).c_str());
-        http.end();
+        Serial.printf("HTTP GET failed: %s\n", HTTPClient::errorToString(httpCode).c_str());
         return false;
     }
 }
+
+// -------------------- bench --------------------
+void ApiClientModule::noteClosed()
+{
+    m_tClosed = micros();
+    m_releaseToClosedUs.add(m_tClosed - m_tRelease);
+}
+
+void ApiClientModule::noteAck(uint32_t bytes)
+{
+    uint32_t dt = micros() - m_tClosed;
+    m_closedToAckUs.add(dt);
+    if (dt)
+        m_uploadBps.add((uint64_t)bytes * 1000000ULL / dt);
+}
+
+// Queue drainer: only the newest take is timed, older ones were already
+// waiting when it closed
+void ApiClientModule::onSentThunk(uint32_t seq, uint32_t bytes, void *ctx)
+{
+    ApiClientModule *self = static_cast<ApiClientModule *>(ctx);
+    if (seq != self->m_ackSeq)
+        return;
+    self->m_ackSeq = UINT32_MAX;
+    self->noteAck(bytes);
+}
+
+void ApiClientModule::printBench(Print &out) const
+{
+    char drain[96], closed[96], ack[96], sps[96], bps[96];
+    m_drainUs.formatJson(drain, sizeof(drain));
+    m_releaseToClosedUs.formatJson(closed, sizeof(closed));
+    m_closedToAckUs.formatJson(ack, sizeof(ack));
+    m_captureSps.formatJson(sps, sizeof(sps));
+    m_uploadBps.formatJson(bps, sizeof(bps));
+    out.printf("{\"bench\":\"capture\",\"target\":\"esp32\",\"mode\":\"%s\",\"codec\":\"%s\",\"takes\":%u,"
+               "\"drain_us\":%s,\"release_to_closed_us\":%s,\"closed_to_ack_us\":%s,"
+               "\"capture_sps\":%s,\"upload_Bps\":%s,\"overruns\":%u}\n",
+               m_mode == CaptureMode::Stream ? "stream" : "file", m_encoder->contentType(),
+               (unsigned)m_releaseToClosedUs.total(), drain, closed, ack, sps, bps,
+               (unsigned)m_ring.overruns());
+}
+
+void ApiClientModule::resetBench()
+{
+    m_drainUs.reset();
+    m_releaseToClosedUs.reset();
+    m_closedToAckUs.reset();
+    m_captureSps.reset();
+    m_uploadBps.reset();
+}
@@ -0,0 +1,196 @@
+#include "AudioEncoder.h"
+#include "WavWriter.h"
+#include <string.h>
+
+// -------------------- WAV helpers --------------------
+static inline void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static inline void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+// RIFF size for a header of hdrBytes followed by dataBytes
+static inline uint32_t riffSize(size_t hdrBytes, uint32_t dataBytes)
+{
+    if (dataBytes == AudioEncoder::kUnknownLength)
+        return AudioEncoder::kUnknownLength;
+    return (uint32_t)(hdrBytes - 8) + dataBytes;
+}
+
+// -------------------- PCM --------------------
+void PcmEncoder::makeHeader(uint8_t *h, uint32_t sampleRate,
+                            uint32_t numSamples, uint32_t dataBytes) const
+{
+    (void)numSamples;
+    // Same builder as WavWriter; kUnknownLength saturates the RIFF size
+    const wav::Header hdr = wav::makeHeader(1, 16, sampleRate, dataBytes);
+    memcpy(h, hdr.bytes, sizeof(hdr.bytes));
+}
+
+size_t PcmEncoder::encode(const int16_t *in, size_t n, uint8_t *out)
+{
+    // ESP32 and every host we build on are little-endian, same as WAV
+    memcpy(out, in, n * sizeof(int16_t));
+    return n * sizeof(int16_t);
+}
+
+// -------------------- IMA-ADPCM --------------------
+static const int16_t kStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767};
+
+static const int8_t kIndexTable[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+void ImaAdpcmEncoder::makeHeader(uint8_t *h, uint32_t sampleRate,
+                                 uint32_t numSamples, uint32_t dataBytes) const
+{
+    memcpy(h + 0, "RIFF", 4);
+    put32(h + 4, riffSize(60, dataBytes));
+    memcpy(h + 8, "WAVE", 4);
+    memcpy(h + 12, "fmt ", 4);
+    put32(h + 16, 20);
+    put16(h + 20, 0x0011); // WAVE_FORMAT_IMA_ADPCM
+    put16(h + 22, 1);
+    put32(h + 24, sampleRate);
+    put32(h + 28, (uint32_t)((uint64_t)sampleRate * kBlockAlign / kSamplesPerBlock));
+    put16(h + 32, kBlockAlign);
+    put16(h + 34, 4);
+    put16(h + 36, 2); // cbSize
+    put16(h + 38, kSamplesPerBlock);
+    memcpy(h + 40, "fact", 4);
+    put32(h + 44, 4);
+    put32(h + 48, numSamples);
+    memcpy(h + 52, "data", 4);
+    put32(h + 56, dataBytes);
+}
+
+void ImaAdpcmEncoder::reset()
+{
+    m_pendingCount = 0;
+    m_predictor = 0;
+    m_stepIndex = 0;
+}
+
+uint8_t ImaAdpcmEncoder::encodeSample(int16_t sample)
+{
+    int32_t diff = sample - m_predictor;
+    uint8_t code = 0;
+    if (diff < 0)
+    {
+        code = 8;
+        diff = -diff;
+    }
+
+    int32_t step = kStepTable[m_stepIndex];
+    int32_t delta = step >> 3;
+    if (diff >= step)
+    {
+        code |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 1;
+        delta += step;
+    }
+
+    m_predictor += (code & 8) ? -delta : delta;
+    if (m_predictor > 32767)
+        m_predictor = 32767;
+    else if (m_predictor < -32768)
+        m_predictor = -32768;
+
+    m_stepIndex += kIndexTable[code & 7];
+    if (m_stepIndex < 0)
+        m_stepIndex = 0;
+    else if (m_stepIndex > 88)
+        m_stepIndex = 88;
+    return code;
+}
+
+// One block: 4-byte header (first sample verbatim + step index), then
+// the remaining 504 samples packed two per byte, low nibble first.
+void ImaAdpcmEncoder::encodeBlock(const int16_t *in, uint8_t *out)
+{
+    m_predictor = in[0];
+    put16(out, (uint16_t)in[0]);
+    out[2] = (uint8_t)m_stepIndex;
+    out[3] = 0;
+
+    uint8_t *p = out + 4;
+    for (size_t i = 1; i < kSamplesPerBlock; i += 2)
+    {
+        uint8_t lo = encodeSample(in[i]);
+        uint8_t hi = encodeSample(in[i + 1]);
+        *p++ = lo | (hi << 4);
+    }
+}
+
+size_t ImaAdpcmEncoder::encode(const int16_t *in, size_t n, uint8_t *out)
+{
+    size_t produced = 0;
+
+    // Top up a partial block from the previous call first
+    if (m_pendingCount > 0)
+    {
+        size_t take = kSamplesPerBlock - m_pendingCount;
+        take = take < n ? take : n;
+        memcpy(m_pending + m_pendingCount, in, take * sizeof(int16_t));
+        m_pendingCount += take;
+        in += take;
+        n -= take;
+        if (m_pendingCount < kSamplesPerBlock)
+            return 0;
+        encodeBlock(m_pending, out);
+        produced += kBlockAlign;
+        m_pendingCount = 0;
+    }
+
+    // Whole blocks straight from the caller's buffer
+    while (n >= kSamplesPerBlock)
+    {
+        encodeBlock(in, out + produced);
+        produced += kBlockAlign;
+        in += kSamplesPerBlock;
+        n -= kSamplesPerBlock;
+    }
+
+    memcpy(m_pending, in, n * sizeof(int16_t));
+    m_pendingCount = n;
+    return produced;
+}
+
+size_t ImaAdpcmEncoder::finish(uint8_t *out)
+{
+    if (m_pendingCount == 0)
+        return 0;
+    // Pad with the last sample; the fact chunk has the real length
+    int16_t last = m_pending[m_pendingCount - 1];
+    for (size_t i = m_pendingCount; i < kSamplesPerBlock; ++i)
+        m_pending[i] = last;
+    encodeBlock(m_pending, out);
+    m_pendingCount = 0;
+    return kBlockAlign;
+}
@@ -0,0 +1,128 @@
+#include "BufferPool.h"
+#include "Metrics.h"
+
+static metrics::Gauge s_poolPeak("pool_peak_blocks");
+static metrics::Counter s_poolExhausted("pool_exhausted");
+
+// -------------------- PoolBlock --------------------
+PoolBlock::PoolBlock(const PoolBlock &o) : m_pool(o.m_pool), m_idx(o.m_idx)
+{
+    if (m_pool)
+        m_pool->addRef(m_idx);
+}
+
+PoolBlock &PoolBlock::operator=(PoolBlock o) noexcept
+{
+    // Copy-and-swap: o takes our old reference with it
+    BufferPool *p = m_pool;
+    uint8_t i = m_idx;
+    m_pool = o.m_pool;
+    m_idx = o.m_idx;
+    o.m_pool = p;
+    o.m_idx = i;
+    return *this;
+}
+
+void PoolBlock::reset()
+{
+    if (m_pool)
+        m_pool->release(m_idx);
+    m_pool = nullptr;
+}
+
+uint8_t *PoolBlock::data() const
+{
+    return m_pool ? m_pool->blockData(m_idx) : nullptr;
+}
+
+size_t PoolBlock::capacity() const
+{
+    return m_pool ? BufferPool::kBlockBytes : 0;
+}
+
+size_t PoolBlock::length() const
+{
+    return m_pool ? m_pool->m_length[m_idx] : 0;
+}
+
+void PoolBlock::setLength(size_t bytes)
+{
+    if (m_pool)
+        m_pool->m_length[m_idx] = bytes < BufferPool::kBlockBytes ? bytes : BufferPool::kBlockBytes;
+}
+
+uint8_t PoolBlock::detach()
+{
+    m_pool = nullptr;
+    return m_idx;
+}
+
+// -------------------- BufferPool --------------------
+BufferPool &BufferPool::audio()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+bool BufferPool::begin(size_t blocks, Placement where)
+{
+    if (m_mem)
+        return true;
+    blocks = min(max(blocks, (size_t)1), kMaxBlocks);
+
+    if (where == Placement::PreferPsram)
+        m_mem = (uint8_t *)heap_caps_malloc(blocks * kBlockBytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    m_psram = m_mem != nullptr;
+    if (!m_mem)
+        m_mem = (uint8_t *)heap_caps_malloc(blocks * kBlockBytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!m_mem)
+    {
+        Serial.printf("[POOL] Cannot allocate %u x %u bytes\n", (unsigned)blocks, (unsigned)kBlockBytes);
+        return false;
+    }
+
+    m_blocks = blocks;
+    for (size_t i = 0; i < blocks; ++i)
+    {
+        m_refs[i].store(0, std::memory_order_relaxed);
+        m_length[i] = 0;
+    }
+    m_free.store(blocks == 32 ? 0xFFFFFFFFu : (1u << blocks) - 1, std::memory_order_release);
+    Serial.printf("[POOL] %u x %u bytes in %s\n", (unsigned)blocks, (unsigned)kBlockBytes,
+                  m_psram ? "PSRAM" : "internal RAM");
+    return true;
+}
+
+PoolBlock BufferPool::acquire()
+{
+    if (!m_mem)
+        begin();
+    uint32_t free = m_free.load(std::memory_order_acquire);
+    while (free)
+    {
+        const uint8_t idx = __builtin_ctz(free);
+        if (m_free.compare_exchange_weak(free, free & ~(1u << idx), std::memory_order_acquire))
+        {
+            m_refs[idx].store(1, std::memory_order_relaxed);
+            m_length[idx] = 0;
+            uint32_t used = m_inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+            uint32_t peak = m_peak.load(std::memory_order_relaxed);
+            while (used > peak && !m_peak.compare_exchange_weak(peak, used, std::memory_order_relaxed))
+            {
+            }
+            s_poolPeak.set(m_peak.load(std::memory_order_relaxed));
+            return PoolBlock(this, idx);
+        }
+    }
+    m_exhausted.fetch_add(1, std::memory_order_relaxed);
+    s_poolExhausted.add();
+    return PoolBlock();
+}
+
+void BufferPool::release(uint8_t idx)
+{
+    if (m_refs[idx].fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    m_inUse.fetch_sub(1, std::memory_order_relaxed);
+    m_free.fetch_or(1u << idx, std::memory_order_release);
+}
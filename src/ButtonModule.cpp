@@ -1,50 +1,82 @@
 #include "ButtonModule.h"
+#include "Metrics.h"
 
-Button::Button(uint8_t pin)
+static metrics::Histogram s_pressLatencyUs("button_press_us", {100, 250, 500, 1000, 2500, 5000, 10000});
+static metrics::Counter s_edgesLost("button_edges_lost");
+
+Button::Button(uint8_t pin, Scheduler &sched)
     : _pin(pin),
-      _stable(HIGH),
-      _lastReading(HIGH),
-      _lastChangeMs(0),
+      _sched(sched),
+      _gestures(sched, &Button::onGesture, this),
       _latchedPressed(false),
       _latchedReleased(false) {}
 
-void Button::begin()
+void Button::begin(uint16_t edgeEvent)
 {
   pinMode(_pin, INPUT_PULLUP); // assume pull-up wiring (active-low)
-  int r = digitalRead(_pin);
-  _stable = r;
-  _lastReading = r;
-  _lastChangeMs = millis();
+  _edgeEvent = edgeEvent;
+  _sched.subscribe(edgeEvent, &Button::onEdges, this);
+  // Held at boot: treat it as a press now
+  if (digitalRead(_pin) == LOW)
+    _gestures.edge(true, _sched.now());
+  attachInterruptArg(digitalPinToInterrupt(_pin), &Button::isr, this, CHANGE);
 }
 
-void Button::update()
+void Button::setCallback(GestureDetector::Callback cb, void *ctx)
 {
-  int reading = digitalRead(_pin);
+  _cbCtx = ctx;
+  _cb = cb;
+}
 
-  if (reading != _lastReading)
-  {
-    _lastReading = reading;
-    _lastChangeMs = millis();
-  }
+void IRAM_ATTR Button::isr(void *arg)
+{
+  Button *b = static_cast<Button *>(arg);
+  Edge e;
+  e.ms = millis();
+  e.us = micros();
+  e.pressed = digitalRead(b->_pin) == LOW; // active-low
+  if (b->_edges.push(&e, 1) == 0)
+    s_edgesLost.add();
+  // One post per burst of bounces: the handler drains the whole queue
+  if (!b->_posted.exchange(true) && !b->_sched.post(b->_edgeEvent))
+    b->_posted = false; // loop queue full; the next edge tries again
+}
 
-  if ((millis() - _lastChangeMs) >= DEBOUNCE_MS && reading != _stable)
+void Button::onEdges(uint16_t, uint32_t, void *ctx)
+{
+  Button *b = static_cast<Button *>(ctx);
+  b->_posted = false; // edges from here on post again
+  Edge e;
+  while (b->_edges.pop(&e, 1) == 1)
   {
-    // Debounced state change
-    bool wasPressed = (_stable == LOW); // active-low
-    bool nowPressed = (reading == LOW);
+    const bool was = b->_gestures.isPressed();
+    b->_gestures.edge(e.pressed, e.ms);
+    if (!was && b->_gestures.isPressed())
+      s_pressLatencyUs.record(micros() - e.us); // ISR -> press handled
+  }
+}
 
-    if (!wasPressed && nowPressed)
-      _latchedPressed = true;
-    if (wasPressed && !nowPressed)
-      _latchedReleased = true;
+void Button::onGesture(Gesture g, uint32_t at, void *ctx)
+{
+  Button *b = static_cast<Button *>(ctx);
+  if (g == Gesture::Press)
+    b->_latchedPressed = true;
+  else if (g == Gesture::Release)
+    b->_latchedReleased = true;
+  if (b->_cb)
+    b->_cb(g, at, b->_cbCtx);
+}
 
-    _stable = reading;
-  }
+void Button::resync()
+{
+  const bool pressed = digitalRead(_pin) == LOW;
+  if (pressed != _gestures.isPressed())
+    _gestures.edge(pressed, _sched.now());
 }
 
 bool Button::isPressed() const
 {
-  return (_stable == LOW); // active-low => LOW means pressed
+  return _gestures.isPressed();
 }
 
 bool Button::wasPressed()
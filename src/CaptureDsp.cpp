@@ -0,0 +1,132 @@
+#include "CaptureDsp.h"
+#include <math.h>
+
+void CaptureDsp::begin(uint32_t sampleRate)
+{
+    // RBJ cookbook high-pass, Q = 1/sqrt(2). Float only here, once.
+    if (m_cfg.hpfHz > 0 && sampleRate > 4u * m_cfg.hpfHz)
+    {
+        const double w = 2.0 * M_PI * m_cfg.hpfHz / sampleRate;
+        const double alpha = sin(w) / (2.0 * M_SQRT1_2);
+        const double a0 = 1.0 + alpha;
+        const double q30 = (double)(1 << 30);
+        m_b0 = (int32_t)lround((1.0 + cos(w)) / 2.0 / a0 * q30);
+        m_a1 = (int32_t)lround(-2.0 * cos(w) / a0 * q30); // |a1| < 2 fits Q30
+        m_a2 = (int32_t)lround((1.0 - alpha) / a0 * q30);
+    }
+    else
+    {
+        // Pass-through: y = x
+        m_b0 = 1 << 30;
+        m_a1 = m_a2 = 0;
+    }
+    reset();
+}
+
+void CaptureDsp::reset()
+{
+    m_dc = 0;
+    m_x1 = m_x2 = m_y1 = m_y2 = 0;
+    m_err = 0;
+    m_env = 0;
+    m_gain = m_cfg.initialGain;
+    m_limited = 0;
+}
+
+void CaptureDsp::process(const int32_t *in, int16_t *out, size_t n)
+{
+    while (n > 0)
+    {
+        size_t k = n < kBlockSamples ? n : kBlockSamples;
+        block(in, out, k);
+        in += k;
+        out += k;
+        n -= k;
+    }
+}
+
+static inline int16_t sat16(int32_t x)
+{
+    x = x < -32768 ? -32768 : x;
+    x = x > 32767 ? 32767 : x;
+    return (int16_t)x;
+}
+
+void CaptureDsp::block(const int32_t *in, int16_t *out, size_t n)
+{
+    // Pass 1: DC blocker + high-pass into scratch, tracking the peak
+    const bool bypass = m_a1 == 0;
+    int32_t dc = m_dc, x1 = m_x1, x2 = m_x2, y1 = m_y1, y2 = m_y2;
+    int64_t err = m_err;
+    uint32_t peak = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        int32_t x = in[i] >> 8; // 24-bit sample
+        dc += ((x << 6) - dc) >> 10; // ~2.5 Hz pole at 16 kHz
+        x -= dc >> 6;
+
+        int32_t y = x;
+        if (!bypass)
+        {
+            // b1 = -2*b0, b2 = b0: one multiply for the feed-forward side
+            int64_t acc = (int64_t)m_b0 * (x - 2 * x1 + x2) - (int64_t)m_a1 * y1 - (int64_t)m_a2 * y2 + err;
+            y = (int32_t)(acc >> 30);
+            err = acc - ((int64_t)y << 30); // keep the truncated bits
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+        }
+        m_scratch[i] = y;
+        uint32_t a = (uint32_t)(y < 0 ? -y : y);
+        peak = a > peak ? a : peak;
+    }
+    m_dc = dc;
+    m_x1 = x1;
+    m_x2 = x2;
+    m_y1 = y1;
+    m_y2 = y2;
+    m_err = err;
+
+    // Gain for the end of this block
+    uint32_t g0 = m_gain, g1 = m_gain;
+    if (m_cfg.agc)
+    {
+        // Envelope: instant attack, ~250 ms release
+        m_env = peak > m_env ? peak : m_env - ((m_env - peak) >> 4);
+        if (m_env > m_cfg.gateLevel)
+        {
+            uint64_t want = ((uint64_t)m_cfg.targetPeak << 24) / m_env;
+            want = want < m_cfg.minGain ? m_cfg.minGain : want;
+            want = want > m_cfg.maxGain ? m_cfg.maxGain : want;
+            // Down fast, up slowly (~0.5 s) so pauses don't pump the noise
+            if (want < g1)
+                g1 -= (g1 - (uint32_t)want) >> 1;
+            else
+                g1 += ((uint32_t)want - g1) >> 5;
+        }
+    }
+
+    // Limiter: nothing in this block may exceed limitPeak after gain
+    if (peak > 0)
+    {
+        uint64_t ceiling = ((uint64_t)m_cfg.limitPeak << 24) / peak;
+        if (g1 > ceiling)
+            g1 = (uint32_t)ceiling;
+        if (g0 > ceiling)
+        {
+            g0 = (uint32_t)ceiling;
+            m_limited++;
+        }
+    }
+    m_gain = g1;
+
+    // Pass 2: ramp the gain across the block and saturate
+    int32_t g = (int32_t)g0;
+    const int32_t step = ((int32_t)g1 - (int32_t)g0) / (int32_t)n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i] = sat16((int32_t)(((int64_t)m_scratch[i] * g) >> 24));
+        g += step;
+    }
+}
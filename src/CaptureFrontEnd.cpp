@@ -0,0 +1,87 @@
+#include "CaptureFrontEnd.h"
+
+CaptureFrontEnd::CaptureFrontEnd(CaptureRing &ring, ChunkCallback cb, void *ctx, MicrosFn nowUs)
+    : m_ring(ring), m_cb(cb), m_ctx(ctx), m_nowUs(nowUs) {}
+
+void CaptureFrontEnd::begin(uint32_t sampleRate, int16_t *chunk, size_t chunkSamples)
+{
+    m_sampleRate = sampleRate;
+    m_chunk = chunk;
+    m_chunkSamples = chunkSamples;
+    m_dsp.begin(sampleRate);
+}
+
+void CaptureFrontEnd::setDsp(const CaptureDsp::Config &cfg)
+{
+    m_dsp = CaptureDsp(cfg);
+    m_dsp.begin(m_sampleRate);
+}
+
+void CaptureFrontEnd::reset()
+{
+    m_dsp.reset();
+    m_gate.reset();
+    m_chunkLen = 0;
+    m_samples = 0;
+    m_dropped = 0;
+}
+
+void CaptureFrontEnd::process(const int32_t *raw, size_t n)
+{
+    while (n > 0 && m_chunk)
+    {
+        size_t k = m_chunkSamples - m_chunkLen;
+        if (k > n)
+            k = n;
+        m_dsp.process(raw, m_chunk + m_chunkLen, k);
+        m_chunkLen += k;
+        m_samples += k;
+        raw += k;
+        n -= k;
+
+        if (m_chunkLen >= m_chunkSamples)
+            flushChunk();
+    }
+}
+
+void CaptureFrontEnd::finish()
+{
+    flushChunk();
+    if (m_trimSilence)
+        m_gate.finish();
+}
+
+void CaptureFrontEnd::flushChunk()
+{
+    if (m_chunkLen == 0)
+        return;
+    uint32_t gateUs = 0;
+    if (m_trimSilence)
+    {
+        // Budget: well under a chunk period (64 ms for 1024 samples)
+        const uint32_t t0 = m_nowUs ? m_nowUs() : 0;
+        m_gate.process(m_chunk, m_chunkLen);
+        gateUs = m_nowUs ? m_nowUs() - t0 : 0;
+    }
+    else
+    {
+        push(m_chunk, m_chunkLen);
+    }
+    if (m_cb)
+        m_cb(m_chunkLen, m_dropped, gateUs, m_ctx);
+    m_chunkLen = 0;
+    m_dropped = 0;
+}
+
+void CaptureFrontEnd::gateEmitThunk(const int16_t *samples, size_t n, void *ctx)
+{
+    static_cast<CaptureFrontEnd *>(ctx)->push(samples, n);
+}
+
+// A full ring means the writer fell a whole second behind (a flash
+// stall, or a Wi-Fi stall it couldn't back up around); the ring counts
+// the dropped samples as overruns
+void CaptureFrontEnd::push(const int16_t *samples, size_t n)
+{
+    m_dropped += n - m_ring.push(samples, n);
+}
@@ -0,0 +1,70 @@
+#include "ChunkedReader.h"
+#include <stdlib.h>
+
+// One line without the CRLF; what doesn't fit is read and dropped.
+// False if the source ends first.
+bool ChunkedReader::readLine(char *line, size_t cap)
+{
+    size_t len = 0;
+    for (;;)
+    {
+        uint8_t c;
+        if (m_src.read(&c, 1) != 1)
+            return false;
+        if (c == '\n')
+            break;
+        if (c != '\r' && len < cap - 1)
+            line[len++] = (char)c;
+    }
+    line[len] = '\0';
+    return true;
+}
+
+// Size line of the next chunk; the last one (size 0) also takes the
+// trailers up to the blank line that ends the body
+bool ChunkedReader::nextChunk()
+{
+    char line[64];
+    if (!readLine(line, sizeof(line)))
+        return false;
+    char *end;
+    const unsigned long size = strtoul(line, &end, 16);
+    if (end == line || (*end && *end != ';' && *end != ' ' && *end != '\t'))
+        return false;
+    m_left = (uint32_t)size;
+    if (m_left > 0)
+    {
+        m_state = State::Data;
+        return true;
+    }
+    do
+    {
+        if (!readLine(line, sizeof(line)))
+            return false;
+    } while (line[0]);
+    m_state = State::Ended;
+    return true;
+}
+
+size_t ChunkedReader::read(uint8_t *dst, size_t len)
+{
+    if (m_state == State::Size && !nextChunk())
+        m_state = State::Failed;
+    if (m_state != State::Data || len == 0)
+        return 0;
+
+    const size_t n = m_src.read(dst, len < m_left ? len : m_left);
+    if (n == 0)
+    {
+        m_state = State::Failed;
+        return 0;
+    }
+    m_left -= n;
+    if (m_left == 0)
+    {
+        // CRLF after the data, then the next size line on the next read
+        char line[4];
+        m_state = readLine(line, sizeof(line)) && !line[0] ? State::Size : State::Failed;
+    }
+    return n;
+}
@@ -0,0 +1,394 @@
+#include "EspHal.h"
+#include "Metrics.h"
+#include <esp_netif.h>
+#include <esp_random.h>
+#include <time.h>
+
+// DMA buffers the reader didn't collect in time
+static metrics::Counter s_rxOverflow("i2s_rx_overflow");
+static metrics::Histogram s_spiffsWriteUs("spiffs_write_us",
+                                          {250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000});
+
+// -------------------- I2S mic --------------------
+I2sMicSource::I2sMicSource(int i2s_num, int sck_pin, int ws_pin, int sd_pin)
+    : m_i2s_num(i2s_num), m_sck_pin(sck_pin), m_ws_pin(ws_pin), m_sd_pin(sd_pin) {}
+
+void I2sMicSource::setDmaBuffers(int count, int len)
+{
+    m_dmaBufCount = count;
+    m_dmaBufLen = len;
+}
+
+bool I2sMicSource::begin(uint32_t sampleRate)
+{
+    m_sampleRate = sampleRate;
+    i2s_config_t cfg = {
+        .mode = static_cast<i2s_mode_t>(I2S_MODE_MASTER | I2S_MODE_RX),
+        .sample_rate = m_sampleRate,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT, // INMP441 records 24-bit inside of 32-bit frames
+        .channel_format = I2S_CHANNEL_FMT_ONLY_RIGHT, // flipped because of bug in the library
+        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = m_dmaBufCount,
+        .dma_buf_len = m_dmaBufLen,
+        .use_apll = false,
+        .tx_desc_auto_clear = false,
+        .fixed_mclk = 0};
+
+    i2s_pin_config_t pins = {
+        .bck_io_num = m_sck_pin,
+        .ws_io_num = m_ws_pin,
+        .data_out_num = I2S_PIN_NO_CHANGE,
+        .data_in_num = m_sd_pin};
+
+    if (i2s_driver_install((i2s_port_t)m_i2s_num, &cfg, 8, &m_events) != ESP_OK)
+        return false;
+    i2s_set_pin((i2s_port_t)m_i2s_num, &pins);
+
+    // Ensure exact mono/32-bit clock setup
+    i2s_set_clk((i2s_port_t)m_i2s_num, m_sampleRate,
+                I2S_BITS_PER_SAMPLE_32BIT, I2S_CHANNEL_MONO);
+    return true;
+}
+
+void I2sMicSource::start()
+{
+    // Reset DMA state for a fresh take and re-assert exact clocking
+    // each time (avoids drift after Wi-Fi)
+    i2s_zero_dma_buffer((i2s_port_t)m_i2s_num);
+    i2s_set_clk((i2s_port_t)m_i2s_num, m_sampleRate,
+                I2S_BITS_PER_SAMPLE_32BIT, I2S_CHANNEL_MONO);
+    i2s_start((i2s_port_t)m_i2s_num);
+}
+
+void I2sMicSource::stop()
+{
+    i2s_stop((i2s_port_t)m_i2s_num);
+    i2s_zero_dma_buffer((i2s_port_t)m_i2s_num);
+}
+
+size_t I2sMicSource::read(int32_t *dst, size_t n, uint32_t timeoutMs)
+{
+    i2s_event_t ev;
+    while (m_events && xQueueReceive(m_events, &ev, 0) == pdTRUE)
+        if (ev.type == I2S_EVENT_RX_Q_OVF)
+            s_rxOverflow.add();
+
+    size_t bytesRead = 0;
+    TickType_t ticks = timeoutMs == kForever ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    if (i2s_read((i2s_port_t)m_i2s_num, (void *)dst, n * sizeof(int32_t), &bytesRead, ticks) != ESP_OK)
+        return 0;
+    return bytesRead / sizeof(int32_t);
+}
+
+// -------------------- I2S speaker --------------------
+I2sSpeakerSink::I2sSpeakerSink(int i2s_num, int bck_pin, int ws_pin, int data_pin)
+    : m_i2s_num(i2s_num), m_bck_pin(bck_pin), m_ws_pin(ws_pin), m_data_pin(data_pin) {}
+
+void I2sSpeakerSink::setDmaBuffers(int count, int len)
+{
+    m_dmaBufCount = count;
+    m_dmaBufLen = len;
+}
+
+bool I2sSpeakerSink::begin(uint32_t sampleRate)
+{
+    const i2s_config_t i2s_config = {
+        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
+        .sample_rate = sampleRate,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT, // we will send 16-bit stereo frames
+        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT, // interleaved stereo
+        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = m_dmaBufCount,
+        .dma_buf_len = m_dmaBufLen,
+        .use_apll = false,
+        .tx_desc_auto_clear = true}; // DMA plays silence, not stale data, if we fall behind
+
+    if (i2s_driver_install((i2s_port_t)m_i2s_num, &i2s_config, 0, NULL) != ESP_OK)
+        return false;
+
+    const i2s_pin_config_t pins = {
+        .bck_io_num = m_bck_pin,
+        .ws_io_num = m_ws_pin,
+        .data_out_num = m_data_pin,
+        .data_in_num = I2S_PIN_NO_CHANGE};
+    i2s_set_pin((i2s_port_t)m_i2s_num, &pins);
+    i2s_stop((i2s_port_t)m_i2s_num);
+    return true;
+}
+
+void I2sSpeakerSink::setSampleRate(uint32_t sampleRate)
+{
+    i2s_set_sample_rates((i2s_port_t)m_i2s_num, sampleRate);
+}
+
+void I2sSpeakerSink::start()
+{
+    i2s_zero_dma_buffer((i2s_port_t)m_i2s_num);
+    i2s_start((i2s_port_t)m_i2s_num);
+}
+
+void I2sSpeakerSink::stop()
+{
+    i2s_stop((i2s_port_t)m_i2s_num);
+}
+
+size_t I2sSpeakerSink::write(const int16_t *frames, size_t n)
+{
+    size_t wrote = 0;
+    i2s_write((i2s_port_t)m_i2s_num, (const void *)frames, n * 2 * sizeof(int16_t), &wrote, portMAX_DELAY);
+    return wrote / (2 * sizeof(int16_t));
+}
+
+// -------------------- SPIFFS --------------------
+namespace
+{
+    class SpiffsFile : public StoredFile
+    {
+    public:
+        explicit SpiffsFile(File f) : m_f(f) {}
+        ~SpiffsFile() override { m_f.close(); }
+
+        size_t read(uint8_t *dst, size_t len) override { return m_f.read(dst, len); }
+        size_t write(const uint8_t *src, size_t len) override
+        {
+            uint32_t t0 = micros();
+            size_t n = m_f.write(src, len);
+            s_spiffsWriteUs.record(micros() - t0);
+            return n;
+        }
+        bool seek(uint32_t pos) override { return m_f.seek(pos, SeekSet); }
+        uint32_t size() override { return m_f.size(); }
+        void flush() override { m_f.flush(); }
+
+    private:
+        File m_f;
+    };
+
+    class WifiConnection : public NetConnection
+    {
+    public:
+        size_t read(uint8_t *dst, size_t len) override
+        {
+            int n = m_client.read(dst, len);
+            return n > 0 ? (size_t)n : 0;
+        }
+        size_t write(const uint8_t *src, size_t len) override { return m_client.write(src, len); }
+        bool connected() override { return m_client.connected(); }
+        int available() override { return m_client.available(); }
+        void close() override { m_client.stop(); }
+
+        WiFiClient m_client;
+    };
+}
+
+SpiffsStore &SpiffsStore::shared()
+{
+    static SpiffsStore store;
+    return store;
+}
+
+std::unique_ptr<StoredFile> SpiffsStore::open(const char *path, OpenMode mode)
+{
+    const char *m = mode == OpenMode::Read ? FILE_READ : mode == OpenMode::Write ? FILE_WRITE
+                                                                                 : FILE_APPEND;
+    File f = SPIFFS.open(path, m);
+    if (!f)
+        return nullptr;
+    return std::unique_ptr<StoredFile>(new SpiffsFile(f));
+}
+
+void SpiffsStore::list(const char *dir, ListCallback cb, void *ctx)
+{
+    // SPIFFS is flat: this walks the names under the "<dir>/" prefix
+    File d = SPIFFS.open(dir);
+    for (File f = d.openNextFile(); f; f = d.openNextFile())
+    {
+        String path = f.path();
+        f.close();
+        cb(path.c_str(), ctx);
+    }
+}
+
+// -------------------- Wi-Fi --------------------
+EspWifiDriver &EspWifiDriver::shared()
+{
+    static EspWifiDriver driver;
+    return driver;
+}
+
+void EspWifiDriver::setEventCallback(EventCallback cb, void *ctx)
+{
+    m_ctx = ctx;
+    m_cb = cb;
+    if (!m_registered)
+    {
+        WiFi.onEvent(onArduinoEvent);
+        m_registered = true;
+    }
+}
+
+void EspWifiDriver::onArduinoEvent(arduino_event_id_t event, arduino_event_info_t info)
+{
+    EspWifiDriver &d = shared();
+    if (!d.m_cb)
+        return;
+    switch (event)
+    {
+    case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+        d.m_cb(Event::Associated, 0, d.m_ctx);
+        break;
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        if (d.m_renewing)
+        {
+            // lwIP answers a NAK with a fresh DISCOVER, so a new address
+            // is still a lease from DHCP: it is saved like a renewed one
+            d.m_renewing = false;
+            d.m_cb(Event::LeaseRenewed, 0, d.m_ctx);
+        }
+        else
+        {
+            d.m_cb(Event::GotIp, 0, d.m_ctx);
+        }
+        break;
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        if (d.m_renewing)
+        {
+            d.m_renewing = false;
+            d.m_cb(Event::LeaseRefused, 0, d.m_ctx);
+        }
+        break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        d.m_renewing = false;
+        d.m_cb(Event::Disconnected, info.wifi_sta_disconnected.reason, d.m_ctx);
+        break;
+    default:
+        break;
+    }
+}
+
+void EspWifiDriver::connect(const char *ssid, const char *password, const uint8_t *bssid, uint8_t channel,
+                            const WifiIpConfig *ip)
+{
+    WiFi.persistent(false); // a flash write per begin() otherwise
+    WiFi.setAutoReconnect(false);
+    WiFi.mode(WIFI_STA);
+    if (ip)
+        WiFi.config(IPAddress(ip->ip), IPAddress(ip->gateway), IPAddress(ip->netmask), IPAddress(ip->dns));
+    else
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // DHCP
+    WiFi.begin(ssid, password, channel, bssid, true);
+}
+
+void EspWifiDriver::disconnect()
+{
+    WiFi.disconnect(false);
+}
+
+void EspWifiDriver::renewLease()
+{
+    // Hand the interface back to the DHCP client: it asks for the address
+    // it holds (CONFIG_LWIP_DHCP_RESTORE_LAST_IP) and reports GOT_IP. The
+    // address is unset until the ACK, so this runs straight after GotIp,
+    // before anything has a socket open.
+    m_renewing = true;
+    esp_netif_dhcpc_start(esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"));
+}
+
+void EspWifiDriver::link(uint8_t bssid[6], uint8_t &channel, WifiIpConfig &ip)
+{
+    const uint8_t *b = WiFi.BSSID();
+    if (b)
+        memcpy(bssid, b, 6);
+    channel = WiFi.channel();
+    ip.ip = WiFi.localIP();
+    ip.gateway = WiFi.gatewayIP();
+    ip.netmask = WiFi.subnetMask();
+    ip.dns = WiFi.dnsIP();
+}
+
+// Tells lease timestamps from this power-up apart from older ones
+static RTC_DATA_ATTR uint32_t s_clockEpoch = 0;
+
+NvsWifiCache &NvsWifiCache::shared()
+{
+    static NvsWifiCache cache;
+    return cache;
+}
+
+bool NvsWifiCache::load(WifiCache &out, uint32_t &leaseAgeS)
+{
+    if (!s_clockEpoch)
+        s_clockEpoch = esp_random() | 1;
+    m_prefs.begin("wifi", true);
+    const bool ok = m_prefs.getBytesLength("cache") == sizeof(out) && m_prefs.getBytes("cache", &out, sizeof(out));
+    const uint32_t epoch = m_prefs.getUInt("epoch", 0);
+    const uint32_t leaseAt = m_prefs.getUInt("leaseAt", 0);
+    m_prefs.end();
+    const uint32_t now = (uint32_t)time(nullptr);
+    leaseAgeS = epoch == s_clockEpoch && now >= leaseAt ? now - leaseAt : UINT32_MAX;
+    return ok;
+}
+
+void NvsWifiCache::save(const WifiCache &cache, bool newLease)
+{
+    if (!s_clockEpoch)
+        s_clockEpoch = esp_random() | 1;
+    m_prefs.begin("wifi", false);
+    m_prefs.putBytes("cache", &cache, sizeof(cache));
+    if (newLease)
+    {
+        m_prefs.putUInt("epoch", s_clockEpoch);
+        m_prefs.putUInt("leaseAt", (uint32_t)time(nullptr));
+    }
+    m_prefs.end();
+}
+
+void NvsWifiCache::clear()
+{
+    m_prefs.begin("wifi", false);
+    m_prefs.clear();
+    m_prefs.end();
+}
+
+WifiTransport &WifiTransport::shared()
+{
+    static WifiTransport transport;
+    return transport;
+}
+
+std::unique_ptr<NetConnection> WifiTransport::connect(const char *host, uint16_t port)
+{
+    std::unique_ptr<WifiConnection> c(new WifiConnection());
+    if (!c->m_client.connect(host, port))
+        return nullptr;
+    return c;
+}
+
+// -------------------- scheduler clock --------------------
+void TaskClock::waitMs(uint32_t ms)
+{
+    m_waiter = xTaskGetCurrentTaskHandle();
+    // pdMS_TO_TICKS overflows past ~71 minutes; nothing here waits that long
+    ulTaskNotifyTake(pdTRUE, ms == kForever ? portMAX_DELAY : pdMS_TO_TICKS(ms < 3600000 ? ms : 3600000));
+}
+
+void TaskClock::wake()
+{
+    // Before the first wait there is nobody to wake; the loop checks the
+    // queue before it blocks anyway
+    TaskHandle_t t = m_waiter;
+    if (!t)
+        return;
+    if (xPortInIsrContext())
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(t, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+    else
+    {
+        xTaskNotifyGive(t);
+    }
+}
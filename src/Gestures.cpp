@@ -0,0 +1,162 @@
+#include "Gestures.h"
+
+static inline bool before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+static void earliest(bool on, uint32_t t, bool &any, uint32_t &at)
+{
+    if (on && (!any || before(t, at)))
+    {
+        at = t;
+        any = true;
+    }
+}
+
+const char *gestureName(Gesture g)
+{
+    switch (g)
+    {
+    case Gesture::Press:
+        return "press";
+    case Gesture::Release:
+        return "release";
+    case Gesture::Click:
+        return "click";
+    case Gesture::DoubleTap:
+        return "double_tap";
+    case Gesture::HoldStart:
+        return "hold_start";
+    case Gesture::HoldEnd:
+        return "hold_end";
+    case Gesture::LongPress:
+        return "long_press";
+    }
+    return "?";
+}
+
+GestureDetector::GestureDetector(Scheduler &sched, Callback cb, void *ctx)
+    : m_sched(sched), m_timer(&GestureDetector::timerThunk, this), m_cb(cb), m_ctx(ctx) {}
+
+void GestureDetector::edge(bool pressed, uint32_t at)
+{
+    // Deadlines that passed before this edge happened come first, even if
+    // their timer hasn't run yet
+    advance(at);
+    m_raw = pressed;
+    if (m_locked || pressed == m_stable)
+        m_bounces++;
+    else
+    {
+        setStable(pressed, at);
+        m_locked = true;
+        m_unlockAt = at + m_cfg.debounceMs;
+    }
+    arm();
+}
+
+void GestureDetector::timerThunk(SchedTimer &, void *ctx)
+{
+    GestureDetector *g = static_cast<GestureDetector *>(ctx);
+    g->advance(g->m_sched.now());
+    g->arm();
+}
+
+void GestureDetector::advance(uint32_t now)
+{
+    uint32_t at;
+    while (nextDeadline(at) && !before(now, at))
+        fire(at);
+}
+
+bool GestureDetector::nextDeadline(uint32_t &at) const
+{
+    bool any = false;
+    earliest(m_locked, m_unlockAt, any, at);
+    earliest(m_stable && !m_holding, m_downAt + m_cfg.holdMs, any, at);
+    earliest(m_stable && m_holding && !m_longSent, m_downAt + m_cfg.longPressMs, any, at);
+    earliest(!m_stable && m_tapPending, m_tapDeadline, any, at);
+    return any;
+}
+
+void GestureDetector::fire(uint32_t at)
+{
+    if (m_locked && !before(at, m_unlockAt))
+    {
+        m_locked = false;
+        if (m_raw != m_stable)
+        {
+            // The level moved while we weren't looking: apply it now and
+            // debounce that edge too
+            setStable(m_raw, at);
+            m_locked = true;
+            m_unlockAt = at + m_cfg.debounceMs;
+        }
+    }
+    else if (m_stable && !m_holding && !before(at, m_downAt + m_cfg.holdMs))
+    {
+        // A tap followed by a hold is a click, then hold-to-talk
+        if (m_tapPending)
+            emit(Gesture::Click, at);
+        m_tapPending = false;
+        m_holding = true;
+        emit(Gesture::HoldStart, at);
+    }
+    else if (m_stable && m_holding && !m_longSent && !before(at, m_downAt + m_cfg.longPressMs))
+    {
+        m_longSent = true;
+        emit(Gesture::LongPress, at);
+    }
+    else if (!m_stable && m_tapPending && !before(at, m_tapDeadline))
+    {
+        m_tapPending = false;
+        emit(Gesture::Click, at);
+    }
+}
+
+void GestureDetector::setStable(bool pressed, uint32_t at)
+{
+    m_stable = pressed;
+    if (pressed)
+    {
+        m_downAt = at;
+        m_holding = false;
+        m_longSent = false;
+        emit(Gesture::Press, at);
+        return;
+    }
+
+    emit(Gesture::Release, at);
+    if (m_holding)
+    {
+        m_holding = false;
+        emit(Gesture::HoldEnd, at);
+    }
+    else if (at - m_downAt <= m_cfg.debounceMs)
+    {
+        // Down for less than the debounce window: a glitch, not a tap
+    }
+    else if (m_tapPending)
+    {
+        m_tapPending = false;
+        emit(Gesture::DoubleTap, at);
+    }
+    else
+    {
+        m_tapPending = true;
+        m_tapDeadline = at + m_cfg.doubleTapMs;
+    }
+}
+
+void GestureDetector::arm()
+{
+    uint32_t at;
+    if (!nextDeadline(at))
+    {
+        m_sched.stopTimer(m_timer);
+        return;
+    }
+    const uint32_t now = m_sched.now();
+    m_sched.startTimer(m_timer, before(now, at) ? at - now : 0);
+}
@@ -0,0 +1,189 @@
+#include "HttpConnectionPool.h"
+#include "NetUtil.h"
+
+HttpConnectionPool &HttpConnectionPool::shared()
+{
+    static HttpConnectionPool pool;
+    return pool;
+}
+
+HttpConnectionPool::HttpConnectionPool()
+{
+    m_lock = xSemaphoreCreateMutex();
+}
+
+void HttpConnectionPool::configure(size_t maxSockets, uint32_t idleTimeoutMs)
+{
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    m_maxSockets = min(max(maxSockets, (size_t)1), kMaxSockets);
+    m_idleTimeoutMs = idleTimeoutMs;
+    xSemaphoreGive(m_lock);
+}
+
+void HttpConnectionPool::reapIdle(uint32_t now)
+{
+    for (size_t i = 0; i < kMaxSockets; ++i)
+    {
+        Slot &s = m_slots[i];
+        if (s.inUse || s.host.length() == 0)
+            continue;
+        if (i >= m_maxSockets || now - s.lastUsedMs > m_idleTimeoutMs || !s.client.connected())
+        {
+            s.client.stop();
+            s.host = "";
+        }
+    }
+}
+
+WiFiClient *HttpConnectionPool::acquire(const String &host, uint16_t port, int &slot, HttpTiming &t)
+{
+    const uint32_t now = millis();
+    slot = -1;
+
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    reapIdle(now);
+
+    // Prefer a live socket to the same host, else an empty slot, else
+    // recycle the least recently used idle one
+    int empty = -1, lru = -1;
+    for (size_t i = 0; i < m_maxSockets; ++i)
+    {
+        Slot &s = m_slots[i];
+        if (s.inUse)
+            continue;
+        if (s.host.length() && s.port == port && s.host == host)
+        {
+            slot = i;
+            break;
+        }
+        if (s.host.length() == 0 && empty < 0)
+            empty = i;
+        else if (s.host.length() && (lru < 0 || s.lastUsedMs < m_slots[lru].lastUsedMs))
+            lru = i;
+    }
+    if (slot < 0)
+        slot = empty >= 0 ? empty : lru;
+    if (slot < 0)
+    {
+        xSemaphoreGive(m_lock);
+        return nullptr;
+    }
+
+    Slot &s = m_slots[slot];
+    s.inUse = true;
+    bool reuse = s.host == host && s.port == port;
+    if (!reuse)
+    {
+        s.client.stop();
+        s.host = host;
+        s.port = port;
+    }
+    xSemaphoreGive(m_lock);
+
+    t.reused = reuse;
+    if (reuse)
+        return &s.client;
+
+    // New socket: time DNS and TCP separately
+    uint32_t t0 = millis();
+    if (!WiFi.hostByName(host.c_str(), s.ip))
+    {
+        release(slot, false);
+        slot = -1;
+        return nullptr;
+    }
+    uint32_t t1 = millis();
+    bool connected = s.client.connect(s.ip, port);
+    uint32_t t2 = millis();
+    t.dnsMs = t1 - t0;
+    t.connectMs = t2 - t1;
+    if (!connected)
+    {
+        release(slot, false);
+        slot = -1;
+        return nullptr;
+    }
+    return &s.client;
+}
+
+void HttpConnectionPool::release(int slot, bool keepAlive)
+{
+    if (slot < 0 || slot >= (int)kMaxSockets)
+        return;
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    Slot &s = m_slots[slot];
+    if (!keepAlive || !s.client.connected())
+    {
+        s.client.stop();
+        s.host = "";
+    }
+    s.lastUsedMs = millis();
+    s.inUse = false;
+    xSemaphoreGive(m_lock);
+}
+
+void HttpConnectionPool::closeAll()
+{
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    for (size_t i = 0; i < kMaxSockets; ++i)
+    {
+        if (m_slots[i].inUse)
+            continue;
+        m_slots[i].client.stop();
+        m_slots[i].host = "";
+    }
+    xSemaphoreGive(m_lock);
+}
+
+// -------------------- PooledRequest --------------------
+PooledRequest::PooledRequest(const String &url, uint32_t timeoutMs)
+{
+    String host, path;
+    uint16_t port = 0;
+    if (splitUrl(url, host, port, path))
+        m_client = HttpConnectionPool::shared().acquire(host, port, m_slot, m_timing);
+    if (!m_client)
+        m_client = &m_own; // HTTPClient connects it itself
+
+    m_http.setReuse(true);
+    m_http.setTimeout(timeoutMs);
+    m_began = m_http.begin(*m_client, url);
+}
+
+PooledRequest::~PooledRequest()
+{
+    // With setReuse(true) end() leaves a keep-alive socket open
+    m_http.end();
+    if (m_slot >= 0)
+        HttpConnectionPool::shared().release(m_slot, m_client->connected());
+}
+
+int PooledRequest::finishSend(uint32_t t0, int httpCode)
+{
+    m_timing.exchangeMs = millis() - t0;
+    return httpCode;
+}
+
+int PooledRequest::send(const char *method, const String &payload)
+{
+    if (!m_began)
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    uint32_t t0 = millis();
+    return finishSend(t0, m_http.sendRequest(method, payload));
+}
+
+int PooledRequest::send(const char *method, Stream *body, size_t len)
+{
+    if (!m_began)
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    uint32_t t0 = millis();
+    return finishSend(t0, m_http.sendRequest(method, body, len));
+}
+
+String PooledRequest::body()
+{
+    uint32_t t0 = millis();
+    String s = m_http.getString();
+    m_timing.transferMs = millis() - t0;
+    return s;
+}
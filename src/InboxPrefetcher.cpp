@@ -0,0 +1,226 @@
+#include "InboxPrefetcher.h"
+#include <WiFi.h>
+#include "HttpConnectionPool.h"
+#include "PowerManager.h"
+#include "Metrics.h"
+
+static metrics::Counter s_prefetched("prefetch_ok");
+static metrics::Counter s_prefetchFail("prefetch_fail");
+static metrics::Counter s_cacheHits("msg_cache_hits");
+static metrics::Counter s_cacheMisses("msg_cache_misses");
+static metrics::Gauge s_cacheBytes("msg_cache_bytes");
+
+void InboxPrefetcher::begin(FileStore &store, const String &messageUrl, const MessageCache::Config &cfg)
+{
+    if (m_task)
+        return;
+    m_url = messageUrl;
+    m_lock = xSemaphoreCreateMutex();
+    m_cache.reset(new MessageCache(store));
+    m_cache->setConfig(cfg);
+    m_cache->begin();
+    s_cacheBytes.set(m_cache->bytes());
+    Serial.printf("[FETCH] %u cached messages (%u bytes)\n", (unsigned)m_cache->count(), (unsigned)m_cache->bytes());
+
+    xTaskCreatePinnedToCore(
+        &InboxPrefetcher::taskThunk,
+        "inbox_fetch",
+        6144,
+        this,
+        1, // below the upload drainer: sending our own takes comes first
+        &m_task,
+        1);
+    metrics::Registry::shared().watchTask("inbox_fetch", m_task);
+}
+
+void InboxPrefetcher::enqueue(const char *id)
+{
+    if (!m_lock || !id[0] || strlen(id) > MessageCache::kMaxIdLen)
+        return;
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    strcpy(m_newest, id);
+    bool known = m_cache->contains(id);
+    for (size_t i = 0; i < m_pending && !known; ++i)
+        known = !strcmp(m_queue[i], id);
+    if (!known && m_pending < kMaxPending)
+        strcpy(m_queue[m_pending++], id);
+    xSemaphoreGive(m_lock);
+    if (!known)
+        xTaskNotifyGive(m_task);
+}
+
+void InboxPrefetcher::pause()
+{
+    m_paused = true;
+}
+
+void InboxPrefetcher::resume()
+{
+    m_paused = false;
+    if (m_task)
+        xTaskNotifyGive(m_task);
+}
+
+bool InboxPrefetcher::cachedPath(const char *id, String &path)
+{
+    if (!m_lock)
+        return false;
+    char p[32];
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    const bool hit = m_cache->path(id, p, sizeof(p));
+    s_cacheBytes.set(m_cache->bytes());
+    xSemaphoreGive(m_lock);
+    (hit ? s_cacheHits : s_cacheMisses).add();
+    if (hit)
+        path = p;
+    return hit;
+}
+
+bool InboxPrefetcher::newest(String &id)
+{
+    if (!m_lock)
+        return false;
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    id = m_newest;
+    xSemaphoreGive(m_lock);
+    return id.length() > 0;
+}
+
+void InboxPrefetcher::taskThunk(void *arg)
+{
+    static_cast<InboxPrefetcher *>(arg)->task();
+}
+
+void InboxPrefetcher::waitWhilePaused()
+{
+    while (m_paused)
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+void InboxPrefetcher::task()
+{
+    for (;;)
+    {
+        // Wake on enqueue() and resume(); retry failures now and then
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(kRetryMs));
+        for (;;)
+        {
+            waitWhilePaused();
+            if (WiFi.status() != WL_CONNECTED)
+                break;
+            char id[MessageCache::kMaxIdLen + 1];
+            xSemaphoreTake(m_lock, portMAX_DELAY);
+            const bool any = m_pending > 0;
+            if (any)
+                strcpy(id, m_queue[0]);
+            xSemaphoreGive(m_lock);
+            if (!any)
+                break;
+
+            PowerManager::shared().setBusy(PowerPolicy::Network, true);
+            const uint32_t t0 = millis();
+            const Fetch r = fetch(id);
+            PowerManager::shared().setBusy(PowerPolicy::Network, false);
+
+            (r == Fetch::Done ? s_prefetched : s_prefetchFail).add();
+            if (r == Fetch::Failed)
+                break; // retry later
+
+            xSemaphoreTake(m_lock, portMAX_DELAY);
+            if (m_pending && !strcmp(m_queue[0], id))
+            {
+                memmove(m_queue[0], m_queue[1], (m_pending - 1) * sizeof(m_queue[0]));
+                m_pending--;
+            }
+            s_cacheBytes.set(m_cache->bytes());
+            xSemaphoreGive(m_lock);
+            if (r == Fetch::Done)
+                Serial.printf("[FETCH] %s cached in %u ms\n", id, (unsigned)(millis() - t0));
+            else
+                Serial.printf("[FETCH] %s dropped\n", id);
+        }
+    }
+}
+
+InboxPrefetcher::Fetch InboxPrefetcher::fetch(const char *id)
+{
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    const bool cached = m_cache->contains(id);
+    xSemaphoreGive(m_lock);
+    if (cached)
+        return Fetch::Done;
+
+    uint32_t offset = 0;
+    for (;;)
+    {
+        // One request per pass; a pause ends the pass and the next one
+        // asks for the rest
+        {
+            PooledRequest req(m_url + id, 15000);
+            if (offset)
+                req.http().addHeader("Range", "bytes=" + String(offset) + "-");
+            const int code = req.send("GET");
+            if (code == 404 || code == 410)
+                offset = UINT32_MAX;
+            else if (code == 200 && offset)
+                offset = 0; // Range ignored: start over
+            else if (code != 200 && code != 206)
+            {
+                Serial.printf("[FETCH] GET %s failed: %d\n", id, code);
+                xSemaphoreTake(m_lock, portMAX_DELAY);
+                m_cache->abortWrite();
+                xSemaphoreGive(m_lock);
+                return Fetch::Failed;
+            }
+
+            const int len = req.http().getSize();
+            bool ok = offset != UINT32_MAX && len > 0;
+            if (ok && offset == 0)
+            {
+                xSemaphoreTake(m_lock, portMAX_DELAY);
+                ok = m_cache->beginWrite(id, len);
+                xSemaphoreGive(m_lock);
+            }
+            if (!ok)
+            {
+                xSemaphoreTake(m_lock, portMAX_DELAY);
+                m_cache->abortWrite();
+                xSemaphoreGive(m_lock);
+                req.http().getStream().stop(); // body left unread
+                return Fetch::Gone;
+            }
+
+            WiFiClient &body = req.http().getStream();
+            uint8_t buf[1024];
+            for (int left = len; left > 0 && !m_paused;)
+            {
+                const size_t n = body.readBytes(buf, left < (int)sizeof(buf) ? left : sizeof(buf));
+                xSemaphoreTake(m_lock, portMAX_DELAY);
+                ok = n > 0 && m_cache->write(buf, n);
+                xSemaphoreGive(m_lock);
+                if (!ok)
+                {
+                    body.stop();
+                    xSemaphoreTake(m_lock, portMAX_DELAY);
+                    m_cache->abortWrite();
+                    xSemaphoreGive(m_lock);
+                    return Fetch::Failed;
+                }
+                left -= n;
+                offset += n;
+            }
+            if (!m_paused)
+            {
+                xSemaphoreTake(m_lock, portMAX_DELAY);
+                ok = m_cache->commitWrite();
+                xSemaphoreGive(m_lock);
+                return ok ? Fetch::Done : Fetch::Failed;
+            }
+            body.stop(); // paused mid-body
+        }
+        Serial.printf("[FETCH] %s paused at %u bytes\n", id, (unsigned)offset);
+        PowerManager::shared().setBusy(PowerPolicy::Network, false);
+        waitWhilePaused();
+        PowerManager::shared().setBusy(PowerPolicy::Network, true);
+    }
+}
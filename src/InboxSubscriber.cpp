@@ -0,0 +1,177 @@
+#include "InboxSubscriber.h"
+#include <WiFi.h>
+#include <ArduinoJson.h>
+#include "InboxPrefetcher.h"
+#include "NetUtil.h"
+#include "Metrics.h"
+#include "PowerManager.h"
+
+void InboxSubscriber::begin(const String &eventsUrl, HttpTransport &net)
+{
+    m_url = eventsUrl;
+    m_net = &net;
+    if (m_task)
+        return;
+    m_parser.setCallback(&InboxSubscriber::onEventThunk, this);
+    xTaskCreatePinnedToCore(
+        &InboxSubscriber::taskThunk,
+        "inbox_sse",
+        4096,
+        this,
+        3,
+        &m_task,
+        1);
+    metrics::Registry::shared().watchTask("inbox_sse", m_task);
+}
+
+void InboxSubscriber::setCallback(Callback cb, void *ctx)
+{
+    m_cb = cb;
+    m_cbCtx = ctx;
+}
+
+bool InboxSubscriber::wasNotified()
+{
+    if (m_latched)
+    {
+        m_latched = false;
+        return true;
+    }
+    return false;
+}
+
+void InboxSubscriber::taskThunk(void *arg)
+{
+    static_cast<InboxSubscriber *>(arg)->task();
+}
+
+void InboxSubscriber::task()
+{
+    uint8_t attempt = 0;
+    for (;;)
+    {
+        if (WiFi.status() != WL_CONNECTED)
+        {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        std::unique_ptr<NetConnection> conn = openStream();
+        if (conn)
+        {
+            m_connected = true;
+            PowerManager::shared().setPushConnected(true);
+            attempt = 0;
+
+            uint32_t lastByte = millis();
+            uint8_t buf[128];
+            while (conn->connected() && !m_parser.ended() && millis() - lastByte < kIdleTimeoutMs)
+            {
+                const int avail = conn->available();
+                if (avail <= 0)
+                {
+                    // Nothing buffered; sleep instead of spinning so the
+                    // radio can drop into modem sleep between pushes
+                    vTaskDelay(pdMS_TO_TICKS(50));
+                    continue;
+                }
+                const size_t n = conn->read(buf, min((size_t)avail, sizeof(buf)));
+                m_parser.feed(buf, n);
+                lastByte = millis();
+            }
+            m_connected = false;
+            PowerManager::shared().setPushConnected(false);
+            Serial.println("[SSE] Stream closed");
+            conn->close();
+        }
+
+        const uint32_t retryMs = m_parser.retryMs() ? m_parser.retryMs() : kBaseRetryMs;
+        uint32_t wait = max(retryMs, backoffMs(attempt, kBaseRetryMs, kMaxRetryMs));
+        if (attempt < 16)
+            attempt++;
+        vTaskDelay(pdMS_TO_TICKS(wait));
+    }
+}
+
+std::unique_ptr<NetConnection> InboxSubscriber::openStream()
+{
+    String host, path;
+    uint16_t port = 0;
+    if (!splitUrl(m_url, host, port, path))
+        return nullptr;
+    std::unique_ptr<NetConnection> conn = m_net->connect(host.c_str(), port);
+    if (!conn)
+        return nullptr;
+
+    char req[320];
+    int len = snprintf(req, sizeof(req),
+                       "GET %s HTTP/1.1\r\n"
+                       "Host: %s\r\n"
+                       "Accept: text/event-stream\r\n"
+                       "Cache-Control: no-cache\r\n",
+                       path.c_str(), host.c_str());
+    if (m_parser.lastId()[0] && len > 0 && len < (int)sizeof(req))
+        len += snprintf(req + len, sizeof(req) - len, "Last-Event-ID: %s\r\n", m_parser.lastId());
+    if (len > 0 && len < (int)sizeof(req))
+        len += snprintf(req + len, sizeof(req) - len, "\r\n");
+    if (len <= 0 || len >= (int)sizeof(req) || conn->write(reinterpret_cast<const uint8_t *>(req), len) != (size_t)len)
+        return nullptr;
+
+    m_parser.reset();
+    if (!readHeaders(*conn))
+        return nullptr;
+    return conn;
+}
+
+// Status line + headers; the parser keeps any body bytes read with them
+bool InboxSubscriber::readHeaders(NetConnection &conn)
+{
+    const uint32_t t0 = millis();
+    uint8_t c;
+    while (!m_parser.headersDone() && conn.connected() && millis() - t0 < 10000)
+    {
+        if (conn.available() <= 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        if (conn.read(&c, 1) == 1)
+            m_parser.feed(&c, 1);
+    }
+
+    const int status = m_parser.status();
+    if (status != 200 || !m_parser.headersDone())
+    {
+        Serial.printf("[SSE] Subscribe failed: %d\n", status);
+        conn.close();
+        return false;
+    }
+    return true;
+}
+
+void InboxSubscriber::onEventThunk(const char *event, const char *data, void *ctx)
+{
+    static_cast<InboxSubscriber *>(ctx)->onEvent(event, data);
+}
+
+void InboxSubscriber::onEvent(const char *event, const char *data)
+{
+    if (strcmp(event, "message") == 0)
+    {
+        m_hasMessages = true;
+        m_latched = true;
+        if (m_prefetch)
+        {
+            JsonDocument doc;
+            if (!deserializeJson(doc, data))
+                m_prefetch->enqueue(doc["id"] | "");
+        }
+    }
+    else if (strcmp(event, "empty") == 0)
+    {
+        m_hasMessages = false;
+    }
+
+    if (m_cb)
+        m_cb(event, data, m_cbCtx);
+}
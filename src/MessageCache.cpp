@@ -0,0 +1,334 @@
+#include "MessageCache.h"
+#include <stdio.h>
+#include <string.h>
+#include "Crc32.h"
+
+static const uint32_t kIndexMagic = 0x4D534731; // "MSG1"
+
+MessageCache::MessageCache(FileStore &store, const char *dir) : m_store(store)
+{
+    snprintf(m_dir, sizeof(m_dir), "%s", dir);
+    snprintf(m_indexPath, sizeof(m_indexPath), "%s/index", m_dir);
+    snprintf(m_indexTmpPath, sizeof(m_indexTmpPath), "%s/index.tmp", m_dir);
+    snprintf(m_tmpPath, sizeof(m_tmpPath), "%s/dl.tmp", m_dir);
+    memset(&m_ix, 0, sizeof(m_ix));
+}
+
+void MessageCache::setConfig(const Config &cfg)
+{
+    m_cfg = cfg;
+    if (m_cfg.maxEntries == 0 || m_cfg.maxEntries > kMaxEntries)
+        m_cfg.maxEntries = kMaxEntries;
+}
+
+void MessageCache::slotPath(size_t i, char *out, size_t len) const
+{
+    snprintf(out, len, "%s/%u.msg", m_dir, (unsigned)i);
+}
+
+int MessageCache::find(const char *id) const
+{
+    for (size_t i = 0; i < kMaxEntries; ++i)
+        if (m_ix.e[i].valid && !strcmp(m_ix.e[i].id, id))
+            return (int)i;
+    return -1;
+}
+
+size_t MessageCache::count() const
+{
+    size_t n = 0;
+    for (const Entry &e : m_ix.e)
+        n += e.valid;
+    return n;
+}
+
+// -------------------- index --------------------
+bool MessageCache::loadIndex()
+{
+    std::unique_ptr<StoredFile> f = m_store.open(m_indexPath, OpenMode::Read);
+    if (!f)
+        return false;
+    Index ix;
+    const size_t got = f->read(reinterpret_cast<uint8_t *>(&ix), sizeof(ix));
+    if (got != sizeof(ix) || ix.magic != kIndexMagic ||
+        ix.check != crc32Update(0, reinterpret_cast<const uint8_t *>(&ix), offsetof(Index, check)))
+        return false;
+    m_ix = ix;
+    return true;
+}
+
+void MessageCache::saveIndex()
+{
+    m_ix.magic = kIndexMagic;
+    m_ix.check = crc32Update(0, reinterpret_cast<const uint8_t *>(&m_ix), offsetof(Index, check));
+    {
+        std::unique_ptr<StoredFile> f = m_store.open(m_indexTmpPath, OpenMode::Write);
+        if (!f)
+            return;
+        f->write(reinterpret_cast<const uint8_t *>(&m_ix), sizeof(m_ix));
+        f->flush();
+    }
+    m_store.remove(m_indexPath);
+    m_store.rename(m_indexTmpPath, m_indexPath);
+}
+
+bool MessageCache::begin()
+{
+    abortWrite();
+    m_store.remove(m_tmpPath);
+    if (!loadIndex())
+        memset(&m_ix, 0, sizeof(m_ix));
+
+    // Reconcile with what is on flash: a power cut can leave a renamed
+    // file the index never heard of, or an entry whose file is gone
+    m_bytes = 0;
+    char path[32];
+    for (size_t i = 0; i < kMaxEntries; ++i)
+    {
+        Entry &e = m_ix.e[i];
+        slotPath(i, path, sizeof(path));
+        if (!e.valid)
+        {
+            if (m_store.exists(path))
+                m_store.remove(path);
+            continue;
+        }
+        e.id[kMaxIdLen] = '\0';
+        std::unique_ptr<StoredFile> f = m_store.open(path, OpenMode::Read);
+        m_bytes += e.size;
+        if (!f || f->size() != e.size)
+        {
+            f.reset();
+            m_stats.corrupt++;
+            drop((int)i);
+        }
+    }
+    makeRoom(0, false); // the budget may have shrunk
+    saveIndex();
+    return true;
+}
+
+// -------------------- entries --------------------
+void MessageCache::drop(int i)
+{
+    char path[32];
+    slotPath(i, path, sizeof(path));
+    m_store.remove(path);
+    if (m_ix.e[i].valid)
+        m_bytes -= m_ix.e[i].size;
+    memset(&m_ix.e[i], 0, sizeof(Entry));
+}
+
+void MessageCache::touch(int i)
+{
+    m_ix.e[i].used = ++m_ix.clock;
+    saveIndex(); // LRU order has to survive a reboot
+}
+
+bool MessageCache::makeRoom(uint32_t size, bool newEntry)
+{
+    if (size > m_cfg.maxBytes)
+        return false;
+    for (;;)
+    {
+        const size_t n = count();
+        if (m_bytes + size <= m_cfg.maxBytes && n + (newEntry ? 1 : 0) <= m_cfg.maxEntries)
+            return true;
+        int lru = -1;
+        for (size_t i = 0; i < kMaxEntries; ++i)
+            if (m_ix.e[i].valid && (lru < 0 || (int32_t)(m_ix.e[i].used - m_ix.e[lru].used) < 0))
+                lru = (int)i;
+        if (lru < 0)
+            return false;
+        drop(lru);
+        m_stats.evicted++;
+    }
+}
+
+bool MessageCache::crcOf(const char *path, uint32_t size, uint32_t &crc)
+{
+    std::unique_ptr<StoredFile> f = m_store.open(path, OpenMode::Read);
+    if (!f || f->size() != size)
+        return false;
+    uint8_t buf[512];
+    crc = 0;
+    for (uint32_t left = size; left > 0;)
+    {
+        const size_t n = f->read(buf, left < sizeof(buf) ? left : sizeof(buf));
+        if (n == 0)
+            return false;
+        crc = crc32Update(crc, buf, n);
+        left -= n;
+    }
+    return true;
+}
+
+std::unique_ptr<StoredFile> MessageCache::openEntry(int i)
+{
+    const Entry &e = m_ix.e[i];
+    char path[32];
+    slotPath(i, path, sizeof(path));
+    uint32_t crc;
+    if (m_cfg.verifyOnOpen && (!crcOf(path, e.size, crc) || crc != e.crc))
+        return nullptr;
+    std::unique_ptr<StoredFile> f = m_store.open(path, OpenMode::Read);
+    if (f && f->size() != e.size)
+        f.reset();
+    return f;
+}
+
+std::unique_ptr<StoredFile> MessageCache::open(const char *id)
+{
+    const int i = find(id);
+    if (i < 0)
+    {
+        m_stats.misses++;
+        return nullptr;
+    }
+    std::unique_ptr<StoredFile> f = openEntry(i);
+    if (!f)
+    {
+        m_stats.corrupt++;
+        m_stats.misses++;
+        drop(i);
+        saveIndex();
+        return nullptr;
+    }
+    m_stats.hits++;
+    touch(i);
+    return f;
+}
+
+bool MessageCache::path(const char *id, char *out, size_t len)
+{
+    if (!open(id))
+        return false;
+    slotPath(find(id), out, len);
+    return true;
+}
+
+bool MessageCache::verify(const char *id)
+{
+    const int i = find(id);
+    if (i < 0)
+        return false;
+    char path[32];
+    slotPath(i, path, sizeof(path));
+    uint32_t crc;
+    if (crcOf(path, m_ix.e[i].size, crc) && crc == m_ix.e[i].crc)
+        return true;
+    m_stats.corrupt++;
+    drop(i);
+    saveIndex();
+    return false;
+}
+
+void MessageCache::remove(const char *id)
+{
+    const int i = find(id);
+    if (i < 0)
+        return;
+    drop(i);
+    saveIndex();
+}
+
+// -------------------- downloads --------------------
+bool MessageCache::beginWrite(const char *id, uint32_t size)
+{
+    abortWrite();
+    const size_t len = strlen(id);
+    if (len == 0 || len > kMaxIdLen || contains(id))
+        return false;
+    // Evictions go to flash now: the download needs the space
+    const size_t before = count();
+    const bool room = makeRoom(size, true);
+    if (count() != before)
+        saveIndex();
+    if (!room)
+        return false;
+    m_file = m_store.open(m_tmpPath, OpenMode::Write);
+    if (!m_file)
+        return false;
+    memcpy(m_writeId, id, len + 1);
+    m_writeSize = size;
+    m_writeLen = 0;
+    m_writeCrc = 0;
+    return true;
+}
+
+bool MessageCache::write(const uint8_t *data, size_t len)
+{
+    if (!m_file)
+        return false;
+    if (m_writeSize ? m_writeLen + len > m_writeSize : !makeRoom(m_writeLen + len, true))
+    {
+        abortWrite(); // longer than announced, or can never fit
+        return false;
+    }
+    const size_t n = m_file->write(data, len);
+    m_writeCrc = crc32Update(m_writeCrc, data, n);
+    m_writeLen += n;
+    if (n != len)
+        abortWrite(); // flash full
+    return n == len;
+}
+
+bool MessageCache::commitWrite()
+{
+    if (!m_file)
+        return false;
+    m_file->flush();
+    m_file.reset();
+    uint32_t crc;
+    if ((m_writeSize && m_writeLen != m_writeSize) || m_writeLen == 0)
+    {
+        abortWrite(); // cut short
+        return false;
+    }
+    if (!crcOf(m_tmpPath, m_writeLen, crc) || crc != m_writeCrc)
+    {
+        m_stats.corrupt++;
+        abortWrite(); // flash didn't keep what we wrote
+        return false;
+    }
+    if (!makeRoom(m_writeLen, true))
+    {
+        abortWrite();
+        return false;
+    }
+
+    int slot = -1;
+    for (size_t i = 0; i < kMaxEntries && slot < 0; ++i)
+        if (!m_ix.e[i].valid)
+            slot = (int)i;
+    char path[32];
+    slotPath(slot, path, sizeof(path));
+    m_store.remove(path);
+    if (!m_store.rename(m_tmpPath, path))
+    {
+        abortWrite();
+        return false;
+    }
+
+    Entry &e = m_ix.e[slot];
+    memcpy(e.id, m_writeId, sizeof(e.id));
+    e.size = m_writeLen;
+    e.crc = crc;
+    e.used = ++m_ix.clock;
+    e.valid = 1;
+    m_bytes += e.size;
+    m_stats.stored++;
+    saveIndex();
+    m_writeId[0] = '\0';
+    return true;
+}
+
+void MessageCache::abortWrite()
+{
+    const bool had = m_file != nullptr || m_writeId[0];
+    m_file.reset();
+    m_writeId[0] = '\0';
+    m_writeLen = 0;
+    if (had)
+        m_store.remove(m_tmpPath);
+}
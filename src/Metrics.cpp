@@ -0,0 +1,181 @@
+#include "Metrics.h"
+#include <stdarg.h>
+#include <WiFi.h>
+#include "HttpConnectionPool.h"
+
+using namespace metrics;
+
+static const size_t kJsonBytes = 2048;
+
+Counter::Counter(const char *name) : m_name(name) { Registry::shared().add(this); }
+Gauge::Gauge(const char *name) : m_name(name) { Registry::shared().add(this); }
+
+Histogram::Histogram(const char *name, std::initializer_list<uint32_t> bounds) : m_name(name)
+{
+    for (uint32_t b : bounds)
+        if (m_nBounds < kMaxBounds)
+            m_bounds[m_nBounds++] = b;
+    for (std::atomic<uint32_t> &b : m_buckets)
+        b.store(0, std::memory_order_relaxed);
+    Registry::shared().add(this);
+}
+
+// Function-local so metrics defined at file scope in any translation unit
+// can register during static init
+Registry &Registry::shared()
+{
+    static Registry registry;
+    return registry;
+}
+
+void Registry::add(Counter *c)
+{
+    if (m_nCounters < kMaxMetrics)
+        m_counters[m_nCounters++] = c;
+}
+
+void Registry::add(Gauge *g)
+{
+    if (m_nGauges < kMaxMetrics)
+        m_gauges[m_nGauges++] = g;
+}
+
+void Registry::add(Histogram *h)
+{
+    if (m_nHistograms < kMaxMetrics)
+        m_histograms[m_nHistograms++] = h;
+}
+
+void Registry::watchTask(const char *name, TaskHandle_t handle)
+{
+    if (!handle || m_nTasks >= kMaxTasks)
+        return;
+    m_taskNames[m_nTasks] = name;
+    m_tasks[m_nTasks++] = handle;
+}
+
+// -------------------- JSON --------------------
+namespace
+{
+    // snprintf into a fixed buffer; remembers overflow
+    class JsonOut
+    {
+    public:
+        JsonOut(char *buf, size_t len) : m_buf(buf), m_len(len) {}
+
+        void add(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+        {
+            if (m_pos >= m_len)
+                return;
+            va_list ap;
+            va_start(ap, fmt);
+            int n = vsnprintf(m_buf + m_pos, m_len - m_pos, fmt, ap);
+            va_end(ap);
+            m_pos = n < 0 ? m_len : m_pos + n;
+        }
+        // Drop a trailing comma before closing an object/array
+        void close(char c)
+        {
+            if (m_pos > 0 && m_pos < m_len && m_buf[m_pos - 1] == ',')
+                m_pos--;
+            add("%c", c);
+        }
+        size_t length() const { return m_pos < m_len ? m_pos : 0; }
+
+    private:
+        char *m_buf;
+        size_t m_len;
+        size_t m_pos = 0;
+    };
+}
+
+size_t Registry::toJson(char *buf, size_t len)
+{
+    JsonOut j(buf, len);
+    j.add("{\"up\":%lu,", (unsigned long)(millis() / 1000));
+    j.add("\"heap\":{\"free\":%u,\"min\":%u,\"max_block\":%u},",
+          (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap(), (unsigned)ESP.getMaxAllocHeap());
+
+    j.add("\"stack\":{");
+    for (size_t i = 0; i < m_nTasks; ++i)
+        j.add("\"%s\":%u,", m_taskNames[i], (unsigned)uxTaskGetStackHighWaterMark(m_tasks[i]));
+    j.close('}');
+
+    j.add(",\"c\":{");
+    for (size_t i = 0; i < m_nCounters; ++i)
+        j.add("\"%s\":%lu,", m_counters[i]->name(), (unsigned long)m_counters[i]->value());
+    j.close('}');
+
+    j.add(",\"g\":{");
+    for (size_t i = 0; i < m_nGauges; ++i)
+        j.add("\"%s\":%ld,", m_gauges[i]->name(), (long)m_gauges[i]->value());
+    j.close('}');
+
+    // Histograms as {"le":[bounds],"n":[counts incl. overflow],"max":..}
+    j.add(",\"h\":{");
+    for (size_t i = 0; i < m_nHistograms; ++i)
+    {
+        const Histogram &h = *m_histograms[i];
+        j.add("\"%s\":{\"le\":[", h.name());
+        for (size_t b = 0; b < h.m_nBounds; ++b)
+            j.add("%lu,", (unsigned long)h.m_bounds[b]);
+        j.close(']');
+        j.add(",\"n\":[");
+        for (size_t b = 0; b <= h.m_nBounds; ++b)
+            j.add("%lu,", (unsigned long)h.m_buckets[b].load(std::memory_order_relaxed));
+        j.close(']');
+        j.add(",\"max\":%lu},", (unsigned long)h.m_max.load(std::memory_order_relaxed));
+    }
+    j.close('}');
+    j.close('}');
+    return j.length();
+}
+
+void Registry::print(Print &out)
+{
+    static char buf[kJsonBytes]; // only loop() or the publisher print
+    size_t n = toJson(buf, sizeof(buf));
+    if (n == 0)
+    {
+        out.println("{\"error\":\"metrics too large\"}");
+        return;
+    }
+    out.write(reinterpret_cast<const uint8_t *>(buf), n);
+    out.println();
+}
+
+// -------------------- publishing --------------------
+void Registry::startPublishing(const String &url, uint32_t periodMs)
+{
+    m_url = url;
+    m_periodMs = periodMs;
+    if (m_publishTask)
+        return;
+    xTaskCreatePinnedToCore(&Registry::publishTaskThunk, "metrics_pub", 4096, this, 1, &m_publishTask, 1);
+    watchTask("metrics_pub", m_publishTask);
+}
+
+void Registry::publishTaskThunk(void *arg)
+{
+    static_cast<Registry *>(arg)->publishTask();
+}
+
+void Registry::publishTask()
+{
+    char *buf = new char[kJsonBytes]; // once, for the life of the task
+    for (;;)
+    {
+        vTaskDelay(pdMS_TO_TICKS(m_periodMs));
+        if (WiFi.status() != WL_CONNECTED)
+            continue;
+        size_t n = toJson(buf, kJsonBytes);
+        if (n == 0)
+            continue;
+
+        PooledRequest req(m_url);
+        req.http().addHeader("Content-Type", "application/json");
+        int code = req.send("POST", String(buf));
+        if (code < 200 || code >= 300)
+            Serial.printf("[METRICS] POST failed: %d\n", code);
+    }
+}
@@ -0,0 +1,21 @@
+#include "NetUtil.h"
+
+bool splitUrl(const String &url, String &host, uint16_t &port, String &path)
+{
+    if (!url.startsWith("http://"))
+        return false;
+    const int hostStart = 7;
+    int slash = url.indexOf('/', hostStart);
+    String authority = slash < 0 ? url.substring(hostStart) : url.substring(hostStart, slash);
+    path = slash < 0 ? String("/") : url.substring(slash);
+
+    int colon = authority.indexOf(':');
+    host = colon < 0 ? authority : authority.substring(0, colon);
+    port = colon < 0 ? 80 : (uint16_t)authority.substring(colon + 1).toInt();
+    return host.length() > 0;
+}
+
+uint32_t backoffMs(uint8_t attempt, uint32_t baseMs, uint32_t capMs)
+{
+    return backoffMs(attempt, baseMs, capMs, esp_random());
+}
@@ -0,0 +1,23 @@
+#include "PcmConvert.h"
+
+static inline int16_t sat16(int32_t x)
+{
+    // min/max compile to conditional moves (or packssdw), never branches
+    x = x < -32768 ? -32768 : x;
+    x = x > 32767 ? 32767 : x;
+    return (int16_t)x;
+}
+
+void pcm32_to_pcm16(const int32_t *__restrict in, int16_t *__restrict out, size_t n, int shift)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        out[i + 0] = sat16(in[i + 0] >> shift);
+        out[i + 1] = sat16(in[i + 1] >> shift);
+        out[i + 2] = sat16(in[i + 2] >> shift);
+        out[i + 3] = sat16(in[i + 3] >> shift);
+    }
+    for (; i < n; ++i)
+        out[i] = sat16(in[i] >> shift);
+}
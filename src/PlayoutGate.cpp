@@ -0,0 +1,29 @@
+#include "PlayoutGate.h"
+
+void PlayoutGate::start(size_t preRollBlocks)
+{
+    m_preRoll = preRollBlocks > 0 ? preRollBlocks : 1;
+    m_starved = false;
+    m_underruns = 0;
+}
+
+bool PlayoutGate::ready(size_t queued, bool fetchDone) const
+{
+    return queued >= m_preRoll || fetchDone;
+}
+
+PlayoutGate::Step PlayoutGate::next(size_t queued, bool fetchDone)
+{
+    if (queued > 0)
+    {
+        m_starved = false;
+        return Step::Play;
+    }
+    if (fetchDone)
+        return Step::End;
+    if (m_starved)
+        return Step::Silence;
+    m_starved = true;
+    m_underruns++;
+    return Step::Underrun;
+}
@@ -0,0 +1,269 @@
+#include "PowerManager.h"
+#include <WiFi.h>
+#include <esp_sleep.h>
+#include <esp_wifi.h>
+#include <sys/time.h>
+#include "driver/rtc_io.h"
+#include "ButtonModule.h"
+#include "WifiModule.h"
+#include "Metrics.h"
+
+static metrics::Counter s_lightSleeps("light_sleeps");
+static metrics::Histogram s_resumeUs("resume_to_record_us",
+                                     {5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000});
+
+static const uint32_t kRtcMagic = 0x50575231; // "PWR1"
+static const uint32_t kResumeWindowUs = 5000000; // later starts aren't a resume
+
+// Survives deep sleep; lost on power-up and reset
+struct RtcPower
+{
+    uint32_t magic;
+    uint64_t residencyMs[(int)PowerState::Count];
+    uint32_t deepWakes;
+    int64_t sleptAtMs; // wall clock, which the RTC keeps running
+};
+static RTC_DATA_ATTR RtcPower s_rtc;
+
+static int64_t wallMs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+PowerManager &PowerManager::shared()
+{
+    static PowerManager pm;
+    return pm;
+}
+
+void PowerManager::begin(Scheduler &sched, uint16_t event, uint8_t wakePin, const PowerPolicy::Config &cfg)
+{
+    m_sched = &sched;
+    m_event = event;
+    m_pin = wakePin;
+    m_policy.setConfig(cfg);
+    m_policy.begin(sched.now());
+    sched.subscribe(event, &PowerManager::onEvent, this);
+
+    const esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+    const bool fromDeep = (cause == ESP_SLEEP_WAKEUP_EXT0 || cause == ESP_SLEEP_WAKEUP_TIMER) && s_rtc.magic == kRtcMagic;
+    if (fromDeep)
+    {
+        for (int s = 0; s < (int)PowerState::Count; ++s)
+            m_policy.addResidency((PowerState)s, s_rtc.residencyMs[s]);
+        const int64_t slept = wallMs() - s_rtc.sleptAtMs;
+        if (slept > 0)
+            m_policy.addResidency(PowerState::DeepSleep, slept);
+        s_rtc.deepWakes++;
+        m_bootCause = cause == ESP_SLEEP_WAKEUP_EXT0 ? Wake::Button : Wake::Inbox;
+        // micros() counts from boot, so this times boot + setup() too
+        m_wakeUs = 0;
+        m_resumeArmed = true;
+        rtc_gpio_deinit((gpio_num_t)m_pin);
+        if (m_bootCause == Wake::Inbox)
+            m_policy.inboxChecked(sched.now() - cfg.inboxPeriodMs); // due now
+    }
+    else
+    {
+        memset(&s_rtc, 0, sizeof(s_rtc));
+        s_rtc.magic = kRtcMagic;
+    }
+    Serial.printf("[PWR] Boot (%s), %u deep sleep wakes so far\n",
+                  fromDeep ? (m_bootCause == Wake::Button ? "button" : "inbox") : "cold", (unsigned)s_rtc.deepWakes);
+    kick();
+}
+
+void PowerManager::setWakeCallback(WakeCallback cb, void *ctx)
+{
+    m_wakeCtx = ctx;
+    m_wakeCb = cb;
+}
+
+// -------------------- activity --------------------
+void PowerManager::setBusy(uint8_t sources, bool busy)
+{
+    if (busy)
+    {
+        m_busy.fetch_or(sources);
+        if ((sources & PowerPolicy::Recording) && m_resumeArmed.exchange(false))
+        {
+            const uint32_t us = micros() - m_wakeUs;
+            if (us < kResumeWindowUs)
+            {
+                m_lastResumeUs = us;
+                s_resumeUs.record(us);
+            }
+        }
+    }
+    else
+    {
+        m_busy.fetch_and((uint8_t)~sources);
+    }
+    kick();
+}
+
+void PowerManager::touch()
+{
+    m_touched = true;
+    kick();
+}
+
+void PowerManager::setPending(bool pending)
+{
+    m_pending = pending;
+}
+
+void PowerManager::setPushConnected(bool connected)
+{
+    m_pushConnected = connected;
+    kick();
+}
+
+void PowerManager::kick()
+{
+    // One event per burst of changes; evaluate() reads the latest state
+    if (m_sched && !m_posted.exchange(true) && !m_sched->post(m_event))
+        m_posted = false;
+}
+
+void PowerManager::onEvent(uint16_t, uint32_t, void *ctx)
+{
+    PowerManager *pm = static_cast<PowerManager *>(ctx);
+    pm->m_posted = false;
+    pm->evaluate();
+}
+
+void PowerManager::onTimer(SchedTimer &, void *ctx)
+{
+    static_cast<PowerManager *>(ctx)->evaluate();
+}
+
+// -------------------- decisions --------------------
+void PowerManager::evaluate()
+{
+    const uint32_t now = m_sched->now();
+    if (m_touched.exchange(false))
+        m_policy.touch(now);
+    m_policy.setBusy(m_busy.load(), now);
+    m_policy.setPending(m_pending.load());
+    m_policy.setPushConnected(m_pushConnected.load());
+
+    if (m_policy.inboxDue(now))
+    {
+        m_policy.inboxChecked(now);
+        if (m_wakeCb)
+            m_wakeCb(Wake::Inbox, m_wakeCtx);
+        m_policy.setBusy(m_busy.load(), now); // the check may have started
+    }
+
+    uint32_t sleepMs;
+    const PowerState s = m_policy.decide(now, sleepMs);
+    if (s == PowerState::LightSleep)
+    {
+        lightSleep(sleepMs);
+        kick(); // look again once the wake has been handled
+        return;
+    }
+    if (s == PowerState::DeepSleep)
+    {
+        deepSleep(sleepMs); // does not return
+        return;
+    }
+
+    setRadio(m_policy.radioIdle());
+    m_policy.enter(s, now);
+    const uint32_t next = m_policy.nextChangeMs(now);
+    if (next == PowerPolicy::kNever)
+        m_sched->stopTimer(m_timer);
+    else
+        m_sched->startTimer(m_timer, next);
+}
+
+void PowerManager::setRadio(bool idle)
+{
+    // Modem sleep keeps the association and wakes for DTIM beacons;
+    // full power only while something is on the network
+    const wifi_ps_type_t ps = idle ? WIFI_PS_MAX_MODEM : WIFI_PS_NONE;
+    if ((int)ps == m_radioPs || WiFi.getMode() == WIFI_OFF)
+        return;
+    esp_wifi_set_ps(ps);
+    m_radioPs = ps;
+}
+
+// -------------------- sleep --------------------
+void PowerManager::armWakeSources(uint32_t sleepMs)
+{
+    // The button pulls the pin low; RTC pulls keep it high while asleep
+    rtc_gpio_pullup_en((gpio_num_t)m_pin);
+    rtc_gpio_pulldown_dis((gpio_num_t)m_pin);
+    esp_sleep_enable_ext0_wakeup((gpio_num_t)m_pin, 0);
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000);
+}
+
+void PowerManager::lightSleep(uint32_t sleepMs)
+{
+    const uint32_t t0 = m_sched->now();
+    m_policy.enter(PowerState::LightSleep, t0);
+    if (m_wifi)
+        m_wifi->suspend();
+    m_radioPs = -1;
+    armWakeSources(sleepMs);
+    Serial.flush();
+
+    esp_light_sleep_start();
+
+    m_wakeUs = micros();
+    m_resumeArmed = true;
+    const esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+    rtc_gpio_deinit((gpio_num_t)m_pin); // back to a digital pin for the edge interrupt
+    m_policy.enter(PowerState::ModemSleep, m_sched->now());
+    s_lightSleeps.add();
+
+    if (m_wifi)
+        m_wifi->resume();
+    if (m_button)
+        m_button->resync();
+    if (cause == ESP_SLEEP_WAKEUP_EXT0 && m_wakeCb)
+        m_wakeCb(Wake::Button, m_wakeCtx);
+    // A timer wake is the inbox check, which evaluate() runs next
+}
+
+void PowerManager::deepSleep(uint32_t sleepMs)
+{
+    const uint32_t now = m_sched->now();
+    m_policy.enter(PowerState::DeepSleep, now);
+    s_rtc.magic = kRtcMagic;
+    for (int s = 0; s < (int)PowerState::Count; ++s)
+        s_rtc.residencyMs[s] = m_policy.residencyMs((PowerState)s, now);
+    s_rtc.sleptAtMs = wallMs();
+
+    Serial.printf("[PWR] Deep sleep, inbox check in %u s\n", (unsigned)(sleepMs / 1000));
+    Serial.flush();
+    if (m_wifi)
+        m_wifi->suspend();
+    armWakeSources(sleepMs);
+    esp_deep_sleep_start();
+}
+
+// -------------------- report --------------------
+void PowerManager::printReport(Print &out)
+{
+    const uint32_t now = m_sched ? m_sched->now() : millis();
+    uint64_t total = 0;
+    for (int s = 0; s < (int)PowerState::Count; ++s)
+        total += m_policy.residencyMs((PowerState)s, now);
+
+    out.printf("{\"power\":{\"state\":\"%s\",\"total_s\":%lu", powerStateName(m_policy.state()),
+               (unsigned long)(total / 1000));
+    for (int s = 0; s < (int)PowerState::Count; ++s)
+    {
+        const uint64_t ms = m_policy.residencyMs((PowerState)s, now);
+        out.printf(",\"%s_pct\":%.2f", powerStateName((PowerState)s), total ? ms * 100.0 / total : 0.0);
+    }
+    out.printf(",\"light_sleeps\":%u,\"deep_wakes\":%u,\"resume_to_record_us\":%u}}\n",
+               (unsigned)m_policy.entries(PowerState::LightSleep), (unsigned)s_rtc.deepWakes,
+               (unsigned)m_lastResumeUs);
+}
@@ -0,0 +1,79 @@
+#include "PowerPolicy.h"
+
+const char *powerStateName(PowerState s)
+{
+    switch (s)
+    {
+    case PowerState::Active:
+        return "active";
+    case PowerState::ModemSleep:
+        return "modem_sleep";
+    case PowerState::LightSleep:
+        return "light_sleep";
+    case PowerState::DeepSleep:
+        return "deep_sleep";
+    default:
+        return "?";
+    }
+}
+
+void PowerPolicy::begin(uint32_t now)
+{
+    m_lastActivity = now;
+    m_nextInbox = now + m_cfg.inboxPeriodMs;
+    m_state = PowerState::Active;
+    m_since = now;
+    m_entries[(int)PowerState::Active]++;
+}
+
+void PowerPolicy::setBusy(uint8_t mask, uint32_t now)
+{
+    // Foreground work that is running or just ended is activity
+    if ((m_busy | mask) & kForeground)
+        m_lastActivity = now;
+    m_busy = mask;
+}
+
+PowerState PowerPolicy::decide(uint32_t now, uint32_t &sleepMs) const
+{
+    sleepMs = 0;
+    if (m_busy)
+        return PowerState::Active;
+
+    const uint32_t idle = now - m_lastActivity;
+    if (idle < m_cfg.lightAfterMs || inboxDue(now))
+        return PowerState::ModemSleep;
+
+    if (keepsLink())
+        return PowerState::ModemSleep; // either sleep would drop the push stream
+    sleepMs = m_nextInbox - now;
+    return idle >= m_cfg.deepAfterMs && !m_pending ? PowerState::DeepSleep : PowerState::LightSleep;
+}
+
+uint32_t PowerPolicy::nextChangeMs(uint32_t now) const
+{
+    if (m_busy)
+        return kNever;
+    uint32_t next = kNever;
+    const uint32_t marks[] = {m_nextInbox, m_lastActivity + m_cfg.lightAfterMs, m_lastActivity + m_cfg.deepAfterMs};
+    const int n = keepsLink() ? 1 : 3; // keeping the link, only the inbox check changes anything
+    for (int i = 0; i < n; ++i)
+        if (before(now, marks[i]) && marks[i] - now < next)
+            next = marks[i] - now;
+    return next;
+}
+
+void PowerPolicy::enter(PowerState s, uint32_t now)
+{
+    if (s == m_state)
+        return;
+    m_residency[(int)m_state] += now - m_since;
+    m_state = s;
+    m_since = now;
+    m_entries[(int)s]++;
+}
+
+uint64_t PowerPolicy::residencyMs(PowerState s, uint32_t now) const
+{
+    return m_residency[(int)s] + (s == m_state ? now - m_since : 0);
+}
@@ -0,0 +1,151 @@
+#include "Resampler.h"
+#include <math.h>
+#include <string.h>
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function, for the Kaiser window
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 25; ++k)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-10 * sum)
+            break;
+    }
+    return sum;
+}
+
+bool Resampler::configure(uint32_t inRate, uint16_t channels)
+{
+    if (inRate == 0 || channels == 0 || channels > 2)
+        return false;
+    const uint32_t g = gcd(m_outRate, inRate);
+    const uint32_t up = m_outRate / g, down = inRate / g;
+
+    // Enough taps to span kBaseTaps samples of the slower rate, rounded
+    // up to a multiple of 4 for the unrolled dot product
+    size_t taps = (kBaseTaps * down + up - 1) / up;
+    taps = taps < kBaseTaps ? kBaseTaps : (taps + 3) & ~(size_t)3;
+    if (up > kMaxPhases || taps > kMaxTaps || up * taps > kMaxCoefs)
+        return false;
+
+    m_inRate = inRate;
+    m_channels = channels;
+    m_up = up;
+    m_down = down;
+    m_taps = taps;
+
+    if (!passthrough())
+    {
+        // Prototype low-pass at L * inRate. Cutoff a bit under Nyquist of
+        // the slower side; beta 6 gives ~60 dB stop band.
+        const size_t n = up * taps;
+        const double fc = 0.45 * (up < down ? (double)up / down : 1.0) / up; // cycles/sample
+        const double beta = 6.0, i0b = besselI0(beta);
+        const double centre = (n - 1) / 2.0;
+        for (size_t p = 0; p < up; ++p)
+        {
+            for (size_t k = 0; k < taps; ++k)
+            {
+                const double j = p + (double)k * up; // prototype index
+                const double t = j - centre;
+                const double sinc = t == 0 ? 2.0 * fc : sin(2.0 * M_PI * fc * t) / (M_PI * t);
+                const double r = t / (centre + 0.5);
+                const double w = besselI0(beta * sqrt(r * r < 1.0 ? 1.0 - r * r : 0.0)) / i0b;
+                // Gain L makes up for the zeros the upsampling inserts
+                const double h = sinc * w * up;
+                m_coef[p * taps + (taps - 1 - k)] = (int16_t)lround(h * 16384.0);
+            }
+        }
+    }
+    reset();
+    return true;
+}
+
+void Resampler::reset()
+{
+    memset(m_hist, 0, sizeof(m_hist));
+    m_pos = 0;
+    m_phase = m_up; // first output needs one input sample
+}
+
+void Resampler::push(const int16_t *frame)
+{
+    for (uint16_t c = 0; c < m_channels; ++c)
+    {
+        m_hist[c][m_pos] = frame[c];
+        m_hist[c][m_pos + m_taps] = frame[c];
+    }
+    m_pos = m_pos + 1 == m_taps ? 0 : m_pos + 1;
+}
+
+// Oldest-to-newest window against a reversed phase: one contiguous MAC
+int16_t Resampler::dot(const int16_t *coef, const int16_t *hist) const
+{
+    int32_t acc = 1 << 13;
+    for (size_t k = 0; k < m_taps; k += 4)
+    {
+        acc += coef[k + 0] * hist[k + 0];
+        acc += coef[k + 1] * hist[k + 1];
+        acc += coef[k + 2] * hist[k + 2];
+        acc += coef[k + 3] * hist[k + 3];
+    }
+    acc >>= 14;
+    acc = acc < -32768 ? -32768 : acc;
+    acc = acc > 32767 ? 32767 : acc;
+    return (int16_t)acc;
+}
+
+size_t Resampler::process(const int16_t *in, size_t inFrames, size_t &consumed,
+                          int16_t *out, size_t outFrames)
+{
+    const uint16_t ch = m_channels;
+    if (passthrough())
+    {
+        // Same rate: only the channel layout may change
+        size_t n = inFrames < outFrames ? inFrames : outFrames;
+        if (ch == 2)
+            memcpy(out, in, n * 2 * sizeof(int16_t));
+        else
+            for (size_t i = 0; i < n; ++i)
+                out[2 * i] = out[2 * i + 1] = in[i];
+        consumed = n;
+        return n;
+    }
+
+    size_t used = 0, made = 0;
+    while (made < outFrames)
+    {
+        while (m_phase >= m_up)
+        {
+            if (used == inFrames)
+            {
+                consumed = used;
+                return made;
+            }
+            push(in + used * ch);
+            used++;
+            m_phase -= m_up;
+        }
+        const int16_t *coef = m_coef + m_phase * m_taps;
+        int16_t l = dot(coef, &m_hist[0][m_pos]);
+        out[2 * made] = l;
+        out[2 * made + 1] = ch == 2 ? dot(coef, &m_hist[1][m_pos]) : l;
+        made++;
+        m_phase += m_down;
+    }
+    consumed = used;
+    return made;
+}
@@ -0,0 +1,476 @@
+#include "ResumableUploader.h"
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "Backoff.h"
+#include "ChunkedReader.h"
+#include "Crc32.h"
+
+static const uint32_t kStateMagic = 0x55504C31; // "UPL1"
+
+// "http://host[:port]/path" without Arduino String; a trailing slash on
+// the path is dropped so "<path>/uploads" comes out right
+static bool parseUrl(const char *url, char *host, size_t hostCap, uint16_t &port, char *path, size_t pathCap)
+{
+    if (strncmp(url, "http://", 7) != 0)
+        return false;
+    const char *h = url + 7;
+    const char *slash = strchr(h, '/');
+    const char *end = slash ? slash : h + strlen(h);
+    const char *colon = (const char *)memchr(h, ':', end - h);
+    const size_t hostLen = (colon ? colon : end) - h;
+    if (hostLen == 0 || hostLen >= hostCap)
+        return false;
+    memcpy(host, h, hostLen);
+    host[hostLen] = '\0';
+    port = colon ? (uint16_t)atoi(colon + 1) : 80;
+
+    size_t pathLen = slash ? strlen(slash) : 0;
+    while (pathLen > 0 && slash[pathLen - 1] == '/')
+        pathLen--;
+    if (pathLen >= pathCap)
+        return false;
+    memcpy(path, slash ? slash : "", pathLen);
+    path[pathLen] = '\0';
+    return true;
+}
+
+// The server's replies are small flat JSON objects: what follows "key":
+static const char *jsonValue(const char *json, const char *key)
+{
+    char pat[24];
+    snprintf(pat, sizeof(pat), "\"%s\"", key);
+    const char *p = strstr(json, pat);
+    if (!p)
+        return nullptr;
+    p += strlen(pat);
+    while (*p == ' ')
+        p++;
+    if (*p++ != ':')
+        return nullptr;
+    while (*p == ' ')
+        p++;
+    return p;
+}
+
+// The server refused this file's content; asking again won't help.
+// Auth, routing and rate limits (401, 403, 404, 429) may clear up.
+static bool rejected(int httpCode)
+{
+    return httpCode == 400 || httpCode == 413 || httpCode == 415 || httpCode == 422;
+}
+
+static int32_t jsonOffset(const char *json)
+{
+    const char *v = jsonValue(json, "offset");
+    if (!v || *v < '0' || *v > '9')
+        return -1;
+    return (int32_t)strtoul(v, nullptr, 10);
+}
+
+ResumableUploader::ResumableUploader(FileStore &store, HttpTransport &net, SchedulerClock &clock,
+                                     size_t partSize, const char *statePath)
+    : m_store(store), m_net(net), m_clock(clock), m_partSize(partSize)
+{
+    snprintf(m_statePath, sizeof(m_statePath), "%s", statePath);
+    snprintf(m_stateTmpPath, sizeof(m_stateTmpPath), "%s.tmp", statePath);
+    m_host[0] = m_base[0] = m_resp[0] = '\0';
+    m_path[0] = m_uploadId[0] = '\0';
+}
+
+// -------------------- session state --------------------
+bool ResumableUploader::loadState(const char *path, uint32_t size)
+{
+    m_uploadId[0] = '\0';
+    m_acked = 0;
+
+    std::unique_ptr<StoredFile> f = m_store.open(m_statePath, OpenMode::Read);
+    if (!f)
+        return false;
+    Session s;
+    const size_t got = f->read(reinterpret_cast<uint8_t *>(&s), sizeof(s));
+    if (got != sizeof(s) || s.magic != kStateMagic ||
+        s.check != crc32Update(0, reinterpret_cast<const uint8_t *>(&s), offsetof(Session, check)))
+        return false;
+
+    // Same path and size is our cue that it is the same recording
+    s.path[kMaxPath] = s.id[kMaxId] = '\0';
+    if (!s.id[0] || strcmp(s.path, path) != 0 || s.size != size || s.acked > size)
+        return false;
+
+    strcpy(m_uploadId, s.id);
+    m_acked = s.acked;
+    return true;
+}
+
+void ResumableUploader::saveState()
+{
+    Session s;
+    memset(&s, 0, sizeof(s));
+    s.magic = kStateMagic;
+    strcpy(s.path, m_path);
+    strcpy(s.id, m_uploadId);
+    s.size = m_size;
+    s.acked = m_acked;
+    s.check = crc32Update(0, reinterpret_cast<const uint8_t *>(&s), offsetof(Session, check));
+    {
+        std::unique_ptr<StoredFile> f = m_store.open(m_stateTmpPath, OpenMode::Write);
+        if (!f)
+            return;
+        f->write(reinterpret_cast<const uint8_t *>(&s), sizeof(s));
+        f->flush();
+    }
+    m_store.remove(m_statePath);
+    m_store.rename(m_stateTmpPath, m_statePath);
+}
+
+void ResumableUploader::forget()
+{
+    m_store.remove(m_statePath);
+    m_uploadId[0] = '\0';
+    m_acked = 0;
+}
+
+// -------------------- HTTP/1.1 --------------------
+void ResumableUploader::disconnect()
+{
+    if (m_conn)
+        m_conn->close();
+    m_conn.reset();
+}
+
+// One line of the response head without the CRLF; false on timeout or
+// when the server hung up
+bool ResumableUploader::readLine(char *line, size_t cap)
+{
+    size_t len = 0;
+    const uint32_t t0 = m_clock.nowMs();
+    for (;;)
+    {
+        if (m_conn->available() <= 0)
+        {
+            if (!m_conn->connected() || m_clock.nowMs() - t0 >= m_policy.timeoutMs)
+                return false;
+            m_clock.waitMs(5);
+            continue;
+        }
+        uint8_t c;
+        if (m_conn->read(&c, 1) != 1)
+            return false;
+        if (c == '\n')
+            break;
+        if (c != '\r' && len < cap - 1)
+            line[len++] = (char)c;
+    }
+    line[len] = '\0';
+    return true;
+}
+
+// The kept connection as a blocking stream for the body: waits for
+// bytes on the clock, 0 once the server hung up or the deadline passed
+class TimedReader : public ByteStream
+{
+public:
+    TimedReader(NetConnection &conn, SchedulerClock &clock, uint32_t timeoutMs)
+        : m_conn(conn), m_clock(clock), m_t0(clock.nowMs()), m_timeoutMs(timeoutMs) {}
+
+    size_t read(uint8_t *dst, size_t len) override
+    {
+        for (;;)
+        {
+            const int avail = m_conn.available();
+            if (avail > 0)
+                return m_conn.read(dst, len < (size_t)avail ? len : (size_t)avail);
+            if (!m_conn.connected())
+                return 0;
+            if (m_clock.nowMs() - m_t0 >= m_timeoutMs)
+            {
+                m_timedOut = true;
+                return 0;
+            }
+            m_clock.waitMs(5);
+        }
+    }
+    size_t write(const uint8_t *, size_t) override { return 0; }
+    bool timedOut() const { return m_timedOut; }
+
+private:
+    NetConnection &m_conn;
+    SchedulerClock &m_clock;
+    const uint32_t m_t0;
+    const uint32_t m_timeoutMs;
+    bool m_timedOut = false;
+};
+
+// Status line, headers, then the body into m_resp (what doesn't fit is
+// read and dropped). Interim 1xx replies are skipped. HEAD, 204 and 304
+// replies have no body; otherwise it is chunked, Content-Length, or runs
+// to the end of the connection.
+bool ResumableUploader::readResponse(const char *method, int &status)
+{
+    char line[128];
+    long length;
+    bool close, chunked;
+    do
+    {
+        if (!readLine(line, sizeof(line)) || strncmp(line, "HTTP/1.", 7) != 0 || strlen(line) < 12)
+            return false;
+        status = atoi(line + 9);
+        length = -1;
+        close = chunked = false;
+        for (;;)
+        {
+            if (!readLine(line, sizeof(line)))
+                return false;
+            if (!line[0])
+                break;
+            if (!strncasecmp(line, "Content-Length:", 15))
+                length = strtol(line + 15, nullptr, 10);
+            else if (!strncasecmp(line, "Transfer-Encoding:", 18) && strstr(line + 18, "chunked"))
+                chunked = true;
+            else if (!strncasecmp(line, "Connection:", 11) && strstr(line + 11, "close"))
+                close = true;
+        }
+    } while (status >= 100 && status < 200);
+
+    size_t kept = 0;
+    m_resp[0] = '\0';
+    const bool bodiless = !strcmp(method, "HEAD") || status == 204 || status == 304;
+    if (!bodiless)
+    {
+        TimedReader in(*m_conn, m_clock, m_policy.timeoutMs);
+        ChunkedReader chunks(in);
+        ByteStream &body = chunked ? static_cast<ByteStream &>(chunks) : in;
+        const bool framed = !chunked && length >= 0;
+        long left = framed ? length : LONG_MAX;
+        uint8_t buf[64];
+        while (left > 0)
+        {
+            const size_t n = body.read(buf, left < (long)sizeof(buf) ? (size_t)left : sizeof(buf));
+            if (n == 0)
+                break;
+            const size_t keep = n < sizeof(m_resp) - 1 - kept ? n : sizeof(m_resp) - 1 - kept;
+            memcpy(m_resp + kept, buf, keep);
+            kept += keep;
+            m_resp[kept] = '\0';
+            left -= n;
+        }
+        const bool complete = chunked ? chunks.ended() : framed ? left == 0 : !in.timedOut();
+        if (!complete)
+            return false;
+    }
+    if (close || (!bodiless && !chunked && length < 0))
+        disconnect();
+    return true;
+}
+
+// One request on the kept connection, reopening it if the server closed
+// it. body (optional) is streamed from offset. Returns the status code,
+// or -1 on a transport error, after which the connection is dropped.
+int ResumableUploader::request(const char *method, const char *path, const char *headers, StoredFile *body,
+                               uint32_t offset, size_t len)
+{
+    m_resp[0] = '\0';
+    if (!m_conn || !m_conn->connected())
+    {
+        disconnect();
+        m_conn = m_net.connect(m_host, m_port);
+        if (!m_conn)
+            return -1;
+        m_stats.connects++;
+    }
+
+    char head[384];
+    const int n = snprintf(head, sizeof(head),
+                           "%s %s%s HTTP/1.1\r\n"
+                           "Host: %s\r\n"
+                           "Content-Length: %u\r\n"
+                           "%s\r\n",
+                           method, m_base, path, m_host, (unsigned)len, headers);
+    bool ok = n > 0 && n < (int)sizeof(head) &&
+              m_conn->write(reinterpret_cast<const uint8_t *>(head), n) == (size_t)n;
+
+    if (ok && body)
+    {
+        uint8_t buf[512];
+        ok = body->seek(offset);
+        for (size_t left = len; ok && left > 0;)
+        {
+            const size_t got = body->read(buf, left < sizeof(buf) ? left : sizeof(buf));
+            ok = got > 0 && m_conn->write(buf, got) == got;
+            left -= got;
+        }
+    }
+
+    int status = -1;
+    if (!ok || !readResponse(method, status))
+    {
+        disconnect();
+        return -1;
+    }
+    return status;
+}
+
+bool ResumableUploader::createSession(const char *contentType)
+{
+    char headers[128];
+    snprintf(headers, sizeof(headers), "Content-Type: %s\r\nUpload-Length: %u\r\n", contentType, (unsigned)m_size);
+    const int httpCode = request("POST", "/uploads", headers, nullptr, 0, 0);
+    m_rejected = rejected(httpCode);
+    if (httpCode != 200 && httpCode != 201)
+        return false;
+
+    const char *v = jsonValue(m_resp, "uploadId");
+    const char *end = v && *v == '"' ? strchr(v + 1, '"') : nullptr;
+    if (!end || end == v + 1 || (size_t)(end - v - 1) > kMaxId)
+        return false; // bad response
+    memcpy(m_uploadId, v + 1, end - v - 1);
+    m_uploadId[end - v - 1] = '\0';
+
+    const int32_t at = jsonOffset(m_resp);
+    m_acked = at > 0 && (uint32_t)at <= m_size ? at : 0;
+    m_stats.sessions++;
+    saveState();
+    return true;
+}
+
+// Server's acknowledged offset, -1 on a transport error, -2 if the
+// session is gone (expired or never existed)
+int32_t ResumableUploader::queryOffset()
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/uploads/%s", m_uploadId);
+    const int httpCode = request("GET", path, "", nullptr, 0, 0);
+    if (httpCode == 404 || httpCode == 410)
+        return -2;
+    if (httpCode != 200)
+        return -1;
+    return jsonOffset(m_resp);
+}
+
+// Returns the server's new offset, or -1 on failure. A checksum reject
+// (409) still reports the server offset so we resend from there.
+int32_t ResumableUploader::sendPart(StoredFile &f, uint32_t offset, size_t len)
+{
+    // First pass for the checksum, second pass streams the body
+    uint8_t buf[512];
+    uint32_t crc = 0;
+    m_rejected = !f.seek(offset); // shorter than when we started
+    for (size_t left = len; left > 0 && !m_rejected;)
+    {
+        const size_t n = f.read(buf, left < sizeof(buf) ? left : sizeof(buf));
+        m_rejected = n == 0;
+        crc = crc32Update(crc, buf, n);
+        left -= n;
+    }
+    if (m_rejected)
+        return -1;
+
+    char headers[160], path[64];
+    snprintf(headers, sizeof(headers),
+             "Content-Type: application/octet-stream\r\n"
+             "Upload-Offset: %u\r\n"
+             "Upload-Checksum: crc32 %08x\r\n",
+             (unsigned)offset, (unsigned)crc);
+    snprintf(path, sizeof(path), "/uploads/%s", m_uploadId);
+
+    const int httpCode = request("PUT", path, headers, &f, offset, len);
+    m_rejected = rejected(httpCode);
+    if (httpCode != 200 && httpCode != 204 && httpCode != 409)
+        return -1;
+    if (!m_resp[0])
+        return httpCode == 409 ? -1 : (int32_t)(offset + len);
+    return jsonOffset(m_resp);
+}
+
+// One pass: sync with the server, then send parts until done. Returns
+// false on the first failure; m_acked tells the caller how far we got.
+bool ResumableUploader::sendRemaining(StoredFile &f, const char *contentType)
+{
+    if (!m_uploadId[0])
+    {
+        if (!createSession(contentType))
+            return false;
+    }
+    else
+    {
+        const int32_t at = queryOffset();
+        if (at == -2)
+        {
+            // Session expired; start over
+            forget();
+            return sendRemaining(f, contentType);
+        }
+        if (at < 0 || (uint32_t)at > m_size)
+            return false;
+        m_acked = at;
+        saveState();
+    }
+
+    while (m_acked < m_size)
+    {
+        const size_t len = m_size - m_acked < m_partSize ? m_size - m_acked : m_partSize;
+        const int32_t at = sendPart(f, m_acked, len);
+        if (at < 0 || (uint32_t)at <= m_acked || (uint32_t)at > m_size)
+            return false; // transport error, checksum reject or no progress
+        m_acked = at;
+        m_stats.parts++;
+        saveState();
+    }
+    return true;
+}
+
+ResumableUploader::Result ResumableUploader::upload(const char *path, const char *baseUrl, const char *contentType)
+{
+    std::unique_ptr<StoredFile> f = m_store.open(path, OpenMode::Read);
+    if (!f || strlen(path) > kMaxPath)
+        return Result::Failed; // nothing to upload
+    if (!parseUrl(baseUrl, m_host, sizeof(m_host), m_port, m_base, sizeof(m_base)))
+        return Result::Retry; // not this file's fault
+
+    snprintf(m_path, sizeof(m_path), "%s", path);
+    m_size = f->size();
+    loadState(path, m_size);
+    // Jitter seed: devices that lost the server together reach this at
+    // different times
+    const uint32_t now = m_clock.nowMs();
+    m_rnd = crc32Update(crc32Update(0, reinterpret_cast<const uint8_t *>(&now), sizeof(now)),
+                        reinterpret_cast<const uint8_t *>(path), strlen(path)) | 1;
+
+    Result result = Result::Retry;
+    m_rejected = false;
+    uint8_t attempt = 0;
+    for (;;)
+    {
+        const uint32_t before = m_acked;
+        if (sendRemaining(*f, contentType))
+        {
+            result = Result::Done;
+            break;
+        }
+        if (m_rejected)
+        {
+            result = Result::Failed;
+            break;
+        }
+        if (m_acked > before)
+            attempt = 0; // the budget is per part, not per file
+        if (++attempt >= m_policy.maxAttempts)
+            break;
+
+        m_rnd ^= m_rnd << 13;
+        m_rnd ^= m_rnd >> 17;
+        m_rnd ^= m_rnd << 5;
+        m_stats.retries++;
+        m_clock.waitMs(backoffMs(attempt, m_policy.baseDelayMs, m_policy.maxDelayMs, m_rnd)); // wake() retries now
+    }
+
+    disconnect();
+    f.reset();
+    if (result != Result::Retry)
+        forget();
+    return result;
+}
@@ -0,0 +1,205 @@
+#include "Scheduler.h"
+
+static const uint32_t kSlotMask = Scheduler::kWheelSlots - 1;
+static const uint32_t kQueueMask = Scheduler::kQueueSize - 1;
+
+// millis() wraps every ~49 days; compare through the signed difference
+static inline bool before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+Scheduler::Scheduler(SchedulerClock &clock)
+    : m_clock(clock), m_cursor(clock.nowMs())
+{
+    for (uint32_t i = 0; i < kQueueSize; ++i)
+        m_cells[i].seq.store(i, std::memory_order_relaxed);
+}
+
+// -------------------- timers --------------------
+// A timer sits in the slot of its due tick, or of the next unprocessed
+// tick if that is already past. Slots are only a filter: timers more than
+// one revolution out share a slot with nearer ones and are skipped until
+// their due time comes round.
+void Scheduler::link(SchedTimer &t)
+{
+    const uint32_t tick = before(t.m_due, m_cursor) ? m_cursor : t.m_due;
+    SchedTimer *&head = m_slots[tick & kSlotMask];
+    t.m_next = head;
+    if (head)
+        head->m_pprev = &t.m_next;
+    head = &t;
+    t.m_pprev = &head;
+}
+
+void Scheduler::unlink(SchedTimer &t)
+{
+    if (!t.m_pprev)
+        return;
+    *t.m_pprev = t.m_next;
+    if (t.m_next)
+        t.m_next->m_pprev = t.m_pprev;
+    t.m_next = nullptr;
+    t.m_pprev = nullptr;
+}
+
+void Scheduler::startTimer(SchedTimer &t, uint32_t delayMs, uint32_t periodMs)
+{
+    unlink(t);
+    t.m_due = m_clock.nowMs() + delayMs;
+    t.m_period = periodMs;
+    link(t);
+}
+
+void Scheduler::stopTimer(SchedTimer &t)
+{
+    unlink(t);
+}
+
+void Scheduler::runSlot(size_t slot, uint32_t now)
+{
+    // Move the slot onto a local list first: callbacks may stop, restart
+    // or start any timer, including ones still waiting on this list
+    SchedTimer *pending = m_slots[slot];
+    m_slots[slot] = nullptr;
+    if (pending)
+        pending->m_pprev = &pending;
+
+    while (pending)
+    {
+        SchedTimer &t = *pending;
+        unlink(t);
+        if (before(now, t.m_due))
+        {
+            link(t); // a later revolution
+            continue;
+        }
+        if (t.m_period)
+        {
+            // Next beat keeps the phase; beats missed while the loop was
+            // busy are skipped rather than fired back to back
+            const uint32_t late = now - t.m_due;
+            t.m_due += t.m_period * (late / t.m_period + 1);
+            link(t);
+        }
+        t.m_cb(t, t.m_ctx);
+    }
+}
+
+uint32_t Scheduler::nextWait(uint32_t now) const
+{
+    // A handful of timers: scanning them beats keeping a heap in order
+    uint32_t wait = SchedulerClock::kForever;
+    for (size_t s = 0; s < kWheelSlots; ++s)
+    {
+        for (const SchedTimer *t = m_slots[s]; t; t = t->m_next)
+        {
+            const uint32_t tick = before(t->m_due, m_cursor) ? m_cursor : t->m_due;
+            const uint32_t w = before(now, tick) ? tick - now : 0;
+            if (w < wait)
+                wait = w;
+        }
+    }
+    return wait;
+}
+
+// -------------------- events --------------------
+bool Scheduler::subscribe(uint16_t event, EventHandler fn, void *ctx)
+{
+    if (m_handlerCount >= kMaxHandlers)
+        return false;
+    m_handlers[m_handlerCount].event = event;
+    m_handlers[m_handlerCount].fn = fn;
+    m_handlers[m_handlerCount].ctx = ctx;
+    m_handlerCount++;
+    return true;
+}
+
+bool Scheduler::post(uint16_t event, uint32_t arg)
+{
+    uint32_t pos = m_enqueue.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;)
+    {
+        cell = &m_cells[pos & kQueueMask];
+        const int32_t dif = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+        if (dif == 0)
+        {
+            if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (dif < 0)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = m_enqueue.load(std::memory_order_relaxed);
+        }
+    }
+    cell->event = event;
+    cell->arg = arg;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    m_clock.wake();
+    return true;
+}
+
+bool Scheduler::pop(uint16_t &event, uint32_t &arg)
+{
+    Cell &cell = m_cells[m_dequeue & kQueueMask];
+    if (cell.seq.load(std::memory_order_acquire) != m_dequeue + 1)
+        return false; // empty, or a producer is still filling it in
+    event = cell.event;
+    arg = cell.arg;
+    cell.seq.store(m_dequeue + kQueueSize, std::memory_order_release);
+    m_dequeue++;
+    return true;
+}
+
+bool Scheduler::queueEmpty() const
+{
+    return m_cells[m_dequeue & kQueueMask].seq.load(std::memory_order_acquire) != m_dequeue + 1;
+}
+
+// -------------------- loop --------------------
+uint32_t Scheduler::runDue()
+{
+    // Only what is queued now; events posted by handlers wait a pass so
+    // a chatty handler can't starve the timers
+    uint32_t n = m_enqueue.load(std::memory_order_acquire) - m_dequeue;
+    uint16_t event;
+    uint32_t arg;
+    while (n-- > 0 && pop(event, arg))
+    {
+        for (size_t i = 0; i < m_handlerCount; ++i)
+            if (m_handlers[i].event == event)
+                m_handlers[i].fn(event, arg, m_handlers[i].ctx);
+    }
+
+    const uint32_t now = m_clock.nowMs();
+    if (!before(now, m_cursor))
+    {
+        // After a long callback or sleep one lap covers every slot
+        const uint32_t from = m_cursor;
+        uint32_t ticks = now - from + 1;
+        if (ticks > kWheelSlots)
+            ticks = kWheelSlots;
+        m_cursor = now + 1; // timers armed by callbacks land after this pass
+        for (uint32_t i = 0; i < ticks; ++i)
+            runSlot((from + i) & kSlotMask, now);
+    }
+
+    return queueEmpty() ? nextWait(m_clock.nowMs()) : 0;
+}
+
+void Scheduler::step()
+{
+    const uint32_t wait = runDue();
+    if (wait == 0)
+        return;
+    const uint32_t t0 = m_clock.nowMs();
+    m_clock.waitMs(wait);
+    m_idleMs += m_clock.nowMs() - t0;
+    m_wakeups++;
+}
@@ -1,143 +1,385 @@
 #include "SpeakerModule.h"
+#include "HttpConnectionPool.h"
+#include "Trace.h"
+#include "Metrics.h"
+#include "PowerManager.h"
 
-// Match recorder defaults
+static metrics::Counter s_underruns("play_underruns");
+static metrics::Histogram s_firstAudioMs("play_first_audio_ms", {50, 100, 200, 300, 500, 1000, 2000});
+
+// Match recorder defaults. Everything is resampled to this; I2S is never
+// reclocked, which is what used to pop between clips.
 #define PLAY_SAMPLE_RATE 16000
 
+static const size_t kBlockFrames = BufferPool::kBlockBytes / (2 * sizeof(int16_t));
+
 SpeakerModule::SpeakerModule(int i2s_num, int bck_pin, int ws_pin, int data_pin)
-    : m_i2s_num(i2s_num), m_bck_pin(bck_pin), m_ws_pin(ws_pin), m_data_pin(data_pin) {}
+    : m_i2s(i2s_num, bck_pin, ws_pin, data_pin), m_resampler(PLAY_SAMPLE_RATE) {}
 
-void SpeakerModule::begin()
+void SpeakerModule::setDmaBuffers(int count, int len)
 {
-    const i2s_config_t i2s_config = {
-        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
-        .sample_rate = PLAY_SAMPLE_RATE,
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT, // we will send 16-bit stereo frames
-        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT, // interleaved stereo
-        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
-        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 4,
-        .dma_buf_len = 64};
+    m_i2s.setDmaBuffers(count, len);
+}
 
-    i2s_driver_install((i2s_port_t)m_i2s_num, &i2s_config, 0, NULL);
+void SpeakerModule::setAudioSink(AudioSink *sink)
+{
+    if (m_outputTask)
+        return;
+    m_sink = sink ? sink : &m_i2s;
+}
 
-    const i2s_pin_config_t pins = {
-        .bck_io_num = m_bck_pin,
-        .ws_io_num = m_ws_pin,
-        .data_out_num = m_data_pin,
-        .data_in_num = I2S_PIN_NO_CHANGE};
-    i2s_set_pin((i2s_port_t)m_i2s_num, &pins);
+void SpeakerModule::setFileStore(FileStore *store)
+{
+    if (m_playing)
+        return;
+    m_store = store ? store : &SpiffsStore::shared();
 }
 
-static bool readAndValidateWavHeader(fs::File &f, uint32_t &dataOffset, uint32_t &dataSize,
-                                     uint32_t &sampleRate, uint16_t &bitsPerSample, uint16_t &channels)
+void SpeakerModule::begin()
 {
-    if (!f)
-        return false;
-    if (f.size() < 44)
-        return false;
+    m_sink->begin(PLAY_SAMPLE_RATE);
+    BufferPool::audio().begin();
 
-    // Read minimal 44B header
-    uint8_t h[44];
-    if (f.read(h, 44) != 44)
-        return false;
+    // File/network reads on core 1 next to loop(); output above them so
+    // a slow read never starves I2S while the ring still has data
+    xTaskCreatePinnedToCore(&SpeakerModule::fetchTaskThunk, "spk_fetch", 5120, this, 4, &m_fetchTask, 1);
+    xTaskCreatePinnedToCore(&SpeakerModule::outputTaskThunk, "spk_out", 3072, this, 10, &m_outputTask, 1);
+    metrics::Registry::shared().watchTask("spk_fetch", m_fetchTask);
+    metrics::Registry::shared().watchTask("spk_out", m_outputTask);
+}
 
-    auto rd32 = [&](int idx) -> uint32_t
+// -------------------- control --------------------
+// size = total stream length if known (0 = unknown), to bound the chunks
+bool SpeakerModule::openClip(ByteStream &src, uint32_t size)
+{
+    WavReader::Error err = m_wav.parse(src, size);
+    if (err != WavReader::Error::None)
     {
-        return (uint32_t)h[idx] | ((uint32_t)h[idx + 1] << 8) | ((uint32_t)h[idx + 2] << 16) | ((uint32_t)h[idx + 3] << 24);
-    };
-    auto rd16 = [&](int idx) -> uint16_t
-    { return (uint16_t)h[idx] | ((uint16_t)h[idx + 1] << 8); };
-
-    if (memcmp(&h[0], "RIFF", 4) != 0 || memcmp(&h[8], "WAVE", 4) != 0)
+        Serial.printf("[PLAY] Not a playable WAV: %s\n", WavReader::errorName(err));
         return false;
-    if (memcmp(&h[12], "fmt ", 4) != 0)
+    }
+    const WavReader::Format &fmt = m_wav.format();
+    if (fmt.channels > 2 || !m_resampler.configure(fmt.sampleRate, fmt.channels))
+    {
+        Serial.printf("[PLAY] Unsupported: %u Hz, %u channels\n", (unsigned)fmt.sampleRate, (unsigned)fmt.channels);
         return false;
-    uint16_t audioFormat = rd16(20);
-    channels = rd16(22);
-    sampleRate = rd32(24);
-    bitsPerSample = rd16(34);
-    if (audioFormat != 1)
-        return false; // PCM only
-
-    // We wrote a canonical header, so assume data chunk immediately follows
-    if (memcmp(&h[36], "data", 4) != 0)
+    }
+    m_src = &src;
+    m_channels = fmt.channels;
+    return true;
+}
+
+bool SpeakerModule::startPlayback(ByteStream &src, uint32_t size)
+{
+    if (!openClip(src, size))
         return false;
-    dataSize = rd32(40);
-    dataOffset = 44;
+    startTasks();
     return true;
 }
 
-bool SpeakerModule::playFile(const char *path)
+// Without a source yet (playUrl) the fetch task opens it first and
+// wakes the output task itself
+void SpeakerModule::startTasks()
+{
+    m_queue.reset(); // empty: the output task drains it after every clip
+    m_stopRequested = false;
+    m_failed = false;
+    m_fetchDone = false;
+    m_playing = true;
+    PowerManager::shared().setBusy(PowerPolicy::Playback, true);
+
+    xTaskNotifyGive(m_fetchTask);
+    if (m_src)
+        xTaskNotifyGive(m_outputTask);
+}
+
+bool SpeakerModule::play(const char *path)
 {
-    fs::File f = SPIFFS.open(path, FILE_READ);
-    if (!f)
+    stop();
+    m_file = m_store->open(path, OpenMode::Read);
+    if (!m_file)
     {
         Serial.println("[PLAY] Failed to open file");
         return false;
     }
+    if (!startPlayback(*m_file, m_file->size()))
+    {
+        m_file.reset();
+        return false;
+    }
+    return true;
+}
 
-    uint32_t dataOffset = 0, dataSize = 0, sampleRate = 0;
-    uint16_t bps = 0, ch = 0;
-    if (!readAndValidateWavHeader(f, dataOffset, dataSize, sampleRate, bps, ch))
+bool SpeakerModule::playStream(ByteStream &src)
+{
+    stop();
+    return startPlayback(src, 0);
+}
+
+bool SpeakerModule::playUrl(const String &url)
+{
+    stop();
+    m_url = url;
+    m_src = nullptr;
+    startTasks();
+    return true;
+}
+
+// Fetch task: the request, then the WAV header off the body
+bool SpeakerModule::openUrl()
+{
+    static const char *kHeaders[] = {"Transfer-Encoding"};
+    m_request = new PooledRequest(m_url); // freed with the source
+    m_request->http().collectHeaders(kHeaders, 1);
+    const int httpCode = m_request->send("GET");
+    if (httpCode != HTTP_CODE_OK)
     {
-        Serial.println("[PLAY] Not a supported WAV (expect 16-bit PCM)");
-        f.close();
+        Serial.printf("[PLAY] GET failed: %d\n", httpCode);
         return false;
     }
+    // getStream() is the raw socket, so a chunked body (getSize() == -1)
+    // still has its framing; without either the body runs to the close
+    m_body.reset(new StreamReader(m_request->http().getStream()));
+    const int len = m_request->http().getSize();
+    if (len < 0 && m_request->http().header("Transfer-Encoding").equalsIgnoreCase("chunked"))
+    {
+        m_chunked.reset(new ChunkedReader(*m_body));
+        return openClip(*m_chunked, 0);
+    }
+    return openClip(*m_body, len > 0 ? (uint32_t)len : 0);
+}
+
+bool SpeakerModule::playFile(const char *path)
+{
+    if (!play(path))
+        return false;
+    while (m_playing)
+        vTaskDelay(pdMS_TO_TICKS(10));
+    return true;
+}
+
+void SpeakerModule::stop()
+{
+    if (!m_playing)
+        return;
+    requestStop();
+    while (m_playing)
+        vTaskDelay(pdMS_TO_TICKS(2));
+}
+
+void SpeakerModule::requestStop()
+{
+    if (m_playing)
+        m_stopRequested = true;
+}
 
-    // Reconfigure sample rate if header differs
-    i2s_set_sample_rates((i2s_port_t)m_i2s_num, sampleRate);
+void SpeakerModule::setDoneCallback(DoneCallback cb, void *ctx)
+{
+    m_doneCtx = ctx;
+    m_doneCb = cb;
+}
 
-    // Seek to data and play
-    f.seek(dataOffset, SeekSet);
-    const size_t MONO_SAMPLES = 512; // mono samples per read
-    static int16_t mono[MONO_SAMPLES];
-    static int16_t stereo[MONO_SAMPLES * 2];
+// -------------------- pipeline --------------------
+void SpeakerModule::writeSilence(size_t frames)
+{
+    static const int16_t zeros[64 * 2] = {0};
+    while (frames > 0)
+    {
+        size_t n = min(frames, (size_t)64);
+        m_sink->write(zeros, n);
+        frames -= n;
+    }
+}
+
+void SpeakerModule::fetchTaskThunk(void *arg)
+{
+    static_cast<SpeakerModule *>(arg)->fetchTask();
+}
 
-    i2s_zero_dma_buffer((i2s_port_t)m_i2s_num);
-    i2s_start((i2s_port_t)m_i2s_num);
+// Blocks in flight are bounded by the queue; the pool only runs dry if
+// another module holds more than its share, so wait it out
+PoolBlock SpeakerModule::waitBlock()
+{
+    for (;;)
+    {
+        PoolBlock blk = BufferPool::audio().acquire();
+        if (blk || m_stopRequested)
+            return blk;
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+}
 
-    size_t remaining = dataSize;
-    while (remaining > 0)
+// Hands a filled block to the output task, backing off while the queue is full
+bool SpeakerModule::queueBlock(PoolBlock &blk)
+{
+    while (m_queue.size() == m_queue.capacity())
     {
-        size_t toReadBytes = min(remaining, MONO_SAMPLES * sizeof(int16_t));
-        size_t got = f.read((uint8_t *)mono, toReadBytes);
-        if (got == 0)
-            break;
+        if (m_stopRequested)
+            return false;
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    uint8_t idx = blk.detach();
+    m_queue.push(&idx, 1);
+    return true;
+}
 
-        size_t samples = got / sizeof(int16_t);
+// Consumer side only, once the fetcher is done
+void SpeakerModule::dropQueued()
+{
+    uint8_t idx;
+    while (m_queue.pop(&idx, 1))
+        BufferPool::audio().adopt(idx); // released as the handle goes
+}
 
-        // If source is mono, duplicate to both L/R. If it's stereo, you could bypass this copy.
-        if (ch == 1)
+// Producer: read ahead as fast as the source allows, resample straight
+// into pool blocks and queue them. Owns closing the source.
+void SpeakerModule::fetchTask()
+{
+    int16_t in[256 * 2];
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!m_playing || m_fetchDone)
+            continue;
+        if (!m_src)
         {
-            for (size_t i = 0, j = 0; i < samples; ++i)
+            // playUrl(): nothing reached the output task yet, so a failed
+            // open ends the clip here
+            if (m_stopRequested || !openUrl())
             {
-                int16_t s = mono[i];
-                stereo[j++] = s; // Right
-                stereo[j++] = s; // Left
+                closeSource();
+                m_fetchDone = true;
+                finish(false);
+                continue;
             }
+            xTaskNotifyGive(m_outputTask);
         }
-        else
+
+        PoolBlock blk;
+        size_t filled = 0; // frames in blk
+        while (!m_stopRequested)
         {
-            // If recorded/stored as stereo 16-bit, just read straight through.
-            // Here we only handle mono for simplicity; real stereo would read directly to `stereo`.
-            for (size_t i = 0, j = 0; i < samples; i += 2)
+            // 0 at the end of the data or on a read timeout
+            size_t frames = m_wav.readFrames(*m_src, in, 256);
+            if (frames == 0)
+                break;
+
+            const int16_t *p = in;
+            while (frames > 0 && !m_stopRequested)
             {
-                stereo[j++] = mono[i];     // Right (first)
-                stereo[j++] = mono[i + 1]; // Left (second)
+                if (!blk)
+                {
+                    blk = waitBlock();
+                    filled = 0;
+                    if (!blk)
+                        break;
+                }
+                size_t used = 0;
+                filled += m_resampler.process(p, frames, used, blk.as<int16_t>() + filled * 2, kBlockFrames - filled);
+                p += used * m_channels;
+                frames -= used;
+                if (filled == kBlockFrames)
+                {
+                    blk.setLength(filled * 2 * sizeof(int16_t));
+                    queueBlock(blk);
+                }
             }
         }
+        if (blk && filled > 0)
+        {
+            blk.setLength(filled * 2 * sizeof(int16_t));
+            queueBlock(blk);
+        }
+        blk.reset();
+        if (m_chunked && m_chunked->failed())
+            m_failed = true;
 
-        size_t bytesToWrite = samples * 2 * sizeof(int16_t); // stereo
-        size_t wrote = 0;
-        i2s_write((i2s_port_t)m_i2s_num, (const void *)stereo, bytesToWrite, &wrote, portMAX_DELAY);
+        closeSource();
+        m_fetchDone = true;
+        xTaskNotifyGive(m_outputTask);
+    }
+}
 
-        if (wrote < bytesToWrite)
-            break; // underrun/stop
-        remaining -= got;
+void SpeakerModule::closeSource()
+{
+    m_file.reset();
+    m_chunked.reset();
+    m_body.reset();
+    if (m_request)
+    {
+        delete m_request; // hands the socket back to the pool
+        m_request = nullptr;
     }
+    m_src = nullptr;
+}
 
-    i2s_stop((i2s_port_t)m_i2s_num);
-    f.close();
-    return true;
-}
\ No newline at end of file
+// Clip over: idle again, and tell the app
+void SpeakerModule::finish(bool completed)
+{
+    m_playing = false;
+    PowerManager::shared().setBusy(PowerPolicy::Playback, false);
+    if (m_doneCb)
+        m_doneCb(completed, m_doneCtx);
+}
+
+void SpeakerModule::outputTaskThunk(void *arg)
+{
+    static_cast<SpeakerModule *>(arg)->outputTask();
+}
+
+// Consumer: pre-roll, then keep I2S fed until the clip ends or stop()
+void SpeakerModule::outputTask()
+{
+    const uint32_t blockMs = kBlockFrames * 1000 / PLAY_SAMPLE_RATE;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!m_playing)
+            continue;
+
+        m_gate.start(min((size_t)((m_preRollMs + blockMs - 1) / blockMs), m_queue.capacity() - 1));
+        const uint32_t t0 = millis();
+        while (!m_gate.ready(m_queue.size(), m_fetchDone) && !m_stopRequested)
+            vTaskDelay(pdMS_TO_TICKS(5));
+        s_firstAudioMs.record(millis() - t0); // no Serial on this task: a printf can stall the sink
+
+        m_sink->start();
+        trace::begin(TraceEvent::Play, m_resampler.inRate());
+
+        const size_t silenceFrames = PLAY_SAMPLE_RATE / 100; // 10 ms
+        while (!m_stopRequested)
+        {
+            const bool fetchDone = m_fetchDone;
+            const PlayoutGate::Step step = m_gate.next(m_queue.size(), fetchDone);
+            if (step == PlayoutGate::Step::End)
+                break;
+            if (step != PlayoutGate::Step::Play)
+            {
+                if (step == PlayoutGate::Step::Underrun)
+                {
+                    m_underruns++;
+                    s_underruns.add();
+                    trace::instant(TraceEvent::Underrun);
+                }
+                writeSilence(silenceFrames);
+                continue;
+            }
+            uint8_t idx;
+            m_queue.pop(&idx, 1); // only this task pops, so it's there
+            PoolBlock blk = BufferPool::audio().adopt(idx);
+            const size_t frames = blk.length() / (2 * sizeof(int16_t));
+            trace::begin(TraceEvent::PlayWrite);
+            m_sink->write(blk.as<int16_t>(), frames);
+            trace::end(TraceEvent::PlayWrite, frames);
+        }
+
+        m_sink->stop();
+        trace::end(TraceEvent::Play, m_underruns);
+
+        // Let the fetcher close the source before we report idle
+        while (!m_fetchDone)
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        dropQueued(); // anything left after stop() goes back to the pool
+        finish(!m_stopRequested && !m_failed);
+    }
+}
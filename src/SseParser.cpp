@@ -0,0 +1,162 @@
+#include "SseParser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+void SseParser::setCallback(EventCallback cb, void *ctx)
+{
+    m_cb = cb;
+    m_cbCtx = ctx;
+}
+
+void SseParser::reset()
+{
+    m_state = State::Status;
+    m_status = -1;
+    m_chunked = false;
+    m_chunkLeft = 0;
+    m_headLen = 0;
+    m_lineLen = 0;
+    m_event[0] = '\0';
+    m_dataLen = 0;
+}
+
+void SseParser::feed(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        const char c = (char)data[i];
+        switch (m_state)
+        {
+        case State::Status:
+        case State::Headers:
+        case State::ChunkSize:
+            if (c == '\n')
+            {
+                m_head[m_headLen] = '\0';
+                m_headLen = 0;
+                headLine();
+            }
+            else if (c != '\r' && m_headLen < sizeof(m_head) - 1)
+            {
+                m_head[m_headLen++] = c;
+            }
+            break;
+        case State::Body:
+            bodyByte(c);
+            break;
+        case State::ChunkData:
+            bodyByte(c);
+            if (--m_chunkLeft == 0)
+                m_state = State::ChunkEnd;
+            break;
+        case State::ChunkEnd:
+            if (c == '\n')
+                m_state = State::ChunkSize;
+            break;
+        case State::Ended:
+            return;
+        }
+    }
+}
+
+// Status line, a header, or a chunk size
+void SseParser::headLine()
+{
+    if (m_state == State::Status)
+    {
+        m_status = strncmp(m_head, "HTTP/", 5) == 0 && strlen(m_head) >= 12 ? atoi(m_head + 9) : -1;
+        m_state = State::Headers;
+    }
+    else if (m_state == State::Headers)
+    {
+        if (m_head[0] == '\0')
+            // Only a 200 carries events; anything else is an error page
+            m_state = m_status != 200 ? State::Ended : m_chunked ? State::ChunkSize : State::Body;
+        else if (!strncasecmp(m_head, "Transfer-Encoding:", 18) && strstr(m_head + 18, "chunked"))
+            m_chunked = true;
+    }
+    else if (m_head[0] != '\0')
+    {
+        m_chunkLeft = strtoul(m_head, nullptr, 16);
+        m_state = m_chunkLeft ? State::ChunkData : State::Ended; // last chunk: server ended the stream
+    }
+}
+
+void SseParser::bodyByte(char c)
+{
+    if (c == '\n')
+    {
+        m_line[m_lineLen] = '\0';
+        m_lineLen = 0;
+        handleLine(m_line);
+    }
+    else if (c != '\r' && m_lineLen < sizeof(m_line) - 1)
+    {
+        m_line[m_lineLen++] = c;
+    }
+}
+
+void SseParser::handleLine(char *line)
+{
+    if (line[0] == '\0')
+    {
+        dispatch();
+        return;
+    }
+    if (line[0] == ':')
+        return; // keep-alive comment
+
+    char *value = strchr(line, ':');
+    if (value)
+    {
+        *value++ = '\0';
+        if (*value == ' ')
+            value++;
+    }
+    else
+    {
+        value = line + strlen(line);
+    }
+
+    if (strcmp(line, "data") == 0)
+    {
+        size_t n = strlen(value);
+        if (m_dataLen > 0 && m_dataLen < sizeof(m_data) - 1)
+            m_data[m_dataLen++] = '\n';
+        if (n > sizeof(m_data) - 1 - m_dataLen)
+            n = sizeof(m_data) - 1 - m_dataLen;
+        memcpy(m_data + m_dataLen, value, n);
+        m_dataLen += n;
+    }
+    else if (strcmp(line, "event") == 0)
+    {
+        strncpy(m_event, value, sizeof(m_event) - 1);
+        m_event[sizeof(m_event) - 1] = '\0';
+    }
+    else if (strcmp(line, "id") == 0)
+    {
+        strncpy(m_lastId, value, sizeof(m_lastId) - 1);
+        m_lastId[sizeof(m_lastId) - 1] = '\0';
+    }
+    else if (strcmp(line, "retry") == 0)
+    {
+        m_retryMs = strtoul(value, nullptr, 10);
+    }
+}
+
+void SseParser::dispatch()
+{
+    // No data, no event (the spec's rule); the name doesn't carry over
+    if (m_dataLen == 0)
+    {
+        m_event[0] = '\0';
+        return;
+    }
+    m_data[m_dataLen] = '\0';
+    m_events++;
+    if (m_cb)
+        m_cb(m_event[0] ? m_event : "message", m_data, m_cbCtx);
+    m_dataLen = 0;
+    m_event[0] = '\0';
+}
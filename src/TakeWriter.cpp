@@ -0,0 +1,287 @@
+#include "TakeWriter.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+TakeWriter::TakeWriter(CaptureRing &ring, SchedulerClock &clock, const char *stagingPath)
+    : m_ring(ring), m_clock(clock), m_path(stagingPath) {}
+
+void TakeWriter::begin(FileStore &store, HttpTransport &net)
+{
+    m_store = &store;
+    m_net = &net;
+}
+
+void TakeWriter::setCommit(CommitFn fn, void *ctx)
+{
+    m_commitCtx = ctx;
+    m_commit = fn;
+}
+
+void TakeWriter::setClosed(ClosedFn fn, void *ctx)
+{
+    m_closedCtx = ctx;
+    m_closed = fn;
+}
+
+bool TakeWriter::open(AudioEncoder &encoder, uint32_t sampleRate)
+{
+    m_encoder = &encoder;
+    m_sampleRate = sampleRate;
+    m_captureDone = false;
+    m_samples = m_bytes = m_sent = 0;
+
+    // The staging path only ever holds the take in progress; finished
+    // takes move into the queue, so anything here was cut short by a reboot
+    if (m_store->exists(m_path))
+        m_store->remove(m_path);
+    m_file = m_store->open(m_path, OpenMode::Write);
+    if (!m_file)
+        return false;
+    uint8_t h[AudioEncoder::kMaxHeaderBytes];
+    m_encoder->makeHeader(h, m_sampleRate, 0, 0); // patched in closeFile()
+    m_fileOk = m_file->write(h, m_encoder->headerSize()) == m_encoder->headerSize();
+    return true;
+}
+
+void TakeWriter::captureDone()
+{
+    m_captureDone = true;
+    m_clock.wake();
+}
+
+// Writes one HTTP/1.1 chunk (or raw bytes)
+static bool writeOut(ByteStream &out, const uint8_t *data, size_t len, bool chunked)
+{
+    if (chunked)
+    {
+        char sz[12];
+        int n = snprintf(sz, sizeof(sz), "%x\r\n", (unsigned)len);
+        if (out.write(reinterpret_cast<const uint8_t *>(sz), n) != (size_t)n)
+            return false;
+    }
+    if (out.write(data, len) != len)
+        return false;
+    if (chunked && out.write(reinterpret_cast<const uint8_t *>("\r\n"), 2) != 2)
+        return false;
+    return true;
+}
+
+// One encoded block: into the staging file, then into the socket while
+// it is live. A file error stops the file but not the stream.
+bool TakeWriter::out(const uint8_t *data, size_t len)
+{
+    if (len == 0)
+        return true;
+    if (m_fileOk && m_file->write(data, len) != len)
+        m_fileOk = false;
+    if (m_live)
+    {
+        if (writeOut(*m_conn, data, len, true))
+            m_sent += len;
+        else
+            dropConnection();
+    }
+    return m_fileOk || m_live;
+}
+
+void TakeWriter::dropConnection()
+{
+    if (m_conn)
+        m_conn->close();
+    m_conn.reset();
+    m_live = false;
+    m_failed = true;
+}
+
+// Drains the ring until the reader is done and it is empty. When the
+// socket can't keep up (the ring is half full after a send) it stops
+// getting live data and the file runs on alone at flash speed. After a
+// write error it keeps draining into the void so the reader never
+// overruns for a dead sink.
+bool TakeWriter::pump()
+{
+    int16_t buf[kPopSamples];
+    bool ok = true;
+    for (;;)
+    {
+        size_t got = m_ring.pop(buf, kPopSamples);
+        if (got == 0)
+        {
+            if (m_captureDone && m_ring.empty())
+                break;
+            // The reader wakes us after every chunk; the timeout covers release
+            m_clock.waitMs(20);
+            continue;
+        }
+        if (!ok || m_encoder->maxEncodedBytes(got) > sizeof(m_encBuf))
+        {
+            ok = false;
+            continue;
+        }
+        const size_t len = m_encoder->encode(buf, got, m_encBuf);
+        m_samples += got;
+        m_bytes += len;
+        ok = out(m_encBuf, len);
+        if (m_live && m_fileOk && m_ring.size() > m_ring.capacity() / 2)
+            m_live = false; // backlog: the rest goes out from the file
+    }
+    const size_t len = m_encoder->finish(m_encBuf);
+    m_bytes += len;
+    return out(m_encBuf, len) && ok;
+}
+
+// Patches the real lengths into the header and closes the file
+bool TakeWriter::closeFile()
+{
+    if (!m_file)
+        return false;
+    if (m_fileOk)
+    {
+        uint8_t h[AudioEncoder::kMaxHeaderBytes];
+        m_encoder->makeHeader(h, m_sampleRate, m_samples, m_bytes);
+        m_file->flush();
+        m_fileOk = m_file->seek(0) && m_file->write(h, m_encoder->headerSize()) == m_encoder->headerSize();
+        m_file->flush();
+    }
+    m_file.reset();
+    return m_fileOk;
+}
+
+void TakeWriter::commit(Result &r)
+{
+    if (m_fileOk && m_commit)
+        r.queued = m_commit(m_path, &r.seq, m_commitCtx);
+    if (!r.queued)
+        m_store->remove(m_path);
+}
+
+TakeWriter::Result TakeWriter::writeFile()
+{
+    Result r;
+    r.ok = pump();
+    r.ok = closeFile() && r.ok;
+    r.samples = m_samples;
+    r.bytes = m_bytes;
+    if (m_closed)
+        m_closed(m_closedCtx);
+    commit(r);
+    return r;
+}
+
+// Request head and the streaming WAV header as the first chunk
+bool TakeWriter::sendHead(const char *host, const char *path)
+{
+    char req[256];
+    int len = snprintf(req, sizeof(req),
+                       "POST %s HTTP/1.1\r\n"
+                       "Host: %s\r\n"
+                       "Content-Type: %s\r\n"
+                       "Transfer-Encoding: chunked\r\n"
+                       "Connection: close\r\n\r\n",
+                       path, host, m_encoder->contentType());
+    // Length is unknown until release; use the streaming convention
+    uint8_t h[AudioEncoder::kMaxHeaderBytes];
+    m_encoder->makeHeader(h, m_sampleRate, AudioEncoder::kUnknownLength, AudioEncoder::kUnknownLength);
+    return len > 0 && len < (int)sizeof(req) &&
+           writeOut(*m_conn, reinterpret_cast<const uint8_t *>(req), len, false) &&
+           writeOut(*m_conn, h, m_encoder->headerSize(), true);
+}
+
+// What the socket fell behind on, from the finished staging file
+void TakeWriter::sendBacklog(Result &r)
+{
+    std::unique_ptr<StoredFile> f = m_store->open(m_path, OpenMode::Read);
+    if (!f || !f->seek(m_encoder->headerSize() + m_sent))
+    {
+        dropConnection();
+        return;
+    }
+    size_t n;
+    while (m_sent < m_bytes && (n = f->read(m_encBuf, sizeof(m_encBuf))) > 0)
+    {
+        if (!writeOut(*m_conn, m_encBuf, n, true))
+        {
+            dropConnection();
+            return;
+        }
+        m_sent += n;
+        r.backlog += n;
+    }
+    if (m_sent < m_bytes)
+        dropConnection(); // short read: the server can't get it all
+}
+
+// Status code from "HTTP/1.1 200 OK"; -1 if nothing arrives in time
+int TakeWriter::readStatus()
+{
+    char line[16];
+    size_t len = 0;
+    const uint32_t t0 = m_clock.nowMs();
+    while (len < sizeof(line) - 1 && m_clock.nowMs() - t0 < kStatusTimeoutMs)
+    {
+        if (m_conn->available() <= 0)
+        {
+            if (!m_conn->connected())
+                break;
+            m_clock.waitMs(5);
+            continue;
+        }
+        uint8_t c;
+        if (m_conn->read(&c, 1) != 1 || c == '\n')
+            break;
+        line[len++] = (char)c;
+    }
+    line[len] = '\0';
+    return len >= 12 ? atoi(line + 9) : -1;
+}
+
+TakeWriter::Result TakeWriter::stream(const char *host, uint16_t port, const char *path)
+{
+    Result r;
+    m_failed = false;
+    if (host && path)
+        m_conn = m_net->connect(host, port);
+    m_live = m_conn && sendHead(host, path);
+    if (!m_live)
+        dropConnection();
+
+    bool ok = pump();
+    ok = closeFile() && ok;
+    if (m_conn && m_sent < m_bytes)
+    {
+        if (ok)
+            sendBacklog(r);
+        else
+            dropConnection(); // the file can't make up the difference
+    }
+
+    bool closed = false;
+    if (m_conn)
+    {
+        static const uint8_t kLastChunk[] = {'0', '\r', '\n', '\r', '\n'};
+        if (writeOut(*m_conn, kLastChunk, sizeof(kLastChunk), false))
+        {
+            if (m_closed)
+                m_closed(m_closedCtx);
+            closed = true;
+            r.status = readStatus(); // the status line is all we need
+        }
+        m_conn->close();
+        m_conn.reset();
+    }
+
+    r.samples = m_samples;
+    r.bytes = m_bytes;
+    r.failedOver = m_failed;
+    r.ok = r.status >= 200 && r.status < 300;
+    if (r.ok)
+    {
+        m_store->remove(m_path);
+        return r;
+    }
+    // Anything short of a 2xx: the whole take goes to the queue
+    if (!closed && m_closed)
+        m_closed(m_closedCtx);
+    commit(r);
+    return r;
+}
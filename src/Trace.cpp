@@ -0,0 +1,122 @@
+#include "Trace.h"
+
+namespace trace
+{
+    CoreRing g_rings[2];
+    volatile bool g_enabled = true;
+}
+
+// Indexed by TraceEvent; shipped in every dump so the decoder never
+// goes stale
+static const char *const kNames[] = {
+    "",
+    "reader_read",
+    "flush_chunk",
+    "ring_full",
+    "stop",
+    "write_take",
+    "stream_take",
+    "upload",
+    "play",
+    "play_write",
+    "underrun",
+};
+static_assert(sizeof(kNames) / sizeof(kNames[0]) == (size_t)TraceEvent::Count, "name every TraceEvent");
+
+// Base64 in "#TRACE ..." lines of 48 input bytes each, so the dump
+// survives a text serial monitor and can be cut out of a log
+namespace
+{
+    class LineEncoder
+    {
+    public:
+        explicit LineEncoder(Print &out) : m_out(out) {}
+
+        void put(const void *data, size_t len)
+        {
+            const uint8_t *p = static_cast<const uint8_t *>(data);
+            while (len--)
+            {
+                m_buf[m_len++] = *p++;
+                if (m_len == sizeof(m_buf))
+                    flush();
+            }
+        }
+        void put8(uint8_t v) { put(&v, 1); }
+        void put16(uint16_t v) { put(&v, 2); }
+        void put32(uint32_t v) { put(&v, 4); }
+
+        void flush()
+        {
+            static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            if (m_len == 0)
+                return;
+            char line[8 + sizeof(m_buf) / 3 * 4 + 2];
+            size_t n = 0;
+            memcpy(line, "#TRACE ", 7);
+            n = 7;
+            for (size_t i = 0; i < m_len; i += 3)
+            {
+                uint32_t v = m_buf[i] << 16;
+                if (i + 1 < m_len)
+                    v |= m_buf[i + 1] << 8;
+                if (i + 2 < m_len)
+                    v |= m_buf[i + 2];
+                line[n++] = b64[(v >> 18) & 63];
+                line[n++] = b64[(v >> 12) & 63];
+                line[n++] = i + 1 < m_len ? b64[(v >> 6) & 63] : '=';
+                line[n++] = i + 2 < m_len ? b64[v & 63] : '=';
+            }
+            line[n++] = '\n';
+            m_out.write(reinterpret_cast<const uint8_t *>(line), n);
+            m_len = 0;
+        }
+
+    private:
+        Print &m_out;
+        uint8_t m_buf[48];
+        size_t m_len = 0;
+    };
+}
+
+void trace::enable(bool on)
+{
+    g_enabled = on;
+}
+
+void trace::clear()
+{
+    for (CoreRing &r : g_rings)
+        r.next.store(0, std::memory_order_relaxed);
+}
+
+void trace::dump(Print &out)
+{
+    bool was = g_enabled;
+    g_enabled = false;
+
+    out.println("#TRACE-BEGIN");
+    LineEncoder enc(out);
+    enc.put("TRC1", 4);
+    enc.put8(1); // format version
+    enc.put8(2); // cores
+    enc.put16(getCpuFrequencyMhz());
+    enc.put16(TRACE_RECORDS);
+    enc.put16((uint16_t)TraceEvent::Count);
+    for (const char *name : kNames)
+    {
+        size_t len = strlen(name);
+        enc.put8(len);
+        enc.put(name, len);
+    }
+    for (CoreRing &r : g_rings)
+    {
+        // Raw ring plus the write index; the decoder unrolls it
+        enc.put32(r.next.load(std::memory_order_relaxed));
+        enc.put(r.rec, sizeof(r.rec));
+    }
+    enc.flush();
+    out.println("#TRACE-END");
+
+    g_enabled = was;
+}
@@ -0,0 +1,335 @@
+#include "UploadQueue.h"
+#include <WiFi.h>
+#include "Metrics.h"
+#include "PowerManager.h"
+
+static metrics::Counter s_uploadOk("upload_ok");
+static metrics::Counter s_uploadFail("upload_fail");
+static metrics::Counter s_uploadDropped("upload_dropped");
+static metrics::Gauge s_queueBytes("queue_bytes");
+
+static const char *kQueueDir = "/q";
+// Two slots written in turn: the one not being written is always whole
+static const char *const kIndexPaths[2] = {"/q/index", "/q/index.1"};
+static const char *kIndexTmpPath = "/q/index.tmp"; // left by older firmware
+static const uint32_t kIndexMagic = 0x51554531; // "QUE1"
+static const uint32_t kRetryMs = 10000;
+
+struct QueueIndex
+{
+    uint32_t magic;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t check; // guards against a torn write
+};
+
+static uint32_t indexCheck(const QueueIndex &ix)
+{
+    return ix.magic ^ (ix.head * 2654435761u) ^ (ix.tail * 40503u) ^ 0xA5A5A5A5u;
+}
+
+UploadQueue::UploadQueue(uint32_t maxBytes, Eviction policy)
+    : m_maxBytes(maxBytes), m_policy(policy) {}
+
+String UploadQueue::entryPath(uint32_t seq) const
+{
+    char p[24];
+    snprintf(p, sizeof(p), "%s/%08lu.wav", kQueueDir, (unsigned long)seq);
+    return String(p);
+}
+
+size_t UploadQueue::count() const
+{
+    return m_tail - m_head;
+}
+
+// -------------------- index --------------------
+static bool readIndex(FileStore &store, const char *path, QueueIndex &ix)
+{
+    std::unique_ptr<StoredFile> f = store.open(path, OpenMode::Read);
+    if (!f)
+        return false;
+    size_t got = f->read(reinterpret_cast<uint8_t *>(&ix), sizeof(ix));
+    return got == sizeof(ix) && ix.magic == kIndexMagic && ix.check == indexCheck(ix) && ix.tail >= ix.head;
+}
+
+// Head and tail only ever grow, so the newer of two good slots is the
+// one further along
+bool UploadQueue::loadIndex()
+{
+    QueueIndex ix[2];
+    const bool ok[2] = {readIndex(*m_store, kIndexPaths[0], ix[0]), readIndex(*m_store, kIndexPaths[1], ix[1])};
+    if (!ok[0] && !ok[1])
+        return false;
+    const bool second = ok[1] && (!ok[0] || ix[1].tail > ix[0].tail ||
+                                  (ix[1].tail == ix[0].tail && ix[1].head > ix[0].head));
+    m_indexSlot = second ? 1 : 0;
+    m_head = ix[m_indexSlot].head;
+    m_tail = ix[m_indexSlot].tail;
+    return true;
+}
+
+// Overwrites the older slot; a torn write fails its check and the
+// other slot still holds the previous queue
+void UploadQueue::saveIndex()
+{
+    QueueIndex ix = {kIndexMagic, m_head, m_tail, 0};
+    ix.check = indexCheck(ix);
+
+    const uint8_t slot = m_indexSlot ^ 1;
+    std::unique_ptr<StoredFile> f = m_store->open(kIndexPaths[slot], OpenMode::Write);
+    if (!f)
+        return;
+    if (f->write(reinterpret_cast<const uint8_t *>(&ix), sizeof(ix)) != sizeof(ix))
+        return;
+    f->flush();
+    m_indexSlot = slot;
+}
+
+struct RecoverScan
+{
+    UploadQueue *queue;
+    bool haveIndex;
+    bool any;
+    uint32_t lo, hi;
+};
+
+void UploadQueue::recoverEntry(const char *path, void *ctx)
+{
+    RecoverScan &scan = *static_cast<RecoverScan *>(ctx);
+    String name = String(path).substring(String(path).lastIndexOf('/') + 1);
+    if (!name.endsWith(".wav"))
+        return;
+    uint32_t seq = name.toInt();
+
+    if (scan.haveIndex && seq < scan.queue->m_head)
+    {
+        // Popped, but the crash came before the delete
+        scan.queue->m_store->remove(path);
+        return;
+    }
+    scan.any = true;
+    scan.lo = min(scan.lo, seq);
+    scan.hi = max(scan.hi, seq);
+}
+
+// Reconcile the index with what is actually on flash
+void UploadQueue::recover()
+{
+    bool haveIndex = loadIndex();
+    if (m_store->exists(kIndexTmpPath))
+        m_store->remove(kIndexTmpPath);
+    RecoverScan scan = {this, haveIndex, false, UINT32_MAX, 0};
+    m_store->list(kQueueDir, &UploadQueue::recoverEntry, &scan);
+    const bool any = scan.any;
+    const uint32_t lo = scan.lo, hi = scan.hi;
+
+    if (!haveIndex)
+    {
+        m_head = any ? lo : 0;
+        m_tail = any ? hi + 1 : 0;
+    }
+    else if (any && hi >= m_tail)
+    {
+        // Committed, but the crash came before the index write
+        m_tail = hi + 1;
+    }
+
+    m_bytes = 0;
+    for (uint32_t seq = m_head; seq < m_tail; ++seq)
+    {
+        std::unique_ptr<StoredFile> f = m_store->open(entryPath(seq).c_str(), OpenMode::Read);
+        if (f)
+            m_bytes += f->size();
+    }
+    saveIndex();
+}
+
+void UploadQueue::begin(FileStore &store, HttpTransport &net)
+{
+    m_store = &store;
+    m_lock = xSemaphoreCreateMutex();
+    m_uploader.reset(new ResumableUploader(store, net, m_clock));
+    recover();
+    Serial.printf("[Q] %u pending (%u bytes)\n", (unsigned)count(), (unsigned)m_bytes);
+
+    xTaskCreatePinnedToCore(
+        &UploadQueue::drainerTaskThunk,
+        "upload_drainer",
+        8192,
+        this,
+        2, // background: below the audio writer
+        &m_drainerTask,
+        1);
+    metrics::Registry::shared().watchTask("upload_drainer", m_drainerTask);
+    s_queueBytes.set(m_bytes);
+}
+
+void UploadQueue::setUploadUrl(const String &url)
+{
+    if (!m_lock)
+    {
+        m_url = url; // before begin(): no drainer to race with yet
+        return;
+    }
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    m_url = url;
+    xSemaphoreGive(m_lock);
+    kick();
+}
+
+void UploadQueue::kick()
+{
+    // TaskClock waits on the drainer's notification too, so this also
+    // cuts an upload's retry backoff short
+    if (m_drainerTask)
+        xTaskNotifyGive(m_drainerTask);
+}
+
+void UploadQueue::setSentCallback(SentCallback cb, void *ctx)
+{
+    m_sentCtx = ctx;
+    m_sentCb = cb;
+}
+
+// -------------------- append / pop --------------------
+void UploadQueue::dropHead()
+{
+    String path = entryPath(m_head);
+    std::unique_ptr<StoredFile> f = m_store->open(path.c_str(), OpenMode::Read);
+    uint32_t size = f ? f->size() : 0;
+    f.reset();
+
+    m_head++;
+    saveIndex(); // index first: a crash now leaves an orphan, not a hole
+    m_store->remove(path.c_str());
+    m_bytes = m_bytes > size ? m_bytes - size : 0;
+    s_queueBytes.set(m_bytes);
+}
+
+bool UploadQueue::commit(const char *finishedPath, uint32_t *seq)
+{
+    std::unique_ptr<StoredFile> f = m_store->open(finishedPath, OpenMode::Read);
+    if (!f)
+        return false;
+    uint32_t size = f->size();
+    f.reset();
+
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+
+    if (size > m_maxBytes || (m_policy == Eviction::RejectNew && m_bytes + size > m_maxBytes))
+    {
+        xSemaphoreGive(m_lock);
+        Serial.println("[Q] Queue full; dropping new recording");
+        m_store->remove(finishedPath);
+        return false;
+    }
+
+    // Evict oldest-first, but never the entry being uploaded right now
+    while (m_bytes + size > m_maxBytes && m_head < m_tail && m_head != m_inFlight)
+    {
+        Serial.printf("[Q] Evicting #%u\n", (unsigned)m_head);
+        dropHead();
+    }
+    if (m_bytes + size > m_maxBytes)
+    {
+        // Only the upload in progress is left to evict: the new take goes
+        const uint32_t sending = m_head;
+        xSemaphoreGive(m_lock);
+        Serial.printf("[Q] #%u is uploading; dropping new recording\n", (unsigned)sending);
+        m_store->remove(finishedPath);
+        return false;
+    }
+
+    String path = entryPath(m_tail);
+    bool ok = m_store->rename(finishedPath, path.c_str());
+    if (ok)
+    {
+        if (seq)
+            *seq = m_tail;
+        m_tail++;
+        m_bytes += size;
+        saveIndex();
+        s_queueBytes.set(m_bytes);
+    }
+    xSemaphoreGive(m_lock);
+
+    if (ok)
+        kick();
+    return ok;
+}
+
+// -------------------- drainer --------------------
+void UploadQueue::drainerTaskThunk(void *arg)
+{
+    static_cast<UploadQueue *>(arg)->drainerTask();
+}
+
+// Sniff the WAV format tag so entries recorded with a different encoder
+// still go out with the right Content-Type
+static const char *contentTypeOf(StoredFile &f)
+{
+    uint8_t h[22];
+    if (!f.seek(0) || f.read(h, sizeof(h)) != sizeof(h))
+        return "audio/wav";
+    uint16_t tag = h[20] | (h[21] << 8);
+    return tag == 0x0011 ? "audio/vnd.wave; codec=11" : "audio/wav";
+}
+
+void UploadQueue::drainerTask()
+{
+    for (;;)
+    {
+        xSemaphoreTake(m_lock, portMAX_DELAY);
+        bool idle = m_head == m_tail || m_url.length() == 0 || WiFi.status() != WL_CONNECTED;
+        uint32_t seq = m_head;
+        String url = m_url;
+        if (!idle)
+            m_inFlight = seq;
+        // Queued takes need the radio again, so no deep sleep
+        PowerManager::shared().setPending(m_head != m_tail);
+        xSemaphoreGive(m_lock);
+
+        if (idle)
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(kRetryMs));
+            continue;
+        }
+
+        String path = entryPath(seq);
+        std::unique_ptr<StoredFile> f = m_store->open(path.c_str(), OpenMode::Read);
+        const char *type = f ? contentTypeOf(*f) : "audio/wav";
+        uint32_t size = f ? f->size() : 0;
+        f.reset();
+
+        PowerManager::shared().setBusy(PowerPolicy::Upload, true);
+        const ResumableUploader::Result r = m_uploader->upload(path.c_str(), url.c_str(), type);
+        PowerManager::shared().setBusy(PowerPolicy::Upload, false);
+
+        // A take that can never go out is dropped so the ones behind it
+        // (and deep sleep) aren't held up
+        xSemaphoreTake(m_lock, portMAX_DELAY);
+        m_inFlight = UINT32_MAX;
+        if (r != ResumableUploader::Result::Retry && m_head == seq)
+            dropHead();
+        xSemaphoreGive(m_lock);
+
+        if (r == ResumableUploader::Result::Done)
+        {
+            s_uploadOk.add();
+            Serial.printf("[Q] Sent #%u, %u left\n", (unsigned)seq, (unsigned)count());
+            if (m_sentCb)
+                m_sentCb(seq, size, m_sentCtx);
+        }
+        else if (r == ResumableUploader::Result::Failed)
+        {
+            s_uploadDropped.add();
+            Serial.printf("[Q] Dropped #%u: rejected or unreadable\n", (unsigned)seq);
+        }
+        else
+        {
+            s_uploadFail.add();
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(kRetryMs));
+        }
+    }
+}
@@ -0,0 +1,157 @@
+#include "Vad.h"
+#include <string.h>
+
+// -------------------- Vad --------------------
+void Vad::reset()
+{
+    m_noise = 0;
+    m_energy = 0;
+    m_hangover = 0;
+    m_warmup = 0;
+}
+
+bool Vad::isSpeech(const int16_t *frame)
+{
+    // s*s >> 8 keeps the sum of 256 frames inside 32 bits
+    uint32_t energy = 0;
+    uint32_t zc = 0;
+    int16_t prev = frame[0];
+    for (size_t i = 0; i < kFrameSamples; ++i)
+    {
+        int32_t s = frame[i];
+        energy += (uint32_t)(s * s) >> 8;
+        zc += (uint32_t)((s ^ prev) < 0);
+        prev = (int16_t)s;
+    }
+    energy /= kFrameSamples;
+    m_energy = energy;
+
+    // The first frames seed the floor; a take usually starts before the
+    // user speaks
+    if (m_warmup < 4)
+    {
+        m_noise = m_warmup == 0 ? energy : (energy < m_noise ? energy : m_noise);
+        m_warmup++;
+        return false;
+    }
+
+    const uint32_t floor = m_noise > m_cfg.minEnergy / m_cfg.onsetRatio ? m_noise : m_cfg.minEnergy / m_cfg.onsetRatio;
+    bool hit = energy > floor * m_cfg.onsetRatio ||
+               (energy > floor * m_cfg.fricativeRatio && zc >= m_cfg.zcrHigh);
+
+    // Follow the noise quickly down and slowly up; creep even during
+    // speech so a steady loud background can't lock the detector open
+    if (!hit)
+        m_noise = energy < m_noise ? m_noise - ((m_noise - energy) >> 2) : m_noise + ((energy - m_noise) >> 4);
+    else if (energy > m_noise)
+        m_noise += (energy - m_noise) >> 10;
+
+    if (hit)
+        m_hangover = m_cfg.hangoverFrames;
+    else if (m_hangover > 0)
+        m_hangover--;
+    return hit || m_hangover > 0;
+}
+
+// -------------------- SilenceGate --------------------
+SilenceGate::SilenceGate(Emit emit, void *ctx, uint8_t preRollFrames, uint16_t maxPauseFrames)
+    : m_emit(emit), m_ctx(ctx),
+      m_preRollFrames(preRollFrames < kMaxPreRollFrames ? preRollFrames : kMaxPreRollFrames),
+      m_maxPauseFrames(maxPauseFrames) {}
+
+void SilenceGate::reset()
+{
+    m_vad.reset();
+    m_accLen = 0;
+    m_preHead = m_preCount = 0;
+    m_open = false;
+    m_silentFrames = 0;
+    m_kept = m_dropped = 0;
+}
+
+void SilenceGate::out(const int16_t *samples, size_t n)
+{
+    m_kept += n;
+    m_emit(samples, n, m_ctx);
+}
+
+void SilenceGate::process(const int16_t *pcm, size_t n)
+{
+    // Whole frames straight from the caller's buffer, the rest via m_acc
+    if (m_accLen > 0)
+    {
+        size_t k = Vad::kFrameSamples - m_accLen < n ? Vad::kFrameSamples - m_accLen : n;
+        memcpy(m_acc + m_accLen, pcm, k * sizeof(int16_t));
+        m_accLen += k;
+        pcm += k;
+        n -= k;
+        if (m_accLen < Vad::kFrameSamples)
+            return;
+        frame(m_acc);
+        m_accLen = 0;
+    }
+    while (n >= Vad::kFrameSamples)
+    {
+        frame(pcm);
+        pcm += Vad::kFrameSamples;
+        n -= Vad::kFrameSamples;
+    }
+    memcpy(m_acc, pcm, n * sizeof(int16_t));
+    m_accLen = n;
+}
+
+void SilenceGate::frame(const int16_t *f)
+{
+    const bool speech = m_vad.isSpeech(f);
+
+    if (m_open)
+    {
+        m_silentFrames = speech ? 0 : m_silentFrames + 1;
+        if (m_silentFrames <= m_maxPauseFrames)
+        {
+            out(f, Vad::kFrameSamples);
+            return;
+        }
+        // Pause too long: close and start collecting pre-roll again
+        m_open = false;
+        m_preHead = m_preCount = 0;
+    }
+
+    if (speech)
+    {
+        // Replay the pre-roll oldest first, then this frame
+        uint8_t start = (m_preHead + kMaxPreRollFrames - m_preCount) % kMaxPreRollFrames;
+        for (uint8_t i = 0; i < m_preCount; ++i)
+            out(m_preRoll[(start + i) % kMaxPreRollFrames], Vad::kFrameSamples);
+        m_preCount = 0;
+        out(f, Vad::kFrameSamples);
+        m_open = true;
+        m_silentFrames = 0;
+        return;
+    }
+
+    if (m_preRollFrames == 0)
+    {
+        m_dropped += Vad::kFrameSamples;
+        return;
+    }
+    if (m_preCount == m_preRollFrames)
+    {
+        m_dropped += Vad::kFrameSamples; // oldest pre-roll frame falls out
+        m_preCount--;
+    }
+    memcpy(m_preRoll[m_preHead], f, sizeof(m_preRoll[0]));
+    m_preHead = (m_preHead + 1) % kMaxPreRollFrames;
+    m_preCount++;
+}
+
+void SilenceGate::finish()
+{
+    if (m_open && m_accLen > 0)
+        out(m_acc, m_accLen);
+    else
+        m_dropped += m_accLen;
+    m_dropped += m_preCount * Vad::kFrameSamples;
+    m_accLen = 0;
+    m_preCount = 0;
+}
@@ -0,0 +1,244 @@
+#include "WavReader.h"
+#include <string.h>
+
+static const uint16_t kFormatPcm = 0x0001;
+static const uint16_t kFormatFloat = 0x0003;
+static const uint16_t kFormatExtensible = 0xFFFE;
+static const uint8_t kMaxChunks = 32; // before data; real files carry a few
+
+static inline uint16_t rd16(const uint8_t *p)
+{
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+const char *WavReader::errorName(Error e)
+{
+    switch (e)
+    {
+    case Error::None:
+        return "ok";
+    case Error::Truncated:
+        return "truncated header";
+    case Error::NotWave:
+        return "not RIFF/WAVE";
+    case Error::BadFormat:
+        return "bad fmt chunk";
+    case Error::Unsupported:
+        return "unsupported encoding";
+    case Error::NoData:
+        return "no data chunk";
+    case Error::BadSize:
+        return "chunk size past end of file";
+    }
+    return "?";
+}
+
+bool WavReader::readExact(ByteStream &s, uint8_t *dst, size_t len)
+{
+    size_t got = 0, n;
+    while (got < len && (n = s.read(dst + got, len - got)) > 0)
+        got += n;
+    m_headerBytes += got;
+    return got == len;
+}
+
+// Forward-only: works without seek()
+bool WavReader::skip(ByteStream &s, uint32_t len)
+{
+    while (len > 0)
+    {
+        size_t n = s.read(m_raw, len < sizeof(m_raw) ? len : sizeof(m_raw));
+        if (n == 0)
+            return false;
+        m_headerBytes += n;
+        len -= n;
+    }
+    return true;
+}
+
+WavReader::Error WavReader::parseFmt(const uint8_t *p, uint32_t len)
+{
+    if (len < 16)
+        return Error::BadFormat;
+    uint16_t tag = rd16(p);
+    const uint16_t channels = rd16(p + 2);
+    const uint32_t rate = rd32(p + 4);
+    const uint16_t align = rd16(p + 12);
+    const uint16_t bits = rd16(p + 14); // may be less than the container
+
+    if (tag == kFormatExtensible)
+    {
+        // cbSize, validBits, channel mask, then the sub-format GUID whose
+        // first two bytes are the real format tag
+        if (len < 40 || rd16(p + 16) < 22)
+            return Error::BadFormat;
+        tag = rd16(p + 24);
+    }
+    if (channels == 0 || rate == 0 || bits == 0 || align == 0 || align % channels != 0)
+        return Error::BadFormat;
+    const uint16_t container = align / channels;
+    if (bits > container * 8)
+        return Error::BadFormat;
+
+    bool ok = (tag == kFormatPcm && container <= 4) || (tag == kFormatFloat && (container == 4 || container == 8));
+    if (!ok || channels > kMaxChannels)
+        return Error::Unsupported;
+
+    m_fmt.isFloat = tag == kFormatFloat;
+    m_fmt.channels = channels;
+    m_fmt.sampleRate = rate;
+    m_fmt.bitsPerSample = container * 8;
+    m_fmt.blockAlign = align;
+    return Error::None;
+}
+
+WavReader::Error WavReader::parse(ByteStream &s, uint32_t streamSize)
+{
+    m_fmt = Format();
+    m_headerBytes = 0;
+    m_remaining = 0;
+    m_carry = 0;
+
+    uint8_t h[12];
+    if (!readExact(s, h, 12))
+        return Error::Truncated;
+    if (memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0)
+        return Error::NotWave;
+
+    // The RIFF size bounds the chunk walk; the real length wins if it is
+    // known and shorter (truncated upload, streaming writer left it 0)
+    const uint32_t riff = rd32(h + 4);
+    const bool bounded = riff >= 4 && riff <= 0xFFFFFFFFu - 8;
+    uint32_t end = bounded ? riff + 8 : 0xFFFFFFFFu;
+    if (streamSize && (!bounded || end > streamSize))
+    {
+        end = streamSize;
+    }
+
+    bool haveFmt = false;
+    for (uint8_t i = 0; i < kMaxChunks; ++i)
+    {
+        if (!readExact(s, h, 8))
+            return haveFmt ? Error::NoData : Error::Truncated;
+        const uint32_t size = rd32(h + 4);
+        const uint32_t left = end > m_headerBytes ? end - m_headerBytes : 0;
+
+        if (memcmp(h, "data", 4) == 0)
+        {
+            if (!haveFmt)
+                return Error::BadFormat;
+            // 0 and 0xFFFFFFFF are what streaming writers leave behind:
+            // play to the end of the RIFF or the stream
+            const bool unknown = size == 0 || size == 0xFFFFFFFFu;
+            uint32_t bytes = unknown ? left : size;
+            if (streamSize && bytes > left)
+                bytes = left;
+            m_fmt.dataBytes = bytes - bytes % m_fmt.blockAlign;
+            m_remaining = m_fmt.dataBytes;
+            return Error::None;
+        }
+
+        const uint32_t padded = size + (size & 1); // chunks are word aligned
+        if (padded < size || (streamSize && padded > left))
+            return Error::BadSize;
+
+        if (memcmp(h, "fmt ", 4) == 0)
+        {
+            uint8_t f[40];
+            const uint32_t take = size < sizeof(f) ? size : sizeof(f);
+            if (!readExact(s, f, take))
+                return Error::Truncated;
+            Error e = parseFmt(f, take);
+            if (e != Error::None)
+                return e;
+            haveFmt = true;
+            if (!skip(s, padded - take))
+                return Error::Truncated;
+        }
+        else if (!skip(s, padded))
+        {
+            return Error::Truncated;
+        }
+    }
+    return Error::NoData;
+}
+
+// Keeps the top 16 bits of wider PCM; float is clamped to [-1, 1)
+void WavReader::decode(const uint8_t *src, int16_t *out, size_t samples) const
+{
+    const uint16_t bytes = m_fmt.bitsPerSample / 8;
+    if (m_fmt.isFloat)
+    {
+        for (size_t i = 0; i < samples; ++i, src += bytes)
+        {
+            double v;
+            if (bytes == 4)
+            {
+                float f;
+                memcpy(&f, src, 4);
+                v = f;
+            }
+            else
+            {
+                memcpy(&v, src, 8);
+            }
+            v *= 32768.0;
+            // NaN fails both compares and lands on 0
+            out[i] = v >= 32767.0 ? 32767 : v <= -32768.0 ? -32768 : v == v ? (int16_t)v : 0;
+        }
+        return;
+    }
+    switch (bytes)
+    {
+    case 1: // 8-bit WAV is unsigned
+        for (size_t i = 0; i < samples; ++i)
+            out[i] = (int16_t)(((int)src[i] - 128) * 256);
+        break;
+    case 2:
+        memcpy(out, src, samples * 2);
+        break;
+    default: // 24/32-bit: the two most significant bytes
+        for (size_t i = 0; i < samples; ++i, src += bytes)
+            out[i] = (int16_t)rd16(src + bytes - 2);
+        break;
+    }
+}
+
+size_t WavReader::readFrames(ByteStream &s, int16_t *out, size_t maxFrames)
+{
+    const size_t align = m_fmt.blockAlign;
+    if (align == 0)
+        return 0;
+    const size_t fit = sizeof(m_raw) / align;
+    size_t done = 0;
+    while (done < maxFrames && (m_remaining > 0 || m_carry >= align))
+    {
+        size_t want = (maxFrames - done < fit ? maxFrames - done : fit) * align;
+        if (want - m_carry > m_remaining) // want > carry: one frame at least
+            want = m_carry + m_remaining;
+        size_t got = m_carry;
+        if (got < want)
+        {
+            size_t n = s.read(m_raw + got, want - got);
+            if (n == 0)
+            {
+                m_remaining = 0; // timeout or early end: stop here
+                break;
+            }
+            m_remaining -= n;
+            got += n;
+        }
+
+        const size_t frames = got / align;
+        decode(m_raw, out + done * m_fmt.channels, frames * m_fmt.channels);
+        done += frames;
+        m_carry = got - frames * align;
+        memmove(m_raw, m_raw + frames * align, m_carry);
+    }
+    return done;
+}
@@ -0,0 +1,236 @@
+#include "WifiConnector.h"
+#include <string.h>
+
+// esp_wifi_disconnect() reports itself with this reason; it is our own
+// doing, not the AP's
+static const uint16_t kReasonAssocLeave = 8;
+
+static bool before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+WifiConnector::WifiConnector(WifiDriver &driver, WifiCacheStore *cache)
+    : m_driver(driver), m_store(cache) {}
+
+uint32_t WifiConnector::hashSsid(const char *ssid)
+{
+    // FNV-1a; only has to tell our own networks apart
+    uint32_t h = 2166136261u;
+    for (const char *p = ssid; *p; ++p)
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    return h;
+}
+
+void WifiConnector::start(const char *ssid, const char *password, uint32_t timeoutMs, uint32_t now)
+{
+    m_ssid = ssid;
+    m_password = password;
+    m_timeout = timeoutMs;
+    m_start = now;
+    m_timings = Timings();
+    m_state = WifiState::Connecting;
+    m_fallBack = m_lost = m_save = false;
+    m_renew = m_renewing = m_renewed = m_refused = false;
+
+    uint32_t leaseAgeS = UINT32_MAX;
+    WifiCache c;
+    m_haveCache = m_store && m_store->load(c, leaseAgeS) && c.ssidHash == hashSsid(ssid) && c.channel != 0;
+    if (m_haveCache)
+    {
+        m_cache = c;
+        connectFast(now, c.lease.ip != 0 && leaseAgeS < m_cfg.leaseMaxAgeS);
+    }
+    else
+    {
+        connectFull(now);
+    }
+}
+
+void WifiConnector::stop()
+{
+    if (m_state == WifiState::Idle)
+        return;
+    m_state = WifiState::Idle;
+    m_driver.disconnect();
+}
+
+void WifiConnector::connectFast(uint32_t now, bool reuseLease)
+{
+    const WifiIpConfig *ip = m_static.ip ? &m_static : reuseLease ? &m_cache.lease : nullptr;
+    m_timings.cachedLease = ip == &m_cache.lease;
+    m_timings.attempts++;
+    m_phase = Phase::Fast;
+    m_phaseStart = now;
+    m_associated = false;
+    m_driver.connect(m_ssid, m_password, m_cache.bssid, m_cache.channel, ip);
+}
+
+void WifiConnector::connectFull(uint32_t now)
+{
+    m_timings.cachedLease = false;
+    m_timings.attempts++;
+    m_phase = Phase::Full;
+    m_phaseStart = now;
+    m_associated = false;
+    m_driver.connect(m_ssid, m_password, nullptr, 0, m_static.ip ? &m_static : nullptr);
+}
+
+void WifiConnector::onEvent(WifiDriver::Event e, uint16_t reason, uint32_t now)
+{
+    if (m_state == WifiState::Connected)
+    {
+        if (e == WifiDriver::Event::Disconnected)
+        {
+            m_timings.lastReason = reason;
+            m_lost = true;
+        }
+        else if (e == WifiDriver::Event::LeaseRenewed && m_renewing)
+        {
+            m_renewing = false;
+            m_renewed = m_save = true;
+        }
+        else if (e == WifiDriver::Event::LeaseRefused && m_renewing)
+        {
+            m_renewing = false;
+            m_refused = true;
+        }
+        return;
+    }
+    if (m_state != WifiState::Connecting)
+        return;
+
+    switch (e)
+    {
+    case WifiDriver::Event::Associated:
+        if (!m_associated)
+            m_assocAt = now;
+        m_associated = true;
+        break;
+    case WifiDriver::Event::GotIp:
+        if (!m_associated)
+            m_assocAt = now;
+        m_associated = true;
+        m_timings.fast = m_phase == Phase::Fast;
+        m_timings.associateMs = m_assocAt - m_start;
+        m_timings.ipMs = now - m_assocAt;
+        m_timings.totalMs = now - m_start;
+        m_phase = Phase::Up;
+        m_state = WifiState::Connected;
+        m_save = true;
+        // The cached lease skipped DHCP; renew it now so its age restarts
+        // and a server that gave the address away says so
+        m_renew = m_timings.cachedLease;
+        break;
+    case WifiDriver::Event::Disconnected:
+        if (reason == kReasonAssocLeave)
+            break; // the attempt we just replaced
+        m_timings.lastReason = reason;
+        m_associated = false;
+        if (m_phase == Phase::Fast)
+            m_fallBack = true;
+        else if (m_phase == Phase::Full)
+        {
+            m_phase = Phase::Retry;
+            m_retryAt = now + m_cfg.retryMs;
+        }
+        break;
+    case WifiDriver::Event::LeaseRenewed:
+    case WifiDriver::Event::LeaseRefused:
+        break; // only asked for once up
+    }
+}
+
+uint32_t WifiConnector::tick(uint32_t now)
+{
+    if (m_state == WifiState::Connected)
+    {
+        if (m_refused)
+        {
+            // Someone else has the address now: forget the lease and join
+            // again with DHCP
+            m_cache.lease = WifiIpConfig();
+            if (m_store)
+                m_store->save(m_cache, false);
+            m_driver.disconnect();
+            start(m_ssid, m_password, m_timeout, now);
+            m_timings.leaseRefused = true;
+            return tick(now);
+        }
+        if (m_save)
+            saveCache();
+        if (m_renew)
+        {
+            m_renew = false;
+            m_renewing = true;
+            m_driver.renewLease();
+        }
+        if (!m_lost)
+            return kNever;
+        // Link dropped: reconnect the same way, with a fresh timeout
+        start(m_ssid, m_password, m_timeout, now);
+    }
+    if (m_state != WifiState::Connecting)
+        return kNever;
+
+    if (now - m_start >= m_timeout)
+    {
+        m_driver.disconnect();
+        m_state = WifiState::Failed;
+        m_timings.totalMs = now - m_start;
+        return kNever;
+    }
+
+    if (m_phase == Phase::Fast && !m_associated && now - m_phaseStart >= m_cfg.fastTimeoutMs)
+        m_fallBack = true;
+    if (m_fallBack)
+    {
+        // The AP moved or is gone: scan. The cache is rewritten once up.
+        m_fallBack = false;
+        m_timings.fellBack = true;
+        m_driver.disconnect();
+        connectFull(now);
+    }
+    else if (m_phase == Phase::Retry && !before(now, m_retryAt))
+    {
+        connectFull(now);
+    }
+
+    uint32_t next = m_start + m_timeout - now;
+    if (m_phase == Phase::Fast && !m_associated)
+    {
+        const uint32_t left = m_phaseStart + m_cfg.fastTimeoutMs - now;
+        next = left < next ? left : next;
+    }
+    else if (m_phase == Phase::Retry)
+    {
+        const uint32_t left = m_retryAt - now;
+        next = left < next ? left : next;
+    }
+    return next;
+}
+
+void WifiConnector::saveCache()
+{
+    m_save = false;
+    WifiCache c;
+    WifiIpConfig ip;
+    c.ssidHash = hashSsid(m_ssid);
+    m_driver.link(c.bssid, c.channel, ip);
+
+    // Keep a reused lease as it was until DHCP renews it: its age runs
+    // from the DHCP answer
+    bool newLease = false;
+    if (m_timings.cachedLease && !m_renewed)
+        c.lease = m_cache.lease;
+    else if (!m_static.ip)
+    {
+        c.lease = ip;
+        newLease = true;
+    }
+
+    // Flash writes only when something changed
+    const bool same = m_haveCache && c.ssidHash == m_cache.ssidHash && c.channel == m_cache.channel &&
+                      !memcmp(c.bssid, m_cache.bssid, sizeof(c.bssid)) && !memcmp(&c.lease, &m_cache.lease, sizeof(c.lease));
+    m_cache = c;
+    m_haveCache = true;
+    if (m_store && (!same || newLease))
+        m_store->save(c, newLease);
+}
@@ -1,21 +1,146 @@
 #include "WifiModule.h"
 #include "secrets.h"
+#include "HttpConnectionPool.h"
+#include "PowerManager.h"
+#include "EspHal.h"
+#include "Metrics.h"
+
+static metrics::Histogram s_connectMs("wifi_connect_ms", {100, 200, 500, 1000, 2000, 3000, 5000, 10000});
+static metrics::Counter s_fastConnects("wifi_fast_connects");
+static metrics::Counter s_fastFallbacks("wifi_fast_fallbacks");
+
+WifiModule::WifiModule()
+    : m_connector(EspWifiDriver::shared(), &NvsWifiCache::shared()) {}
+
+void WifiModule::init()
+{
+    if (m_lock)
+        return;
+    m_lock = xSemaphoreCreateMutex();
+    m_changed = xSemaphoreCreateBinary();
+    EspWifiDriver::shared().setEventCallback(onDriverEvent, this);
+}
 
 void WifiModule::beginStation()
 {
+    init();
     WiFi.mode(WIFI_STA);
 }
 
+void WifiModule::setChangeCallback(ChangeCallback cb, void *ctx)
+{
+    m_changeCtx = ctx;
+    m_changeCb = cb;
+}
+
+void WifiModule::setStaticIp(IPAddress ip, IPAddress gateway, IPAddress netmask, IPAddress dns)
+{
+    WifiIpConfig cfg;
+    cfg.ip = ip;
+    cfg.gateway = gateway;
+    cfg.netmask = netmask;
+    cfg.dns = dns;
+    m_connector.setStaticIp(cfg);
+}
+
+void WifiModule::forgetNetwork()
+{
+    NvsWifiCache::shared().clear();
+}
+
 bool WifiModule::connect(const char *ssid, const char *password, uint32_t timeoutMs)
 {
-    WiFi.begin(ssid, password);
+    startConnect(ssid, password, timeoutMs);
+    for (;;)
+    {
+        const WifiState s = poll();
+        if (s != WifiState::Connecting)
+            return s == WifiState::Connected;
+        // Until the next driver event or connector deadline
+        xSemaphoreTake(m_changed, m_pollIn == WifiConnector::kNever ? portMAX_DELAY : pdMS_TO_TICKS(m_pollIn));
+    }
+}
+
+void WifiModule::startConnect(const char *ssid, const char *password, uint32_t timeoutMs)
+{
+    init();
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    m_connector.start(ssid, password, timeoutMs, millis());
+    xSemaphoreGive(m_lock);
+    poll();
+}
 
-    unsigned long start = millis();
-    while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeoutMs)
+void WifiModule::onDriverEvent(WifiDriver::Event e, uint16_t reason, void *ctx)
+{
+    WifiModule *w = static_cast<WifiModule *>(ctx);
+    xSemaphoreTake(w->m_lock, portMAX_DELAY);
+    w->m_connector.onEvent(e, reason, millis());
+    xSemaphoreGive(w->m_lock);
+    xSemaphoreGive(w->m_changed);
+    if (w->m_changeCb)
+        w->m_changeCb(w->m_changeCtx);
+}
+
+WifiState WifiModule::poll()
+{
+    if (!m_lock)
+        return m_reported;
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    m_pollIn = m_connector.tick(millis());
+    const WifiState s = m_connector.state();
+    xSemaphoreGive(m_lock);
+    report(s);
+    return s;
+}
+
+void WifiModule::report(WifiState s)
+{
+    if (s == m_reported)
+        return;
+    m_reported = s;
+    PowerManager::shared().setBusy(PowerPolicy::Network, s == WifiState::Connecting);
+
+    const WifiConnector::Timings &t = m_connector.timings();
+    if (s == WifiState::Connected)
     {
-        delay(100);
+        s_connectMs.record(t.totalMs);
+        if (t.fast)
+            s_fastConnects.add();
+        if (t.fellBack)
+            s_fastFallbacks.add();
+        Serial.printf("[WIFI] Connected in %u ms (join %u, address %u; %s, %s)\n", (unsigned)t.totalMs,
+                      (unsigned)t.associateMs, (unsigned)t.ipMs, t.fast ? "cached AP" : t.fellBack ? "scan after miss" : "scan",
+                      t.cachedLease ? "cached lease" : "DHCP");
+    }
+    else if (s == WifiState::Failed)
+    {
+        Serial.printf("[WIFI] Connect failed after %u ms, %u attempts, reason %u\n", (unsigned)t.totalMs,
+                      (unsigned)t.attempts, (unsigned)t.lastReason);
     }
-    return WiFi.status() == WL_CONNECTED;
+}
+
+void WifiModule::suspend()
+{
+    if (m_lock)
+    {
+        xSemaphoreTake(m_lock, portMAX_DELAY);
+        const WifiState s = m_connector.state();
+        m_suspended = s == WifiState::Connecting || s == WifiState::Connected;
+        m_connector.stop();
+        xSemaphoreGive(m_lock);
+    }
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    report(WifiState::Idle);
+}
+
+void WifiModule::resume()
+{
+    if (!m_suspended)
+        return;
+    m_suspended = false;
+    WiFi.mode(WIFI_STA);
+    startConnect(m_connector.ssid(), m_connector.password(), m_connector.timeoutMs());
 }
 
 bool WifiModule::isConnected() const
@@ -33,23 +158,22 @@ int WifiModule::httpGet(const String &url, String &payloadOut, uint32_t timeoutM
     if (!isConnected())
         return -1; // not connected
 
-    WiFiClient client; // For HTTPS, switch to WiFiClientSecure and set fingerprints/validation
-    HTTPClient http;
-
-    http.setTimeout(timeoutMs);
-    if (!http.begin(client, url))
+    // Keep-alive socket from the shared pool. For HTTPS the pool would
+    // need WiFiClientSecure slots with fingerprints/validation.
+    PooledRequest req(url, timeoutMs);
+    if (!req.ok())
     {
         return -2; // begin failed
     }
 
-    int httpCode = http.GET();
+    int httpCode = req.send("GET");
     if (httpCode > 0)
     {
         if (httpCode == HTTP_CODE_OK)
         {
-            payloadOut = http.getString();
+            payloadOut = req.body();
         }
     }
-    http.end();
+    m_lastTiming = req.timing();
     return httpCode; // Could be 200.., or negative error from HTTPClient
 }
\ No newline at end of file
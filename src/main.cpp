@@ -10,7 +10,16 @@
 
 #include "ButtonModule.h"
 #include "AudioRecorderModule.h"
+#include "ApiClientModule.h"
+#include "WifiModule.h"
 #include "SpeakerModule.h"
+#include "BufferPool.h"
+#include "Scheduler.h"
+#include "PowerManager.h"
+#include "EspHal.h"
+#include "Trace.h"
+#include "Metrics.h"
+#include "secrets.h"
 
 // -------------------- Pins & UI --------------------
 #define BUTTON_PIN 33
@@ -37,10 +46,18 @@
 
 static const char *kFile = "/record.wav";
 
-Button button(BUTTON_PIN);
+// loop() sleeps in the scheduler until a timer is due or a module posts
+// an event, instead of spinning on delay(1)
+static TaskClock schedClock;
+static Scheduler sched(schedClock);
+
+Button button(BUTTON_PIN, sched);
 AudioRecorderModule audioRecorder(I2S_MIC_NUM, I2S_MIC_SCK, I2S_MIC_WS, I2S_MIC_SD);
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
 SpeakerModule speaker(I2S_SPK_NUM, I2S_SPK_SCK, I2S_SPK_WS, I2S_SPK_SD);
+WifiModule wifi;
+// Inbox only: audioRecorder owns the mic, so begin() is never called
+ApiClientModule apiClient(I2S_MIC_NUM, I2S_MIC_SCK, I2S_MIC_WS, I2S_MIC_SD, 16000, 512, 30, kFile);
 
 enum class Mode
 {
@@ -51,6 +68,189 @@ enum class Mode
 };
 static Mode mode = Mode::Ready;
 
+// -------------------- Event loop --------------------
+enum AppEvent : uint16_t
+{
+  kEvButtonEdge = 1, // posted by the button ISR
+  kEvPlaybackDone,   // arg: 1 = played to the end
+  kEvPower,          // PowerManager's own
+  kEvWifi,           // Wi-Fi state changed: poll the connector
+};
+
+static metrics::Gauge s_loopIdle("loop_idle_pct");
+static metrics::Gauge s_loopWakeups("loop_wakeups_per_s");
+static metrics::Gauge s_eventsDropped("loop_events_dropped");
+
+// Serial monitor: 't' dumps the trace rings (tools/trace2json.py),
+// 'm' prints the metrics, 'p' the time spent in each power state
+static void pollSerial(SchedTimer &, void *)
+{
+  while (Serial.available())
+  {
+    int c = Serial.read();
+    if (c == 't')
+      trace::dump(Serial);
+    else if (c == 'm')
+      metrics::Registry::shared().print(Serial);
+    else if (c == 'p')
+      PowerManager::shared().printReport(Serial);
+  }
+}
+static SchedTimer serialTimer(pollSerial, nullptr);
+
+static void sampleLoopStats(SchedTimer &, void *)
+{
+  static uint32_t lastIdle = 0, lastWakeups = 0;
+  const uint32_t idle = sched.idleMs(), wakeups = sched.wakeups();
+  s_loopIdle.set((idle - lastIdle) * 100 / 10000);
+  s_loopWakeups.set((wakeups - lastWakeups) / 10);
+  s_eventsDropped.set(sched.dropped());
+  lastIdle = idle;
+  lastWakeups = wakeups;
+}
+static SchedTimer statsTimer(sampleLoopStats, nullptr);
+
+// Output task -> loop
+static void onSpeakerDone(bool completed, void *)
+{
+  sched.post(kEvPlaybackDone, completed);
+}
+
+// An inbox check came due while Wi-Fi was still coming back from
+// light sleep; it runs once the link is up
+static bool inboxWanted = false;
+
+// Blocks the loop for one request at most; a no-op while the push
+// stream is up. Network busy keeps the policy awake until it's done.
+static void checkInbox()
+{
+  inboxWanted = false;
+  PowerManager::shared().setBusy(PowerPolicy::Network, true);
+  if (apiClient.checkInbox())
+    Serial.println("[INBOX] Messages waiting");
+  PowerManager::shared().setBusy(PowerPolicy::Network, false);
+}
+
+static void pollWifi(SchedTimer &, void *);
+static SchedTimer wifiTimer(pollWifi, nullptr);
+
+// Connector deadlines and fallbacks, run on the loop
+static void pollWifi(SchedTimer &, void *)
+{
+  const WifiState s = wifi.poll();
+  if (wifi.pollInMs() == WifiConnector::kNever)
+    sched.stopTimer(wifiTimer);
+  else
+    sched.startTimer(wifiTimer, wifi.pollInMs());
+  if (s == WifiState::Connected && inboxWanted)
+    checkInbox();
+}
+
+// Wi-Fi event task -> loop
+static void onWifiChange(void *)
+{
+  sched.post(kEvWifi);
+}
+
+static void onWifiEvent(uint16_t, uint32_t, void *)
+{
+  pollWifi(wifiTimer, nullptr);
+}
+
+// Sleep ended by the button, or the periodic inbox check is due
+static void onWake(PowerManager::Wake cause, void *)
+{
+  if (cause == PowerManager::Wake::Button)
+  {
+    Serial.println("[PWR] Woken by button");
+    return;
+  }
+  if (wifi.state() == WifiState::Connected)
+  {
+    checkInbox();
+    return;
+  }
+  // Light sleep resumes Wi-Fi on wake; after a failed join, try again
+  inboxWanted = true;
+  if (wifi.state() != WifiState::Connecting)
+  {
+    wifi.startConnect(WIFI_SSID, WIFI_PASSWORD);
+    onWifiChange(nullptr);
+  }
+}
+
+// Newest inbox message: from flash once the prefetcher has it, else
+// straight from the server
+static bool playNewestMessage()
+{
+  InboxPrefetcher &prefetch = apiClient.prefetcher();
+  String id, path;
+  if (!prefetch.newest(id))
+    return false;
+  if (prefetch.cachedPath(id.c_str(), path))
+    return speaker.play(path.c_str());
+  return speaker.playUrl(prefetch.messageUrl(id.c_str()));
+}
+
+static void onPlaybackDone(uint16_t, uint32_t completed, void *)
+{
+  Serial.println(completed ? "[PLAY] Done" : "[PLAY] Stopped");
+  // if (SPIFFS.exists(kFile))
+  // {
+  //   SPIFFS.remove(kFile);
+  //   Serial.println("Removing file");
+  // };
+  // mode = Mode::Ready;
+}
+
+// Clicks step through record -> stop -> play. Hold-to-talk would map
+// HoldStart/HoldEnd onto start/stop the same way.
+static void onButton(Gesture g, uint32_t, void *)
+{
+  Serial.printf("Button: %s\n", gestureName(g));
+  // Held button keeps us awake; any gesture restarts the idle timers
+  if (g == Gesture::Press || g == Gesture::Release)
+    PowerManager::shared().setBusy(PowerPolicy::Input, g == Gesture::Press);
+  else
+    PowerManager::shared().touch();
+  if (g == Gesture::DoubleTap)
+  {
+    Serial.println(playNewestMessage() ? "[PLAY] Inbox message" : "[PLAY] Nothing to play");
+    return;
+  }
+  if (g != Gesture::Click)
+    return;
+  // switch (mode)
+  // {
+  // case Mode::Ready:
+  //   if (audioRecorder.startRecording(kFile))
+  //   {
+  //     mode = Mode::Recording;
+  //     Serial.println("[REC] Started");
+  //   }
+  //   else
+  //   {
+  //     Serial.println("[REC] Start failed");
+  //   }
+  //   break;
+
+  // case Mode::Recording:
+  //   audioRecorder.stopRecording();
+  //   mode = Mode::JustRecorded;
+  //   Serial.println("[REC] Stopped. Press to play.");
+  //   break;
+
+  // case Mode::JustRecorded:
+  //   Serial.println("[PLAY] Playing...");
+  //   mode = speaker.play(kFile) ? Mode::Playing : Mode::Ready; // onPlaybackDone follows
+  //   break;
+
+  // case Mode::Playing:
+  //   // Ignore presses while already playing
+  //   break;
+  // }
+}
+
 void setup()
 {
   Serial.begin(115200);
@@ -60,6 +260,13 @@ void setup()
 
   delay(200); // Necessary?
 
+  // Audio blocks for every module, before any of them starts
+  BufferPool::audio().begin(16, BufferPool::Placement::PreferPsram);
+
+  // FLASH: takes, the upload queue and the message cache live here
+  if (!SPIFFS.begin(true))
+    Serial.println("[SPIFFS] Mount failed");
+
   // MICROPHONE -----------------------------------------------
   audioRecorder.begin();
 
@@ -84,7 +291,32 @@ void setup()
   speaker.begin();
 
   // BUTTON
-  button.begin();
+  button.setCallback(onButton, nullptr);
+  button.begin(kEvButtonEdge);
+
+  // EVENT LOOP
+  speaker.setDoneCallback(onSpeakerDone, nullptr);
+  sched.subscribe(kEvPlaybackDone, onPlaybackDone, nullptr);
+  sched.startTimer(serialTimer, 20, 20);
+  sched.startTimer(statsTimer, 10000, 10000);
+
+  // WI-FI and INBOX: pushed while subscribed, checked on wake otherwise
+  wifi.setChangeCallback(onWifiChange, nullptr);
+  sched.subscribe(kEvWifi, onWifiEvent, nullptr);
+  wifi.beginStation();
+  wifi.startConnect(WIFI_SSID, WIFI_PASSWORD);
+  onWifiChange(nullptr); // arm the poll timer
+  apiClient.setInboxPath(API_PATH);
+  apiClient.prefetchInbox(); // before the stream, so no announcement is missed
+  apiClient.subscribeInbox();
+
+  // POWER: sleeps once idle, the button (an RTC GPIO) wakes it
+  PowerManager::shared().setWifi(&wifi);
+  PowerManager::shared().setButton(&button);
+  PowerManager::shared().setWakeCallback(onWake, nullptr);
+  PowerManager::shared().begin(sched, kEvPower, BUTTON_PIN);
+  // // Keep pumping I2S->SPIFFS while recording: a periodic timer started
+  // // on record and stopped with it would call audioRecorder.handle()
 
   // // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
   // if(!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
@@ -116,58 +348,6 @@ void loop()
   // Microphone
   // audioRecorder.plot(); // Working
 
-  // Button
-  button.update();
-
-  if (button.wasPressed())
-  {
-    Serial.println("Button pressed");
-    // switch (mode)
-    // {
-    // case Mode::Ready:
-    //   if (audioRecorder.startRecording(kFile))
-    //   {
-    //     mode = Mode::Recording;
-    //     Serial.println("[REC] Started");
-    //   }
-    //   else
-    //   {
-    //     Serial.println("[REC] Start failed");
-    //   }
-    //   break;
-
-    // case Mode::Recording:
-    //   audioRecorder.stopRecording();
-    //   mode = Mode::JustRecorded;
-    //   Serial.println("[REC] Stopped. Press to play.");
-    //   break;
-
-    // case Mode::JustRecorded:
-    // {
-    //   Serial.println("[PLAY] Playing...");
-    //   mode = Mode::Playing;
-    //   bool ok = speaker.playFile(kFile); // blocking until done
-    //   Serial.println(ok ? "[PLAY] Done" : "[PLAY] Failed");
-    //   if (SPIFFS.exists("/record.wav"))
-    //   {
-    //     SPIFFS.remove("/record.wav");
-    //     Serial.println("Removing file");
-    //   };
-    //   mode = Mode::Ready;
-    //   break;
-    // }
-
-    // case Mode::Playing:
-    //   // Ignore presses while already playing
-    //   break;
-    // }
-  }
-
-  // // Keep pumping I2S->SPIFFS while recording
-  // if (mode == Mode::Recording)
-  // {
-  //   audioRecorder.handle();
-  // }
-
-  delay(1);
-}
\ No newline at end of file
+  // Timers and events, then sleep until the next one is due
+  sched.step();
+}
@@ -0,0 +1,241 @@
+// IMA-ADPCM encoder round trip: encode like the writer task, decode with
+// a reference decoder, compare with the input.
+//
+//   program adpcm [--runs N] [--min-snr DB] [clip.wav...]
+//
+// Without clips it runs on built-in signals (a tone sweep, and a tone
+// with noise at speech level). Checks: the WAV header carries format
+// 0x0011, 256-byte blocks and the true sample count in the fact chunk;
+// the data is a whole number of blocks; feeding the encoder in odd block
+// sizes gives the same bytes as one call; every decoded signal reaches
+// the SNR floor. Prints SNR per clip and encode throughput.
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "AudioEncoder.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    s_checks++;
+    if (!ok)
+    {
+        s_failures++;
+        fprintf(stderr, "FAIL: %s\n", what);
+    }
+}
+
+static uint16_t rd16le(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+static uint32_t rd32le(const uint8_t *p) { return rd16le(p) | (uint32_t)rd16le(p + 2) << 16; }
+
+// -------------------- reference decoder --------------------
+static const int16_t kSteps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767};
+static const int8_t kIndexAdjust[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+static int16_t decodeNibble(uint8_t code, int32_t &pred, int &index)
+{
+    const int32_t step = kSteps[index];
+    int32_t diff = step >> 3;
+    if (code & 4)
+        diff += step;
+    if (code & 2)
+        diff += step >> 1;
+    if (code & 1)
+        diff += step >> 2;
+    pred += (code & 8) ? -diff : diff;
+    pred = std::max<int32_t>(-32768, std::min<int32_t>(32767, pred));
+    index = std::max(0, std::min(88, index + kIndexAdjust[code & 7]));
+    return (int16_t)pred;
+}
+
+static void decodeBlock(const uint8_t *b, int16_t *out)
+{
+    int32_t pred = (int16_t)rd16le(b);
+    int index = std::min<int>(b[2], 88);
+    out[0] = (int16_t)pred;
+    size_t k = 1;
+    for (size_t i = 4; i < ImaAdpcmEncoder::kBlockAlign; ++i)
+    {
+        out[k++] = decodeNibble(b[i] & 0x0F, pred, index);
+        out[k++] = decodeNibble(b[i] >> 4, pred, index);
+    }
+}
+
+// -------------------- encode like the writer task --------------------
+// pop sizes vary like ring pops do; 0 = one call for the whole clip
+static std::vector<uint8_t> encodeAll(const std::vector<int16_t> &pcm, size_t pop)
+{
+    ImaAdpcmEncoder enc;
+    enc.reset();
+    std::vector<uint8_t> out(enc.maxEncodedBytes(pcm.size()) + ImaAdpcmEncoder::kBlockAlign);
+    size_t len = 0;
+    if (pop == 0)
+    {
+        len = enc.encode(pcm.data(), pcm.size(), out.data());
+    }
+    else
+    {
+        uint32_t rnd = 7;
+        for (size_t at = 0; at < pcm.size();)
+        {
+            rnd = rnd * 1103515245u + 12345u;
+            const size_t n = std::min(pcm.size() - at, 1 + (rnd >> 8) % pop);
+            len += enc.encode(pcm.data() + at, n, out.data() + len);
+            at += n;
+        }
+    }
+    len += enc.finish(out.data() + len);
+    out.resize(len);
+    return out;
+}
+
+static double snrDb(const std::vector<int16_t> &ref, const std::vector<int16_t> &got)
+{
+    double sig = 0, err = 0;
+    for (size_t i = 0; i < ref.size(); ++i)
+    {
+        const double d = (double)ref[i] - got[i];
+        sig += (double)ref[i] * ref[i];
+        err += d * d;
+    }
+    return err > 0 ? 10 * log10(sig / err) : 99.0;
+}
+
+// -------------------- built-in signals --------------------
+static std::vector<int16_t> sweep(uint32_t rate, double seconds)
+{
+    std::vector<int16_t> s((size_t)(rate * seconds));
+    double phase = 0;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        const double f = 100 + 3900 * i / (double)s.size();
+        phase += 2 * M_PI * f / rate;
+        s[i] = (int16_t)(12000 * sin(phase));
+    }
+    return s;
+}
+
+static std::vector<int16_t> toneInNoise(uint32_t rate, double seconds)
+{
+    std::vector<int16_t> s((size_t)(rate * seconds));
+    uint32_t rnd = 99;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        rnd = rnd * 1664525u + 1013904223u;
+        const double noise = ((int32_t)(rnd >> 16) - 32768) / 32768.0;
+        s[i] = (int16_t)(3000 * sin(2 * M_PI * 220 * i / rate) + 1500 * sin(2 * M_PI * 660 * i / rate) + 300 * noise);
+    }
+    return s;
+}
+
+int adpcmBench(int argc, char **argv)
+{
+    int runs = 10;
+    double minSnr = 20.0;
+    std::vector<const char *> clips;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--runs") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--min-snr") && i + 1 < argc)
+            minSnr = atof(argv[++i]);
+        else if (argv[i][0] != '-')
+            clips.push_back(argv[i]);
+        else
+            runs = 0; // unknown option
+    }
+    if (runs < 1)
+    {
+        fprintf(stderr, "usage: program adpcm [--runs N] [--min-snr DB] [clip.wav...]\n");
+        return 2;
+    }
+
+    struct Signal
+    {
+        std::string name;
+        std::vector<int16_t> pcm;
+    };
+    std::vector<Signal> signals;
+    for (const char *clip : clips)
+    {
+        FileAudioSource src(clip);
+        if (!src.ok())
+        {
+            fprintf(stderr, "%s: not a 16-bit mono PCM WAV\n", clip);
+            return 1;
+        }
+        signals.push_back({clip, src.samples()});
+    }
+    if (signals.empty())
+    {
+        signals.push_back({"sweep", sweep(16000, 5)});
+        signals.push_back({"tone+noise", toneInNoise(16000, 5)});
+    }
+
+    // Header as the writer patches it at the end of a take
+    ImaAdpcmEncoder enc;
+    uint8_t h[AudioEncoder::kMaxHeaderBytes];
+    enc.makeHeader(h, 16000, 12345, 25 * ImaAdpcmEncoder::kBlockAlign);
+    check(!memcmp(h, "RIFF", 4) && !memcmp(h + 8, "WAVE", 4) && rd16le(h + 20) == 0x0011 &&
+              rd16le(h + 32) == ImaAdpcmEncoder::kBlockAlign && rd16le(h + 38) == ImaAdpcmEncoder::kSamplesPerBlock,
+          "header: IMA-ADPCM fmt chunk");
+    check(!memcmp(h + 40, "fact", 4) && rd32le(h + 48) == 12345 && !memcmp(h + 52, "data", 4) &&
+              rd32le(h + 56) == 25u * ImaAdpcmEncoder::kBlockAlign && rd32le(h + 4) == enc.headerSize() - 8 + rd32le(h + 56),
+          "header: fact and data sizes");
+
+    printf("{\"bench\":\"adpcm\",\"clips\":[");
+    double worst = 99, ns = 0;
+    uint64_t encoded = 0;
+    for (size_t c = 0; c < signals.size(); ++c)
+    {
+        const std::vector<int16_t> &pcm = signals[c].pcm;
+        const std::vector<uint8_t> bytes = encodeAll(pcm, 0);
+        const size_t blocks = bytes.size() / ImaAdpcmEncoder::kBlockAlign;
+        check(bytes.size() % ImaAdpcmEncoder::kBlockAlign == 0 &&
+                  blocks == (pcm.size() + ImaAdpcmEncoder::kSamplesPerBlock - 1) / ImaAdpcmEncoder::kSamplesPerBlock,
+              "data is whole blocks covering the clip");
+        check(encodeAll(pcm, 700) == bytes, "odd pop sizes encode the same bytes");
+
+        std::vector<int16_t> decoded(blocks * ImaAdpcmEncoder::kSamplesPerBlock);
+        for (size_t b = 0; b < blocks; ++b)
+            decodeBlock(&bytes[b * ImaAdpcmEncoder::kBlockAlign], &decoded[b * ImaAdpcmEncoder::kSamplesPerBlock]);
+        decoded.resize(pcm.size()); // the fact chunk's length
+        const double snr = snrDb(pcm, decoded);
+        worst = std::min(worst, snr);
+
+        // Throughput: best of N whole-clip encodes
+        double best = 1e30;
+        for (int r = 0; r < runs; ++r)
+        {
+            const Clock::time_point t0 = Clock::now();
+            encodeAll(pcm, 512);
+            best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - t0).count());
+        }
+        ns += best;
+        encoded += pcm.size();
+        printf("%s{\"name\":\"%s\",\"samples\":%zu,\"snr_db\":%.1f,\"ratio\":%.2f}", c ? "," : "",
+               signals[c].name.c_str(), pcm.size(), snr, bytes.size() ? pcm.size() * 2.0 / bytes.size() : 0.0);
+    }
+    check(worst >= minSnr, "SNR above the floor");
+    printf("],\"worst_snr_db\":%.1f,\"msamples_per_s\":%.1f,\"checks\":%u,\"failures\":%u}\n",
+           worst, ns > 0 ? encoded * 1e3 / ns : 0.0, s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Host benchmarks, one per subcommand of the native program. Each takes
+// the arguments after its name and prints one JSON line on stdout.
+int ringBench(int argc, char **argv);
+int pcmBench(int argc, char **argv);
+int adpcmBench(int argc, char **argv);
+int vadBench(int argc, char **argv);
+int dspBench(int argc, char **argv);
+int resampleBench(int argc, char **argv);
+int wavFuzz(int argc, char **argv);
+int schedBench(int argc, char **argv);
+int buttonReplay(int argc, char **argv);
+int powerSim(int argc, char **argv);
+int wifiBench(int argc, char **argv);
+int messageCacheBench(int argc, char **argv);
+int uploadBench(int argc, char **argv);
+int sseBench(int argc, char **argv);
+int playBench(int argc, char **argv);
@@ -0,0 +1,244 @@
+// Button gesture replay: feeds recorded edge timings through the
+// GestureDetector on a virtual clock and checks the gestures that come
+// out, including when the loop is too busy to pick edges up at once.
+//
+//   program button [--late MS] [capture.csv...]
+//
+// Without files it runs the built-in fixtures (bouncy clicks, double
+// taps, holds, long presses, glitches, the millis() wrap). A capture is
+// a logic-analyzer export of the button pin, one "time_s,level" line per
+// edge (header lines are skipped, level 0 = pressed); its gestures are
+// printed, one JSON line per file.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "Gestures.h"
+#include "Scheduler.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+struct RawEdge
+{
+    uint32_t ms;
+    bool pressed;
+};
+
+struct Seen
+{
+    Gesture g;
+    uint32_t at;
+};
+
+static void record(Gesture g, uint32_t at, void *ctx)
+{
+    static_cast<std::vector<Seen> *>(ctx)->push_back({g, at});
+}
+
+// Like step(), but never sleeps past end: the next edge may come first
+static void runUntil(Scheduler &sched, VirtualClock &clock, uint32_t end)
+{
+    for (;;)
+    {
+        const uint32_t wait = sched.runDue();
+        const int32_t left = (int32_t)(end - clock.nowMs());
+        if (left <= 0)
+            return;
+        clock.advance(wait < (uint32_t)left ? wait : (uint32_t)left);
+    }
+}
+
+// With lateMs the loop task only gets to run every lateMs, as if busy:
+// edges queue up meanwhile and are drained before the timers, like the
+// scheduler does. Gestures must still be timed from the edges.
+static std::vector<Seen> replay(const std::vector<RawEdge> &edges, uint32_t start, uint32_t lateMs)
+{
+    VirtualClock clock(start);
+    Scheduler sched(clock);
+    std::vector<Seen> seen;
+    GestureDetector det(sched, record, &seen);
+    const uint32_t end = (edges.empty() ? 0 : edges.back().ms) + 5000;
+    if (lateMs == 0)
+    {
+        for (const RawEdge &e : edges)
+        {
+            runUntil(sched, clock, start + e.ms);
+            det.edge(e.pressed, start + e.ms);
+        }
+        runUntil(sched, clock, start + end);
+    }
+    else
+    {
+        size_t next = 0;
+        for (uint32_t t = 0; t <= end; t += lateMs)
+        {
+            clock.advance(start + t - clock.nowMs());
+            for (; next < edges.size() && edges[next].ms <= t; ++next)
+                det.edge(edges[next].pressed, start + edges[next].ms);
+            sched.runDue();
+        }
+    }
+    for (Seen &s : seen)
+        s.at -= start;
+    return seen;
+}
+
+// A press held for holdMs with contact bounce on both edges
+static void bouncyPress(std::vector<RawEdge> &out, uint32_t at, uint32_t holdMs)
+{
+    const uint32_t down[] = {0, 1, 1, 3, 4};
+    for (size_t i = 0; i < 5; ++i)
+        out.push_back({at + down[i], i % 2 == 0});
+    const uint32_t up[] = {0, 1, 2};
+    for (size_t i = 0; i < 3; ++i)
+        out.push_back({at + holdMs + up[i], i % 2 == 1});
+}
+
+static std::string names(const std::vector<Seen> &seen)
+{
+    std::string s;
+    for (const Seen &x : seen)
+    {
+        if (!s.empty())
+            s += ' ';
+        s += gestureName(x.g);
+    }
+    return s;
+}
+
+struct Fixture
+{
+    const char *name;
+    std::vector<RawEdge> edges;
+    const char *expect;
+};
+
+static std::vector<Fixture> fixtures()
+{
+    std::vector<Fixture> f;
+    Fixture click = {"click", {}, "press release click"};
+    bouncyPress(click.edges, 100, 120);
+    f.push_back(click);
+
+    Fixture dbl = {"double_tap", {}, "press release press release double_tap"};
+    bouncyPress(dbl.edges, 100, 90);
+    bouncyPress(dbl.edges, 310, 90);
+    f.push_back(dbl);
+
+    Fixture hold = {"hold", {}, "press hold_start release hold_end"};
+    bouncyPress(hold.edges, 100, 1200);
+    f.push_back(hold);
+
+    Fixture lng = {"long_press", {}, "press hold_start long_press release hold_end"};
+    bouncyPress(lng.edges, 100, 2600);
+    f.push_back(lng);
+
+    Fixture tapHold = {"tap_then_hold", {}, "press release press click hold_start release hold_end"};
+    bouncyPress(tapHold.edges, 100, 100);
+    bouncyPress(tapHold.edges, 300, 900);
+    f.push_back(tapHold);
+
+    // A 2 ms spike from ESD or a loose wire: reported, but never a tap
+    Fixture glitch = {"glitch", {{100, true}, {102, false}}, "press release"};
+    f.push_back(glitch);
+
+    // Two slow clicks are two clicks, not a double tap
+    Fixture twoClicks = {"two_clicks", {}, "press release click press release click"};
+    bouncyPress(twoClicks.edges, 100, 100);
+    bouncyPress(twoClicks.edges, 700, 100);
+    f.push_back(twoClicks);
+    return f;
+}
+
+static bool loadCapture(const char *path, std::vector<RawEdge> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[128];
+    double t0 = -1;
+    while (fgets(line, sizeof(line), f))
+    {
+        double t;
+        int level;
+        if (sscanf(line, "%lf,%d", &t, &level) != 2 && sscanf(line, "%lf %d", &t, &level) != 2)
+            continue;
+        if (t0 < 0)
+            t0 = t;
+        out.push_back({(uint32_t)((t - t0) * 1000.0), level == 0});
+    }
+    fclose(f);
+    return true;
+}
+
+int buttonReplay(int argc, char **argv)
+{
+    uint32_t lateMs = 0;
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--late") && i + 1 < argc)
+            lateMs = strtoul(argv[++i], nullptr, 10);
+        else if (argv[i][0] != '-')
+            files.push_back(argv[i]);
+        else
+        {
+            fprintf(stderr, "usage: program button [--late MS] [capture.csv...]\n");
+            return 2;
+        }
+    }
+
+    if (!files.empty())
+    {
+        for (const char *path : files)
+        {
+            std::vector<RawEdge> edges;
+            if (!loadCapture(path, edges))
+            {
+                fprintf(stderr, "cannot read %s\n", path);
+                return 1;
+            }
+            std::vector<Seen> seen = replay(edges, 0, lateMs);
+            printf("{\"bench\":\"button\",\"capture\":\"%s\",\"edges\":%zu,\"gestures\":[", path, edges.size());
+            for (size_t i = 0; i < seen.size(); ++i)
+                printf("%s{\"g\":\"%s\",\"ms\":%u}", i ? "," : "", gestureName(seen[i].g), (unsigned)seen[i].at);
+            printf("]}\n");
+        }
+        return 0;
+    }
+
+    // Every fixture at both ends of the clock, delivered on time and late
+    unsigned checks = 0, failures = 0;
+    const uint32_t starts[] = {0, 0xFFFFFF00u};
+    const uint32_t lates[] = {0, lateMs ? lateMs : 40};
+    for (const Fixture &fx : fixtures())
+    {
+        for (uint32_t start : starts)
+        {
+            std::vector<Seen> ref;
+            for (uint32_t late : lates)
+            {
+                std::vector<Seen> seen = replay(fx.edges, start, late);
+                checks++;
+                bool ok = names(seen) == fx.expect;
+                // Press is timed at the first raw edge, whatever the bounce
+                ok &= !seen.empty() && seen[0].g == Gesture::Press && seen[0].at == fx.edges[0].ms;
+                if (late == 0)
+                    ref = seen;
+                // Late delivery changes nothing, timestamps included
+                for (size_t i = 0; ok && i < seen.size(); ++i)
+                    ok = i < ref.size() && seen[i].g == ref[i].g && seen[i].at == ref[i].at;
+                if (!ok)
+                {
+                    failures++;
+                    fprintf(stderr, "FAIL %s (start %u, late %u): got \"%s\", want \"%s\"\n", fx.name,
+                            (unsigned)start, (unsigned)late, names(seen).c_str(), fx.expect);
+                }
+            }
+        }
+    }
+    printf("{\"bench\":\"button\",\"fixtures\":%zu,\"checks\":%u,\"failures\":%u,\"late_ms\":%u}\n",
+           fixtures().size(), checks, failures, (unsigned)lates[1]);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+// Front-end benchmark: cost of CaptureDsp per sample next to the plain
+// shift it replaces, output levels, and golden-output regression.
+//
+//   program dsp [--runs N] [--no-agc] [--write-golden DIR | --check-golden DIR] clip.wav...
+//
+// Golden files are the 16-bit output as raw little-endian PCM, one per
+// clip (DIR/<clip name>.pcm). --write-golden records them from a build
+// you trust; --check-golden compares bit for bit and exits 1 on the
+// first difference, so filter or AGC changes can't slip in unnoticed.
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+#include "CaptureDsp.h"
+#include "PcmConvert.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const int kMicShift = 11; // what the mic fake shifts up by
+
+static uint64_t cycles()
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static std::string goldenPath(const char *dir, const char *clip)
+{
+    const char *base = strrchr(clip, '/');
+    std::string name = base ? base + 1 : clip;
+    return std::string(dir) + "/" + name.substr(0, name.rfind('.')) + ".pcm";
+}
+
+// 0 = match, 1 = differs, -1 = no golden file
+static int checkGolden(const std::string &path, const std::vector<int16_t> &out, size_t &firstDiff)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return -1;
+    std::vector<int16_t> ref(out.size() + 1);
+    size_t n = fread(ref.data(), sizeof(int16_t), ref.size(), f);
+    fclose(f);
+    for (firstDiff = 0; firstDiff < out.size() && firstDiff < n; ++firstDiff)
+        if (ref[firstDiff] != out[firstDiff])
+            return 1;
+    return n == out.size() ? 0 : 1;
+}
+
+static double dbfs(double v)
+{
+    return v > 0 ? 20.0 * log10(v / 32768.0) : -120.0;
+}
+
+int dspBench(int argc, char **argv)
+{
+    int runs = 20;
+    bool agc = true;
+    const char *writeDir = nullptr, *checkDir = nullptr;
+    std::vector<const char *> clips;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *a = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(a, "--runs") && hasValue)
+            runs = atoi(argv[++i]);
+        else if (!strcmp(a, "--no-agc"))
+            agc = false;
+        else if (!strcmp(a, "--write-golden") && hasValue)
+            writeDir = argv[++i];
+        else if (!strcmp(a, "--check-golden") && hasValue)
+            checkDir = argv[++i];
+        else if (a[0] != '-')
+            clips.push_back(a);
+    }
+    if (clips.empty() || runs < 1)
+    {
+        fprintf(stderr, "usage: program dsp [--runs N] [--no-agc] "
+                        "[--write-golden DIR | --check-golden DIR] clip.wav...\n");
+        return 2;
+    }
+
+    CaptureDsp::Config cfg;
+    cfg.agc = agc;
+    uint64_t samples = 0, clipped = 0;
+    double dspNs = 0, shiftNs = 0, dspCycles = 0, inPeak = 0, outPeak = 0, sumSq = 0, sum = 0;
+    int goldenFailures = 0, goldenMissing = 0;
+    for (const char *clip : clips)
+    {
+        FileAudioSource src(clip, kMicShift);
+        if (!src.ok())
+        {
+            fprintf(stderr, "%s: not a 16-bit mono PCM WAV\n", clip);
+            return 1;
+        }
+        // The 32-bit containers the mic would hand over
+        const std::vector<int16_t> &pcm = src.samples();
+        std::vector<int32_t> raw(pcm.size());
+        for (size_t i = 0; i < pcm.size(); ++i)
+            raw[i] = (int32_t)pcm[i] << kMicShift;
+        std::vector<int16_t> out(pcm.size());
+
+        // Best of N, in the reader's 1024-sample blocks
+        CaptureDsp dsp(cfg);
+        dsp.begin(src.fileSampleRate() ? src.fileSampleRate() : 16000);
+        double bestNs = 1e30, bestCycles = 1e30, bestShift = 1e30;
+        for (int r = 0; r < runs; ++r)
+        {
+            dsp.reset();
+            auto t0 = Clock::now();
+            uint64_t c0 = cycles();
+            for (size_t i = 0; i < raw.size(); i += 1024)
+                dsp.process(&raw[i], &out[i], std::min((size_t)1024, raw.size() - i));
+            bestCycles = std::min(bestCycles, (double)(cycles() - c0));
+            bestNs = std::min(bestNs, std::chrono::duration<double, std::nano>(Clock::now() - t0).count());
+        }
+        std::vector<int16_t> shifted(pcm.size());
+        for (int r = 0; r < runs; ++r)
+        {
+            auto t0 = Clock::now();
+            for (size_t i = 0; i < raw.size(); i += 1024)
+                pcm32_to_pcm16(&raw[i], &shifted[i], std::min((size_t)1024, raw.size() - i), kMicShift);
+            bestShift = std::min(bestShift, std::chrono::duration<double, std::nano>(Clock::now() - t0).count());
+        }
+        dspNs += bestNs;
+        dspCycles += bestCycles;
+        shiftNs += bestShift;
+        samples += raw.size();
+
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            inPeak = std::max(inPeak, fabs((double)pcm[i]));
+            outPeak = std::max(outPeak, fabs((double)out[i]));
+            sumSq += (double)out[i] * out[i];
+            sum += out[i];
+            clipped += out[i] == 32767 || out[i] == -32768;
+        }
+
+        if (writeDir)
+        {
+            std::string path = goldenPath(writeDir, clip);
+            FILE *f = fopen(path.c_str(), "wb");
+            if (!f || fwrite(out.data(), sizeof(int16_t), out.size(), f) != out.size())
+            {
+                fprintf(stderr, "cannot write %s\n", path.c_str());
+                return 1;
+            }
+            fclose(f);
+        }
+        if (checkDir)
+        {
+            size_t at = 0;
+            std::string path = goldenPath(checkDir, clip);
+            int r = checkGolden(path, out, at);
+            if (r < 0)
+                goldenMissing++;
+            else if (r > 0)
+            {
+                goldenFailures++;
+                fprintf(stderr, "%s: differs from %s at sample %zu\n", clip, path.c_str(), at);
+            }
+        }
+    }
+
+    const char *golden = !checkDir ? "skipped" : goldenFailures ? "mismatch" : goldenMissing ? "missing" : "match";
+    printf("{\"bench\":\"dsp\",\"clips\":%zu,\"samples\":%llu,\"agc\":%s,"
+           "\"ns_per_sample\":%.3f,\"cycles_per_sample\":%.2f,\"shift_ns_per_sample\":%.3f,"
+           "\"in_peak_dbfs\":%.1f,\"out_peak_dbfs\":%.1f,\"out_rms_dbfs\":%.1f,\"out_dc\":%.2f,"
+           "\"clipped\":%llu,\"golden\":\"%s\"}\n",
+           clips.size(), (unsigned long long)samples, agc ? "true" : "false",
+           dspNs / samples, dspCycles / samples, shiftNs / samples,
+           dbfs(inPeak), dbfs(outPeak), dbfs(sqrt(sumSq / samples)), sum / samples,
+           (unsigned long long)clipped, golden);
+    return goldenFailures || goldenMissing ? 1 : 0;
+}
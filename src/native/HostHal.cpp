@@ -0,0 +1,616 @@
+#include "HostHal.h"
+#include <algorithm>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+static uint32_t rd32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t rd16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+// -------------------- FileAudioSource --------------------
+FileAudioSource::FileAudioSource(const char *wavPath, int shift) : m_shift(shift)
+{
+    FILE *f = fopen(wavPath, "rb");
+    if (!f)
+        return;
+
+    // Walk the chunks; only 16-bit mono PCM is accepted
+    uint8_t h[12];
+    bool pcm = false;
+    if (fread(h, 1, 12, f) == 12 && !memcmp(h, "RIFF", 4) && !memcmp(h + 8, "WAVE", 4))
+    {
+        uint8_t ch[8];
+        while (fread(ch, 1, 8, f) == 8)
+        {
+            uint32_t len = rd32(ch + 4);
+            if (!memcmp(ch, "fmt ", 4) && len >= 16)
+            {
+                uint8_t fmt[16];
+                if (fread(fmt, 1, 16, f) != 16)
+                    break;
+                pcm = rd16(fmt) == 1 && rd16(fmt + 2) == 1 && rd16(fmt + 14) == 16;
+                m_fileRate = rd32(fmt + 4);
+                fseek(f, (len - 16) + (len & 1), SEEK_CUR);
+            }
+            else if (!memcmp(ch, "data", 4) && pcm)
+            {
+                m_samples.resize(len / 2);
+                m_samples.resize(fread(m_samples.data(), 2, m_samples.size(), f));
+                break;
+            }
+            else
+            {
+                fseek(f, len + (len & 1), SEEK_CUR);
+            }
+        }
+    }
+    fclose(f);
+}
+
+bool FileAudioSource::begin(uint32_t sampleRate)
+{
+    m_sampleRate = sampleRate;
+    if (m_fileRate && m_fileRate != sampleRate)
+        fprintf(stderr, "FileAudioSource: clip is %u Hz, capture runs at %u Hz\n", m_fileRate, sampleRate);
+    return ok();
+}
+
+void FileAudioSource::start()
+{
+    m_pos = 0;
+    m_served = 0;
+    m_t0 = Clock::now();
+    m_running = true;
+}
+
+uint64_t FileAudioSource::capturedSamples() const
+{
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - m_t0).count();
+    return (uint64_t)us * m_sampleRate / 1000000;
+}
+
+size_t FileAudioSource::read(int32_t *dst, size_t n, uint32_t timeoutMs)
+{
+    if (!m_running)
+        return 0;
+
+    // Like i2s_read: block until the whole request is captured or time is up
+    if (m_realtime)
+    {
+        const auto deadline = timeoutMs == kForever ? Clock::time_point::max()
+                                                    : Clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (capturedSamples() < m_served + n && Clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        n = std::min<uint64_t>(n, capturedSamples() - m_served);
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        int16_t s = m_pos < m_samples.size() ? m_samples[m_pos++] : 0;
+        dst[i] = (int32_t)((uint32_t)(int32_t)s << m_shift);
+    }
+    m_served += n;
+    return n;
+}
+
+// -------------------- FileAudioSink --------------------
+FileAudioSink::FileAudioSink(const char *rawPath, size_t dmaFrames) : m_dmaFrames(dmaFrames)
+{
+    if (rawPath)
+        m_out = fopen(rawPath, "wb");
+}
+
+FileAudioSink::~FileAudioSink()
+{
+    if (m_out)
+        fclose(m_out);
+}
+
+bool FileAudioSink::begin(uint32_t sampleRate)
+{
+    m_sampleRate = sampleRate;
+    return true;
+}
+
+void FileAudioSink::start()
+{
+    m_written = 0;
+    m_t0 = Clock::now();
+    m_running = true;
+}
+
+size_t FileAudioSink::write(const int16_t *frames, size_t n)
+{
+    if (!m_running)
+        return 0;
+
+    auto played = [this]() -> uint64_t
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - m_t0).count();
+        return (uint64_t)us * m_sampleRate / 1000000;
+    };
+
+    // The DMA queue ran dry before this write: the gap went out as silence
+    uint64_t p = played();
+    if (p > m_written)
+    {
+        m_underrunFrames += p - m_written;
+        m_written = p;
+    }
+
+    // Block while the queue is full, as i2s_write(portMAX_DELAY) would
+    while (m_written + n > played() + m_dmaFrames)
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+
+    if (m_out)
+        fwrite(frames, sizeof(int16_t) * 2, n, m_out);
+    m_written += n;
+    return n;
+}
+
+// -------------------- HostFileStore --------------------
+namespace
+{
+    class HostFile : public StoredFile
+    {
+    public:
+        HostFile(FILE *f, uint32_t writeLatencyUs) : m_f(f), m_writeLatencyUs(writeLatencyUs) {}
+        ~HostFile() override { fclose(m_f); }
+
+        size_t read(uint8_t *dst, size_t len) override { return fread(dst, 1, len, m_f); }
+        size_t write(const uint8_t *src, size_t len) override
+        {
+            if (m_writeLatencyUs)
+                std::this_thread::sleep_for(std::chrono::microseconds(m_writeLatencyUs));
+            return fwrite(src, 1, len, m_f);
+        }
+        bool seek(uint32_t pos) override { return fseek(m_f, pos, SEEK_SET) == 0; }
+        uint32_t size() override
+        {
+            long at = ftell(m_f);
+            fseek(m_f, 0, SEEK_END);
+            long end = ftell(m_f);
+            fseek(m_f, at, SEEK_SET);
+            return (uint32_t)end;
+        }
+        void flush() override { fflush(m_f); }
+
+    private:
+        FILE *m_f;
+        const uint32_t m_writeLatencyUs;
+    };
+}
+
+HostFileStore::HostFileStore(const char *root) : m_root(root)
+{
+    while (!m_root.empty() && m_root.back() == '/')
+        m_root.pop_back();
+}
+
+std::unique_ptr<StoredFile> HostFileStore::open(const char *path, OpenMode mode)
+{
+    const char *m = mode == OpenMode::Read ? "rb" : mode == OpenMode::Write ? "wb"
+                                                                            : "ab";
+    FILE *f = fopen(full(path).c_str(), m);
+    if (!f)
+        return nullptr;
+    return std::unique_ptr<StoredFile>(new HostFile(f, m_writeLatencyUs));
+}
+
+bool HostFileStore::exists(const char *path)
+{
+    FILE *f = fopen(full(path).c_str(), "rb");
+    if (f)
+        fclose(f);
+    return f != nullptr;
+}
+
+bool HostFileStore::remove(const char *path) { return ::remove(full(path).c_str()) == 0; }
+
+bool HostFileStore::rename(const char *from, const char *to)
+{
+    return ::rename(full(from).c_str(), full(to).c_str()) == 0;
+}
+
+void HostFileStore::list(const char *dir, ListCallback cb, void *ctx)
+{
+    DIR *d = opendir(full(dir).c_str());
+    if (!d)
+        return;
+    std::vector<std::string> paths;
+    for (struct dirent *e = readdir(d); e; e = readdir(d))
+        if (e->d_type == DT_REG)
+            paths.push_back(std::string(dir) + "/" + e->d_name);
+    closedir(d);
+    // Collected first so the callback may remove what it is shown
+    for (const std::string &p : paths)
+        cb(p.c_str(), ctx);
+}
+
+// -------------------- LoopbackTransport --------------------
+class LoopbackConnection : public NetConnection
+{
+public:
+    explicit LoopbackConnection(LoopbackTransport &server) : m_server(server) {}
+
+    size_t write(const uint8_t *src, size_t len) override
+    {
+        if (!m_open)
+            return 0;
+        if (m_state == State::Done)
+        {
+            // Keep-alive: the next request once the reply has been read
+            if (!m_server.m_handler || m_readPos < m_response.size())
+                return 0;
+            m_state = State::Headers;
+            m_response.clear();
+            m_readPos = 0;
+        }
+        bool hangUp = false;
+        if (len > 0 && m_server.m_dropRate > 0 && m_server.nextRand() % 1000000 < m_server.m_dropRate * 1e6)
+        {
+            // Hang up part way through this write
+            len = m_server.nextRand() % len;
+            hangUp = true;
+            m_server.m_stats.drops++;
+        }
+        else if (m_server.m_dropAfter > 0)
+        {
+            if (len >= m_server.m_dropAfter)
+            {
+                len = m_server.m_dropAfter;
+                hangUp = true;
+                m_server.m_stats.drops++;
+                m_server.m_dropAfter = 0;
+            }
+            else
+            {
+                m_server.m_dropAfter -= len;
+            }
+        }
+        for (size_t i = 0; i < len; ++i)
+            feed(src[i]);
+        if (hangUp)
+        {
+            m_open = false;
+            m_server.m_lastBody = m_body; // what made it in before it
+        }
+        return len;
+    }
+
+    size_t read(uint8_t *dst, size_t len) override
+    {
+        size_t n = std::min<size_t>(len, std::max(available(), 0));
+        memcpy(dst, m_response.data() + m_readPos, n);
+        m_readPos += n;
+        return n;
+    }
+
+    int available() override
+    {
+        if (m_state != State::Done || Clock::now() < m_readyAt)
+            return 0;
+        return (int)(m_response.size() - m_readPos);
+    }
+
+    bool connected() override
+    {
+        if (m_server.m_handler)
+            return m_open;
+        return m_open && (m_state != State::Done || available() > 0 || Clock::now() < m_readyAt);
+    }
+    void close() override { m_open = false; }
+
+private:
+    enum class State
+    {
+        Headers,
+        Body,      // Content-Length body
+        ChunkSize, // chunked: hex size line
+        ChunkData,
+        ChunkEnd,  // CRLF after a chunk
+        Trailer,
+        Done
+    };
+
+    void feed(uint8_t c)
+    {
+        switch (m_state)
+        {
+        case State::Headers:
+            m_line += (char)c;
+            if (m_line.size() >= 4 && m_line.compare(m_line.size() - 4, 4, "\r\n\r\n") == 0)
+                headersDone();
+            break;
+        case State::Body:
+            m_body.push_back(c);
+            if (--m_remaining == 0)
+                finish();
+            break;
+        case State::ChunkSize:
+            m_line += (char)c;
+            if (c == '\n')
+            {
+                m_remaining = strtoul(m_line.c_str(), nullptr, 16);
+                m_line.clear();
+                m_state = m_remaining ? State::ChunkData : State::Trailer;
+            }
+            break;
+        case State::ChunkData:
+            m_body.push_back(c);
+            if (--m_remaining == 0)
+                m_state = State::ChunkEnd;
+            break;
+        case State::ChunkEnd:
+            if (c == '\n')
+                m_state = State::ChunkSize;
+            break;
+        case State::Trailer:
+            m_line += (char)c;
+            if (c == '\n')
+            {
+                bool blank = m_line == "\r\n";
+                m_line.clear();
+                if (blank)
+                    finish();
+            }
+            break;
+        case State::Done:
+            break;
+        }
+    }
+
+    void headersDone()
+    {
+        m_head = m_line;
+        const char *h = m_line.c_str();
+        const char *cl = strcasestr(h, "\r\nContent-Length:");
+        bool chunked = strcasestr(h, "\r\nTransfer-Encoding: chunked") != nullptr;
+        m_line.clear();
+        if (chunked)
+        {
+            m_state = State::ChunkSize;
+        }
+        else if (cl && (m_remaining = strtoul(cl + 17, nullptr, 10)) > 0)
+        {
+            m_state = State::Body;
+        }
+        else
+        {
+            finish();
+        }
+    }
+
+    void finish()
+    {
+        m_state = State::Done;
+        m_server.m_stats.requests++;
+        m_server.m_stats.bodyBytes += m_body.size();
+
+        int code = m_server.m_status;
+        LoopbackTransport::Reply reply;
+        if (m_server.m_handler)
+        {
+            // "METHOD /path HTTP/1.1\r\n" then the header lines
+            LoopbackTransport::Request req;
+            const size_t sp1 = m_head.find(' ');
+            const size_t sp2 = m_head.find(' ', sp1 + 1);
+            const size_t eol = m_head.find("\r\n");
+            req.method = m_head.substr(0, sp1);
+            req.path = m_head.substr(sp1 + 1, sp2 - sp1 - 1);
+            req.headers = m_head.substr(eol + 2);
+            req.body = m_body;
+            code = m_server.m_handler(req, reply, m_server.m_handlerCtx);
+        }
+        m_server.m_lastBody.swap(m_body);
+        m_body.clear();
+        if (code < 0)
+        {
+            m_open = false; // hang up unanswered
+            return;
+        }
+
+        char status[80];
+        // 1xx, 204 and 304 replies never have a body, so no length either
+        const bool bodiless = code < 200 || code == 204 || code == 304;
+        if (bodiless || strcasestr(reply.headers.c_str(), "Transfer-Encoding:"))
+            snprintf(status, sizeof(status), "HTTP/1.1 %d Loopback\r\n", code);
+        else
+            snprintf(status, sizeof(status), "HTTP/1.1 %d Loopback\r\nContent-Length: %u\r\n", code,
+                     (unsigned)reply.body.size());
+        m_response = reply.interim + status + reply.headers + "\r\n" + reply.body;
+        m_readyAt = Clock::now() + std::chrono::milliseconds(m_server.m_delayMs);
+    }
+
+    LoopbackTransport &m_server;
+    bool m_open = true;
+    State m_state = State::Headers;
+    std::string m_line;
+    std::string m_head; // request line and headers
+    std::vector<uint8_t> m_body;
+    size_t m_remaining = 0;
+    std::string m_response;
+    size_t m_readPos = 0;
+    Clock::time_point m_readyAt;
+};
+
+void LoopbackTransport::setHandler(Handler h, void *ctx)
+{
+    m_handler = h;
+    m_handlerCtx = ctx;
+}
+
+void LoopbackTransport::setDropRate(double p, uint32_t seed)
+{
+    m_dropRate = p;
+    m_rnd = seed ? seed : 1;
+}
+
+uint32_t LoopbackTransport::nextRand()
+{
+    m_rnd ^= m_rnd << 13;
+    m_rnd ^= m_rnd >> 17;
+    m_rnd ^= m_rnd << 5;
+    return m_rnd;
+}
+
+std::unique_ptr<NetConnection> LoopbackTransport::connect(const char *, uint16_t)
+{
+    m_stats.connects++;
+    return std::unique_ptr<NetConnection>(new LoopbackConnection(*this));
+}
+
+// -------------------- SteadyClock --------------------
+uint32_t SteadyClock::nowMs()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - m_t0)
+        .count();
+}
+
+void SteadyClock::waitMs(uint32_t ms)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (ms == kForever)
+        m_cv.wait(lock, [this] { return m_woken; });
+    else
+        m_cv.wait_for(lock, std::chrono::milliseconds(ms), [this] { return m_woken; });
+    m_woken = false;
+}
+
+void SteadyClock::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_woken = true;
+    }
+    m_cv.notify_one();
+}
+
+// -------------------- FakeWifiDriver --------------------
+void FakeWifiDriver::setAp(const uint8_t bssid[6], uint8_t channel)
+{
+    memcpy(m_bssid, bssid, sizeof(m_bssid));
+    m_channel = channel;
+}
+
+void FakeWifiDriver::setEventCallback(EventCallback cb, void *ctx)
+{
+    m_ctx = ctx;
+    m_cb = cb;
+}
+
+void FakeWifiDriver::push(uint32_t at, Event e, uint16_t reason)
+{
+    m_queue.push_back({at, e, reason});
+}
+
+void FakeWifiDriver::inject(Event e, uint16_t reason)
+{
+    push(m_clock.nowMs(), e, reason);
+}
+
+void FakeWifiDriver::connect(const char *, const char *password, const uint8_t *bssid, uint8_t channel,
+                             const WifiIpConfig *ip)
+{
+    m_queue.clear();
+    m_connects++;
+    m_targeted = bssid != nullptr;
+    uint32_t t = m_clock.nowMs();
+    if (bssid)
+    {
+        t += m_timing.probeMs;
+        if (memcmp(bssid, m_bssid, sizeof(m_bssid)) || channel != m_channel)
+        {
+            if (!m_silentOnMiss)
+                push(t, Event::Disconnected, kReasonNoApFound);
+            return;
+        }
+    }
+    else
+    {
+        t += m_timing.scanMs;
+    }
+    t += m_timing.authMs;
+    if (m_password != password)
+    {
+        push(t, Event::Disconnected, kReasonAuthFail);
+        return;
+    }
+    push(t, Event::Associated);
+    m_ip = ip ? *ip : m_lease;
+    push(t + (ip ? m_timing.staticMs : m_timing.dhcpMs), Event::GotIp);
+}
+
+void FakeWifiDriver::renewLease()
+{
+    m_renewals++;
+    const uint32_t t = m_clock.nowMs() + m_timing.renewMs;
+    if (m_ip.ip != m_lease.ip)
+    {
+        push(t, Event::LeaseRefused);
+        return;
+    }
+    m_ip = m_lease;
+    push(t, Event::LeaseRenewed);
+}
+
+void FakeWifiDriver::deliver()
+{
+    // In due order, one at a time: the queue may change under the callback
+    const uint32_t now = m_clock.nowMs();
+    for (;;)
+    {
+        auto due = std::min_element(m_queue.begin(), m_queue.end(), [](const Pending &a, const Pending &b) {
+            return (int32_t)(a.at - b.at) < 0;
+        });
+        if (due == m_queue.end() || (int32_t)(now - due->at) < 0)
+            return;
+        const Pending p = *due;
+        m_queue.erase(due);
+        if (m_cb)
+            m_cb(p.e, p.reason, m_ctx);
+    }
+}
+
+uint32_t FakeWifiDriver::nextEventMs() const
+{
+    const uint32_t now = m_clock.nowMs();
+    uint32_t next = UINT32_MAX;
+    for (const Pending &p : m_queue)
+    {
+        const uint32_t in = (int32_t)(p.at - now) > 0 ? p.at - now : 0;
+        next = std::min(next, in);
+    }
+    return next;
+}
+
+void FakeWifiDriver::link(uint8_t bssid[6], uint8_t &channel, WifiIpConfig &ip)
+{
+    memcpy(bssid, m_bssid, sizeof(m_bssid));
+    channel = m_channel;
+    ip = m_ip;
+}
+
+// -------------------- MemoryWifiCache --------------------
+bool MemoryWifiCache::load(WifiCache &out, uint32_t &leaseAgeS)
+{
+    if (!m_have)
+        return false;
+    out = m_cache;
+    leaseAgeS = m_leaseAgeS;
+    return true;
+}
+
+void MemoryWifiCache::save(const WifiCache &cache, bool newLease)
+{
+    m_cache = cache;
+    m_have = true;
+    m_saves++;
+    if (newLease)
+        m_leaseAgeS = 0;
+}
@@ -0,0 +1,291 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AudioHal.h"
+#include "FileStore.h"
+#include "HttpTransport.h"
+#include "Scheduler.h"
+#include "WifiDriver.h"
+
+// Linux stand-ins for the board HAL, used by the native environment
+
+// Replays a 16-bit mono WAV as if it came off the INMP441: each sample
+// is put back in the top of a 32-bit container (<< shift) and, in real
+// time mode, read() only returns what the clock says has been captured.
+// After the clip it keeps delivering silence, like a mic would.
+class FileAudioSource : public AudioSource
+{
+public:
+    explicit FileAudioSource(const char *wavPath, int shift = 11);
+
+    void setRealtime(bool on) { m_realtime = on; } // off = as fast as possible
+    bool ok() const { return !m_samples.empty(); }
+    bool finished() const { return m_pos >= m_samples.size(); }
+    uint32_t fileSampleRate() const { return m_fileRate; }
+    const std::vector<int16_t> &samples() const { return m_samples; }
+
+    bool begin(uint32_t sampleRate) override;
+    void start() override;
+    void stop() override { m_running = false; }
+    size_t read(int32_t *dst, size_t n, uint32_t timeoutMs) override;
+
+private:
+    uint64_t capturedSamples() const;
+
+    std::vector<int16_t> m_samples;
+    const int m_shift;
+    uint32_t m_fileRate = 0;
+    uint32_t m_sampleRate = 16000;
+    bool m_realtime = true;
+    bool m_running = false;
+    size_t m_pos = 0;      // next sample of the clip
+    uint64_t m_served = 0; // samples handed out since start()
+    std::chrono::steady_clock::time_point m_t0;
+};
+
+// Consumes stereo frames at the sample rate with a DMA-sized queue in
+// front, optionally writing them to a raw file. Frames the clock played
+// before they arrived are counted as underrun.
+class FileAudioSink : public AudioSink
+{
+public:
+    explicit FileAudioSink(const char *rawPath = nullptr, size_t dmaFrames = 2048);
+    ~FileAudioSink() override;
+
+    uint64_t framesWritten() const { return m_written; }
+    uint64_t underrunFrames() const { return m_underrunFrames; }
+
+    bool begin(uint32_t sampleRate) override;
+    void setSampleRate(uint32_t sampleRate) override { m_sampleRate = sampleRate; }
+    void start() override;
+    void stop() override { m_running = false; }
+    size_t write(const int16_t *frames, size_t n) override;
+
+private:
+    FILE *m_out = nullptr;
+    const size_t m_dmaFrames;
+    uint32_t m_sampleRate = 16000;
+    bool m_running = false;
+    uint64_t m_written = 0; // since start()
+    uint64_t m_underrunFrames = 0;
+    std::chrono::steady_clock::time_point m_t0;
+};
+
+// Maps "/path" onto <root>/path
+class HostFileStore : public FileStore
+{
+public:
+    explicit HostFileStore(const char *root);
+
+    // Every write on files opened afterwards sleeps this long (slow flash)
+    void setWriteLatencyUs(uint32_t us) { m_writeLatencyUs = us; }
+
+    std::unique_ptr<StoredFile> open(const char *path, OpenMode mode) override;
+    bool exists(const char *path) override;
+    bool remove(const char *path) override;
+    bool rename(const char *from, const char *to) override;
+    void list(const char *dir, ListCallback cb, void *ctx) override;
+
+private:
+    std::string full(const char *path) const { return m_root + path; }
+
+    std::string m_root;
+    uint32_t m_writeLatencyUs = 0;
+};
+
+// In-process HTTP/1.1 server: every connect() gets a connection that
+// parses the request as it is written (Content-Length or chunked) and,
+// once the body is complete, answers with the configured status.
+//
+// With a handler the test plays the server: it sees each request and
+// writes the reply, and the connection stays open for the next request
+// (keep-alive). A negative status hangs up without answering; reply
+// headers with a Transfer-Encoding leave the body framing to the test,
+// and 1xx/204/304 replies go out without a Content-Length.
+class LoopbackTransport : public HttpTransport
+{
+public:
+    struct Stats
+    {
+        uint32_t requests = 0;
+        uint64_t bodyBytes = 0; // de-chunked
+        uint32_t connects = 0;
+        uint32_t drops = 0;     // hung up mid-request by setDropRate()
+    };
+
+    struct Request
+    {
+        std::string method;
+        std::string path;
+        std::string headers; // raw, one "Name: value\r\n" per line
+        std::vector<uint8_t> body;
+    };
+
+    struct Reply
+    {
+        std::string headers; // extra "Name: value\r\n" lines
+        std::string body;
+        std::string interim; // raw 1xx responses sent ahead of the reply
+    };
+
+    typedef int (*Handler)(const Request &req, Reply &reply, void *ctx);
+
+    void setStatus(int code) { m_status = code; }
+    void setResponseDelayMs(uint32_t ms) { m_delayMs = ms; }
+    void setHandler(Handler h, void *ctx);
+    // Each write() of a request hangs up part way with this chance
+    void setDropRate(double p, uint32_t seed = 1);
+    // Hang up once this many more request bytes are in (0 = never)
+    void dropAfter(uint64_t bytes) { m_dropAfter = bytes; }
+    const Stats &stats() const { return m_stats; }
+    // De-chunked; after a hang-up, what arrived of the request
+    const std::vector<uint8_t> &lastBody() const { return m_lastBody; }
+
+    std::unique_ptr<NetConnection> connect(const char *host, uint16_t port) override;
+
+private:
+    friend class LoopbackConnection;
+
+    uint32_t nextRand();
+
+    int m_status = 200;
+    uint32_t m_delayMs = 0;
+    Handler m_handler = nullptr;
+    void *m_handlerCtx = nullptr;
+    double m_dropRate = 0;
+    uint64_t m_dropAfter = 0;
+    uint32_t m_rnd = 1;
+    Stats m_stats;
+    std::vector<uint8_t> m_lastBody;
+};
+
+// Scheduler time under test control: waitMs() jumps straight to the
+// deadline (a second when nothing is scheduled) unless a post() came in
+// first, and advance() stands in for time spent inside callbacks
+class VirtualClock : public SchedulerClock
+{
+public:
+    explicit VirtualClock(uint32_t startMs = 0) : m_now(startMs) {}
+
+    uint32_t nowMs() override { return m_now.load(); }
+    void waitMs(uint32_t ms) override
+    {
+        if (!m_woken.exchange(false))
+            m_now += ms == kForever ? 1000 : ms;
+    }
+    void wake() override { m_woken = true; }
+    void advance(uint32_t ms) { m_now += ms; }
+
+private:
+    std::atomic<uint32_t> m_now;
+    std::atomic<bool> m_woken{false};
+};
+
+// Wall-clock time for tests with real threads: waitMs() sleeps until the
+// timeout or a wake() from another thread, like TaskClock on the board
+class SteadyClock : public SchedulerClock
+{
+public:
+    uint32_t nowMs() override;
+    void waitMs(uint32_t ms) override;
+    void wake() override;
+
+private:
+    const std::chrono::steady_clock::time_point m_t0 = std::chrono::steady_clock::now();
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_woken = false;
+};
+
+// One AP on a virtual clock with scripted join and DHCP times. Events
+// are queued with their due time and handed to the callback by
+// deliver(), standing in for the board's event task.
+class FakeWifiDriver : public WifiDriver
+{
+public:
+    struct Timing
+    {
+        uint32_t scanMs = 2200; // every channel
+        uint32_t probeMs = 60;  // one channel, one BSSID
+        uint32_t authMs = 150;  // auth, association, 4-way handshake
+        uint32_t dhcpMs = 900;
+        uint32_t staticMs = 5;
+        uint32_t renewMs = 40;  // REQUEST and ACK on a link that is up
+    };
+
+    explicit FakeWifiDriver(SchedulerClock &clock) : m_clock(clock) {}
+
+    void setTiming(const Timing &t) { m_timing = t; }
+    void setAp(const uint8_t bssid[6], uint8_t channel);
+    void setPassword(const char *password) { m_password = password; }
+    // A targeted join on the wrong AP gets no answer instead of a quick
+    // "no AP found"
+    void setSilentOnMiss(bool silent) { m_silentOnMiss = silent; }
+    // What DHCP hands out from now on; a renewal of any other address
+    // is refused
+    void setDhcpLease(const WifiIpConfig &lease) { m_lease = lease; }
+    // An event from outside the current attempt (link loss, stale news)
+    void inject(Event e, uint16_t reason);
+
+    void deliver();
+    uint32_t nextEventMs() const; // UINT32_MAX: nothing queued
+    uint32_t connects() const { return m_connects; }
+    uint32_t renewals() const { return m_renewals; }
+    bool lastWasTargeted() const { return m_targeted; }
+    const WifiIpConfig &dhcpLease() const { return m_lease; }
+
+    void setEventCallback(EventCallback cb, void *ctx) override;
+    void connect(const char *ssid, const char *password, const uint8_t *bssid, uint8_t channel,
+                 const WifiIpConfig *ip) override;
+    void disconnect() override { m_queue.clear(); }
+    void renewLease() override;
+    void link(uint8_t bssid[6], uint8_t &channel, WifiIpConfig &ip) override;
+
+private:
+    struct Pending
+    {
+        uint32_t at;
+        Event e;
+        uint16_t reason;
+    };
+    void push(uint32_t at, Event e, uint16_t reason = 0);
+
+    SchedulerClock &m_clock;
+    Timing m_timing;
+    uint8_t m_bssid[6] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+    uint8_t m_channel = 6;
+    std::string m_password = "secret";
+    bool m_silentOnMiss = false;
+    WifiIpConfig m_lease{0x3901a8c0, 0x0101a8c0, 0x00ffffff, 0x0101a8c0}; // 192.168.1.57/24
+    WifiIpConfig m_ip;
+    std::vector<Pending> m_queue;
+    EventCallback m_cb = nullptr;
+    void *m_ctx = nullptr;
+    uint32_t m_connects = 0;
+    uint32_t m_renewals = 0;
+    bool m_targeted = false;
+};
+
+// WifiCacheStore in memory; the test sets the lease age
+class MemoryWifiCache : public WifiCacheStore
+{
+public:
+    bool load(WifiCache &out, uint32_t &leaseAgeS) override;
+    void save(const WifiCache &cache, bool newLease) override;
+    void clear() override { m_have = false; }
+
+    void setLeaseAgeS(uint32_t s) { m_leaseAgeS = s; }
+    uint32_t leaseAgeS() const { return m_leaseAgeS; }
+    const WifiCache &cache() const { return m_cache; }
+    uint32_t saves() const { return m_saves; }
+
+private:
+    bool m_have = false;
+    WifiCache m_cache;
+    uint32_t m_leaseAgeS = 0;
+    uint32_t m_saves = 0;
+};
@@ -0,0 +1,296 @@
+// Message cache against a directory on the host file system.
+//
+//   program msgcache [--dir PATH] [--size BYTES] [--count N]
+//
+// Checks: stored messages come back intact; room is made least recently
+// used first by bytes and by entry count, and the order survives a
+// restart; an oversize message or one cut short of its announced size is
+// never indexed; a flipped byte is caught by verify() and verifyOnOpen;
+// after a power cut begin() drops wrong-size entries, a leftover
+// download and files no entry owns, and a torn index starts empty.
+// Prints lookup and store times.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "MessageCache.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    s_checks++;
+    if (!ok)
+    {
+        s_failures++;
+        fprintf(stderr, "FAIL: %s\n", what);
+    }
+}
+
+static std::vector<uint8_t> body(uint32_t size, uint8_t seed)
+{
+    std::vector<uint8_t> b(size);
+    for (uint32_t i = 0; i < size; ++i)
+        b[i] = (uint8_t)(i * 31 + seed);
+    return b;
+}
+
+// Downloads in 1 KB chunks like InboxPrefetcher
+static bool store(MessageCache &c, const char *id, const std::vector<uint8_t> &b)
+{
+    if (!c.beginWrite(id, b.size()))
+        return false;
+    for (size_t at = 0; at < b.size(); at += 1024)
+        if (!c.write(b.data() + at, b.size() - at < 1024 ? b.size() - at : 1024))
+            return false;
+    return c.commitWrite();
+}
+
+static bool readsBack(MessageCache &c, const char *id, const std::vector<uint8_t> &b)
+{
+    std::unique_ptr<StoredFile> f = c.open(id);
+    if (!f || f->size() != b.size())
+        return false;
+    std::vector<uint8_t> got(b.size());
+    return f->read(got.data(), got.size()) == b.size() && got == b;
+}
+
+static void clearDir(HostFileStore &fs, const char *dir)
+{
+    char path[64];
+    for (size_t i = 0; i < MessageCache::kMaxEntries; ++i)
+    {
+        snprintf(path, sizeof(path), "%s/%u.msg", dir, (unsigned)i);
+        fs.remove(path);
+    }
+    for (const char *name : {"index", "index.tmp", "dl.tmp"})
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        fs.remove(path);
+    }
+}
+
+// Slot file currently holding b, by content
+static int slotOf(HostFileStore &fs, const std::vector<uint8_t> &b)
+{
+    char path[32];
+    for (size_t i = 0; i < MessageCache::kMaxEntries; ++i)
+    {
+        snprintf(path, sizeof(path), "/m/%u.msg", (unsigned)i);
+        std::unique_ptr<StoredFile> f = fs.open(path, OpenMode::Read);
+        if (!f || f->size() != b.size())
+            continue;
+        std::vector<uint8_t> got(b.size());
+        if (f->read(got.data(), got.size()) == b.size() && got == b)
+            return (int)i;
+    }
+    return -1;
+}
+
+static void writeFile(HostFileStore &fs, const char *path, const std::vector<uint8_t> &b)
+{
+    std::unique_ptr<StoredFile> f = fs.open(path, OpenMode::Write);
+    if (f)
+        f->write(b.data(), b.size());
+}
+
+int messageCacheBench(int argc, char **argv)
+{
+    std::string root = "/tmp/msgcache";
+    uint32_t size = 20000;
+    unsigned n = 200;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--dir") && i + 1 < argc)
+            root = argv[++i];
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc)
+            size = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+            n = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "usage: program msgcache [--dir PATH] [--size BYTES] [--count N]\n");
+            return 2;
+        }
+    }
+    mkdir(root.c_str(), 0755);
+    mkdir((root + "/m").c_str(), 0755);
+    HostFileStore fs(root.c_str());
+    clearDir(fs, "/m");
+
+    MessageCache::Config cfg;
+    cfg.maxBytes = 100000;
+    cfg.maxEntries = 4;
+    const std::vector<uint8_t> a = body(30000, 1), b = body(30000, 2), c = body(30000, 3), d = body(30000, 4);
+
+    // Store and look up
+    MessageCache cache(fs);
+    cache.setConfig(cfg);
+    cache.begin();
+    check(store(cache, "a", a) && store(cache, "b", b) && store(cache, "c", c), "stores three");
+    check(cache.count() == 3 && cache.bytes() == 90000, "count and bytes");
+    check(readsBack(cache, "a", a) && readsBack(cache, "b", b), "reads back what was stored");
+    check(!cache.open("nope") && cache.stats().misses == 1, "unknown id misses");
+    check(!cache.beginWrite("a", 10), "cached id is not downloaded again");
+
+    // a and b were used after c: c is least recently used and goes first
+    check(store(cache, "d", d), "stores past the byte budget");
+    check(!cache.contains("c") && cache.contains("a") && cache.contains("b") && cache.bytes() == 90000,
+          "byte budget evicts the least recently used");
+
+    // Entry count: small ones push out big ones, oldest use first
+    std::vector<uint8_t> tiny = body(100, 9);
+    readsBack(cache, "a", a);
+    readsBack(cache, "d", d);
+    check(store(cache, "t1", tiny) && cache.count() == 4, "fills the entry budget");
+    check(store(cache, "t2", tiny) && cache.count() == 4 && !cache.contains("b"), "entry count budget");
+    check(store(cache, "t3", tiny) && !cache.contains("a") && cache.contains("d"), "count evicts in LRU order");
+
+    // LRU order survives a restart: t1, then t3, are the oldest now
+    readsBack(cache, "d", d);
+    readsBack(cache, "t2", tiny);
+    {
+        MessageCache again(fs);
+        again.setConfig(cfg);
+        again.begin();
+        check(again.count() == 4 && again.contains("d") && again.contains("t1"), "index survives a restart");
+        check(store(again, "t4", tiny) && store(again, "t5", tiny) && !again.contains("t1") &&
+                  !again.contains("t3") && again.contains("t2") && readsBack(again, "d", d),
+              "LRU order survives a restart");
+    }
+
+    // Oversize and short downloads never reach the index
+    clearDir(fs, "/m");
+    {
+        MessageCache x(fs);
+        x.setConfig(cfg);
+        x.begin();
+        check(!x.beginWrite("huge", cfg.maxBytes + 1), "oversize refused up front");
+        check(x.beginWrite("short", 5000) && x.write(tiny.data(), tiny.size()) && !x.commitWrite(),
+              "download cut short is rejected");
+        check(!x.contains("short") && !fs.exists("/m/dl.tmp") && x.stats().stored == 0,
+              "rejected download leaves nothing behind");
+        check(x.beginWrite("long", 50) && !x.write(tiny.data(), tiny.size()) && !x.writing(),
+              "longer than announced is rejected");
+    }
+
+    // Flipped byte on flash
+    clearDir(fs, "/m");
+    {
+        MessageCache x(fs);
+        x.setConfig(cfg);
+        x.begin();
+        store(x, "a", a);
+        store(x, "b", b);
+        std::vector<uint8_t> bad = a;
+        bad[12345] ^= 0x10;
+        char path[32];
+        snprintf(path, sizeof(path), "/m/%d.msg", slotOf(fs, a));
+        writeFile(fs, path, bad);
+        check(x.contains("a") && !x.verify("a") && !x.contains("a") && x.stats().corrupt == 1,
+              "verify drops a flipped byte");
+
+        MessageCache::Config strict = cfg;
+        strict.verifyOnOpen = true;
+        x.setConfig(strict);
+        bad = b;
+        bad[0] ^= 1;
+        snprintf(path, sizeof(path), "/m/%d.msg", slotOf(fs, b));
+        writeFile(fs, path, bad);
+        check(!x.open("b") && !x.contains("b") && x.stats().corrupt == 2, "verifyOnOpen drops a flipped byte");
+    }
+
+    // Power cut leftovers: truncated entry, half download, orphan slot
+    clearDir(fs, "/m");
+    {
+        MessageCache x(fs);
+        x.setConfig(cfg);
+        x.begin();
+        store(x, "a", a);
+        store(x, "b", b);
+        char path[32];
+        snprintf(path, sizeof(path), "/m/%d.msg", slotOf(fs, a));
+        writeFile(fs, path, std::vector<uint8_t>(a.begin(), a.begin() + 1000));
+        writeFile(fs, "/m/dl.tmp", tiny);
+        writeFile(fs, "/m/9.msg", tiny);
+    }
+    {
+        MessageCache x(fs);
+        x.setConfig(cfg);
+        x.begin();
+        check(!x.contains("a") && x.contains("b") && x.bytes() == b.size() && x.stats().corrupt == 1,
+              "wrong-size entry dropped at begin");
+        check(!fs.exists("/m/dl.tmp") && !fs.exists("/m/9.msg"), "leftover download and orphan removed");
+    }
+
+    // Torn index: starts empty, old slot files are cleaned up
+    {
+        std::unique_ptr<StoredFile> f = fs.open("/m/index", OpenMode::Read);
+        std::vector<uint8_t> ix(f ? f->size() : 0);
+        if (f)
+            f->read(ix.data(), ix.size());
+        f.reset();
+        ix.resize(ix.size() / 2);
+        writeFile(fs, "/m/index", ix);
+        MessageCache x(fs);
+        x.setConfig(cfg);
+        x.begin();
+        check(x.count() == 0 && x.bytes() == 0 && slotOf(fs, b) < 0, "torn index resets and cleans up");
+        check(store(x, "a", a) && readsBack(x, "a", a), "usable after a torn index");
+    }
+
+    // Budget shrunk between boots
+    {
+        MessageCache x(fs);
+        x.setConfig(cfg);
+        x.begin();
+        store(x, "b", b);
+        MessageCache::Config small = cfg;
+        small.maxBytes = 40000;
+        MessageCache y(fs);
+        y.setConfig(small);
+        y.begin();
+        check(y.count() == 1 && y.contains("b") && y.bytes() == b.size(), "smaller budget trims at begin");
+    }
+
+    // Timing: hits from the cache vs storing new messages
+    clearDir(fs, "/m");
+    MessageCache t(fs);
+    MessageCache::Config big;
+    big.maxBytes = size * 8;
+    t.setConfig(big);
+    t.begin();
+    const std::vector<uint8_t> msg = body(size, 7);
+    char id[16];
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point s0 = Clock::now();
+    for (unsigned i = 0; i < n; ++i)
+    {
+        snprintf(id, sizeof(id), "m%u", i);
+        store(t, id, msg);
+    }
+    const Clock::time_point s1 = Clock::now();
+    unsigned hits = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        snprintf(id, sizeof(id), "m%u", n - 1 - (i % 8));
+        char path[32];
+        hits += t.path(id, path, sizeof(path));
+    }
+    const Clock::time_point s2 = Clock::now();
+    check(hits == n && t.count() == 8 && t.stats().evicted == (n > 8 ? n - 8 : 0), "steady state churn");
+    clearDir(fs, "/m");
+
+    const double storeUs = n ? std::chrono::duration<double, std::micro>(s1 - s0).count() / n : 0;
+    const double hitUs = n ? std::chrono::duration<double, std::micro>(s2 - s1).count() / n : 0;
+    printf("{\"bench\":\"msgcache\",\"size\":%u,\"store_us\":%.1f,\"hit_us\":%.1f,\"evicted\":%u,"
+           "\"checks\":%u,\"failures\":%u}\n",
+           (unsigned)size, storeUs, hitUs, (unsigned)t.stats().evicted, s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
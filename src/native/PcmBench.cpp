@@ -0,0 +1,124 @@
+// 32 -> 16-bit conversion kernel against the per-sample loop it replaced.
+//
+//   program pcm [--block N] [--reps R]
+//
+// Checks: the kernel matches the old branchy conversion bit for bit for
+// both recorder shifts (>>11 ApiClientModule, >>14 AudioRecorderModule)
+// over full-scale noise, the saturation edges and every block tail length.
+// Prints ns/sample for each at the board's block size.
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "PcmConvert.h"
+#include "Bench.h"
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    s_checks++;
+    if (!ok)
+    {
+        s_failures++;
+        fprintf(stderr, "FAIL: %s\n", what);
+    }
+}
+
+// What processChunk() did per sample before the shared kernel
+static int16_t oldConvert(int32_t s, int shift)
+{
+    int32_t v = s >> shift;
+    if (v > 32767)
+        return 32767;
+    if (v < -32768)
+        return -32768;
+    return (int16_t)v;
+}
+
+static void oldBlock(const int32_t *in, int16_t *out, size_t n, int shift)
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = oldConvert(in[i], shift);
+}
+
+// Keeps the optimiser from dropping the timed loop
+static volatile int16_t s_sink;
+
+template <typename F>
+static double nsPerSample(F convert, const std::vector<int32_t> &in, std::vector<int16_t> &out, int shift, int reps)
+{
+    const Clock::time_point t0 = Clock::now();
+    for (int r = 0; r < reps; ++r)
+    {
+        convert(in.data(), out.data(), in.size(), shift);
+        s_sink = out[r % out.size()];
+    }
+    const double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+    return ns / ((double)reps * in.size());
+}
+
+int pcmBench(int argc, char **argv)
+{
+    size_t block = 1024; // one pool block of int32 I2S samples
+    int reps = 200000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--block") && i + 1 < argc)
+            block = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--reps") && i + 1 < argc)
+            reps = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: program pcm [--block N] [--reps R]\n");
+            return 2;
+        }
+    }
+    if (block == 0 || reps <= 0)
+        return 2;
+
+    // Full-scale 32-bit noise so both shifts saturate part of the time
+    std::vector<int32_t> in(block);
+    uint32_t rnd = 12345;
+    for (size_t i = 0; i < block; ++i)
+    {
+        rnd = rnd * 1664525u + 1013904223u;
+        in[i] = (int32_t)rnd;
+    }
+    const int32_t edges[] = {INT32_MIN, INT32_MIN + 1, INT32_MAX, -1, 0, 1,
+                             32767 * 2048, 32768 * 2048, -32768 * 2048, -32769 * 2048,
+                             32767 * 16384, -32768 * 16384};
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]) && i < block; ++i)
+        in[i] = edges[i];
+
+    std::vector<int16_t> want(block), got(block);
+    for (int shift : {11, 14})
+    {
+        oldBlock(in.data(), want.data(), block, shift);
+        pcm32_to_pcm16(in.data(), got.data(), block, shift);
+        check(want == got, shift == 11 ? "shift 11 matches the old loop" : "shift 14 matches the old loop");
+    }
+    // Odd lengths exercise the unrolled loop's tail
+    bool tails = true;
+    for (size_t n = 0; n < 9 && n <= block; ++n)
+    {
+        std::fill(got.begin(), got.end(), 0x5555);
+        oldBlock(in.data(), want.data(), n, 11);
+        pcm32_to_pcm16(in.data(), got.data(), n, 11);
+        tails = tails && std::equal(want.begin(), want.begin() + n, got.begin()) &&
+                (n == block || got[n] == 0x5555);
+    }
+    check(tails, "tail lengths convert exactly n samples");
+
+    const double oldNs = nsPerSample(oldBlock, in, got, 11, reps);
+    const double newNs = nsPerSample(pcm32_to_pcm16, in, got, 11, reps);
+    printf("{\"bench\":\"pcm\",\"block\":%u,\"old_ns_per_sample\":%.3f,\"kernel_ns_per_sample\":%.3f,"
+           "\"speedup\":%.2f,\"checks\":%u,\"failures\":%u}\n",
+           (unsigned)block, oldNs, newNs, newNs > 0 ? oldNs / newNs : 0.0, s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,458 @@
+// Streamed playback against a stand-in server: the clip is fetched over
+// the loopback transport at a scripted network rate, resampled into
+// blocks and played through a fake I2S sink that stamps every write.
+// The two threads mirror SpeakerModule's fetch and output tasks and the
+// output side makes its decisions through the same PlayoutGate.
+//
+//   program play [--preroll MS] [--rate X] [--stall MS] [clip.wav]
+//
+// Checks: audio starts once the pre-roll is in, long before the clip
+// has downloaded; a steady network plays without underruns; a stall
+// longer than the buffer is one underrun, filled with silence, and
+// playback picks up where it stopped; the audio that came out is the
+// clip, resampled, in order, also when the server sends it chunked (no
+// Content-Length); a chunked body cut short is reported as broken.
+// Without a clip a 22.05 kHz tone is used.
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ChunkedReader.h"
+#include "PlayoutGate.h"
+#include "Resampler.h"
+#include "SpscRing.h"
+#include "WavReader.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint32_t kOutRate = 16000;
+static const size_t kBlockFrames = 512; // a pool block of stereo int16, 32 ms
+static const size_t kBlocks = 8;
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    s_checks++;
+    if (!ok)
+    {
+        s_failures++;
+        fprintf(stderr, "FAIL: %s\n", what);
+    }
+}
+
+static double msSince(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// The fake I2S: real-time pacing from FileAudioSink, plus a stamp per write
+class StampedSink : public FileAudioSink
+{
+public:
+    struct Write
+    {
+        double ms; // since the request went out
+        size_t frames;
+        bool silent;
+    };
+
+    explicit StampedSink(Clock::time_point t0) : FileAudioSink(nullptr, 8 * 256), m_t0(t0) {}
+
+    size_t write(const int16_t *frames, size_t n) override
+    {
+        bool silent = true;
+        for (size_t i = 0; i < n * 2 && silent; ++i)
+            silent = frames[i] == 0;
+        m_writes.push_back({msSince(m_t0), n, silent});
+        if (!silent)
+            m_audio.insert(m_audio.end(), frames, frames + n * 2);
+        return FileAudioSink::write(frames, n);
+    }
+
+    const std::vector<Write> &writes() const { return m_writes; }
+    const std::vector<int16_t> &audio() const { return m_audio; }
+
+private:
+    Clock::time_point m_t0;
+    std::vector<Write> m_writes;
+    std::vector<int16_t> m_audio; // everything but inserted silence
+};
+
+// The socket as the fetch task sees it: bytes arrive at a fixed rate,
+// with nothing at all for stallMs once stallAt bytes are through
+class ThrottledStream : public ByteStream
+{
+public:
+    ThrottledStream(NetConnection &conn, double bytesPerMs, size_t stallAt, uint32_t stallMs)
+        : m_conn(conn), m_bytesPerMs(bytesPerMs), m_stallAt(stallAt), m_stallMs(stallMs), m_t0(Clock::now())
+    {
+    }
+
+    size_t read(uint8_t *dst, size_t len) override
+    {
+        size_t allowed;
+        while ((allowed = allowance()) <= m_read)
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        const size_t n = m_conn.read(dst, std::min(len, allowed - m_read));
+        m_read += n;
+        return n;
+    }
+    size_t write(const uint8_t *src, size_t len) override { return m_conn.write(src, len); }
+
+private:
+    size_t allowance()
+    {
+        double ms = msSince(m_t0);
+        if (m_stallMs && m_read >= m_stallAt)
+        {
+            if (m_stallStart < 0)
+                m_stallStart = ms;
+            if (ms < m_stallStart + m_stallMs)
+                return m_read;
+            ms -= m_stallMs;
+        }
+        return (size_t)(ms * m_bytesPerMs);
+    }
+
+    NetConnection &m_conn;
+    const double m_bytesPerMs;
+    const size_t m_stallAt;
+    const uint32_t m_stallMs;
+    const Clock::time_point m_t0;
+    size_t m_read = 0;
+    double m_stallStart = -1;
+};
+
+// The clip with a Content-Length, chunked (odd sizes, an extension and a
+// trailer), or chunked and cut off two thirds of the way in
+static int serve(const LoopbackTransport::Request &req, LoopbackTransport::Reply &reply, void *ctx)
+{
+    const std::vector<uint8_t> &wav = *static_cast<const std::vector<uint8_t> *>(ctx);
+    reply.headers = "Content-Type: audio/wav\r\n";
+    if (req.path == "/inbox/clip.wav")
+    {
+        reply.body.assign(wav.begin(), wav.end());
+        return 200;
+    }
+    const bool cut = req.path == "/inbox/cut.wav";
+    if (req.path != "/inbox/chunked.wav" && !cut)
+        return 404;
+    reply.headers += "Transfer-Encoding: chunked\r\n";
+    const size_t end = cut ? wav.size() * 2 / 3 : wav.size();
+    for (size_t pos = 0, n = 1; pos < wav.size(); pos += n, n = n * 7 % 4093 + 1)
+    {
+        n = std::min(n, wav.size() - pos);
+        char size[32];
+        snprintf(size, sizeof(size), pos == 0 ? "%zx;name=clip\r\n" : "%zx\r\n", n);
+        reply.body += size;
+        if (pos + n > end)
+        {
+            reply.body.append(wav.begin() + pos, wav.begin() + end);
+            return 200;
+        }
+        reply.body.append(wav.begin() + pos, wav.begin() + pos + n);
+        reply.body += "\r\n";
+    }
+    reply.body += "0\r\nX-Checksum: none\r\n\r\n";
+    return 200;
+}
+
+static void put(std::vector<uint8_t> &b, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        b.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static std::vector<uint8_t> makeWav(const std::vector<int16_t> &samples, uint32_t rate)
+{
+    std::vector<uint8_t> b;
+    const uint32_t dataBytes = samples.size() * 2;
+    b.insert(b.end(), {'R', 'I', 'F', 'F'});
+    put(b, 36 + dataBytes, 4);
+    b.insert(b.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    put(b, 16, 4);
+    put(b, 1, 2);
+    put(b, 1, 2);
+    put(b, rate, 4);
+    put(b, rate * 2, 4);
+    put(b, 2, 2);
+    put(b, 16, 2);
+    b.insert(b.end(), {'d', 'a', 't', 'a'});
+    put(b, dataBytes, 4);
+    for (int16_t s : samples)
+        put(b, (uint16_t)s, 2);
+    return b;
+}
+
+// Status line and headers off the socket, a byte at a time
+static int readHead(ByteStream &s, uint32_t &contentLength, bool &chunked)
+{
+    std::string head;
+    uint8_t c;
+    while (head.size() < 4 || head.compare(head.size() - 4, 4, "\r\n\r\n"))
+    {
+        if (s.read(&c, 1) != 1)
+            return -1;
+        head += (char)c;
+    }
+    const size_t cl = head.find("Content-Length: ");
+    contentLength = cl == std::string::npos ? 0 : strtoul(head.c_str() + cl + 16, nullptr, 10);
+    chunked = head.find("Transfer-Encoding: chunked") != std::string::npos;
+    return head.compare(0, 5, "HTTP/") ? -1 : atoi(head.c_str() + 9);
+}
+
+struct Run
+{
+    double firstAudioMs = -1; // first non-silent write
+    double downloadMs = 0;    // last byte of the body in
+    double stallEndMs = 0;    // first write of audio after the underrun
+    uint32_t underruns = 0;
+    uint64_t sinkUnderrunFrames = 0;
+    bool broken = false; // chunked body ended inside its framing
+    std::vector<int16_t> audio;
+};
+
+// One clip, fetch and output on their own threads as on the board
+static Run play(LoopbackTransport &net, const char *path, uint32_t preRollMs, double bytesPerMs, size_t stallAt,
+                uint32_t stallMs)
+{
+    Run run;
+    const Clock::time_point t0 = Clock::now();
+    StampedSink sink(t0);
+    sink.begin(kOutRate);
+
+    std::vector<int16_t> blocks[kBlocks];
+    for (std::vector<int16_t> &b : blocks)
+        b.resize(kBlockFrames * 2);
+    size_t lengths[kBlocks] = {};
+    SpscRing<uint8_t, kBlocks> free, queue; // block indices, as PoolBlock::detach() hands them over
+    for (uint8_t i = 0; i < kBlocks; ++i)
+        free.push(&i, 1);
+    std::atomic<bool> fetchDone{false};
+
+    std::unique_ptr<NetConnection> conn = net.connect("api.test", 80);
+    const std::string req = std::string("GET ") + path + " HTTP/1.1\r\nHost: api.test\r\n\r\n";
+    conn->write(reinterpret_cast<const uint8_t *>(req.data()), req.size());
+
+    std::thread fetch([&]()
+    {
+        ThrottledStream net(*conn, bytesPerMs, stallAt, stallMs);
+        ChunkedReader chunks(net);
+        uint32_t len = 0;
+        bool chunked = false;
+        WavReader wav;
+        Resampler resampler(kOutRate);
+        const int status = readHead(net, len, chunked);
+        ByteStream &src = chunked ? static_cast<ByteStream &>(chunks) : net;
+        if (status != 200 || wav.parse(src, len) != WavReader::Error::None ||
+            !resampler.configure(wav.format().sampleRate, wav.format().channels))
+        {
+            fetchDone = true;
+            return;
+        }
+        const size_t channels = wav.format().channels;
+        int16_t in[256 * 2];
+        uint8_t idx = 0;
+        size_t filled = 0;
+        bool have = false;
+        size_t frames;
+        while ((frames = wav.readFrames(src, in, 256)) > 0)
+        {
+            const int16_t *p = in;
+            while (frames > 0)
+            {
+                while (!have && !(have = free.pop(&idx, 1)))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                size_t used = 0;
+                filled += resampler.process(p, frames, used, blocks[idx].data() + filled * 2, kBlockFrames - filled);
+                p += used * channels;
+                frames -= used;
+                if (filled == kBlockFrames)
+                {
+                    lengths[idx] = filled;
+                    queue.push(&idx, 1); // never full: as many indices as slots
+                    filled = 0;
+                    have = false;
+                }
+            }
+        }
+        run.downloadMs = msSince(t0);
+        run.broken = chunked && chunks.failed();
+        if (have && filled > 0)
+        {
+            lengths[idx] = filled;
+            queue.push(&idx, 1);
+        }
+        fetchDone = true;
+    });
+
+    // SpeakerModule::outputTask with the RTOS calls swapped for threads
+    PlayoutGate gate;
+    const uint32_t blockMs = kBlockFrames * 1000 / kOutRate;
+    gate.start(std::min<size_t>((preRollMs + blockMs - 1) / blockMs, kBlocks - 1));
+    while (!gate.ready(queue.size(), fetchDone))
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    sink.start();
+
+    static const int16_t zeros[kOutRate / 100 * 2] = {0};
+    bool resumed = false;
+    for (;;)
+    {
+        const bool done = fetchDone;
+        const PlayoutGate::Step step = gate.next(queue.size(), done);
+        if (step == PlayoutGate::Step::End)
+            break;
+        if (step != PlayoutGate::Step::Play)
+        {
+            sink.write(zeros, kOutRate / 100);
+            continue;
+        }
+        uint8_t idx;
+        queue.pop(&idx, 1);
+        if (gate.underruns() && !resumed)
+        {
+            run.stallEndMs = msSince(t0);
+            resumed = true;
+        }
+        sink.write(blocks[idx].data(), lengths[idx]);
+        free.push(&idx, 1);
+    }
+    sink.stop();
+    fetch.join();
+    conn->close();
+
+    for (const StampedSink::Write &w : sink.writes())
+        if (!w.silent)
+        {
+            run.firstAudioMs = w.ms;
+            break;
+        }
+    run.underruns = gate.underruns();
+    run.sinkUnderrunFrames = sink.underrunFrames();
+    run.audio = sink.audio();
+    return run;
+}
+
+// What the clip should sound like: the whole thing through the resampler
+static std::vector<int16_t> reference(const std::vector<int16_t> &clip, uint32_t rate)
+{
+    Resampler r(kOutRate);
+    r.configure(rate, 1);
+    std::vector<int16_t> out;
+    int16_t buf[kBlockFrames * 2];
+    for (size_t pos = 0; pos < clip.size();)
+    {
+        size_t used = 0;
+        const size_t n = r.process(clip.data() + pos, std::min<size_t>(clip.size() - pos, 256), used, buf, kBlockFrames);
+        out.insert(out.end(), buf, buf + n * 2);
+        pos += used;
+    }
+    return out;
+}
+
+// The sink drops all-zero writes as silence; so must the reference
+static bool sameAudio(const std::vector<int16_t> &got, const std::vector<int16_t> &want)
+{
+    std::vector<int16_t> w;
+    for (size_t i = 0; i < want.size(); i += kBlockFrames * 2)
+    {
+        const size_t n = std::min(want.size() - i, kBlockFrames * 2);
+        bool silent = true;
+        for (size_t k = 0; k < n && silent; ++k)
+            silent = want[i + k] == 0;
+        if (!silent)
+            w.insert(w.end(), want.begin() + i, want.begin() + i + n);
+    }
+    return got == w;
+}
+
+int playBench(int argc, char **argv)
+{
+    uint32_t preRollMs = 200;
+    double rate = 2.0; // network speed, in multiples of the clip's byte rate
+    uint32_t stallMs = 600;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--preroll") && i + 1 < argc)
+            preRollMs = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--rate") && i + 1 < argc)
+            rate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--stall") && i + 1 < argc)
+            stallMs = strtoul(argv[++i], nullptr, 10);
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+        {
+            fprintf(stderr, "usage: program play [--preroll MS] [--rate X] [--stall MS] [clip.wav]\n");
+            return 2;
+        }
+    }
+
+    std::vector<int16_t> clip;
+    uint32_t clipRate = 22050;
+    if (path)
+    {
+        FileAudioSource src(path);
+        if (!src.ok())
+        {
+            fprintf(stderr, "play: can't read %s\n", path);
+            return 2;
+        }
+        clip = src.samples();
+        clipRate = src.fileSampleRate();
+    }
+    else
+    {
+        for (uint32_t i = 0; i < clipRate * 2; ++i)
+            clip.push_back((int16_t)(8000 * sin(2 * M_PI * 440 * i / clipRate)));
+    }
+    std::vector<uint8_t> wav = makeWav(clip, clipRate);
+    const std::vector<int16_t> want = reference(clip, clipRate);
+    const double clipMs = clip.size() * 1000.0 / clipRate;
+    const double bytesPerMs = rate * clipRate * 2 / 1000.0;
+
+    LoopbackTransport net;
+    net.setHandler(serve, &wav);
+
+    // Steady network
+    Run steady = play(net, "/inbox/clip.wav", preRollMs, bytesPerMs, 0, 0);
+    // Pre-roll is whole blocks; at rate x the network brings them in 1/x of their play time
+    const uint32_t blockMs = kBlockFrames * 1000 / kOutRate;
+    const double fillMs = (preRollMs + blockMs - 1) / blockMs * blockMs / rate;
+    check(steady.firstAudioMs >= 0 && steady.firstAudioMs < steady.downloadMs / 2,
+          "first audio long before the download ends");
+    check(steady.firstAudioMs < fillMs + 100, "first audio about when the pre-roll is in");
+    check(steady.underruns == 0, "steady network: no underruns");
+    check(sameAudio(steady.audio, want), "steady network: audio is the clip");
+
+    // The network stops for longer than the buffer holds, a third of the way in
+    Run stalled = play(net, "/inbox/clip.wav", preRollMs, bytesPerMs, wav.size() / 3, stallMs);
+    check(stalled.underruns == 1, "stall: one underrun");
+    check(stalled.stallEndMs > 0, "stall: playback resumes");
+    check(sameAudio(stalled.audio, want), "stall: audio is the clip, nothing lost or repeated");
+
+    // No Content-Length: the chunk framing must not reach the decoder
+    Run chunked = play(net, "/inbox/chunked.wav", preRollMs, bytesPerMs, 0, 0);
+    check(!chunked.broken, "chunked: framing read cleanly");
+    check(sameAudio(chunked.audio, want), "chunked: audio is the clip");
+    Run cut = play(net, "/inbox/cut.wav", preRollMs, bytesPerMs, 0, 0);
+    check(cut.broken, "chunked, cut off: reported as broken");
+    check(!cut.audio.empty() && cut.audio.size() < want.size(), "chunked, cut off: plays what came");
+
+    printf("{\"bench\":\"play\",\"clip_ms\":%.0f,\"net_rate\":%.1f,\"preroll_ms\":%u,"
+           "\"first_audio_ms\":%.1f,\"download_ms\":%.1f,\"stall_ms\":%u,\"stall_underruns\":%u,"
+           "\"stall_resume_ms\":%.1f,\"sink_underrun_frames\":%llu,\"checks\":%u,\"failures\":%u}\n",
+           clipMs, rate, preRollMs, steady.firstAudioMs, steady.downloadMs, stallMs, stalled.underruns,
+           stalled.stallEndMs, (unsigned long long)steady.sinkUnderrunFrames, s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,326 @@
+// Power policy over a simulated day: a seeded workload of button
+// sessions and incoming messages run through PowerPolicy the way the
+// PowerManager drives it on the board, with the time spent in each
+// state turned into an average current and battery life.
+//
+//   program power [--days N] [--seed N] [--reconnect MS] [--battery MAH]
+//                 [--push keep|poll]
+//
+// Sessions (press, record, upload, sometimes play back) come between
+// 07:00 and 23:00; messages at any hour. Like main.cpp, the device always
+// subscribes to the inbox push stream, which is up whenever it is awake
+// and on the network, except during seeded server outages (a few an hour
+// to ten minutes long, every six hours or so). While the stream is up a
+// message is noticed at once; otherwise at the next inbox check, which
+// makes a request. Failed uploads stay queued until the next inbox check.
+// --push picks PowerPolicy::Push; without it the run uses the shipped
+// default, as main.cpp does.
+//
+// Checks: never asleep while something is busy, never in deep sleep with
+// uploads queued, never below modem sleep while keeping a connected
+// stream, no message waits longer than an inbox period plus the
+// reconnect, residency adds up to the simulated time, and the device
+// sleeps at all: both sleeps with Poll, some sleep during outages with
+// KeepLink.
+//
+// The currents are assumptions for a bare ESP32 module, not measurements
+// of this board (the display and regulator add to every state):
+// active 95 mA, modem sleep 22 mA, light sleep 0.9 mA, deep sleep
+// 0.15 mA. The baseline is the same workload without sleeping, idling
+// with the radio on at 40 mA.
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "PowerPolicy.h"
+#include "Bench.h"
+
+static const double kStateMa[] = {95.0, 22.0, 0.9, 0.15};
+static const double kNoSleepIdleMa = 40.0;
+static const uint32_t kDayMs = 86400000;
+
+struct Span
+{
+    uint32_t start, end;
+    uint8_t src;
+};
+
+struct Workload
+{
+    std::vector<uint32_t> presses; // session starts, sorted
+    std::vector<Span> spans;       // what the sessions keep busy
+    std::vector<uint32_t> failedUploadsEnd;
+    std::vector<uint32_t> messages; // arrival times, sorted
+    std::vector<Span> outages;      // push stream unreachable, sorted
+};
+
+struct SimParams
+{
+    uint32_t days = 1;
+    uint32_t seed = 1;
+    uint32_t reconnectMs = 2500; // Wi-Fi back up after light sleep
+    uint32_t bootMs = 400;       // extra after deep sleep
+    uint32_t checkMs = 600;      // one inbox request
+    PowerPolicy::Push push = PowerPolicy::Config().push;
+    bool sleep = true;
+};
+
+struct SimResult
+{
+    uint64_t residency[(int)PowerState::Count] = {};
+    uint32_t entries[(int)PowerState::Count] = {};
+    uint32_t inboxChecks = 0; // requests; the push stream makes them unneeded
+    std::vector<uint32_t> notifyMs;
+    unsigned violations = 0;
+};
+
+static Workload makeWorkload(const SimParams &p)
+{
+    std::mt19937 rng(p.seed);
+    std::exponential_distribution<double> sessionGap(1.0 / (45 * 60000.0));
+    std::exponential_distribution<double> messageGap(1.0 / (90 * 60000.0));
+    std::uniform_int_distribution<uint32_t> recordMs(4000, 30000), uploadMs(1000, 5000), playMs(5000, 20000);
+    std::uniform_real_distribution<double> coin(0, 1);
+
+    Workload w;
+    const uint32_t end = p.days * kDayMs;
+    for (double t = sessionGap(rng); t < end; t += sessionGap(rng))
+    {
+        const uint32_t s = (uint32_t)t, hour = s % kDayMs / 3600000;
+        if (hour < 7 || hour >= 23)
+            continue;
+        if (!w.presses.empty() && s < w.spans.back().end)
+            continue; // still busy with the last one
+        w.presses.push_back(s);
+        w.spans.push_back({s, s + 250, PowerPolicy::Input});
+        const uint32_t recEnd = s + 300 + recordMs(rng);
+        w.spans.push_back({s + 300, recEnd, PowerPolicy::Recording});
+        const uint32_t upEnd = recEnd + uploadMs(rng);
+        w.spans.push_back({recEnd, upEnd, PowerPolicy::Upload});
+        if (coin(rng) < 0.1)
+            w.failedUploadsEnd.push_back(upEnd);
+        if (coin(rng) < 0.3)
+            w.spans.push_back({upEnd + 2000, upEnd + 2000 + playMs(rng), PowerPolicy::Playback});
+    }
+    for (double t = messageGap(rng); t < end; t += messageGap(rng))
+        w.messages.push_back((uint32_t)t);
+    std::exponential_distribution<double> outageGap(1.0 / (6 * 3600000.0));
+    std::uniform_int_distribution<uint32_t> outageMs(60000, 600000);
+    for (double t = outageGap(rng); t < end; t += outageGap(rng))
+    {
+        const uint32_t s = (uint32_t)t;
+        w.outages.push_back({s, s + outageMs(rng), PowerPolicy::Network});
+        t = w.outages.back().end;
+    }
+    return w;
+}
+
+static uint8_t busyAt(const std::vector<Span> &spans, uint32_t t)
+{
+    uint8_t mask = 0;
+    for (const Span &s : spans)
+        if (s.start <= t && t < s.end)
+            mask |= s.src;
+    return mask;
+}
+
+static uint32_t nextBoundary(const std::vector<Span> &spans, uint32_t t)
+{
+    uint32_t next = UINT32_MAX;
+    for (const Span &s : spans)
+    {
+        if (s.start > t)
+            next = std::min(next, s.start);
+        if (s.end > t)
+            next = std::min(next, s.end);
+    }
+    return next;
+}
+
+static SimResult simulate(const Workload &w, const SimParams &p)
+{
+    PowerPolicy::Config cfg;
+    cfg.push = p.push;
+    if (!p.sleep)
+        cfg.lightAfterMs = cfg.deepAfterMs = PowerPolicy::kNever / 2;
+    PowerPolicy pol(cfg);
+    pol.begin(0);
+
+    SimResult r;
+    std::vector<Span> spans = w.spans; // plus the reconnects and checks
+    size_t nextPress = 0, nextMsg = 0, nextFail = 0;
+    bool pending = false;
+    uint32_t radioUpAt = 0; // network usable from here on
+    const uint32_t end = p.days * kDayMs;
+    uint32_t t = 0;
+    while (t < end)
+    {
+        for (; nextFail < w.failedUploadsEnd.size() && w.failedUploadsEnd[nextFail] <= t; ++nextFail)
+            pending = true;
+
+        // Awake, on the network and reaching the server: the stream is
+        // up and messages are noticed as they arrive
+        const bool streamUp = t >= radioUpAt && !busyAt(w.outages, t);
+        pol.setPushConnected(streamUp);
+        if (streamUp)
+            for (; nextMsg < w.messages.size() && w.messages[nextMsg] <= t; ++nextMsg)
+                r.notifyMs.push_back(t - w.messages[nextMsg]);
+
+        spans.erase(std::remove_if(spans.begin(), spans.end(), [t](const Span &s) { return s.end <= t; }),
+                    spans.end());
+        const uint8_t busy = busyAt(spans, t);
+        pol.setBusy(busy, t);
+        pol.setPending(pending);
+        if (pol.inboxDue(t))
+        {
+            // A request once the radio is up unless the stream already
+            // told us, plus the queued uploads
+            pol.inboxChecked(t);
+            const uint32_t from = std::max(t, radioUpAt);
+            if (!streamUp)
+            {
+                r.inboxChecks++;
+                spans.push_back({t, from + p.checkMs, PowerPolicy::Network});
+                for (; nextMsg < w.messages.size() && w.messages[nextMsg] <= from; ++nextMsg)
+                    r.notifyMs.push_back(from + p.checkMs - w.messages[nextMsg]);
+            }
+            if (pending)
+            {
+                spans.push_back({from, from + 3000, PowerPolicy::Upload});
+                pending = false;
+            }
+            continue;
+        }
+
+        uint32_t sleepMs;
+        const PowerState s = pol.decide(t, sleepMs);
+        if (busy && s != PowerState::Active)
+            r.violations++;
+        if (s == PowerState::DeepSleep && pending)
+            r.violations++;
+        if ((s == PowerState::LightSleep || s == PowerState::DeepSleep) && pol.keepsLink())
+            r.violations++;
+        pol.enter(s, t);
+
+        if (s == PowerState::LightSleep || s == PowerState::DeepSleep)
+        {
+            // Sleep until the timer or the next button press
+            for (; nextPress < w.presses.size() && w.presses[nextPress] <= t; ++nextPress)
+                ;
+            uint32_t wake = t + sleepMs;
+            if (nextPress < w.presses.size() && w.presses[nextPress] < wake)
+                wake = w.presses[nextPress];
+            wake = std::min(wake, end);
+            pol.enter(PowerState::ModemSleep, wake);
+            // Wi-Fi was off; after deep sleep the firmware boots first
+            const uint32_t back = p.reconnectMs + (s == PowerState::DeepSleep ? p.bootMs : 0);
+            radioUpAt = wake + back;
+            spans.push_back({wake, radioUpAt, PowerPolicy::Network});
+            t = wake;
+            continue;
+        }
+
+        uint32_t next = std::min(nextBoundary(spans, t), end);
+        const uint32_t change = pol.nextChangeMs(t);
+        if (change != PowerPolicy::kNever)
+            next = std::min(next, t + change);
+        if (nextMsg < w.messages.size() && w.messages[nextMsg] > t)
+            next = std::min(next, w.messages[nextMsg]);
+        next = std::min(next, nextBoundary(w.outages, t));
+        if (t < radioUpAt)
+            next = std::min(next, radioUpAt);
+        t = next > t ? next : t + 1;
+    }
+
+    uint64_t total = 0;
+    for (int s = 0; s < (int)PowerState::Count; ++s)
+    {
+        r.residency[s] = pol.residencyMs((PowerState)s, end);
+        r.entries[s] = pol.entries((PowerState)s);
+        total += r.residency[s];
+    }
+    if (total != end)
+        r.violations++;
+    const uint32_t worst = cfg.inboxPeriodMs + p.reconnectMs + p.bootMs + p.checkMs;
+    for (uint32_t ms : r.notifyMs)
+        if (ms > worst)
+            r.violations++;
+    if (r.notifyMs.size() != w.messages.size())
+        r.violations++;
+    // The shipped wiring once never slept: the stream held the link for
+    // good. Poll must reach both sleeps; KeepLink must sleep through outages.
+    const uint32_t light = r.entries[(int)PowerState::LightSleep], deep = r.entries[(int)PowerState::DeepSleep];
+    if (p.sleep && p.push == PowerPolicy::Push::Poll && (!light || !deep))
+        r.violations++;
+    if (p.sleep && p.push == PowerPolicy::Push::KeepLink && !w.outages.empty() && !light && !deep)
+        r.violations++;
+    return r;
+}
+
+static double averageMa(const SimResult &r, bool noSleep)
+{
+    double mAms = 0, total = 0;
+    for (int s = 0; s < (int)PowerState::Count; ++s)
+    {
+        const double ma = noSleep && s != (int)PowerState::Active ? kNoSleepIdleMa : kStateMa[s];
+        mAms += ma * r.residency[s];
+        total += r.residency[s];
+    }
+    return total ? mAms / total : 0;
+}
+
+int powerSim(int argc, char **argv)
+{
+    SimParams p;
+    double batteryMah = 1000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--days") && i + 1 < argc)
+            p.days = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            p.seed = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--reconnect") && i + 1 < argc)
+            p.reconnectMs = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--battery") && i + 1 < argc)
+            batteryMah = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--push") && i + 1 < argc)
+            p.push = !strcmp(argv[++i], "poll") ? PowerPolicy::Push::Poll : PowerPolicy::Push::KeepLink;
+        else
+        {
+            fprintf(stderr, "usage: program power [--days N] [--seed N] [--reconnect MS] [--battery MAH] [--push keep|poll]\n");
+            return 2;
+        }
+    }
+    if (p.days == 0 || p.days > 40)
+    {
+        fprintf(stderr, "--days must be 1..40\n");
+        return 2;
+    }
+
+    const Workload w = makeWorkload(p);
+    const SimResult r = simulate(w, p);
+    SimParams never = p;
+    never.sleep = false;
+    const SimResult base = simulate(w, never);
+
+    std::vector<uint32_t> lat = r.notifyMs;
+    std::sort(lat.begin(), lat.end());
+    const double total = (double)p.days * kDayMs;
+    const double ma = averageMa(r, false), baseMa = averageMa(base, true);
+
+    printf("{\"bench\":\"power\",\"days\":%u,\"seed\":%u,\"push\":\"%s\",\"sessions\":%zu,\"messages\":%zu,"
+           "\"outages\":%zu,\"inbox_checks\":%u",
+           (unsigned)p.days, (unsigned)p.seed, p.push == PowerPolicy::Push::Poll ? "poll" : "keep", w.presses.size(),
+           w.messages.size(), w.outages.size(), (unsigned)r.inboxChecks);
+    for (int s = 0; s < (int)PowerState::Count; ++s)
+        printf(",\"%s_pct\":%.2f,\"%s_entries\":%u", powerStateName((PowerState)s), r.residency[s] * 100.0 / total,
+               powerStateName((PowerState)s), (unsigned)r.entries[s]);
+    printf(",\"notify_p50_s\":%.1f,\"notify_max_s\":%.1f", lat.empty() ? 0.0 : lat[lat.size() / 2] / 1000.0,
+           lat.empty() ? 0.0 : lat.back() / 1000.0);
+    printf(",\"avg_ma\":%.2f,\"no_sleep_ma\":%.2f,\"battery_days\":%.1f,\"no_sleep_battery_days\":%.1f",
+           ma, baseMa, batteryMah / ma / 24.0, batteryMah / baseMa / 24.0);
+    printf(",\"violations\":%u}\n", r.violations + base.violations);
+    return r.violations + base.violations ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+// Resampler benchmark: for each input rate the speaker accepts, quality
+// (THD+N of a 1 kHz tone, alias rejection of a tone above the output
+// Nyquist) and throughput into the fixed 16 kHz stereo output.
+//
+//   program resample [--runs N] [--out-rate HZ]
+//
+// Input is synthetic, so no fixtures are needed. Output is one JSON line
+// with an entry per rate/channel combination.
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Resampler.h"
+#include "Bench.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const uint32_t kRates[] = {8000, 11025, 16000, 22050, 24000, 32000, 44100, 48000};
+
+static std::vector<int16_t> tone(uint32_t rate, uint16_t ch, double hz, double seconds, double amp)
+{
+    std::vector<int16_t> v((size_t)(rate * seconds) * ch);
+    for (size_t i = 0; i < v.size() / ch; ++i)
+        for (uint16_t c = 0; c < ch; ++c)
+            v[i * ch + c] = (int16_t)lround(amp * 32767.0 * sin(2.0 * M_PI * hz * i / rate + c));
+    return v;
+}
+
+// Whole signal in 256-frame reads, like the fetch task
+static std::vector<int16_t> run(Resampler &rs, const std::vector<int16_t> &in, uint16_t ch)
+{
+    std::vector<int16_t> out;
+    int16_t buf[256 * 2];
+    rs.reset();
+    const size_t frames = in.size() / ch;
+    for (size_t at = 0; at < frames;)
+    {
+        size_t n = std::min((size_t)256, frames - at), used = 0;
+        size_t made = rs.process(&in[at * ch], n, used, buf, 256);
+        out.insert(out.end(), buf, buf + made * 2);
+        at += used;
+    }
+    return out;
+}
+
+// Least-squares fit of a sinusoid at hz on the left channel; returns
+// signal power over residual power in dB. Skips the filter warm-up.
+static double snrDb(const std::vector<int16_t> &st, uint32_t rate, double hz)
+{
+    const size_t n = st.size() / 2, skip = rate / 20;
+    if (n <= skip * 2)
+        return 0;
+    double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0;
+    for (size_t i = skip; i < n - skip; ++i)
+    {
+        double s = sin(2.0 * M_PI * hz * i / rate), c = cos(2.0 * M_PI * hz * i / rate), y = st[2 * i];
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+        ys += y * s;
+        yc += y * c;
+    }
+    const double det = ss * cc - sc * sc;
+    const double a = (ys * cc - yc * sc) / det, b = (yc * ss - ys * sc) / det;
+    double sig = 0, res = 0;
+    for (size_t i = skip; i < n - skip; ++i)
+    {
+        double fit = a * sin(2.0 * M_PI * hz * i / rate) + b * cos(2.0 * M_PI * hz * i / rate);
+        sig += fit * fit;
+        res += (st[2 * i] - fit) * (st[2 * i] - fit);
+    }
+    return 10.0 * log10(sig / (res > 1e-9 ? res : 1e-9));
+}
+
+static double rmsDb(const std::vector<int16_t> &st, size_t skip)
+{
+    double sum = 0;
+    size_t n = 0;
+    for (size_t i = skip * 2; i < st.size(); i += 2, ++n)
+        sum += (double)st[i] * st[i];
+    return n ? 10.0 * log10(sum / n / (32767.0 * 32767.0) + 1e-20) : -200.0;
+}
+
+int resampleBench(int argc, char **argv)
+{
+    int runs = 5;
+    uint32_t outRate = 16000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--runs") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--out-rate") && i + 1 < argc)
+            outRate = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "usage: program resample [--runs N] [--out-rate HZ]\n");
+            return 2;
+        }
+    }
+
+    static Resampler rs(outRate); // 15 KB of table, keep it off the stack
+    printf("{\"bench\":\"resample\",\"out_rate\":%u,\"results\":[", outRate);
+    bool first = true;
+    for (uint32_t rate : kRates)
+    {
+        for (uint16_t ch = 1; ch <= 2; ++ch)
+        {
+            printf("%s{\"in_rate\":%u,\"channels\":%u", first ? "" : ",", rate, ch);
+            first = false;
+            if (!rs.configure(rate, ch))
+            {
+                printf(",\"supported\":false}");
+                continue;
+            }
+
+            // Quality: -6 dBFS 1 kHz tone, THD+N at the output rate
+            std::vector<int16_t> in = tone(rate, ch, 1000.0, 1.0, 0.5);
+            double snr = snrDb(run(rs, in, ch), outRate, 1000.0);
+
+            // Alias rejection: a tone between the output Nyquist and the
+            // input's should vanish
+            char alias[16] = "null";
+            const double hz = 0.6 * outRate;
+            if (hz < 0.45 * rate)
+                snprintf(alias, sizeof(alias), "%.1f", rmsDb(run(rs, tone(rate, ch, hz, 1.0, 0.5), ch), outRate / 20) - rmsDb(tone(rate, 1, hz, 1.0, 0.5), 0));
+
+            // Throughput: 10 s of audio, best of N
+            std::vector<int16_t> longIn = tone(rate, ch, 440.0, 10.0, 0.5);
+            double best = 1e30;
+            size_t outFrames = 0;
+            for (int r = 0; r < runs; ++r)
+            {
+                auto t0 = Clock::now();
+                outFrames = run(rs, longIn, ch).size() / 2;
+                best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - t0).count());
+            }
+            printf(",\"supported\":true,\"phases\":%zu,\"taps\":%zu,\"thd_n_db\":%.1f,\"alias_db\":%s,"
+                   "\"ns_per_out_frame\":%.1f,\"x_realtime\":%.0f}",
+                   rs.phases(), rs.taps(), -snr, alias, best / outFrames, 10e9 / best);
+        }
+    }
+    printf("]}\n");
+    return 0;
+}
@@ -0,0 +1,166 @@
+// SPSC ring stress: one std::thread pushes, another pops, as the I2S
+// reader and the writer task do on the board.
+//
+//   program ring [--items N] [--seed S]
+//
+// Checks: with a producer that waits for room, every item arrives once
+// and in order across wrap-around with odd push/pop sizes; the high-water
+// mark never passes the capacity; with a producer that drops like the
+// reader does and a consumer that stalls, what arrives is still in order
+// and every missing item is counted as an overrun; reset() clears the
+// counters. Prints items/s through the ring.
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "SpscRing.h"
+#include "Bench.h"
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    s_checks++;
+    if (!ok)
+    {
+        s_failures++;
+        fprintf(stderr, "FAIL: %s\n", what);
+    }
+}
+
+// Small ring so the indices wrap many times a run
+typedef SpscRing<uint32_t, 1024> Ring;
+
+struct Result
+{
+    uint64_t received = 0;
+    uint64_t outOfOrder = 0; // item not greater than the one before
+    double seconds = 0;
+};
+
+// xorshift so both threads can draw chunk sizes without sharing state
+static uint32_t nextRand(uint32_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+// lossless: the producer waits for room; otherwise it drops what doesn't fit
+// like pushRing(). stallEvery: the consumer sleeps 1 ms every that many
+// pops, like a writer stuck on flash.
+static Result run(Ring &ring, uint64_t items, bool lossless, unsigned stallEvery, uint32_t seed)
+{
+    Result r;
+    std::atomic<bool> done{false};
+    const Clock::time_point t0 = Clock::now();
+
+    std::thread producer([&] {
+        uint32_t rnd = seed;
+        uint32_t buf[300];
+        uint64_t next = 1;
+        while (next <= items)
+        {
+            size_t n = 1 + nextRand(rnd) % 300;
+            if (n > items - next + 1)
+                n = items - next + 1;
+            for (size_t i = 0; i < n; ++i)
+                buf[i] = (uint32_t)(next + i);
+            size_t sent = 0;
+            while (lossless && sent < n)
+            {
+                // Only what fits, so a full ring is not an overrun
+                const size_t room = Ring::capacity() - ring.size();
+                const size_t k = room < n - sent ? room : n - sent;
+                if (k == 0)
+                    std::this_thread::yield();
+                else
+                    sent += ring.push(buf + sent, k);
+            }
+            if (!lossless)
+                ring.push(buf, n);
+            next += n;
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    std::thread consumer([&] {
+        uint32_t rnd = seed * 7 + 1;
+        uint32_t buf[300];
+        uint32_t last = 0;
+        unsigned pops = 0;
+        for (;;)
+        {
+            const bool finished = done.load(std::memory_order_acquire);
+            size_t got = ring.pop(buf, 1 + nextRand(rnd) % 300);
+            for (size_t i = 0; i < got; ++i)
+            {
+                if (buf[i] <= last)
+                    r.outOfOrder++;
+                last = buf[i];
+            }
+            r.received += got;
+            if (got == 0 && finished)
+                break;
+            if (got == 0)
+                std::this_thread::yield();
+            if (stallEvery && ++pops % stallEvery == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    producer.join();
+    consumer.join();
+    r.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+    return r;
+}
+
+int ringBench(int argc, char **argv)
+{
+    uint64_t items = 4000000;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--items") && i + 1 < argc)
+            items = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "usage: program ring [--items N] [--seed S]\n");
+            return 2;
+        }
+    }
+    if (seed == 0)
+        seed = 1;
+
+    static Ring ring;
+    Result lossless = run(ring, items, true, 0, seed);
+    check(lossless.received == items, "lossless: every item arrives");
+    check(lossless.outOfOrder == 0, "lossless: in order");
+    check(ring.overruns() == 0, "lossless: no overruns");
+    check(ring.highWater() <= Ring::capacity() && ring.empty(), "high water within capacity, drained");
+
+    ring.reset();
+    check(ring.overruns() == 0 && ring.highWater() == 0 && ring.empty(), "reset clears counters");
+
+    // Dropping producer against a stalling consumer: gaps, never reorders
+    const uint64_t dropItems = items / 20;
+    Result lossy = run(ring, dropItems, false, 64, seed + 1);
+    check(lossy.outOfOrder == 0, "lossy: what arrives is in order");
+    check(lossy.received + ring.overruns() == dropItems, "lossy: every missing item is an overrun");
+    check(ring.overruns() > 0 && ring.highWater() == Ring::capacity(), "lossy: stalls fill the ring");
+
+    printf("{\"bench\":\"ring\",\"items\":%llu,\"items_per_s\":%.0f,\"lossy_overruns\":%u,"
+           "\"checks\":%u,\"failures\":%u}\n",
+           (unsigned long long)items, lossless.seconds > 0 ? items / lossless.seconds : 0.0,
+           (unsigned)ring.overruns(), s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
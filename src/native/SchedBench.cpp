@@ -0,0 +1,395 @@
+// Scheduler checks on a virtual clock, plus the cost of posting and
+// dispatching an event and the wakeup rate of the board's idle timer set
+// compared with the old delay(1) loop.
+//
+//   program sched [--events N]
+//
+// Checks: timers fire exactly at their due time, in due order, including
+// ones further out than a wheel revolution and across the millis() wrap;
+// periodic timers keep their phase when callbacks are slow and skip beats
+// after a stall; timers can be stopped and restarted from callbacks;
+// events are FIFO, handlers see them in subscription order, a full queue
+// drops and counts; concurrent posts lose and reorder nothing.
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "Scheduler.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    s_checks++;
+    if (!ok)
+    {
+        s_failures++;
+        fprintf(stderr, "FAIL: %s\n", what);
+    }
+}
+
+// Runs the loop until the clock reaches end
+static void runUntil(Scheduler &sched, VirtualClock &clock, uint32_t end)
+{
+    while ((int32_t)(clock.nowMs() - end) < 0)
+        sched.step();
+    sched.runDue();
+}
+
+// -------------------- timers --------------------
+struct Probe
+{
+    VirtualClock *clock;
+    std::vector<uint32_t> fired; // clock at each call
+    uint32_t cost = 0;           // ms each call takes
+};
+
+static void probeFire(SchedTimer &, void *ctx)
+{
+    Probe &p = *static_cast<Probe *>(ctx);
+    p.fired.push_back(p.clock->nowMs());
+    p.clock->advance(p.cost);
+}
+
+static void checkOneShots(uint32_t start)
+{
+    VirtualClock clock(start);
+    Scheduler sched(clock);
+    const uint32_t delays[] = {30, 10, 20, 10, 63, 64, 65, 1000, 5000, 0};
+    const size_t n = sizeof(delays) / sizeof(delays[0]);
+    std::vector<Probe> probes(n);
+    std::vector<SchedTimer *> timers;
+    for (size_t i = 0; i < n; ++i)
+    {
+        probes[i].clock = &clock;
+        timers.push_back(new SchedTimer(probeFire, &probes[i]));
+        sched.startTimer(*timers[i], delays[i]);
+    }
+    runUntil(sched, clock, start + 6000);
+
+    bool exact = true;
+    for (size_t i = 0; i < n; ++i)
+    {
+        exact &= probes[i].fired.size() == 1 && probes[i].fired[0] == start + delays[i];
+        exact &= !timers[i]->active();
+        delete timers[i];
+    }
+    check(exact, start ? "one-shots fire on time across the wrap" : "one-shots fire on time");
+    check(sched.runDue() == SchedulerClock::kForever, "nothing left scheduled");
+}
+
+static void checkPeriodic(uint32_t start)
+{
+    VirtualClock clock(start);
+    Scheduler sched(clock);
+    Probe p;
+    p.clock = &clock;
+    p.cost = 3;
+    SchedTimer t(probeFire, &p);
+    sched.startTimer(t, 7, 7);
+    runUntil(sched, clock, start + 10000);
+
+    bool phase = p.fired.size() >= 10000 / 7;
+    for (size_t i = 0; phase && i < p.fired.size(); ++i)
+        phase = p.fired[i] == start + 7 * (uint32_t)(i + 1);
+    check(phase, "periodic timer keeps its phase with slow callbacks");
+
+    // A 200 ms stall: missed beats are skipped, the next one stays on grid
+    p.fired.clear();
+    p.cost = 0;
+    clock.advance(200);
+    sched.runDue();
+    runUntil(sched, clock, clock.nowMs() + 20);
+    bool skipped = p.fired.size() >= 2 && (p.fired[1] - start) % 7 == 0 && p.fired[1] - p.fired[0] <= 7;
+    check(skipped, "stalled periodic timer skips missed beats");
+    sched.stopTimer(t);
+}
+
+struct Juggler
+{
+    Scheduler *sched;
+    VirtualClock *clock;
+    SchedTimer *self;
+    SchedTimer *victim;
+    unsigned runs = 0;
+    std::vector<uint32_t> at;
+};
+
+// Restarts itself with no delay three times, then stops the victim
+static void juggle(SchedTimer &t, void *ctx)
+{
+    Juggler &j = *static_cast<Juggler *>(ctx);
+    j.at.push_back(j.clock->nowMs());
+    if (++j.runs < 4)
+        j.sched->startTimer(t, 0);
+    else
+        j.sched->stopTimer(*j.victim);
+}
+
+static void stopSelf(SchedTimer &t, void *ctx)
+{
+    Juggler &j = *static_cast<Juggler *>(ctx);
+    j.runs++;
+    j.sched->stopTimer(t); // periodic, stopped on its first beat
+}
+
+struct Rival
+{
+    Scheduler *sched;
+    SchedTimer *other;
+    unsigned *fired;
+};
+
+// Two timers due on the same tick, each stopping the other
+static void stopRival(SchedTimer &, void *ctx)
+{
+    Rival &r = *static_cast<Rival *>(ctx);
+    ++*r.fired;
+    r.sched->stopTimer(*r.other);
+}
+
+static void checkCallbacks()
+{
+    VirtualClock clock(100);
+    Scheduler sched(clock);
+    Juggler j;
+    Probe victimProbe;
+    victimProbe.clock = &clock;
+    SchedTimer juggler(juggle, &j);
+    SchedTimer victim(probeFire, &victimProbe);
+    j.sched = &sched;
+    j.clock = &clock;
+    j.self = &juggler;
+    j.victim = &victim;
+
+    // The victim shares the juggler's slot, a revolution later
+    sched.startTimer(juggler, 10);
+    sched.startTimer(victim, 10 + Scheduler::kWheelSlots);
+
+    // One pass runs the juggler once; the restart waits for a later tick
+    clock.advance(10);
+    sched.runDue();
+    check(j.runs == 1, "timer restarted from its callback waits a pass");
+    check(sched.runDue() == 1, "restarted timer is due on the next tick");
+    runUntil(sched, clock, 200);
+    check(j.runs == 4 && j.at[3] == 113, "zero-delay restarts run once per tick");
+    check(victimProbe.fired.empty() && !victim.active(), "timer stopped by another callback never fires");
+
+    Juggler s;
+    s.sched = &sched;
+    SchedTimer selfStop(stopSelf, &s);
+    sched.startTimer(selfStop, 5, 5);
+    runUntil(sched, clock, clock.nowMs() + 100);
+    check(s.runs == 1 && !selfStop.active(), "periodic timer can stop itself");
+
+    unsigned fired = 0;
+    Rival ra, rb;
+    SchedTimer a(stopRival, &ra), b(stopRival, &rb);
+    ra = {&sched, &b, &fired};
+    rb = {&sched, &a, &fired};
+    sched.startTimer(a, 50);
+    sched.startTimer(b, 50);
+    runUntil(sched, clock, clock.nowMs() + 100);
+    check(fired == 1 && !a.active() && !b.active(), "timer stopped while due in the same pass never fires");
+}
+
+// -------------------- events --------------------
+struct Log
+{
+    std::vector<uint32_t> seen; // handler id << 16 | arg
+    Scheduler *sched = nullptr;
+};
+
+static void handlerA(uint16_t, uint32_t arg, void *ctx)
+{
+    static_cast<Log *>(ctx)->seen.push_back(1u << 16 | arg);
+}
+
+static void handlerB(uint16_t, uint32_t arg, void *ctx)
+{
+    static_cast<Log *>(ctx)->seen.push_back(2u << 16 | arg);
+}
+
+static void repost(uint16_t event, uint32_t arg, void *ctx)
+{
+    Log &l = *static_cast<Log *>(ctx);
+    l.seen.push_back(arg);
+    if (arg < 3)
+        l.sched->post(event, arg + 1);
+}
+
+static void checkEvents()
+{
+    VirtualClock clock;
+    Scheduler sched(clock);
+    Log log;
+    log.sched = &sched;
+    sched.subscribe(1, handlerA, &log);
+    sched.subscribe(2, handlerB, &log);
+    sched.subscribe(1, handlerB, &log);
+
+    sched.post(1, 10);
+    sched.post(2, 20);
+    sched.post(1, 11);
+    sched.runDue();
+    const uint32_t expect[] = {1u << 16 | 10, 2u << 16 | 10, 2u << 16 | 20, 1u << 16 | 11, 2u << 16 | 11};
+    check(log.seen.size() == 5 && !memcmp(log.seen.data(), expect, sizeof(expect)),
+          "events FIFO, handlers in subscription order");
+
+    log.seen.clear();
+    unsigned accepted = 0;
+    for (uint32_t i = 0; i < Scheduler::kQueueSize + 8; ++i)
+        accepted += sched.post(2, i);
+    check(accepted == Scheduler::kQueueSize && sched.dropped() == 8, "full queue drops and counts");
+    sched.runDue();
+    check(log.seen.size() == Scheduler::kQueueSize, "queued events survive an overflow");
+
+    // Wrap the queue indices a few times
+    bool order = true;
+    for (uint32_t round = 0; round < 10; ++round)
+    {
+        log.seen.clear();
+        for (uint32_t i = 0; i < 20; ++i)
+            sched.post(2, round * 100 + i);
+        sched.runDue();
+        for (uint32_t i = 0; order && i < 20; ++i)
+            order = log.seen.size() == 20 && (log.seen[i] & 0xffff) == round * 100 + i;
+    }
+    check(order, "FIFO across queue wrap");
+
+    log.seen.clear();
+    sched.subscribe(3, repost, &log);
+    sched.post(3, 0);
+    const uint32_t wait = sched.runDue();
+    check(log.seen.size() == 1 && wait == 0, "event posted by a handler waits a pass");
+    sched.runDue();
+    sched.runDue();
+    sched.runDue();
+    check(log.seen.size() == 4, "reposted events all arrive");
+
+    // step() must not sleep over a pending event
+    const uint32_t t0 = clock.nowMs();
+    sched.post(2, 0);
+    sched.step();
+    check(clock.nowMs() == t0, "step() does not sleep with events queued");
+}
+
+// -------------------- concurrency --------------------
+struct Tally
+{
+    std::vector<uint32_t> next; // per producer
+    uint32_t total = 0;
+    bool ordered = true;
+};
+
+static void tally(uint16_t, uint32_t arg, void *ctx)
+{
+    Tally &t = *static_cast<Tally *>(ctx);
+    const uint32_t producer = arg >> 24, seq = arg & 0xffffff;
+    t.ordered &= seq == t.next[producer];
+    t.next[producer] = seq + 1;
+    t.total++;
+}
+
+static void checkProducers(uint32_t perProducer)
+{
+    const unsigned kProducers = 4;
+    VirtualClock clock;
+    Scheduler sched(clock);
+    Tally t;
+    t.next.assign(kProducers, 0);
+    sched.subscribe(7, tally, &t);
+
+    std::vector<std::thread> threads;
+    for (unsigned p = 0; p < kProducers; ++p)
+        threads.emplace_back([&sched, p, perProducer]
+                             {
+                                 for (uint32_t i = 0; i < perProducer; ++i)
+                                     while (!sched.post(7, p << 24 | i))
+                                         std::this_thread::yield();
+                             });
+    const uint32_t want = kProducers * perProducer;
+    while (t.total < want)
+    {
+        if (sched.runDue() != 0)
+            std::this_thread::yield();
+    }
+    for (std::thread &th : threads)
+        th.join();
+    check(t.total == want && t.ordered, "concurrent posts arrive complete and in per-producer order");
+}
+
+// post() + dispatch, uncontended, in batches like a busy loop pass
+static double postCost(uint32_t events)
+{
+    VirtualClock clock;
+    Scheduler sched(clock);
+    Tally t;
+    t.next.assign(1, 0);
+    sched.subscribe(7, tally, &t);
+    Clock::time_point t0 = Clock::now();
+    for (uint32_t i = 0; i < events; i += 16)
+    {
+        for (uint32_t k = 0; k < 16; ++k)
+            sched.post(7, i + k);
+        sched.runDue();
+    }
+    const double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+    check(t.ordered && sched.dropped() == 0, "batched posts all dispatched");
+    return ns / events;
+}
+
+// -------------------- wakeups --------------------
+static void nop(SchedTimer &, void *) {}
+
+// The timers main.cpp runs while idle, over a simulated minute
+static void loopLoad(double &wakeupsPerS, double &meanSleepMs)
+{
+    VirtualClock clock;
+    Scheduler sched(clock);
+    SchedTimer button(nop, nullptr), serial(nop, nullptr), stats(nop, nullptr);
+    sched.startTimer(button, 5, 5);
+    sched.startTimer(serial, 20, 20);
+    sched.startTimer(stats, 10000, 10000);
+    runUntil(sched, clock, 60000);
+    wakeupsPerS = sched.wakeups() / 60.0;
+    meanSleepMs = sched.wakeups() ? (double)sched.idleMs() / sched.wakeups() : 0;
+}
+
+int schedBench(int argc, char **argv)
+{
+    uint32_t events = 200000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--events") && i + 1 < argc)
+            events = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "usage: program sched [--events N]\n");
+            return 2;
+        }
+    }
+
+    checkOneShots(0);
+    checkOneShots(0xFFFFFF00u);
+    checkPeriodic(0);
+    checkPeriodic(0xFFFFF000u);
+    checkCallbacks();
+    checkEvents();
+    checkProducers(20000);
+    const double nsPerEvent = postCost(events);
+    double wakeupsPerS, meanSleepMs;
+    loopLoad(wakeupsPerS, meanSleepMs);
+
+    printf("{\"bench\":\"sched\",\"checks\":%u,\"failures\":%u,\"post_dispatch_ns\":%.1f,"
+           "\"idle_wakeups_per_s\":%.1f,\"mean_sleep_ms\":%.2f,\"old_loop_wakeups_per_s\":1000}\n",
+           s_checks, s_failures, nsPerEvent, wakeupsPerS, meanSleepMs);
+    return s_failures ? 1 : 0;
+}
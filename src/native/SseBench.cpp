@@ -0,0 +1,188 @@
+// Inbox event stream parser against a stand-in server on the loopback
+// transport, read the way InboxSubscriber reads the socket.
+//
+//   program sse [--pings N] [--seed S]
+//
+// Checks: keep-alive comments and blank lines without data raise no
+// events (a ": ping" used to arrive as a "message"); an event name with
+// no data doesn't carry over to the next event; message, empty, id,
+// retry and multi-line data come through; chunked framing split at
+// random points gives the same events as a plain body; a non-200 reply
+// raises nothing; the last chunk ends the stream. Prints parse rate.
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "SseParser.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    s_checks++;
+    if (!ok)
+    {
+        s_failures++;
+        fprintf(stderr, "FAIL: %s\n", what);
+    }
+}
+
+struct Server
+{
+    int status = 200;
+    bool chunked = false;
+    uint32_t rnd = 1;
+    std::string stream; // SSE text
+    std::string lastEventId;
+};
+
+static uint32_t nextRand(uint32_t &s)
+{
+    s = s * 1664525u + 1013904223u;
+    return s >> 8;
+}
+
+static int serve(const LoopbackTransport::Request &req, LoopbackTransport::Reply &reply, void *ctx)
+{
+    Server &s = *static_cast<Server *>(ctx);
+    const size_t at = req.headers.find("Last-Event-ID: ");
+    s.lastEventId = at == std::string::npos ? "" : req.headers.substr(at + 15, req.headers.find("\r\n", at) - at - 15);
+    reply.headers = "Content-Type: text/event-stream\r\n";
+    if (!s.chunked)
+    {
+        reply.body = s.stream;
+        return s.status;
+    }
+    // Chunks of random size, cutting lines and CRLFs anywhere
+    reply.headers += "Transfer-Encoding: chunked\r\n";
+    for (size_t pos = 0; pos < s.stream.size();)
+    {
+        const size_t n = std::min<size_t>(s.stream.size() - pos, 1 + nextRand(s.rnd) % 40);
+        char size[16];
+        snprintf(size, sizeof(size), "%x\r\n", (unsigned)n);
+        reply.body += size + s.stream.substr(pos, n) + "\r\n";
+        pos += n;
+    }
+    reply.body += "0\r\n\r\n";
+    return s.status;
+}
+
+struct Seen
+{
+    std::vector<std::string> events;
+    std::vector<std::string> data;
+};
+
+static void onEvent(const char *event, const char *data, void *ctx)
+{
+    Seen &seen = *static_cast<Seen *>(ctx);
+    seen.events.push_back(event);
+    seen.data.push_back(data);
+}
+
+// Subscribe, then read whatever is buffered in small random pieces
+static Seen subscribe(LoopbackTransport &net, SseParser &parser, uint32_t seed)
+{
+    Seen seen;
+    parser.setCallback(onEvent, &seen);
+    parser.reset();
+    std::unique_ptr<NetConnection> conn = net.connect("api.test", 80);
+    std::string req = "GET /inbox/events HTTP/1.1\r\nHost: api.test\r\nAccept: text/event-stream\r\n";
+    if (parser.lastId()[0])
+        req += std::string("Last-Event-ID: ") + parser.lastId() + "\r\n";
+    req += "\r\n";
+    conn->write(reinterpret_cast<const uint8_t *>(req.data()), req.size());
+
+    uint8_t buf[128];
+    while (!parser.ended() && conn->available() > 0)
+    {
+        const size_t want = 1 + nextRand(seed) % sizeof(buf);
+        parser.feed(buf, conn->read(buf, std::min<size_t>(want, conn->available())));
+    }
+    conn->close();
+    return seen;
+}
+
+int sseBench(int argc, char **argv)
+{
+    unsigned pings = 20000;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--pings") && i + 1 < argc)
+            pings = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "usage: program sse [--pings N] [--seed S]\n");
+            return 2;
+        }
+    }
+
+    LoopbackTransport net;
+    Server server;
+    server.rnd = seed;
+    net.setHandler(serve, &server);
+    SseParser parser;
+
+    // Pings alone
+    server.stream = ": ping\n\n: ping\r\n\r\n:\n\n";
+    Seen seen = subscribe(net, parser, seed);
+    check(parser.status() == 200 && seen.events.empty(), "keep-alive comments raise no events");
+
+    // A conversation, plain then chunked
+    server.stream =
+        ": ping\n\n"
+        "event: message\ndata: {\"id\": \"a1\"}\nid: 7\n\n"
+        ": ping\n\n"
+        "event: empty\n\n"
+        "data: {\"id\": \"b2\"}\n\n"
+        "event: empty\r\ndata: {}\r\n\r\n"
+        "retry: 5000\n\n"
+        "data: line one\ndata: line two\n\n";
+    const std::vector<std::string> wantEvents = {"message", "message", "empty", "message"};
+    const std::vector<std::string> wantData = {"{\"id\": \"a1\"}", "{\"id\": \"b2\"}", "{}", "line one\nline two"};
+    for (bool chunked : {false, true})
+    {
+        server.chunked = chunked;
+        for (uint32_t s = 0; s < 20; ++s)
+        {
+            seen = subscribe(net, parser, seed + s);
+            if (seen.events != wantEvents || seen.data != wantData)
+                break;
+        }
+        check(seen.events == wantEvents, chunked ? "chunked: event names" : "plain: event names");
+        check(seen.data == wantData, chunked ? "chunked: event data" : "plain: event data");
+        check(!strcmp(parser.lastId(), "7") && parser.retryMs() == 5000, "id and retry kept");
+        check(parser.ended() == chunked, "last chunk ends the stream");
+    }
+    subscribe(net, parser, seed);
+    check(server.lastEventId == "7", "reconnect sends Last-Event-ID");
+
+    // Error page
+    server.status = 503;
+    server.stream = "data: not an event\n\n";
+    seen = subscribe(net, parser, seed);
+    check(parser.status() == 503 && parser.ended() && seen.events.empty(), "non-200 reply raises nothing");
+    server.status = 200;
+
+    // Rate over a long idle stream: pings with the odd message
+    server.chunked = true;
+    server.stream.clear();
+    for (unsigned i = 0; i < pings; ++i)
+        server.stream += i % 100 == 99 ? "event: message\ndata: {\"id\": \"m\"}\n\n" : ": ping\n\n";
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    seen = subscribe(net, parser, seed);
+    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    check(seen.events.size() == pings / 100, "only the messages among the pings");
+
+    printf("{\"bench\":\"sse\",\"pings\":%u,\"events\":%u,\"mb_per_s\":%.1f,\"checks\":%u,\"failures\":%u}\n",
+           pings, (unsigned)seen.events.size(), s > 0 ? server.stream.size() / s / 1e6 : 0.0, s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,382 @@
+// Resumable uploader against a stand-in server on the loopback transport
+// that hangs up at random.
+//
+//   program upload [--dir PATH] [--size BYTES] [--seeds N] [--drop P]
+//
+// Checks: a clean upload goes out part by part on one kept connection;
+// with connections cut mid-request, before the reply and after the
+// server applied a part, every seed still ends with the server holding
+// the file byte for byte; an upload that gives up resumes from the saved
+// session in a new uploader (as after a reboot) without resending what
+// was acknowledged; chunked replies, bodiless 204s and interim 100s
+// keep the connection; an expired session starts over; rejected content
+// fails without retries while an auth error retries; retries wait on the
+// clock and wake() cuts the wait short. Prints retries and connects per
+// upload and bytes sent per file byte.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "Crc32.h"
+#include "ResumableUploader.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+typedef ResumableUploader::Result Result;
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    s_checks++;
+    if (!ok)
+    {
+        s_failures++;
+        fprintf(stderr, "FAIL: %s\n", what);
+    }
+}
+
+// -------------------- stand-in server --------------------
+struct StandIn
+{
+    struct Upload
+    {
+        uint32_t length;
+        std::vector<uint8_t> data;
+        bool live;
+    };
+
+    std::vector<Upload> uploads; // id "u<index>"
+    uint32_t rnd = 1;
+    double hangUp = 0;    // before looking at the request
+    double loseReply = 0; // after applying it
+    bool down = false;    // every request hangs up
+    int putsLeft = -1;    // go down after this many PUTs; -1 never
+    int rejectCreate = 0; // answer POSTs with this status
+    bool chunked = false;   // JSON replies in chunks, no Content-Length
+    bool noContent = false; // PUTs answer 204 without a body
+    bool interim = false;   // a 100 Continue ahead of every reply
+    uint32_t creates = 0;
+    uint64_t applied = 0; // part bytes appended
+};
+
+static bool chance(StandIn &s, double p)
+{
+    s.rnd = s.rnd * 1664525u + 1013904223u;
+    return p > 0 && (s.rnd >> 8) % 1000000 < p * 1e6;
+}
+
+static bool header(const std::string &headers, const char *name, std::string &value)
+{
+    const std::string key = std::string("\r\n") + name + ": ";
+    const std::string all = "\r\n" + headers;
+    const size_t at = all.find(key);
+    if (at == std::string::npos)
+        return false;
+    const size_t from = at + key.size();
+    value = all.substr(from, all.find("\r\n", from) - from);
+    return true;
+}
+
+static int serve(const LoopbackTransport::Request &req, LoopbackTransport::Reply &reply, void *ctx)
+{
+    StandIn &s = *static_cast<StandIn *>(ctx);
+    if (s.down || chance(s, s.hangUp))
+        return -1;
+
+    static const std::string base = "/inbox/uploads";
+    char json[64];
+    int code = 404;
+    std::string v;
+    if (req.method == "POST" && s.rejectCreate)
+    {
+        return s.rejectCreate;
+    }
+    else if (req.method == "POST" && req.path == base && header(req.headers, "Upload-Length", v))
+    {
+        s.uploads.push_back({(uint32_t)strtoul(v.c_str(), nullptr, 10), {}, true});
+        s.creates++;
+        snprintf(json, sizeof(json), "{\"uploadId\": \"u%u\", \"offset\": 0}", (unsigned)s.uploads.size() - 1);
+        code = 201;
+    }
+    else if (req.path.compare(0, base.size() + 2, base + "/u") == 0)
+    {
+        const size_t i = strtoul(req.path.c_str() + base.size() + 2, nullptr, 10);
+        if (i >= s.uploads.size() || !s.uploads[i].live)
+            return 404;
+        StandIn::Upload &u = s.uploads[i];
+        code = 200;
+        if (req.method == "PUT")
+        {
+            if (s.putsLeft == 0)
+            {
+                s.down = true;
+                return -1;
+            }
+            if (s.putsLeft > 0)
+                s.putsLeft--;
+            std::string off, sum;
+            char want[24];
+            snprintf(want, sizeof(want), "crc32 %08x", (unsigned)crc32Update(0, req.body.data(), req.body.size()));
+            if (!header(req.headers, "Upload-Offset", off) || !header(req.headers, "Upload-Checksum", sum) ||
+                strtoul(off.c_str(), nullptr, 10) != u.data.size() || sum != want ||
+                u.data.size() + req.body.size() > u.length)
+            {
+                code = 409;
+            }
+            else
+            {
+                u.data.insert(u.data.end(), req.body.begin(), req.body.end());
+                s.applied += req.body.size();
+            }
+        }
+        snprintf(json, sizeof(json), "{\"offset\": %u}", (unsigned)u.data.size());
+    }
+    else
+    {
+        return 404;
+    }
+    if (s.interim)
+        reply.interim = "HTTP/1.1 100 Continue\r\n\r\n";
+    if (s.noContent && req.method == "PUT" && code == 200)
+        return 204;
+    if (s.chunked)
+    {
+        // Two chunks, the second with an extension, and a trailer
+        const size_t half = strlen(json) / 2;
+        char framed[128];
+        snprintf(framed, sizeof(framed), "%zx\r\n%.*s\r\n%zx;x=1\r\n%s\r\n0\r\nX-Done: 1\r\n\r\n", half, (int)half,
+                 json, strlen(json) - half, json + half);
+        reply.headers = "Transfer-Encoding: chunked\r\n";
+        reply.body = framed;
+    }
+    else
+    {
+        reply.body = json;
+    }
+    if (chance(s, s.loseReply))
+        return -1;
+    return code;
+}
+
+// Server copy of the file: the upload that got all of it
+static bool serverHas(const StandIn &s, const std::vector<uint8_t> &file)
+{
+    for (const StandIn::Upload &u : s.uploads)
+        if (u.live && u.data == file)
+            return true;
+    return false;
+}
+
+static std::vector<uint8_t> makeFile(HostFileStore &fs, const char *path, uint32_t size, uint32_t seed)
+{
+    std::vector<uint8_t> b(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        seed = seed * 1103515245u + 12345u;
+        b[i] = (uint8_t)(seed >> 16);
+    }
+    std::unique_ptr<StoredFile> f = fs.open(path, OpenMode::Write);
+    if (f)
+        f->write(b.data(), b.size());
+    return b;
+}
+
+int uploadBench(int argc, char **argv)
+{
+    std::string root = "/tmp/uploadbench";
+    uint32_t size = 200000;
+    unsigned seeds = 20;
+    double drop = 0.01;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--dir") && i + 1 < argc)
+            root = argv[++i];
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc)
+            size = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--seeds") && i + 1 < argc)
+            seeds = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--drop") && i + 1 < argc)
+            drop = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: program upload [--dir PATH] [--size BYTES] [--seeds N] [--drop P]\n");
+            return 2;
+        }
+    }
+    mkdir(root.c_str(), 0755);
+    HostFileStore fs(root.c_str());
+    fs.remove("/upload.ses");
+    const char *url = "http://api.test:8080/inbox/";
+    const size_t part = 16 * 1024;
+
+    // Clean run: one session, one connection, whole parts
+    {
+        const std::vector<uint8_t> file = makeFile(fs, "/take.wav", size, 1);
+        LoopbackTransport net;
+        StandIn server;
+        net.setHandler(serve, &server);
+        VirtualClock clock;
+        ResumableUploader up(fs, net, clock, part);
+        check(up.upload("/take.wav", url, "audio/wav") == Result::Done && serverHas(server, file),
+              "clean upload arrives intact");
+        check(up.stats().parts == (size + part - 1) / part && up.stats().sessions == 1 && server.creates == 1,
+              "one session, one request per part");
+        check(net.stats().connects == 1 && up.stats().retries == 0, "parts share one kept connection");
+        check(!fs.exists("/upload.ses"), "session forgotten once done");
+        check(up.upload("/nope.wav", url, "audio/wav") == Result::Failed &&
+                  net.stats().requests == up.stats().parts + 1,
+              "missing file fails for good, nothing sent");
+    }
+
+    // Reply framing: each variant still shares one connection
+    for (int framing = 0; framing < 3; ++framing)
+    {
+        static const char *const kWhat[] = {"chunked replies are de-chunked", "204 replies have no body",
+                                            "100 Continue is skipped"};
+        const std::vector<uint8_t> file = makeFile(fs, "/take.wav", size, 2);
+        LoopbackTransport net;
+        StandIn server;
+        server.chunked = framing == 0;
+        server.noContent = framing == 1;
+        server.interim = framing == 2;
+        net.setHandler(serve, &server);
+        VirtualClock clock;
+        ResumableUploader up(fs, net, clock, part);
+        check(up.upload("/take.wav", url, "audio/wav") == Result::Done && serverHas(server, file) &&
+                  net.stats().connects == 1 && up.stats().retries == 0,
+              kWhat[framing]);
+    }
+
+    // Random hang-ups: on a write, before the reply, after applying
+    unsigned completed = 0;
+    uint64_t retries = 0, connects = 0, sent = 0;
+    for (unsigned seed = 1; seed <= seeds; ++seed)
+    {
+        const std::vector<uint8_t> file = makeFile(fs, "/take.wav", size, seed);
+        LoopbackTransport net;
+        net.setDropRate(drop, seed);
+        StandIn server;
+        server.rnd = seed * 7919;
+        server.hangUp = 0.05;
+        server.loseReply = 0.05;
+        net.setHandler(serve, &server);
+        VirtualClock clock;
+        ResumableUploader up(fs, net, clock, part);
+        ResumableUploader::RetryPolicy policy;
+        policy.maxAttempts = 30;
+        up.setRetryPolicy(policy);
+        const bool ok = up.upload("/take.wav", url, "audio/wav") == Result::Done;
+        completed += ok && serverHas(server, file);
+        retries += up.stats().retries;
+        connects += up.stats().connects;
+        sent += net.stats().bodyBytes;
+        fs.remove("/upload.ses");
+    }
+    check(completed == seeds, "every seed ends with the file on the server");
+
+    // Give up part way, resume in a new uploader as after a reboot
+    {
+        const std::vector<uint8_t> file = makeFile(fs, "/take.wav", size, 99);
+        LoopbackTransport net;
+        StandIn server;
+        server.putsLeft = 3;
+        net.setHandler(serve, &server);
+        VirtualClock clock;
+        ResumableUploader::RetryPolicy policy;
+        policy.maxAttempts = 3;
+        {
+            ResumableUploader up(fs, net, clock, part);
+            up.setRetryPolicy(policy);
+            const uint32_t t0 = clock.nowMs();
+            check(up.upload("/take.wav", url, "audio/wav") == Result::Retry && up.stats().parts == 3,
+                  "gives up for now after the budget");
+            check(up.stats().retries == 2 && clock.nowMs() > t0, "retries wait on the clock");
+        }
+        check(fs.exists("/upload.ses"), "session saved across the give-up");
+        server.down = false;
+        server.putsLeft = -1;
+        ResumableUploader again(fs, net, clock, part);
+        check(again.upload("/take.wav", url, "audio/wav") == Result::Done && serverHas(server, file),
+              "resumes after a reboot");
+        check(again.stats().sessions == 0 && server.creates == 1 && server.applied == size,
+              "resume sends only what was not acknowledged");
+    }
+
+    // Expired session: the server forgot it, start over
+    {
+        const std::vector<uint8_t> file = makeFile(fs, "/take.wav", size, 5);
+        LoopbackTransport net;
+        StandIn server;
+        server.putsLeft = 2;
+        net.setHandler(serve, &server);
+        VirtualClock clock;
+        ResumableUploader::RetryPolicy policy;
+        policy.maxAttempts = 2;
+        {
+            ResumableUploader up(fs, net, clock, part);
+            up.setRetryPolicy(policy);
+            up.upload("/take.wav", url, "audio/wav");
+        }
+        server.uploads[0].live = false;
+        server.down = false;
+        server.putsLeft = -1;
+        ResumableUploader again(fs, net, clock, part);
+        check(again.upload("/take.wav", url, "audio/wav") == Result::Done && serverHas(server, file) &&
+                  server.creates == 2,
+              "expired session starts over");
+    }
+
+    // Rejected content fails at once; an auth error is worth retrying
+    {
+        makeFile(fs, "/take.wav", size, 8);
+        LoopbackTransport net;
+        StandIn server;
+        server.rejectCreate = 413;
+        net.setHandler(serve, &server);
+        VirtualClock clock;
+        ResumableUploader up(fs, net, clock, part);
+        check(up.upload("/take.wav", url, "audio/wav") == Result::Failed && up.stats().retries == 0 &&
+                  !fs.exists("/upload.ses"),
+              "413 on create fails without retrying");
+        server.rejectCreate = 401;
+        ResumableUploader::RetryPolicy policy;
+        policy.maxAttempts = 3;
+        up.setRetryPolicy(policy);
+        check(up.upload("/take.wav", url, "audio/wav") == Result::Retry && up.stats().retries == 2,
+              "401 on create is retried");
+    }
+
+    // wake() (kick() on the board) ends a backoff at once
+    {
+        makeFile(fs, "/take.wav", size, 7);
+        LoopbackTransport net;
+        StandIn server;
+        server.down = true;
+        net.setHandler(serve, &server);
+        VirtualClock clock;
+        ResumableUploader up(fs, net, clock, part);
+        ResumableUploader::RetryPolicy policy;
+        policy.maxAttempts = 2;
+        policy.baseDelayMs = policy.maxDelayMs = 60000;
+        up.setRetryPolicy(policy);
+        clock.wake();
+        const uint32_t t0 = clock.nowMs();
+        check(up.upload("/take.wav", url, "audio/wav") == Result::Retry && up.stats().retries == 1 &&
+                  clock.nowMs() == t0,
+              "wake() cuts the backoff short");
+        fs.remove("/upload.ses");
+    }
+    fs.remove("/take.wav");
+
+    printf("{\"bench\":\"upload\",\"size\":%u,\"seeds\":%u,\"drop\":%.3f,\"completed\":%u,"
+           "\"retries_per_upload\":%.1f,\"connects_per_upload\":%.1f,\"sent_per_byte\":%.2f,"
+           "\"checks\":%u,\"failures\":%u}\n",
+           (unsigned)size, seeds, drop, completed, seeds ? (double)retries / seeds : 0.0,
+           seeds ? (double)connects / seeds : 0.0, seeds && size ? (double)sent / ((double)seeds * size) : 0.0,
+           s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+// VAD benchmark: cost per sample of Vad::isSpeech() and frame accuracy
+// against labelled fixtures, plus how much SilenceGate keeps.
+//
+//   program vad [--runs N] clip.wav...
+//
+// Labels come from clip.txt next to clip.wav if present, in Audacity's
+// label export format: "start<TAB>end[<TAB>name]" in seconds, one
+// speech region per line. Frames whose midpoint falls in a region are
+// speech.
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Vad.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+using Clock = std::chrono::steady_clock;
+
+typedef std::vector<std::pair<double, double>> Regions;
+
+static bool loadLabels(const std::string &wav, Regions &out)
+{
+    std::string path = wav.substr(0, wav.rfind('.')) + ".txt";
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+        return false;
+    double a, b;
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "%lf %lf", &a, &b) == 2 && b > a)
+            out.emplace_back(a, b);
+    fclose(f);
+    return true;
+}
+
+static bool inRegion(const Regions &r, double t)
+{
+    for (const auto &p : r)
+        if (t >= p.first && t < p.second)
+            return true;
+    return false;
+}
+
+static void countKept(const int16_t *, size_t, void *) {}
+
+int vadBench(int argc, char **argv)
+{
+    int runs = 20;
+    std::vector<const char *> clips;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--runs") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (argv[i][0] != '-')
+            clips.push_back(argv[i]);
+    }
+    if (clips.empty() || runs < 1)
+    {
+        fprintf(stderr, "usage: program vad [--runs N] clip.wav...\n");
+        return 2;
+    }
+
+    uint64_t samples = 0, kept = 0;
+    double ns = 0;
+    uint32_t speechFrames = 0, speechHit = 0, silenceFrames = 0, silenceHit = 0, labelled = 0;
+    for (const char *clip : clips)
+    {
+        FileAudioSource src(clip);
+        if (!src.ok())
+        {
+            fprintf(stderr, "%s: not a 16-bit mono PCM WAV\n", clip);
+            return 1;
+        }
+        const std::vector<int16_t> &pcm = src.samples();
+        const size_t frames = pcm.size() / Vad::kFrameSamples;
+        const double frameSec = (double)Vad::kFrameSamples / (src.fileSampleRate() ? src.fileSampleRate() : 16000);
+
+        // Cost: the detector alone, best of N passes
+        std::vector<uint8_t> decision(frames);
+        double best = 1e30;
+        for (int r = 0; r < runs; ++r)
+        {
+            Vad vad;
+            auto t0 = Clock::now();
+            for (size_t f = 0; f < frames; ++f)
+                decision[f] = vad.isSpeech(&pcm[f * Vad::kFrameSamples]);
+            best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - t0).count());
+        }
+        ns += best;
+        samples += frames * Vad::kFrameSamples;
+
+        // Accuracy against the labels
+        Regions labels;
+        if (loadLabels(clip, labels))
+        {
+            labelled += frames;
+            for (size_t f = 0; f < frames; ++f)
+            {
+                bool truth = inRegion(labels, (f + 0.5) * frameSec);
+                (truth ? speechFrames : silenceFrames)++;
+                if (truth && decision[f])
+                    speechHit++;
+                if (!truth && !decision[f])
+                    silenceHit++;
+            }
+        }
+
+        // What the capture path would keep
+        SilenceGate gate(&countKept, nullptr);
+        gate.process(pcm.data(), pcm.size());
+        gate.finish();
+        kept += gate.keptSamples();
+    }
+
+    printf("{\"bench\":\"vad\",\"clips\":%zu,\"samples\":%llu,\"ns_per_sample\":%.3f,"
+           "\"labelled_frames\":%u,\"speech_recall\":%.3f,\"silence_rejection\":%.3f,\"kept_ratio\":%.3f}\n",
+           clips.size(), (unsigned long long)samples, samples ? ns / samples : 0.0,
+           labelled, speechFrames ? (double)speechHit / speechFrames : 0.0,
+           silenceFrames ? (double)silenceHit / silenceFrames : 0.0,
+           samples ? (double)kept / samples : 1.0);
+    return 0;
+}
@@ -0,0 +1,299 @@
+// WavReader fuzzer: round-trips randomly generated WAVs of every
+// supported layout, then feeds mutated copies (bit flips, truncation,
+// bogus sizes, inserted chunks) through a stream that returns short
+// reads, like a socket. Deterministic for a given seed.
+//
+//   program wavfuzz [--iterations N] [--seed S]
+//
+// Checks that valid files decode to the expected samples, and that no
+// input makes the reader read past the end of the stream or return
+// more frames than the stream could hold. Build with
+// -fsanitize=address,undefined to catch memory errors as well.
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "WavReader.h"
+#include "Bench.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+// Non-seekable source with random short reads
+class ChoppyStream : public ByteStream
+{
+public:
+    ChoppyStream(const Bytes &data, std::mt19937 &rng) : m_data(data), m_rng(rng) {}
+
+    size_t read(uint8_t *dst, size_t len) override
+    {
+        if (len == 0)
+            return 0;
+        size_t n = std::min(len, (size_t)(m_rng() % 97 + 1));
+        n = std::min(n, m_data.size() - m_pos);
+        memcpy(dst, m_data.data() + m_pos, n);
+        m_pos += n;
+        return n;
+    }
+    size_t write(const uint8_t *, size_t) override { return 0; }
+    size_t position() const { return m_pos; }
+
+private:
+    const Bytes &m_data;
+    std::mt19937 &m_rng;
+    size_t m_pos = 0;
+};
+
+struct Layout
+{
+    uint16_t tag; // 1 = PCM, 3 = float
+    uint16_t bytes;
+    uint16_t channels;
+    uint32_t rate;
+    bool extensible;
+    bool extraChunks;
+    bool unknownSize; // data size left 0 as a streaming writer would
+};
+
+static void put16(Bytes &b, uint32_t v)
+{
+    b.push_back(v & 0xFF);
+    b.push_back((v >> 8) & 0xFF);
+}
+
+static void put32(Bytes &b, uint32_t v)
+{
+    put16(b, v & 0xFFFF);
+    put16(b, v >> 16);
+}
+
+static void putId(Bytes &b, const char *id)
+{
+    b.insert(b.end(), id, id + 4);
+}
+
+// Sample i of channel c, exactly representable in every format
+static int16_t expected(size_t i, uint16_t c)
+{
+    return (int16_t)((((i * 7 + c * 3) % 256) - 128) << 8);
+}
+
+static Bytes makeWav(const Layout &l, size_t frames, std::mt19937 &rng)
+{
+    Bytes b;
+    putId(b, "RIFF");
+    put32(b, 0); // patched below
+    putId(b, "WAVE");
+    if (l.extraChunks)
+    {
+        // Odd size exercises the pad byte
+        putId(b, "LIST");
+        put32(b, 13);
+        for (int i = 0; i < 14; ++i)
+            b.push_back((uint8_t)rng());
+    }
+    putId(b, "fmt ");
+    put32(b, l.extensible ? 40 : 16);
+    put16(b, l.extensible ? 0xFFFE : l.tag);
+    put16(b, l.channels);
+    put32(b, l.rate);
+    put32(b, l.rate * l.channels * l.bytes);
+    put16(b, l.channels * l.bytes);
+    put16(b, l.bytes * 8);
+    if (l.extensible)
+    {
+        put16(b, 22);
+        put16(b, l.bytes * 8);
+        put32(b, l.channels == 1 ? 4 : 3);
+        put16(b, l.tag);
+        static const uint8_t tail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        b.insert(b.end(), tail, tail + sizeof(tail));
+    }
+    if (l.extraChunks)
+    {
+        putId(b, "fact");
+        put32(b, 4);
+        put32(b, (uint32_t)frames);
+    }
+    putId(b, "data");
+    put32(b, l.unknownSize ? 0 : (uint32_t)(frames * l.channels * l.bytes));
+    for (size_t i = 0; i < frames; ++i)
+    {
+        for (uint16_t c = 0; c < l.channels; ++c)
+        {
+            const int16_t s = expected(i, c);
+            if (l.tag == 3 && l.bytes == 4)
+            {
+                float f = s / 32768.0f;
+                uint8_t p[4];
+                memcpy(p, &f, 4);
+                b.insert(b.end(), p, p + 4);
+            }
+            else if (l.tag == 3)
+            {
+                double d = s / 32768.0;
+                uint8_t p[8];
+                memcpy(p, &d, 8);
+                b.insert(b.end(), p, p + 8);
+            }
+            else if (l.bytes == 1)
+            {
+                b.push_back((uint8_t)((s >> 8) + 128));
+            }
+            else
+            {
+                // Top 16 bits carry the sample, the rest is noise that
+                // decoding must drop
+                for (uint16_t k = 0; k + 2 < l.bytes; ++k)
+                    b.push_back((uint8_t)rng());
+                put16(b, (uint16_t)s);
+            }
+        }
+    }
+    if (!l.unknownSize)
+    {
+        const uint32_t riff = (uint32_t)b.size() - 8;
+        memcpy(&b[4], &riff, 4);
+    }
+    return b;
+}
+
+static Layout randomLayout(std::mt19937 &rng)
+{
+    static const uint32_t rates[] = {8000, 16000, 22050, 44100, 48000};
+    Layout l;
+    if (rng() % 5 == 0)
+    {
+        l.tag = 3;
+        l.bytes = rng() % 2 ? 4 : 8;
+    }
+    else
+    {
+        l.tag = 1;
+        l.bytes = 1 + rng() % 4;
+    }
+    l.channels = 1 + rng() % 2;
+    l.rate = rates[rng() % 5];
+    l.extensible = rng() % 3 == 0;
+    l.extraChunks = rng() % 2;
+    l.unknownSize = rng() % 6 == 0;
+    return l;
+}
+
+static void mutate(Bytes &b, std::mt19937 &rng)
+{
+    const int edits = 1 + rng() % 4;
+    for (int e = 0; e < edits && !b.empty(); ++e)
+    {
+        const size_t at = rng() % std::min(b.size(), (size_t)96); // the header is the interesting part
+        switch (rng() % 5)
+        {
+        case 0: // flip a bit
+            b[at] ^= (uint8_t)(1u << (rng() % 8));
+            break;
+        case 1: // random byte
+            b[at] = (uint8_t)rng();
+            break;
+        case 2: // huge or zero size field at a random aligned spot
+        {
+            const uint32_t v = rng() % 2 ? 0xFFFFFFFFu - (rng() % 16) : 0;
+            if (at + 4 <= b.size())
+                memcpy(&b[at & ~(size_t)3], &v, 4);
+            break;
+        }
+        case 3: // truncate
+            b.resize(rng() % b.size());
+            break;
+        case 4: // insert junk
+            b.insert(b.begin() + at, 1 + rng() % 8, (uint8_t)rng());
+            break;
+        }
+    }
+}
+
+int wavFuzz(int argc, char **argv)
+{
+    uint32_t iterations = 20000, seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+            iterations = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "usage: program wavfuzz [--iterations N] [--seed S]\n");
+            return 2;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    static WavReader reader; // 1.5 KB buffer
+    uint32_t validOk = 0, failures = 0, accepted = 0;
+    uint32_t rejected[8] = {0};
+    std::vector<int16_t> out(256 * WavReader::kMaxChannels);
+
+    for (uint32_t it = 0; it < iterations; ++it)
+    {
+        const Layout l = randomLayout(rng);
+        const size_t frames = rng() % 600;
+        Bytes wav = makeWav(l, frames, rng);
+        const bool mutated = it % 2 == 1;
+        if (mutated)
+            mutate(wav, rng);
+        const bool sized = rng() % 2;
+
+        ChoppyStream s(wav, rng);
+        WavReader::Error err = reader.parse(s, sized ? (uint32_t)wav.size() : 0);
+        if (err != WavReader::Error::None)
+        {
+            rejected[(int)err]++;
+            if (!mutated)
+            {
+                failures++;
+                fprintf(stderr, "iter %u: valid file rejected: %s\n", it, WavReader::errorName(err));
+            }
+            continue;
+        }
+
+        // Decode everything in uneven slices
+        const WavReader::Format &f = reader.format();
+        size_t total = 0, n;
+        bool match = true;
+        while ((n = reader.readFrames(s, out.data(), 1 + rng() % 256)) > 0)
+        {
+            if (!mutated && f.channels == l.channels)
+                for (size_t i = 0; i < n && match; ++i)
+                    for (uint16_t c = 0; c < f.channels; ++c)
+                        match = match && out[i * f.channels + c] == expected(total + i, c);
+            total += n;
+        }
+        if (s.position() > wav.size() || total * f.blockAlign > wav.size())
+        {
+            failures++;
+            fprintf(stderr, "iter %u: %zu frames from a %zu-byte stream\n", it, total, wav.size());
+        }
+        if (mutated)
+        {
+            accepted++;
+        }
+        else if (!match || total != frames)
+        {
+            failures++;
+            fprintf(stderr, "iter %u: decoded %zu/%zu frames, %s (tag %u, %u bytes, %u ch)\n", it, total, frames,
+                    match ? "samples ok" : "samples differ", l.tag, l.bytes, l.channels);
+        }
+        else
+        {
+            validOk++;
+        }
+    }
+
+    printf("{\"bench\":\"wavfuzz\",\"iterations\":%u,\"seed\":%u,\"valid_ok\":%u,\"mutated_accepted\":%u,"
+           "\"rejected\":{\"truncated\":%u,\"not_wave\":%u,\"bad_format\":%u,\"unsupported\":%u,"
+           "\"no_data\":%u,\"bad_size\":%u},\"failures\":%u}\n",
+           iterations, seed, validOk, accepted, rejected[1], rejected[2], rejected[3], rejected[4],
+           rejected[5], rejected[6], failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+// Wi-Fi connect paths against a scripted driver on a virtual clock.
+//
+//   program wifi [--scan MS] [--dhcp MS]
+//
+// Checks: a cold connect scans and caches the AP and lease; a warm one
+// joins the cached AP without scanning and skips DHCP; an old lease goes
+// through DHCP again; a reused lease is renewed in the background and
+// saved with a fresh age, and one DHCP refuses (NAK) means a rejoin with
+// DHCP; an AP that moved, or ignores the targeted join,
+// costs one probe (or the fast timeout) and then a scan; a wrong
+// password fails at the timeout without touching the cache; another
+// SSID ignores the cache; a static IP is never replaced by a lease; a
+// lost link reconnects on the fast path; our own disconnect events
+// don't count as failures. Prints the time to connect for each path.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "WifiConnector.h"
+#include "Bench.h"
+#include "HostHal.h"
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    s_checks++;
+    if (!ok)
+    {
+        s_failures++;
+        fprintf(stderr, "FAIL: %s\n", what);
+    }
+}
+
+static const uint32_t kTimeoutMs = 15000;
+
+// One device: clock, driver, cache and connector wired like WifiModule
+struct Rig
+{
+    VirtualClock clock;
+    FakeWifiDriver driver{clock};
+    MemoryWifiCache cache;
+    WifiConnector conn{driver, &cache};
+
+    explicit Rig(const FakeWifiDriver::Timing &t)
+    {
+        driver.setTiming(t);
+        driver.setEventCallback(onEvent, this);
+    }
+
+    static void onEvent(WifiDriver::Event e, uint16_t reason, void *ctx)
+    {
+        Rig *r = static_cast<Rig *>(ctx);
+        r->conn.onEvent(e, reason, r->clock.nowMs());
+    }
+
+    // Events and deadlines in time order until the connect settles
+    WifiState settle()
+    {
+        for (;;)
+        {
+            driver.deliver();
+            const uint32_t wait = conn.tick(clock.nowMs());
+            if (conn.state() != WifiState::Connecting)
+                return conn.state();
+            const uint32_t ev = driver.nextEventMs();
+            clock.advance(wait < ev ? wait : ev);
+        }
+    }
+
+    // Once up: background work (the lease renewal) until none is left
+    WifiState drain()
+    {
+        for (;;)
+        {
+            driver.deliver();
+            const uint32_t wait = conn.tick(clock.nowMs());
+            const uint32_t ev = driver.nextEventMs();
+            if (ev == UINT32_MAX && conn.state() != WifiState::Connecting)
+                return conn.state();
+            clock.advance(wait < ev ? wait : ev);
+        }
+    }
+
+    WifiState connect(const char *ssid = "home", const char *password = "secret")
+    {
+        conn.start(ssid, password, kTimeoutMs, clock.nowMs());
+        return settle();
+    }
+};
+
+int wifiBench(int argc, char **argv)
+{
+    FakeWifiDriver::Timing t;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--scan") && i + 1 < argc)
+            t.scanMs = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--dhcp") && i + 1 < argc)
+            t.dhcpMs = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "usage: program wifi [--scan MS] [--dhcp MS]\n");
+            return 2;
+        }
+    }
+    const WifiConnector::Config cfg;
+    const uint32_t coldMs = t.scanMs + t.authMs + t.dhcpMs;
+    const uint32_t warmMs = t.probeMs + t.authMs + t.staticMs;
+
+    // Cold, then warm, then with the lease too old to reuse
+    Rig r(t);
+    check(r.connect() == WifiState::Connected, "cold connects");
+    WifiConnector::Timings cold = r.conn.timings();
+    check(!cold.fast && !cold.cachedLease && !r.driver.lastWasTargeted(), "cold connect scans, uses DHCP");
+    check(cold.totalMs == coldMs && cold.associateMs == t.scanMs + t.authMs && cold.ipMs == t.dhcpMs,
+          "cold phases add up");
+    check(r.cache.saves() == 1 && r.cache.cache().channel == 6 && r.cache.cache().lease.ip == r.driver.dhcpLease().ip,
+          "cold connect caches AP and lease");
+
+    r.conn.stop();
+    r.cache.setLeaseAgeS(600);
+    check(r.connect() == WifiState::Connected, "warm connects");
+    WifiConnector::Timings warm = r.conn.timings();
+    check(warm.fast && warm.cachedLease && warm.attempts == 1 && r.driver.lastWasTargeted(),
+          "warm connect joins the cached AP with the cached lease");
+    check(warm.totalMs == warmMs, "warm connect skips scan and DHCP");
+    check(r.cache.saves() == 1, "unchanged cache is not rewritten");
+    check(r.drain() == WifiState::Connected && r.driver.renewals() == 1 && r.cache.saves() == 2 &&
+              r.cache.leaseAgeS() == 0 && r.cache.cache().lease.ip == r.driver.dhcpLease().ip,
+          "reused lease is renewed and saved with a fresh age");
+
+    r.conn.stop();
+    r.cache.setLeaseAgeS(cfg.leaseMaxAgeS);
+    check(r.connect() == WifiState::Connected, "stale lease connects");
+    WifiConnector::Timings stale = r.conn.timings();
+    check(stale.fast && !stale.cachedLease && stale.totalMs == t.probeMs + t.authMs + t.dhcpMs,
+          "stale lease: targeted join, then DHCP");
+    check(r.cache.saves() == 3 && r.driver.renewals() == 1, "fresh lease is saved, not renewed");
+
+    // The server gave the cached address away: the renewal is refused
+    // and the same AP is joined again with DHCP
+    Rig nak(t);
+    nak.connect();
+    nak.conn.stop();
+    WifiIpConfig other = nak.driver.dhcpLease();
+    other.ip = 0x4201a8c0; // 192.168.1.66
+    nak.driver.setDhcpLease(other);
+    check(nak.connect() == WifiState::Connected && nak.conn.timings().cachedLease, "taken lease joins on it");
+    const uint32_t joins = nak.driver.connects();
+    check(nak.drain() == WifiState::Connected && nak.conn.timings().leaseRefused && nak.conn.timings().fast &&
+              !nak.conn.timings().cachedLease && nak.driver.connects() == joins + 1,
+          "refused lease: targeted rejoin with DHCP");
+    check(nak.cache.cache().lease.ip == other.ip && nak.cache.leaseAgeS() == 0 && nak.driver.renewals() == 1,
+          "refused lease: the new one is cached");
+
+    // Link drops while up: reconnects on the fast path
+    r.driver.inject(WifiDriver::Event::Disconnected, 4);
+    r.driver.deliver();
+    r.conn.tick(r.clock.nowMs());
+    check(r.conn.state() == WifiState::Connecting && r.settle() == WifiState::Connected && r.conn.timings().fast,
+          "lost link reconnects to the cached AP");
+
+    // AP moved to another channel: the probe misses, then a scan
+    r.conn.stop();
+    const uint8_t moved[6] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x02};
+    r.driver.setAp(moved, 11);
+    check(r.connect() == WifiState::Connected, "moved AP connects");
+    WifiConnector::Timings mv = r.conn.timings();
+    check(mv.fellBack && !mv.fast && mv.attempts == 2 && mv.lastReason == WifiDriver::kReasonNoApFound,
+          "moved AP: fast path refused, fell back");
+    check(mv.totalMs == t.probeMs + coldMs, "moved AP costs one probe on top of a scan");
+    check(r.cache.cache().channel == 11 && r.cache.cache().bssid[5] == 2, "cache follows the AP");
+
+    // AP swapped and the targeted join gets no answer at all
+    r.conn.stop();
+    const uint8_t swapped[6] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x03};
+    r.driver.setAp(swapped, 11);
+    r.driver.setSilentOnMiss(true);
+    check(r.connect() == WifiState::Connected, "silent miss connects");
+    WifiConnector::Timings silent = r.conn.timings();
+    check(silent.fellBack && silent.totalMs == cfg.fastTimeoutMs + coldMs, "silent miss waits out the fast timeout");
+    r.driver.setSilentOnMiss(false);
+
+    // Wrong password: retries until the timeout, cache untouched
+    r.conn.stop();
+    const uint32_t saves = r.cache.saves();
+    check(r.connect("home", "wrong") == WifiState::Failed, "wrong password fails");
+    WifiConnector::Timings bad = r.conn.timings();
+    check(bad.totalMs == kTimeoutMs && bad.attempts > 2 && bad.lastReason == WifiDriver::kReasonAuthFail,
+          "wrong password: retried until the timeout");
+    check(r.cache.saves() == saves, "failed connect leaves the cache");
+
+    // Another network: the cache is for "home"
+    check(r.connect("office") == WifiState::Connected && !r.conn.timings().fast, "other SSID scans");
+
+    // Our own disconnect (reason 8) during a scan is not a failure
+    Rig own(t);
+    own.conn.start("home", "secret", kTimeoutMs, own.clock.nowMs());
+    own.clock.advance(100);
+    own.driver.inject(WifiDriver::Event::Disconnected, 8);
+    check(own.settle() == WifiState::Connected && own.conn.timings().attempts == 1 &&
+              own.conn.timings().totalMs == coldMs,
+          "assoc-leave from our own disconnect is ignored");
+
+    // Static IP: never DHCP, never a cached lease
+    Rig st(t);
+    WifiIpConfig ip;
+    ip.ip = 0x0a01a8c0; // 192.168.1.10
+    ip.gateway = 0x0101a8c0;
+    ip.netmask = 0x00ffffff;
+    st.conn.setStaticIp(ip);
+    check(st.connect() == WifiState::Connected && st.conn.timings().totalMs == t.scanMs + t.authMs + t.staticMs,
+          "static IP: scan, no DHCP");
+    check(st.cache.cache().lease.ip == 0, "static IP is not cached as a lease");
+    st.conn.stop();
+    check(st.connect() == WifiState::Connected && st.conn.timings().totalMs == warmMs, "static IP: warm join");
+
+    printf("{\"bench\":\"wifi\",\"cold_ms\":%u,\"warm_ms\":%u,\"stale_lease_ms\":%u,\"moved_ap_ms\":%u,"
+           "\"silent_ap_ms\":%u,\"speedup\":%.1f,\"checks\":%u,\"failures\":%u}\n",
+           (unsigned)cold.totalMs, (unsigned)warm.totalMs, (unsigned)stale.totalMs, (unsigned)mv.totalMs,
+           (unsigned)silent.totalMs, warm.totalMs ? (double)cold.totalMs / warm.totalMs : 0.0, s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
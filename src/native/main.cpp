@@ -0,0 +1,51 @@
+// Native environment entry point: host benchmarks against the HAL fakes.
+//
+//   pio run -e native
+//   .pio/build/native/program <bench> [options] clip.wav...
+//
+// Unit tests under test/ bring their own main(); PlatformIO builds them
+// with PIO_UNIT_TESTING and the rest of src/native for the HAL fakes.
+#ifndef PIO_UNIT_TESTING
+#include <stdio.h>
+#include <string.h>
+#include "Bench.h"
+
+struct BenchEntry
+{
+    const char *name;
+    int (*run)(int argc, char **argv);
+    const char *help;
+};
+
+static const BenchEntry kBenches[] = {
+    {"ring", ringBench, "SPSC ring stress from two threads: order, loss, overrun accounting"},
+    {"pcm", pcmBench, "32->16-bit conversion kernel vs the old per-sample loop, ns/sample"},
+    {"adpcm", adpcmBench, "IMA-ADPCM round trip: header, block framing, SNR, encode rate"},
+    {"vad", vadBench, "VAD cost and accuracy against Audacity label files"},
+    {"dsp", dspBench, "front-end cost per sample, levels and golden output"},
+    {"resample", resampleBench, "playback resampler quality and throughput per input rate"},
+    {"wavfuzz", wavFuzz, "WAV parser round trips and mutated headers over short reads"},
+    {"sched", schedBench, "event loop timers and queue on a virtual clock, wakeup rate"},
+    {"button", buttonReplay, "gesture detection over recorded button edge timings"},
+    {"wifi", wifiBench, "connect paths: cold scan, cached AP and lease, fallbacks"},
+    {"msgcache", messageCacheBench, "inbox message cache: LRU budgets, integrity, power-cut recovery"},
+    {"upload", uploadBench, "resumable upload against a server that hangs up at random"},
+    {"play", playBench, "streamed playback: time to first audio, underruns, fake I2S timestamps"},
+    {"sse", sseBench, "inbox event stream parsing: pings, framing, chunking, errors"},
+    {"power", powerSim, "sleep policy over a simulated day: residency, latency, battery"},
+};
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2)
+    {
+        for (const BenchEntry &b : kBenches)
+            if (!strcmp(argv[1], b.name))
+                return b.run(argc - 1, argv + 1);
+    }
+    fprintf(stderr, "usage: program <bench> [options] clip.wav...\n");
+    for (const BenchEntry &b : kBenches)
+        fprintf(stderr, "  %-10s %s\n", b.name, b.help);
+    return 2;
+}
+#endif
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""Regenerates the capture fixtures: 16 kHz mono 16-bit WAVs of voiced
+bursts (a harmonic stack with a syllable-rate envelope) between pauses,
+over a low noise floor. Deterministic, so the checked-in files only
+change when this script does.
+
+    python3 test/fixtures/make_fixtures.py
+"""
+import math
+import os
+import random
+import struct
+import wave
+
+RATE = 16000
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def voiced(n, f0, rnd):
+    out = []
+    for i in range(n):
+        t = i / RATE
+        env = 0.5 - 0.5 * math.cos(2 * math.pi * 4 * t)  # ~4 syllables/s
+        f = f0 * (1 + 0.05 * math.sin(2 * math.pi * 3 * t))
+        s = sum(math.sin(2 * math.pi * f * k * t) / k for k in range(1, 6))
+        out.append(6000 * env * s / 2.3 + rnd.gauss(0, 60))
+    return out
+
+
+def noise(n, rnd):
+    return [rnd.gauss(0, 60) for _ in range(n)]
+
+
+def write(name, segments):
+    rnd = random.Random(name)
+    pcm = []
+    for kind, seconds, *args in segments:
+        n = int(seconds * RATE)
+        pcm += voiced(n, args[0], rnd) if kind == "voice" else noise(n, rnd)
+    with wave.open(os.path.join(HERE, name), "wb") as w:
+        w.setnchannels(1)
+        w.setsampwidth(2)
+        w.setframerate(RATE)
+        w.writeframes(b"".join(struct.pack("<h", max(-32768, min(32767, int(s)))) for s in pcm))
+
+
+# Two phrases with a pause longer than SilenceGate's maxPause between them
+write("phrases.wav", [("quiet", 0.3), ("voice", 0.8, 140), ("quiet", 1.0), ("voice", 0.6, 210), ("quiet", 0.3)])
+# Long lead-in before a short answer, as after a press with nothing to say yet
+write("late_start.wav", [("quiet", 0.9), ("voice", 0.5, 180), ("quiet", 0.2)])
@@ -0,0 +1,363 @@
+// Capture harness: replays the fixture WAVs through the modules the board
+// runs (CaptureFrontEnd on a reader thread, TakeWriter on this one, the
+// ResumableUploader the queue drainer uses) against the HAL fakes. It
+// covers both capture modes and both codecs, plus a stream that loses its
+// connection mid-take. Every take must reach the server whole. Each test
+// prints one JSON line with the keys ApiClientModule's printBench() emits
+// on target, so runs can be diffed.
+//
+//   pio test -e native -f test_capture
+//
+// The environment stands in for the old bench options:
+//   CAPTURE_REALTIME=1            pace capture at the sample rate like the mic
+//   CAPTURE_WRITE_LATENCY_US=U    per-write delay on the file store
+//   CAPTURE_ACK_DELAY_MS=D        server delay before each response
+//   CAPTURE_RUNS=N                takes per fixture (default 2)
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AudioEncoder.h"
+#include "CaptureFrontEnd.h"
+#include "Crc32.h"
+#include "LatencyStats.h"
+#include "ResumableUploader.h"
+#include "TakeWriter.h"
+#include "HostHal.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const uint32_t kSampleRate = 16000;
+static const size_t kChunkSamples = 1024;
+static const size_t kReadSamples = 256; // one DMA buffer
+static const char *kStagingPath = "/rec.wav";
+static const char *kQueuedPath = "/queued.wav";
+static const char *kFixtures[] = {"test/fixtures/phrases.wav", "test/fixtures/late_start.wav"};
+
+struct Options
+{
+    bool realtime = false;
+    uint32_t writeLatencyUs = 0;
+    uint32_t ackDelayMs = 0;
+    int runs = 2;
+};
+
+static Options s_opt;
+static char s_root[64];
+
+static uint32_t envU32(const char *name, uint32_t dflt)
+{
+    const char *v = getenv(name);
+    return v && *v ? strtoul(v, nullptr, 10) : dflt;
+}
+
+static uint32_t usBetween(Clock::time_point a, Clock::time_point b)
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(b - a).count();
+}
+
+// -------------------- stand-in server --------------------
+// The inbox as the board sees it: a chunked POST of a whole take, or the
+// resumable protocol the queue drainer speaks (see ResumableUploader.h)
+struct Inbox
+{
+    std::vector<uint8_t> take; // last complete take, either way
+    std::vector<uint8_t> upload;
+    uint32_t uploadLength = 0;
+    uint32_t streamed = 0, uploaded = 0;
+};
+
+static bool header(const std::string &headers, const char *name, std::string &value)
+{
+    const std::string key = std::string("\r\n") + name + ": ";
+    const std::string all = "\r\n" + headers;
+    const size_t at = all.find(key);
+    if (at == std::string::npos)
+        return false;
+    const size_t from = at + key.size();
+    value = all.substr(from, all.find("\r\n", from) - from);
+    return true;
+}
+
+static int serve(const LoopbackTransport::Request &req, LoopbackTransport::Reply &reply, void *ctx)
+{
+    Inbox &inbox = *static_cast<Inbox *>(ctx);
+    std::string v;
+    char json[64];
+    if (req.method == "POST" && req.path == "/inbox")
+    {
+        inbox.take = req.body;
+        inbox.streamed++;
+        return 201;
+    }
+    if (req.method == "POST" && req.path == "/inbox/uploads" && header(req.headers, "Upload-Length", v))
+    {
+        inbox.uploadLength = strtoul(v.c_str(), nullptr, 10);
+        inbox.upload.clear();
+        reply.body = "{\"uploadId\": \"u0\", \"offset\": 0}";
+        return 201;
+    }
+    if (req.path != "/inbox/uploads/u0")
+        return 404;
+    if (req.method == "PUT")
+    {
+        std::string off, sum;
+        char want[24];
+        snprintf(want, sizeof(want), "crc32 %08x", (unsigned)crc32Update(0, req.body.data(), req.body.size()));
+        if (!header(req.headers, "Upload-Offset", off) || !header(req.headers, "Upload-Checksum", sum) ||
+            strtoul(off.c_str(), nullptr, 10) != inbox.upload.size() || sum != want)
+            return 409;
+        inbox.upload.insert(inbox.upload.end(), req.body.begin(), req.body.end());
+        if (inbox.upload.size() == inbox.uploadLength)
+        {
+            inbox.take = inbox.upload;
+            inbox.uploaded++;
+        }
+    }
+    snprintf(json, sizeof(json), "{\"offset\": %u}", (unsigned)inbox.upload.size());
+    reply.body = json;
+    return 200;
+}
+
+// -------------------- one take --------------------
+struct Measure
+{
+    LatencyStats<64> releaseToClosedUs;
+    LatencyStats<64> closedToAckUs;
+    LatencyStats<64> captureSps;
+    LatencyStats<64> uploadBps;
+    uint32_t overruns = 0;
+    uint64_t captured = 0, kept = 0;
+};
+
+struct Rig
+{
+    HostFileStore store{s_root};
+    LoopbackTransport net;
+    SteadyClock clock; // the writer's and the uploader's
+    Inbox inbox;
+    Clock::time_point tClosed;
+
+    Rig()
+    {
+        store.setWriteLatencyUs(s_opt.writeLatencyUs);
+        net.setResponseDelayMs(s_opt.ackDelayMs);
+        net.setHandler(&serve, &inbox);
+    }
+};
+
+static bool commitToQueue(const char *path, uint32_t *seq, void *ctx)
+{
+    *seq = 0;
+    return static_cast<HostFileStore *>(ctx)->rename(path, kQueuedPath);
+}
+
+static void onClosed(void *ctx)
+{
+    static_cast<Rig *>(ctx)->tClosed = Clock::now();
+}
+
+static void wakeWriter(size_t, size_t, uint32_t, void *ctx)
+{
+    static_cast<SteadyClock *>(ctx)->wake();
+}
+
+// What the drainer does with a queued entry
+static bool drainQueue(Rig &rig, AudioEncoder &enc)
+{
+    ResumableUploader uploader(rig.store, rig.net, rig.clock);
+    const bool done = uploader.upload(kQueuedPath, "http://inbox.local/inbox", enc.contentType()) ==
+                      ResumableUploader::Result::Done;
+    if (done)
+        rig.store.remove(kQueuedPath);
+    return done;
+}
+
+static uint32_t encodedBytes(AudioEncoder &enc, uint32_t samples)
+{
+    if (enc.headerSize() == 44)
+        return samples * sizeof(int16_t);
+    const uint32_t n = ImaAdpcmEncoder::kSamplesPerBlock;
+    return (samples + n - 1) / n * ImaAdpcmEncoder::kBlockAlign;
+}
+
+// Records one fixture as a take and gets it to the inbox the way the board
+// would in this mode: streamed, or queued and drained
+static TakeWriter::Result recordTake(Rig &rig, const char *clip, AudioEncoder &enc, bool stream, Measure &m)
+{
+    CaptureRing ring;
+    CaptureFrontEnd front(ring, &wakeWriter, &rig.clock);
+    int16_t chunk[kChunkSamples];
+    front.begin(kSampleRate, chunk, kChunkSamples); // firmware defaults: AGC and trim on
+
+    TakeWriter writer(ring, rig.clock, kStagingPath);
+    writer.begin(rig.store, rig.net);
+    writer.setCommit(&commitToQueue, &rig.store);
+    writer.setClosed(&onClosed, &rig);
+
+    FileAudioSource mic(clip);
+    TEST_ASSERT_TRUE_MESSAGE(mic.ok(), clip);
+    mic.setRealtime(s_opt.realtime);
+    mic.begin(kSampleRate);
+    TEST_ASSERT_TRUE(writer.open(enc, kSampleRate));
+
+    // Reader: what readerTask() does on core 0; the end of the clip is the
+    // button release. Off real time it waits for the writer instead of
+    // overrunning, so every run encodes the whole clip.
+    Clock::time_point tStart = Clock::now(), tRelease;
+    mic.start();
+    std::thread reader([&] {
+        int32_t raw[kReadSamples];
+        while (!mic.finished())
+        {
+            while (!s_opt.realtime && ring.size() > ring.capacity() / 4)
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            front.process(raw, mic.read(raw, kReadSamples, AudioSource::kForever));
+        }
+        tRelease = Clock::now();
+        front.finish();
+        mic.stop();
+        writer.captureDone();
+    });
+
+    TakeWriter::Result r = stream ? writer.stream("inbox.local", 80, "/inbox") : writer.writeFile();
+    reader.join();
+    if (r.queued && drainQueue(rig, enc))
+        r.ok = true;
+    const Clock::time_point tAck = Clock::now();
+
+    m.releaseToClosedUs.add(usBetween(tRelease, rig.tClosed));
+    if (tRelease > tStart)
+        m.captureSps.add((uint64_t)front.samples() * 1000000ULL / usBetween(tStart, tRelease));
+    if (r.ok)
+    {
+        const uint32_t dt = usBetween(rig.tClosed, tAck);
+        m.closedToAckUs.add(dt);
+        if (dt)
+            m.uploadBps.add((uint64_t)(enc.headerSize() + r.bytes) * 1000000ULL / dt);
+    }
+    m.overruns += ring.overruns();
+    m.captured += front.samples();
+    m.kept += front.gate().keptSamples();
+
+    // Whatever route it took, the inbox has every sample the gate kept
+    TEST_ASSERT_EQUAL_UINT32(0, ring.overruns());
+    TEST_ASSERT_EQUAL_UINT32(front.gate().keptSamples(), r.samples);
+    TEST_ASSERT_EQUAL_UINT32(enc.headerSize() + encodedBytes(enc, r.samples), rig.inbox.take.size());
+    TEST_ASSERT_FALSE(rig.store.exists(kStagingPath));
+    TEST_ASSERT_FALSE(rig.store.exists(kQueuedPath));
+    return r;
+}
+
+static void report(const char *mode, AudioEncoder &enc, const Measure &m)
+{
+    char closed[96], ack[96], sps[96], bps[96];
+    m.releaseToClosedUs.formatJson(closed, sizeof(closed));
+    m.closedToAckUs.formatJson(ack, sizeof(ack));
+    m.captureSps.formatJson(sps, sizeof(sps));
+    m.uploadBps.formatJson(bps, sizeof(bps));
+    printf("{\"bench\":\"capture\",\"target\":\"native\",\"mode\":\"%s\",\"codec\":\"%s\",\"takes\":%u,"
+           "\"realtime\":%s,\"write_latency_us\":%u,\"ack_delay_ms\":%u,"
+           "\"release_to_closed_us\":%s,\"closed_to_ack_us\":%s,"
+           "\"capture_sps\":%s,\"upload_Bps\":%s,\"overruns\":%u,\"kept_ratio\":%.3f}\n",
+           mode, enc.contentType(), (unsigned)m.releaseToClosedUs.total(),
+           s_opt.realtime ? "true" : "false", (unsigned)s_opt.writeLatencyUs, (unsigned)s_opt.ackDelayMs,
+           closed, ack, sps, bps, (unsigned)m.overruns,
+           m.captured ? (double)m.kept / m.captured : 1.0);
+}
+
+static void runMode(bool stream, AudioEncoder &enc)
+{
+    Measure m;
+    for (const char *clip : kFixtures)
+    {
+        for (int run = 0; run < s_opt.runs; ++run)
+        {
+            Rig rig;
+            const TakeWriter::Result r = recordTake(rig, clip, enc, stream, m);
+            TEST_ASSERT_TRUE(r.ok);
+            TEST_ASSERT_EQUAL_UINT32(stream ? 1 : 0, rig.inbox.streamed);
+            TEST_ASSERT_EQUAL_UINT32(stream ? 0 : 1, rig.inbox.uploaded);
+        }
+    }
+    report(stream ? "stream" : "file", enc, m);
+}
+
+void setUp(void)
+{
+    snprintf(s_root, sizeof(s_root), "/tmp/capture.XXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(s_root));
+}
+
+void tearDown(void)
+{
+    std::string cmd = std::string("rm -rf ") + s_root;
+    (void)system(cmd.c_str());
+}
+
+static void test_file_mode_pcm(void)
+{
+    PcmEncoder enc;
+    runMode(false, enc);
+}
+
+static void test_file_mode_adpcm(void)
+{
+    ImaAdpcmEncoder enc;
+    runMode(false, enc);
+}
+
+static void test_stream_mode_pcm(void)
+{
+    PcmEncoder enc;
+    runMode(true, enc);
+}
+
+static void test_stream_mode_adpcm(void)
+{
+    ImaAdpcmEncoder enc;
+    runMode(true, enc);
+}
+
+// The connection dies half way through the first phrase: the take goes
+// through the queue instead, starting from sample 0
+static void test_stream_disconnect_arrives_via_queue(void)
+{
+    Measure m;
+    ImaAdpcmEncoder enc;
+    Rig rig;
+    rig.net.dropAfter(2 * ImaAdpcmEncoder::kBlockAlign);
+    const TakeWriter::Result r = recordTake(rig, kFixtures[0], enc, true, m);
+    TEST_ASSERT_TRUE(r.failedOver);
+    TEST_ASSERT_TRUE(r.queued);
+    TEST_ASSERT_TRUE(r.ok);
+    TEST_ASSERT_EQUAL_UINT32(1, rig.net.stats().drops);
+    TEST_ASSERT_EQUAL_UINT32(0, rig.inbox.streamed);
+    TEST_ASSERT_EQUAL_UINT32(1, rig.inbox.uploaded);
+
+    uint8_t h[AudioEncoder::kMaxHeaderBytes];
+    enc.makeHeader(h, kSampleRate, r.samples, r.bytes);
+    TEST_ASSERT_EQUAL_MEMORY(h, rig.inbox.take.data(), enc.headerSize());
+    report("stream_failover", enc, m);
+}
+
+int main(int, char **)
+{
+    s_opt.realtime = envU32("CAPTURE_REALTIME", 0) != 0;
+    s_opt.writeLatencyUs = envU32("CAPTURE_WRITE_LATENCY_US", 0);
+    s_opt.ackDelayMs = envU32("CAPTURE_ACK_DELAY_MS", 0);
+    s_opt.runs = (int)envU32("CAPTURE_RUNS", 2);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_file_mode_pcm);
+    RUN_TEST(test_file_mode_adpcm);
+    RUN_TEST(test_stream_mode_pcm);
+    RUN_TEST(test_stream_mode_adpcm);
+    RUN_TEST(test_stream_disconnect_arrives_via_queue);
+    return UNITY_END();
+}
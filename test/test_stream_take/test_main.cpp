@@ -0,0 +1,325 @@
+// Stream-mode takes against the loopback server, through the same
+// CaptureFrontEnd and TakeWriter the board's reader and writer tasks run.
+// Every encoded byte is teed to the staging file, so however the stream
+// ends the whole take is on the server or in the queue.
+//
+//   pio test -e native -f test_stream_take
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AudioEncoder.h"
+#include "CaptureFrontEnd.h"
+#include "TakeWriter.h"
+#include "WavWriter.h"
+#include "HostHal.h"
+
+static const uint32_t kSampleRate = 16000;
+static const size_t kChunkSamples = 1024;
+static const size_t kReadSamples = 256;
+static const char *kStagingPath = "/take.wav";
+static const char *kQueuedPath = "/queued.wav";
+
+static char s_root[64];
+static std::string s_clip;
+
+// 1.5 s of 440 Hz bursts with gaps, written once per test
+static void writeClip(const char *path)
+{
+    std::vector<int16_t> pcm(kSampleRate * 3 / 2);
+    for (size_t i = 0; i < pcm.size(); ++i)
+    {
+        const bool on = (i / 4000) % 2 == 0;
+        pcm[i] = on ? (int16_t)(8000 * ((i * 440 * 2 / kSampleRate) % 2 ? 1 : -1)) : 0;
+    }
+    const wav::Header h = wav::makeHeader(1, 16, kSampleRate, pcm.size() * sizeof(int16_t));
+    FILE *f = fopen(path, "wb");
+    fwrite(h.bytes, 1, sizeof(h.bytes), f);
+    fwrite(pcm.data(), sizeof(int16_t), pcm.size(), f);
+    fclose(f);
+}
+
+void setUp(void)
+{
+    snprintf(s_root, sizeof(s_root), "/tmp/stream_take.XXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(s_root));
+    s_clip = std::string(s_root) + "/clip.wav";
+    writeClip(s_clip.c_str());
+}
+
+void tearDown(void)
+{
+    std::string cmd = std::string("rm -rf ") + s_root;
+    (void)system(cmd.c_str());
+}
+
+static std::vector<uint8_t> readAll(HostFileStore &store, const char *path)
+{
+    std::vector<uint8_t> out;
+    std::unique_ptr<StoredFile> f = store.open(path, OpenMode::Read);
+    if (!f)
+        return out;
+    out.resize(f->size());
+    out.resize(f->read(out.data(), out.size()));
+    return out;
+}
+
+static uint32_t encodedBytes(AudioEncoder &enc, uint32_t samples)
+{
+    if (enc.headerSize() == 44)
+        return samples * sizeof(int16_t);
+    const uint32_t n = ImaAdpcmEncoder::kSamplesPerBlock;
+    return (samples + n - 1) / n * ImaAdpcmEncoder::kBlockAlign;
+}
+
+// The board's stand-in for UploadQueue::commit()
+static bool commitToQueue(const char *path, uint32_t *seq, void *ctx)
+{
+    *seq = 7;
+    return static_cast<HostFileStore *>(ctx)->rename(path, kQueuedPath);
+}
+
+static void wakeWriter(size_t, size_t, uint32_t, void *ctx)
+{
+    static_cast<SteadyClock *>(ctx)->wake();
+}
+
+struct Take
+{
+    TakeWriter::Result result;
+    uint32_t captured = 0;
+    uint32_t overruns = 0;
+};
+
+// Reader on its own thread like i2s_reader, writer on this one. The
+// reader only runs ahead of the writer by backlogSamples when it is
+// told to; otherwise it paces itself like the mic.
+static Take runTake(HostFileStore &store, HttpTransport &net, AudioEncoder &enc, bool stream,
+                    size_t backlogSamples = 0)
+{
+    Take take;
+    CaptureRing ring;
+    SteadyClock clock;
+    CaptureFrontEnd front(ring, &wakeWriter, &clock);
+    int16_t chunk[kChunkSamples];
+    front.begin(kSampleRate, chunk, kChunkSamples);
+    front.setSilenceTrim(false); // every captured sample must arrive
+
+    TakeWriter writer(ring, clock, kStagingPath);
+    writer.begin(store, net);
+    writer.setCommit(&commitToQueue, &store);
+    TEST_ASSERT_TRUE(writer.open(enc, kSampleRate));
+
+    FileAudioSource mic(s_clip.c_str());
+    TEST_ASSERT_TRUE(mic.ok());
+    mic.setRealtime(false);
+    mic.begin(kSampleRate);
+    mic.start();
+
+    std::atomic<size_t> read{0};
+    std::atomic<bool> done{false};
+    std::thread reader([&] {
+        int32_t raw[kReadSamples];
+        while (!mic.finished())
+        {
+            if (read >= backlogSamples)
+                while (ring.size() > ring.capacity() / 4)
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+            const size_t got = mic.read(raw, kReadSamples, 0);
+            front.process(raw, got);
+            read += got;
+        }
+        front.finish();
+        mic.stop();
+        done = true;
+        writer.captureDone();
+    });
+    // A writer that starts late finds the ring past half full
+    while (read < backlogSamples && !done)
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+    take.result = stream ? writer.stream("inbox.local", 80, "/inbox/me") : writer.writeFile();
+    reader.join();
+    take.captured = front.samples();
+    take.overruns = ring.overruns();
+    return take;
+}
+
+// The server's copy without the streaming header in front
+static std::vector<uint8_t> serverData(LoopbackTransport &net, AudioEncoder &enc)
+{
+    const std::vector<uint8_t> &body = net.lastBody();
+    if (body.size() < enc.headerSize())
+        return std::vector<uint8_t>();
+    return std::vector<uint8_t>(body.begin() + enc.headerSize(), body.end());
+}
+
+static void assertQueuedWhole(HostFileStore &store, AudioEncoder &enc, const Take &take)
+{
+    TEST_ASSERT_EQUAL_UINT32(0, take.overruns);
+    TEST_ASSERT_TRUE(take.result.queued);
+    TEST_ASSERT_EQUAL_UINT32(7, take.result.seq);
+    TEST_ASSERT_FALSE(store.exists(kStagingPath));
+    TEST_ASSERT_EQUAL_UINT32(take.captured, take.result.samples);
+
+    // Header and length cover the take from sample 0
+    const std::vector<uint8_t> file = readAll(store, kQueuedPath);
+    TEST_ASSERT_EQUAL_UINT32(enc.headerSize() + encodedBytes(enc, take.captured), file.size());
+    uint8_t h[AudioEncoder::kMaxHeaderBytes];
+    enc.makeHeader(h, kSampleRate, take.captured, encodedBytes(enc, take.captured));
+    TEST_ASSERT_EQUAL_MEMORY(h, file.data(), enc.headerSize());
+}
+
+static void streamsWholeTake(AudioEncoder &enc)
+{
+    HostFileStore store(s_root);
+    LoopbackTransport net;
+    const Take take = runTake(store, net, enc, true);
+
+    TEST_ASSERT_TRUE(take.result.ok);
+    TEST_ASSERT_EQUAL_INT(200, take.result.status);
+    TEST_ASSERT_FALSE(take.result.queued);
+    TEST_ASSERT_FALSE(take.result.failedOver);
+    TEST_ASSERT_EQUAL_UINT32(0, take.overruns);
+    TEST_ASSERT_EQUAL_UINT32(encodedBytes(enc, take.captured), serverData(net, enc).size());
+    TEST_ASSERT_FALSE(store.exists(kStagingPath));
+    TEST_ASSERT_FALSE(store.exists(kQueuedPath));
+}
+
+static void test_stream_delivers_take_pcm(void)
+{
+    PcmEncoder enc;
+    streamsWholeTake(enc);
+}
+
+static void test_stream_delivers_take_adpcm(void)
+{
+    ImaAdpcmEncoder enc;
+    streamsWholeTake(enc);
+}
+
+// The head of the take is what the server already has; the queue must
+// get it too, and the encoder must not restart at the failure
+static void disconnectQueuesWholeTake(AudioEncoder &enc)
+{
+    HostFileStore store(s_root);
+    LoopbackTransport net;
+    net.dropAfter(encodedBytes(enc, kSampleRate / 2)); // ~0.5 s in
+    const Take take = runTake(store, net, enc, true);
+
+    TEST_ASSERT_FALSE(take.result.ok);
+    TEST_ASSERT_TRUE(take.result.failedOver);
+    TEST_ASSERT_EQUAL_UINT32(1, net.stats().drops);
+    assertQueuedWhole(store, enc, take);
+
+    const std::vector<uint8_t> sent = serverData(net, enc);
+    const std::vector<uint8_t> file = readAll(store, kQueuedPath);
+    TEST_ASSERT_TRUE(sent.size() > 0 && sent.size() < file.size() - enc.headerSize());
+    TEST_ASSERT_EQUAL_MEMORY(sent.data(), file.data() + enc.headerSize(), sent.size());
+}
+
+static void test_disconnect_mid_take_queues_whole_take_pcm(void)
+{
+    PcmEncoder enc;
+    disconnectQueuesWholeTake(enc);
+}
+
+static void test_disconnect_mid_take_queues_whole_take_adpcm(void)
+{
+    ImaAdpcmEncoder enc;
+    disconnectQueuesWholeTake(enc);
+}
+
+// The last chunk went out but the server said no: nothing was lost yet
+static void test_error_status_queues_take(void)
+{
+    HostFileStore store(s_root);
+    LoopbackTransport net;
+    net.setStatus(500);
+    PcmEncoder enc;
+    const Take take = runTake(store, net, enc, true);
+
+    TEST_ASSERT_FALSE(take.result.ok);
+    TEST_ASSERT_FALSE(take.result.failedOver);
+    TEST_ASSERT_EQUAL_INT(500, take.result.status);
+    assertQueuedWhole(store, enc, take);
+
+    const std::vector<uint8_t> sent = serverData(net, enc);
+    const std::vector<uint8_t> file = readAll(store, kQueuedPath);
+    TEST_ASSERT_EQUAL_UINT32(file.size() - enc.headerSize(), sent.size());
+    TEST_ASSERT_EQUAL_MEMORY(sent.data(), file.data() + enc.headerSize(), sent.size());
+}
+
+// Hung up after the last chunk, before any status line
+static void test_no_status_queues_take(void)
+{
+    HostFileStore store(s_root);
+    LoopbackTransport net;
+    net.setStatus(-1);
+    PcmEncoder enc;
+    const Take take = runTake(store, net, enc, true);
+
+    TEST_ASSERT_FALSE(take.result.ok);
+    TEST_ASSERT_EQUAL_INT(-1, take.result.status);
+    assertQueuedWhole(store, enc, take);
+}
+
+static void test_connect_failure_queues_take(void)
+{
+    HostFileStore store(s_root);
+    LoopbackTransport net;
+    net.dropAfter(1); // the request line never makes it
+    PcmEncoder enc;
+    const Take take = runTake(store, net, enc, true);
+
+    TEST_ASSERT_TRUE(take.result.failedOver);
+    assertQueuedWhole(store, enc, take);
+}
+
+// The socket fell behind: the tail goes out from the staging file and
+// the server still ends up with every byte, in order
+static void test_backlog_sent_from_flash(void)
+{
+    HostFileStore store(s_root);
+    LoopbackTransport net;
+    PcmEncoder enc;
+    const Take take = runTake(store, net, enc, true, CaptureRing::capacity() * 3 / 4);
+
+    TEST_ASSERT_TRUE(take.result.ok);
+    TEST_ASSERT_GREATER_THAN(0, take.result.backlog);
+    TEST_ASSERT_EQUAL_UINT32(0, take.overruns);
+    TEST_ASSERT_EQUAL_UINT32(encodedBytes(enc, take.captured), serverData(net, enc).size());
+    TEST_ASSERT_FALSE(store.exists(kStagingPath));
+}
+
+static void test_file_mode_queues_take(void)
+{
+    HostFileStore store(s_root);
+    LoopbackTransport net;
+    ImaAdpcmEncoder enc;
+    const Take take = runTake(store, net, enc, false);
+
+    TEST_ASSERT_TRUE(take.result.ok);
+    TEST_ASSERT_EQUAL_UINT32(0, net.stats().connects);
+    assertQueuedWhole(store, enc, take);
+}
+
+int main(int, char **)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stream_delivers_take_pcm);
+    RUN_TEST(test_stream_delivers_take_adpcm);
+    RUN_TEST(test_disconnect_mid_take_queues_whole_take_pcm);
+    RUN_TEST(test_disconnect_mid_take_queues_whole_take_adpcm);
+    RUN_TEST(test_error_status_queues_take);
+    RUN_TEST(test_no_status_queues_take);
+    RUN_TEST(test_connect_failure_queues_take);
+    RUN_TEST(test_backlog_sent_from_flash);
+    RUN_TEST(test_file_mode_queues_take);
+    return UNITY_END();
+}
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Turn a trace::dump() from a serial log into Chrome trace JSON.
+
+    pio device monitor | tee serial.log     # press 't' to dump
+    tools/trace2json.py serial.log > trace.json
+
+Open trace.json in chrome://tracing or https://ui.perfetto.dev. Each core
+is a thread; begin/end pairs become slices, counters become tracks.
+If the log holds several dumps, the last one is used.
+"""
+import argparse
+import base64
+import json
+import struct
+import sys
+
+PHASES = {0: "i", 1: "B", 2: "E", 3: "C"}
+
+
+def last_dump(lines):
+    dump, cur = None, None
+    for line in lines:
+        line = line.strip()
+        if line == "#TRACE-BEGIN":
+            cur = []
+        elif line == "#TRACE-END" and cur is not None:
+            dump, cur = b"".join(cur), None
+        elif cur is not None and line.startswith("#TRACE "):
+            cur.append(base64.b64decode(line[7:]))
+    return dump
+
+
+def decode(blob):
+    if blob[:4] != b"TRC1":
+        raise ValueError("not a trace dump")
+    version, cores, mhz, per_core, nnames = struct.unpack_from("<BBHHH", blob, 4)
+    if version != 1:
+        raise ValueError("unsupported trace version %d" % version)
+    pos = 12
+    names = []
+    for _ in range(nnames):
+        n = blob[pos]
+        names.append(blob[pos + 1:pos + 1 + n].decode())
+        pos += 1 + n
+
+    events = []
+    for core in range(cores):
+        (written,) = struct.unpack_from("<I", blob, pos)
+        pos += 4
+        ring = [struct.unpack_from("<IHHI", blob, pos + 12 * i) for i in range(per_core)]
+        pos += 12 * per_core
+
+        # Oldest surviving record first; skip slots whose sequence doesn't
+        # match (overwritten while the dump was being taken)
+        first = max(0, written - per_core)
+        latest = None
+        for idx in range(first, written):
+            cycles, ident, seq, arg = ring[idx % per_core]
+            if seq != idx & 0xFFFF:
+                continue
+            # The 32-bit cycle counter wraps every 2^32 / f seconds, but a
+            # writer preempted between claiming its slot and reading the
+            # counter lands a little behind its successor. Take the step
+            # from the latest record as signed: only a jump back of more
+            # than half the range is a wrap.
+            if latest is None:
+                latest = at = cycles
+            else:
+                step = (cycles - latest) & 0xFFFFFFFF
+                at = latest + (step - (1 << 32) if step >= 1 << 31 else step)
+                latest = max(latest, at)
+            ev, ph = ident & 0x3FFF, ident >> 14
+            name = names[ev] if ev < len(names) else "event_%d" % ev
+            e = {"name": name, "ph": PHASES[ph], "pid": 0, "tid": core,
+                 "ts": at / mhz}
+            if ph == 3:
+                e["args"] = {name: arg}
+            else:
+                e["args"] = {"arg": arg}
+                if ph == 0:
+                    e["s"] = "t"
+            events.append(e)
+
+    events.sort(key=lambda e: e["ts"])
+    if events:
+        t0 = events[0]["ts"]
+        for e in events:
+            e["ts"] = round(e["ts"] - t0, 3)
+    meta = [{"name": "thread_name", "ph": "M", "pid": 0, "tid": c,
+             "args": {"name": "core %d" % c}} for c in range(cores)]
+    return {"traceEvents": meta + events, "displayTimeUnit": "ms"}
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("log", nargs="?", help="serial log (default: stdin)")
+    args = ap.parse_args()
+
+    src = open(args.log, errors="replace") if args.log else sys.stdin
+    blob = last_dump(src)
+    if blob is None:
+        sys.exit("no #TRACE-BEGIN ... #TRACE-END block found")
+    json.dump(decode(blob), sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()